@@ -19,8 +19,11 @@ out vec2 tex_coord;
 
 void main()
 {
-    frag_normal = v_normal;
+    vec3 position = DecodePosition(v_position);
+    vec3 normal = DecodeNormal(v_normal);
+
+    frag_normal = normal;
     frag_color = v_color;
     tex_coord = v_texture_coord;
-    gl_Position = Projection * View * Model * vec4(v_position, 1.0);
+    gl_Position = Projection * View * Model * vec4(position, 1.0);
 }
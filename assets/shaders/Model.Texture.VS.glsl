@@ -13,6 +13,8 @@ out vec2 tex_coord;
 
 void main()
 {
+    vec3 position = DecodePosition(v_position);
+
     tex_coord = v_texture_coord;
-    gl_Position = Model * vec4(v_position, 1.0);
+    gl_Position = Model * vec4(position, 1.0);
 }
@@ -1,4 +1,4 @@
-#include "Constants.h"
+﻿#include "Constants.h"
 #include "core/managers/resource_path.h"
 #include "utils/text_utils.h"
 
@@ -29,11 +29,18 @@ const std::vector<ShaderConfig> Constants::Loader::GetShaderConfigs()
         {"FallingStars", "FallingStars", "FallingStars", "FallingStars", true},
         {"Firefly", "Firefly", "Firefly", "Firefly", true},
         {"CubeMapFramebufferShader", "Framebuffer", "Framebuffer", "Framebuffer", true},
+        {"CubeMapLayeredShader", "Layered", "Layered", "", false},
+        {"CubeMapParaboloidShader", "Paraboloid", "Paraboloid", "Paraboloid", true},
         {"CubeMapReflectionShader", "CubeMap", "CubeMap", "", false},
         {"CubeMapNormalShader", "Normal", "Normal", "", false},
         {"DeferredRenderCompositionShader", "Composition", "Composition", "", false},
         {"DeferredRenderLightPassShader", "LightPass", "LightPass", "", false},
         {"DeferredRender2TextureShader", "Render2Texture", "Render2Texture", "", false},
+        {"DepthPrepassShader", "DepthPrepass", "DepthPrepass", "", false},
+        {"VisibilityBufferShader", "Visibility", "Visibility", "", false},
+        {"VisibilityResolveShader", "Resolve", "Resolve", "", false},
+        {"HiZBuildShader", "", "", "", false, "HiZBuild"},
+        {"HiZCullShader", "", "", "", false, "HiZCull"},
     };
 };
 
@@ -42,12 +49,29 @@ const std::vector<MeshConfig> Constants::Loader::GetMeshConfigs(WindowObject* wi
 {
     return 
     {
-        {"quad", PATH_JOIN(window->props.selfDir, RESOURCE_PATH::MODELS, "primitives"), "quad.obj", false},
+        {"quad", PATH_JOIN(window->props.selfDir, RESOURCE_PATH::MODELS, "primitives"), "quad.obj", false, true},
         {"cube", PATH_JOIN(window->props.selfDir, RESOURCE_PATH::MODELS, "primitives"), "box.obj", false},
         {"bunny", PATH_JOIN(window->props.selfDir, RESOURCE_PATH::MODELS, "animals"), "bunny.obj", false},
         {"box", PATH_JOIN(window->props.selfDir, RESOURCE_PATH::MODELS, "primitives"), "box.obj", false},
-        {"sphere", PATH_JOIN(window->props.selfDir, RESOURCE_PATH::MODELS, "primitives"), "sphere.obj", false},
+        {"sphere", PATH_JOIN(window->props.selfDir, RESOURCE_PATH::MODELS, "primitives"), "sphere.obj", false, true},
         {"archer", PATH_JOIN(window->props.selfDir, RESOURCE_PATH::MODELS, "characters", "archer"), "Archer.fbx", false},
 		{"plane", PATH_JOIN(window->props.selfDir, RESOURCE_PATH::MODELS, "primitives"), "plane50.obj", false}
     };
 }
+
+
+const std::vector<std::string> Constants::Loader::GetPrefetchMeshes()
+{
+    return { "quad", "cube", "sphere", "archer", "plane" };
+}
+
+
+const std::vector<std::string> Constants::Loader::GetPrefetchShaders()
+{
+    return
+    {
+        "WaterDrops", "Firefly", "FallingStars",
+        "DeferredRenderLightPassShader", "DeferredRenderCompositionShader", "DeferredRender2TextureShader",
+        "CubeMapReflectionShader"
+    };
+}
@@ -4,6 +4,7 @@
 #define __CONSTANTS_H__
 
 #include "core/window/window_object.h"
+#include "utils/gl_utils.h"
 #include "Structures.h"
 
 #include <glm/glm.hpp>
@@ -36,12 +37,71 @@ public:
         static const glm::mat4 PROJECTION_MATRIX;
 
         static constexpr float ROTATION_SPEED = glm::radians(6.0f);
+
+        // Skybox faces keep their 8-bit RGB data (GL_SRGB8 would need gamma corrected output)
+        static constexpr GLenum SKYBOX_FORMAT = GL_RGB8;
+
+        // Reflection probe: the static layer (skybox, terrain) is baked once, the dynamic layer
+        // (archers) is redrawn over a copy of it FACES_PER_UPDATE faces at a time,
+        // UPDATE_RATE times per second (0 - every frame)
+        static constexpr GLenum COLOR_FORMAT = GL_RGBA16F;
+        static constexpr int FACES_PER_UPDATE = 2;
+        static constexpr float UPDATE_RATE = 30.0f;
+        static constexpr unsigned int ALL_FACES = 0x3F;
+
+        // Meshes drawn into the probe accept LOD_BIAS times the level of detail error of the main view
+        static constexpr float LOD_BIAS = 4.0f;
+
+        // The reflections sample level 0 only (GL_LINEAR), mips are kept per face when enabled
+        static constexpr bool MIPMAPS = false;
+
+        // Draw every mesh instanced once per face, gl_Layer written by the vertex shader
+        // (ARB_shader_viewport_layer_array / AMD_vertex_shader_layer), instead of the geometry shader
+        static constexpr bool LAYERED_RENDERING = true;
+        static constexpr GLuint FACE_BUFFER_BINDING = 0;
+
+        // Environment capture (EnvironmentMode): six cube faces, or two paraboloid hemispheres (upper +Y,
+        // lower -Y) of PARABOLOID_SIZE^2 each, stored as the layers of a 2D array texture
+        static constexpr int ENVIRONMENT_MODE = 0;
+        static constexpr int PARABOLOID_SIZE = 512;
+        static constexpr GLenum PARABOLOID_FORMAT = GL_RGBA16F;
     };
 
     struct DeferredRender
     {
         static constexpr unsigned int MAX_LIGHTS = 300;
         static constexpr unsigned int G_BUFFER_COUNT = 3;
+        static constexpr int NR_ARCHERS = 5;
+
+        // Render target formats (G-buffer: Position, Normal, Color + light accumulation)
+        static constexpr GLenum G_BUFFER_POSITION_FORMAT = GL_RGBA16F;
+        static constexpr GLenum G_BUFFER_NORMAL_FORMAT = GL_RGBA16F;
+        static constexpr GLenum G_BUFFER_COLOR_FORMAT = GL_RGBA8;
+        static constexpr GLenum LIGHT_BUFFER_FORMAT = GL_RGBA16F;
+
+        // Light accumulation resolution divisor (1 - full, 2 - half, 4 - quarter)
+        static constexpr int LIGHT_RESOLUTION_SCALE = 1;
+        static constexpr int MAX_LIGHT_RESOLUTION_SCALE = 4;
+
+        // Offscreen particle target, composited additively over the lit scene
+        static constexpr GLenum PARTICLE_BUFFER_FORMAT = GL_RGBA16F;
+        static constexpr int PARTICLE_RESOLUTION_SCALE = 2;
+        static constexpr int MAX_PARTICLE_RESOLUTION_SCALE = 4;
+
+        // Visibility buffer: (draw ID << bits) | triangle ID per pixel, 0 means empty
+        // (VISIBILITY_TRIANGLE_BITS and MAX_VISIBILITY_INSTANCES are mirrored in Resolve.FS.glsl)
+        static constexpr GLenum VISIBILITY_BUFFER_FORMAT = GL_R32UI;
+        static constexpr unsigned int VISIBILITY_TRIANGLE_BITS = 20;
+        static constexpr unsigned int MAX_VISIBILITY_INSTANCES = 16;
+
+        // Every scene draw uses the coarsest level of detail of its mesh entry whose simplification error
+        // covers at most LOD_PIXEL_ERROR pixels on screen
+        static constexpr float LOD_PIXEL_ERROR = 1.0f;
+
+        // Occlusion culling (0 - off, 1 - CPU, 2 - GPU compute + indirect draws)
+        static constexpr int OCCLUSION_CULLING_MODE = 0;
+        // Width of the Hi-Z level read back for the CPU test
+        static constexpr int HI_Z_READBACK_WIDTH = 256;
 
         // Light properties
         static constexpr float LIGHT_RADIUS = 2.5f;
@@ -68,10 +128,15 @@ public:
     {
         static constexpr unsigned int MAX_TEXTURES = 32;
         static constexpr unsigned int MAX_MODELS = 50;
+        // VRAM for loaded image textures, idle ones drop mips / get evicted above it
+        static constexpr size_t TEXTURE_MEMORY_BUDGET = 256u << 20;
 
         // Shaders and Models Paths
         static const std::vector<ShaderConfig> GetShaderConfigs();
         static const std::vector<MeshConfig> GetMeshConfigs(WindowObject* window);
+        // Declared assets every frame needs, loaded on the workers during Init instead of on first use
+        static const std::vector<std::string> GetPrefetchMeshes();
+        static const std::vector<std::string> GetPrefetchShaders();
     };
 
     struct WaterfallLake_WaterDrops
@@ -84,6 +149,9 @@ public:
         static constexpr unsigned int NR_PARTICLES = 4000;
         static constexpr float SIZE_PARTICLE = 0.2f;
 
+        // Particle sprites are packed into one texture array, SPRITE_SIZE^2 per layer
+        static constexpr unsigned int SPRITE_SIZE = 256;
+
         static constexpr unsigned int DEFAULT_ID = 0;
 
         static constexpr unsigned int DEFAULT_FRAMEBUFFER_OBJECT = 0;
@@ -94,6 +162,9 @@ public:
         static constexpr float RADIUS = 10.0f;
         static constexpr float H_MAX = 5.5f;
 
+        // The terrain grid is split in TERRAIN_CHUNKS x TERRAIN_CHUNKS mesh entries for culling
+        static constexpr int TERRAIN_CHUNKS = 6;
+
 		// Bezier control points - Waterfall
         static constexpr glm::vec3 CONTROL_P0 = glm::vec3(+08.00f, +00.60f, -14.00f);
         static constexpr glm::vec3 CONTROL_P1 = glm::vec3(+05.50f, -01.20f, -11.00f);
@@ -1,5 +1,6 @@
 ﻿#include "CreatePlane.h"
 #include "Constants.h"
+#include "core/managers/mesh_optimizer.h"
 
 #include <iostream>
 #include <fstream>
@@ -319,50 +320,57 @@ Mesh* Create::CreateMesh(
     const vector<VertexFormat>& vertices,
     const vector<unsigned int>& indices)
 {
-    // Generate and bind VAO
-    unsigned int VAO;
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
-
-    // Generate and bind VBO
-    unsigned int VBO;
-    glGenBuffers(1, &VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(VertexFormat), vertices.data(), GL_STATIC_DRAW);
-
-    // Generate and bind IBO
-    unsigned int IBO;
-    glGenBuffers(1, &IBO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
-
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertexFormat), (void*)offsetof(VertexFormat, position));
+    // Upload through gpu_utils::UploadData so the mesh owns its VBO / IBO
+    // (same VertexFormat attribute layout: position, normal, texture coordinate, color)
+    Mesh* mesh = new Mesh(name);
+    if (!mesh->InitFromData(vertices, indices))
+    {
+        cerr << "Failed to create mesh " << name << endl;
+    }
 
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(VertexFormat), (void*)offsetof(VertexFormat, normal));
+    return mesh;
+}
 
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(VertexFormat), (void*)offsetof(VertexFormat, text_coord));
 
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(VertexFormat), (void*)offsetof(VertexFormat, color));
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Function: OptimizeGrid
+// Description: Row order only reuses the vertices of the previous row once they've left the post-transform
+//              cache. Each chunk is reordered for the cache on its own (entries stay contiguous index ranges),
+//              then the vertices shared by all chunks are renumbered in order of first use. The overdraw pass
+//              is skipped: a heightfield seen from above has little of it and the depth prepass takes care of it.
+// Parameters:
+//   - name: Name of the mesh, for the report.
+//   - vertices: Grid vertices, reordered.
+//   - indices: Grid indices, reordered and renumbered.
+//   - entries: Chunk index ranges.
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void Create::OptimizeGrid(
+    const char* name,
+    vector<VertexFormat>& vertices,
+    vector<unsigned int>& indices,
+    const vector<MeshEntry>& entries)
+{
+    if (!MeshOptimizer::IsEnabled() || indices.empty())
+        return;
 
-    glBindVertexArray(0);
+    float acmrBefore = MeshOptimizer::ComputeACMR(indices.data(), indices.size(), vertices.size());
 
-    CheckOpenGLError();
+    for (const auto& entry : entries)
+    {
+        MeshOptimizer::OptimizeVertexCache(indices.data() + entry.baseIndex, entry.nrIndices, vertices.size());
+    }
 
-    // Create Mesh object
-    Mesh* mesh = new Mesh(name);
-    mesh->InitFromBuffer(VAO, static_cast<unsigned int>(indices.size()));
-    mesh->vertices = vertices;
-    mesh->indices = indices;
+    vector<unsigned int> remap;
+    size_t nrUsed = MeshOptimizer::OptimizeVertexFetchRemap(indices.data(), indices.size(), vertices.size(), remap);
+    MeshOptimizer::RemapIndices(indices.data(), indices.size(), remap);
+    MeshOptimizer::RemapVertices(vertices, remap, nrUsed);
 
-    return mesh;
+    float acmrAfter = MeshOptimizer::ComputeACMR(indices.data(), indices.size(), vertices.size());
+    cout << "Optimized mesh '" << name << "': ACMR " << acmrBefore << " -> " << acmrAfter << endl;
 }
 
 
-///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Function: CreateGridMesh
 // Description: Creates a grid mesh with the specified dimensions and size.
 // Parameters:
@@ -461,40 +469,56 @@ Mesh* Create::CreateGridMesh(
         );
     }
 
-    for (int z = 0; z < gridZ - 1; ++z)
+    // Quads are emitted chunk by chunk so that every chunk is a contiguous index range
+    const int chunks = WL::TERRAIN_CHUNKS;
+    const int quadsX = gridX - 1;
+    const int quadsZ = gridZ - 1;
+    vector<MeshEntry> chunkEntries;
+
+    for (int cz = 0; cz < chunks; ++cz)
     {
-        for (int x = 0; x < gridX - 1; ++x)
+        for (int cx = 0; cx < chunks; ++cx)
         {
-            unsigned int topLeft = z * gridX + x;
-            unsigned int topRight = topLeft + 1;
-            unsigned int bottomLeft = (z + 1) * gridX + x;
-            unsigned int bottomRight = bottomLeft + 1;
-
-            indices.push_back(topLeft);
-            indices.push_back(bottomLeft);
-            indices.push_back(topRight);
-
-            indices.push_back(topRight);
-            indices.push_back(bottomLeft);
-            indices.push_back(bottomRight);
+            MeshEntry chunk;
+            chunk.baseIndex = static_cast<unsigned int>(indices.size());
+
+            for (int z = quadsZ * cz / chunks; z < quadsZ * (cz + 1) / chunks; ++z)
+            {
+                for (int x = quadsX * cx / chunks; x < quadsX * (cx + 1) / chunks; ++x)
+                {
+                    unsigned int topLeft = z * gridX + x;
+                    unsigned int topRight = topLeft + 1;
+                    unsigned int bottomLeft = (z + 1) * gridX + x;
+                    unsigned int bottomRight = bottomLeft + 1;
+
+                    indices.push_back(topLeft);
+                    indices.push_back(bottomLeft);
+                    indices.push_back(topRight);
+
+                    indices.push_back(topRight);
+                    indices.push_back(bottomLeft);
+                    indices.push_back(bottomRight);
+                }
+            }
+
+            chunk.nrIndices = static_cast<unsigned int>(indices.size()) - chunk.baseIndex;
+            if (chunk.nrIndices)
+                chunkEntries.push_back(chunk);
         }
     }
 
+    OptimizeGrid(name, vertices, indices, chunkEntries);
+
     Mesh* planeMesh = CreateMesh(name, vertices, indices);
+    planeMesh->meshEntries = chunkEntries;
+    planeMesh->ComputeBounds();
 
 	auto texture = TextureManager::GetTexture(textureName);
     if (texture)
     {
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-        GLfloat borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-        glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-
-        glGenerateMipmap(GL_TEXTURE_2D);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        glBindTexture(GL_TEXTURE_2D, 0);
+        // White border, trilinear: mips were built when the texture was loaded
+        texture->SetWrappingMode(GL_CLAMP_TO_BORDER);
+        texture->SetFiltering(GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
 
         auto material = new Material();
         material->texture = texture;
@@ -46,6 +46,13 @@ public:
     static float FBM(glm::vec2 p);
 
 private:
+    // Reorder the chunk indices for the vertex cache and the vertices in order of first use
+    static void OptimizeGrid(
+        const char* name,
+        std::vector<VertexFormat>& vertices,
+        std::vector<unsigned int>& indices,
+        const std::vector<MeshEntry>& entries);
+
     // Compute a point on a cubic Bezier curve for a given t parameter
     static glm::vec3 Bezier(
         float t,
@@ -1,21 +1,83 @@
 ﻿#include "CubeMap.h"
 #include "Constants.h"
+#include "utils/image_utils.h"
 #include "utils/memory_utils.h"
 
+#include <algorithm>
+#include <cmath>
+#include <functional>
 #include <iostream>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
 
 using namespace std;
 using CM = Constants::CubeMap;
 
 
+// Decoded skybox face (RGB8) and its mip chain, level 0 first
+struct CubeFaceImage
+{
+    int width = 0;
+    int height = 0;
+    vector<vector<unsigned char>> levels;
+};
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Function: DecodeCubeFace
+// Description: Loads one skybox face as 8-bit RGB and box filters it down to 1x1. Runs on its own thread, one
+//              per face.
+// Parameters:
+//   - path: Image file of the face.
+//   - image: Receives the face, no levels when decoding fails.
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static void DecodeCubeFace(const string& path, CubeFaceImage& image)
+{
+    int chn;
+    unsigned char* data = stbi_load(path.c_str(), &image.width, &image.height, &chn, 3);
+    if (!data)
+        return;
+
+    int w = image.width, h = image.height;
+    image.levels.emplace_back(data, data + static_cast<size_t>(w) * h * 3);
+    stbi_image_free(data);
+
+    while (w > 1 || h > 1)
+    {
+        image.levels.push_back(image_utils::Downsample(image.levels.back().data(), w, h, 3));
+        w = max(w / 2, 1);
+        h = max(h / 2, 1);
+    }
+}
+
+
 CubeMap::CubeMap(WindowObject* window) : window(window)
 {
     framebuffer_object = 0;
 	resolution = glm::ivec2(0);
 
     color_texture = depth_texture = 0;
+    static_framebuffer = static_color_texture = static_depth_texture = 0;
+    copy_framebuffers[0] = copy_framebuffers[1] = 0;
+    mip_levels = 1;
+
+    static_dirty = true;
+    pending_faces = CM::ALL_FACES;
+    faces_per_update = CM::FACES_PER_UPDATE;
+    update_rate = CM::UPDATE_RATE;
+    update_timer = 0;
+    next_face = 0;
+
+    for (int face = 0; face < 6; face++)
+        face_frustums[face].Extract(CM::PROJECTION_MATRIX * CM::VIEW_MATRICES[face]);
+
+    face_buffer = 0;
+    layered_supported = false;
+    layered_rendering = false;
+    environment_mode = CM::ENVIRONMENT_MODE;
+    face_width = face_height = 0;
     cube_texture = cube_angle = 0.0f,
 
     width = height = 0;
@@ -24,10 +86,9 @@ CubeMap::CubeMap(WindowObject* window) : window(window)
 
 CubeMap::~CubeMap()
 {
-    if (framebuffer_object) glDeleteFramebuffers(1, &framebuffer_object);
+    ReleaseBuffers();
+    if (face_buffer) glDeleteBuffers(1, &face_buffer);
     if (cube_texture) glDeleteTextures(1, &cube_texture);
-    if (color_texture) glDeleteTextures(1, &color_texture);
-    if (depth_texture) glDeleteTextures(1, &depth_texture);
     if (window)
     {
         delete window;
@@ -49,17 +110,7 @@ void CubeMap::ResizeBuffers(int width, int height)
     this->height = height;
     resolution = glm::ivec2(width, height);
 
-    if (color_texture)
-    {
-        glDeleteTextures(1, &color_texture);
-        color_texture = 0;
-    }
-    if (depth_texture)
-    {
-        glDeleteTextures(1, &depth_texture);
-        depth_texture = 0;
-    }
-
+    ReleaseBuffers();
     CreateFramebuffer(width, height);
     cout << "CubeMap buffers resized to " << width << "x" << height << endl;
 }
@@ -103,12 +154,26 @@ void CubeMap::Init(
 
     // Create the framebuffer for rendering into the CubeMap
     CreateFramebuffer(width, height);
+
+    // Per-face matrices for the layered path
+    glm::mat4 faceViewProjection[6];
+    for (int face = 0; face < 6; face++)
+        faceViewProjection[face] = CM::PROJECTION_MATRIX * CM::VIEW_MATRICES[face];
+
+    glGenBuffers(1, &face_buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, face_buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(faceViewProjection), glm::value_ptr(faceViewProjection[0]), GL_STATIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    layered_supported = GLEW_ARB_shader_viewport_layer_array || GLEW_AMD_vertex_shader_layer;
+    SetLayeredRendering(CM::LAYERED_RENDERING);
 }
 
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Function: UploadCubeMapTexture
-// Description: Loads six images into the CubeMap texture (one for each face) and configures its settings.
+// Description: Loads six images into the CubeMap texture (one for each face) and configures its settings. The
+//              faces are decoded and mipmapped in parallel, then uploaded once into immutable 8-bit storage.
 // Parameters:
 //   - posx: File path for the +X face texture.
 //   - posy: File path for the +Y face texture.
@@ -123,14 +188,39 @@ unsigned int CubeMap::UploadCubeMapTexture(
     const string& posx, const string& posy, const string& posz,
     const string& negx, const string& negy, const string& negz)
 {
-    int width, height, chn;
+    // GL_TEXTURE_CUBE_MAP_POSITIVE_X + i order
+    const string paths[6] = { posx, negx, posy, negy, posz, negz };
+    CubeFaceImage faces[6];
+
+    vector<thread> threads;
+    for (int face = 0; face < 6; face++)
+    {
+        threads.emplace_back(DecodeCubeFace, cref(paths[face]), ref(faces[face]));
+    }
+    for (auto& thread : threads)
+    {
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+
+    for (int face = 0; face < 6; face++)
+    {
+        if (faces[face].levels.empty())
+        {
+            cerr << "Error: Failed to load cubemap face " << paths[face] << endl;
+            return 0;
+        }
+        if (faces[face].width != faces[0].width || faces[face].height != faces[0].height)
+        {
+            cerr << "Error: Cubemap face " << paths[face] << " is " << faces[face].width << "x" << faces[face].height
+                << ", expected " << faces[0].width << "x" << faces[0].height << endl;
+            return 0;
+        }
+    }
 
-    unsigned char* data_posx = stbi_load(posx.c_str(), &width, &height, &chn, 0);
-    unsigned char* data_posy = stbi_load(posy.c_str(), &width, &height, &chn, 0);
-    unsigned char* data_posz = stbi_load(posz.c_str(), &width, &height, &chn, 0);
-    unsigned char* data_negx = stbi_load(negx.c_str(), &width, &height, &chn, 0);
-    unsigned char* data_negy = stbi_load(negy.c_str(), &width, &height, &chn, 0);
-    unsigned char* data_negz = stbi_load(negz.c_str(), &width, &height, &chn, 0);
+    int levels = static_cast<int>(faces[0].levels.size());
 
     glGenTextures(1, &cube_texture);
 
@@ -138,34 +228,36 @@ unsigned int CubeMap::UploadCubeMapTexture(
 
     glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexStorage2D(GL_TEXTURE_CUBE_MAP, levels, CM::SKYBOX_FORMAT, faces[0].width, faces[0].height);
+
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
-    float maxAnisotropy;
-    glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAnisotropy);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, maxAnisotropy);
+    if (GLEW_EXT_texture_filter_anisotropic)
+    {
+        float maxAnisotropy;
+        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAnisotropy);
+        glTexParameterf(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_ANISOTROPY_EXT, maxAnisotropy);
+    }
 
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_RGBA32F, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data_posx);
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_Y, 0, GL_RGBA32F, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data_posy);
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_Z, 0, GL_RGBA32F, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data_posz);
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_X, 0, GL_RGBA32F, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data_negx);
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_Y, 0, GL_RGBA32F, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data_negy);
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_Z, 0, GL_RGBA32F, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data_negz);
-
-    glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+    for (int face = 0; face < 6; face++)
+    {
+        int w = faces[face].width, h = faces[face].height;
+        for (int level = 0; level < levels; level++)
+        {
+            glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, 0, 0, w, h,
+                GL_RGB, GL_UNSIGNED_BYTE, faces[face].levels[level].data());
+            w = max(w / 2, 1);
+            h = max(h / 2, 1);
+        }
+    }
 
-    // free memory
-    SAFE_FREE(data_posx);
-    SAFE_FREE(data_posy);
-    SAFE_FREE(data_posz);
-    SAFE_FREE(data_negx);
-    SAFE_FREE(data_negy);
-    SAFE_FREE(data_negz);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
 
     return cube_texture;
 }
@@ -173,73 +265,322 @@ unsigned int CubeMap::UploadCubeMapTexture(
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Function: CreateFramebuffer
-// Description: Creates a framebuffer and attaches a color texture and depth texture for rendering into the CubeMap.
+// Description: Creates the dynamic environment (color + depth, layered framebuffer), the static layer it is
+//              reset from, and the two framebuffers used to copy and downsample single faces. The paraboloid
+//              mode keeps its own size (PARABOLOID_SIZE) and format instead of the cubemap ones.
 // Parameters:
-//   - width: Width of the framebuffer textures.
-//   - height: Height of the framebuffer textures.
+//   - width: Width of the cubemap faces.
+//   - height: Height of the cubemap faces.
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 void CubeMap::CreateFramebuffer(int width, int height)
 {
-    glGenFramebuffers(1, &framebuffer_object);
-    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_object);
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 
-    glGenTextures(1, &color_texture);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, color_texture);
+    bool paraboloid = environment_mode == ENVIRONMENT_PARABOLOID;
+    face_width = paraboloid ? CM::PARABOLOID_SIZE : width;
+    face_height = paraboloid ? CM::PARABOLOID_SIZE : height;
+    GLenum colorFormat = paraboloid ? CM::PARABOLOID_FORMAT : CM::COLOR_FORMAT;
 
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_X, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_Y, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_Y, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_Z, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_Z, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    mip_levels = CM::MIPMAPS ? 1 + static_cast<int>(floor(log2(static_cast<float>(max(face_width, face_height))))) : 1;
 
-    if (color_texture)
-    {
-        //cubemap params
-        glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+    color_texture = CreateFaceTexture(colorFormat, mip_levels);
+    depth_texture = CreateFaceTexture(GL_DEPTH_COMPONENT24, 1);
+    static_color_texture = CreateFaceTexture(colorFormat, 1);
+    static_depth_texture = CreateFaceTexture(GL_DEPTH_COMPONENT24, 1);
 
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    framebuffer_object = CreateLayeredFramebuffer(color_texture, depth_texture);
+    static_framebuffer = CreateLayeredFramebuffer(static_color_texture, static_depth_texture);
+    glGenFramebuffers(2, copy_framebuffers);
 
-        if (GLEW_EXT_texture_filter_anisotropic) {
-            float maxAnisotropy;
-            glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAnisotropy);
-            glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, maxAnisotropy);
-        }
-        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    static_dirty = true;
+    pending_faces = CM::ALL_FACES;
+}
+
+
+void CubeMap::ReleaseBuffers()
+{
+    if (framebuffer_object) glDeleteFramebuffers(1, &framebuffer_object);
+    if (static_framebuffer) glDeleteFramebuffers(1, &static_framebuffer);
+    if (copy_framebuffers[0]) glDeleteFramebuffers(2, copy_framebuffers);
+    if (color_texture) glDeleteTextures(1, &color_texture);
+    if (depth_texture) glDeleteTextures(1, &depth_texture);
+    if (static_color_texture) glDeleteTextures(1, &static_color_texture);
+    if (static_depth_texture) glDeleteTextures(1, &static_depth_texture);
 
-        // Bind the color textures to the framebuffer as a color attachments
-        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, color_texture, 0);
+    framebuffer_object = static_framebuffer = 0;
+    copy_framebuffers[0] = copy_framebuffers[1] = 0;
+    color_texture = depth_texture = 0;
+    static_color_texture = static_depth_texture = 0;
+}
 
-        glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
 
-        std::vector<GLenum> draw_textures;
-        draw_textures.push_back(GL_COLOR_ATTACHMENT0);
-        glDrawBuffers(draw_textures.size(), &draw_textures[0]);
+GLuint CubeMap::CreateFaceTexture(GLenum format, int levels) const
+{
+    GLenum target = environment_mode == ENVIRONMENT_PARABOLOID ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_CUBE_MAP;
+
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    glBindTexture(target, texture);
+    if (target == GL_TEXTURE_2D_ARRAY)
+        glTexStorage3D(target, levels, format, face_width, face_height, GetFaceCount());
+    else
+        glTexStorage2D(target, levels, format, face_width, face_height);
+
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    glBindTexture(target, 0);
+
+    return texture;
+}
 
-    }
 
-    glGenTextures(1, &depth_texture);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, depth_texture);
+GLuint CubeMap::CreateLayeredFramebuffer(GLuint colorTexture, GLuint depthTexture) const
+{
+    GLuint framebuffer = 0;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
 
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_X, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_Y, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_Y, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_Z, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
-    glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_Z, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    // Every face (cube face or array layer) is attached, the shaders select them with gl_Layer
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, colorTexture, 0);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0);
 
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth_texture, 0);
+    GLenum drawBuffer = GL_COLOR_ATTACHMENT0;
+    glDrawBuffers(1, &drawBuffer);
 
     // Check if the framebuffer is complete
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) 
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
     {
         std::cerr << "Error: Framebuffer is not complete! Status: " << glCheckFramebufferStatus(GL_FRAMEBUFFER) << std::endl;
     }
 
-    // Unbind the framebuffer
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return framebuffer;
+}
+
+
+void CubeMap::BeginStaticBake()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, static_framebuffer);
+    glViewport(0, 0, face_width, face_height);
+    glClearColor(0, 0, 0, 1);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // The paraboloid shader clips every triangle to its hemisphere
+    if (environment_mode == ENVIRONMENT_PARABOLOID)
+        glEnable(GL_CLIP_DISTANCE0);
+}
+
+
+void CubeMap::EndStaticBake()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDisable(GL_CLIP_DISTANCE0);
+
+    // Every face of the dynamic cubemap now shows an outdated static layer
+    static_dirty = false;
+    pending_faces = CM::ALL_FACES;
+}
+
+
+void CubeMap::SetEnvironmentMode(int mode)
+{
+    environment_mode = mode == ENVIRONMENT_PARABOLOID ? ENVIRONMENT_PARABOLOID : ENVIRONMENT_CUBEMAP;
+    next_face = 0;
+
+    // Already initialized: recreate the targets in the new layout, the static layer gets baked again
+    if (face_width)
+    {
+        ReleaseBuffers();
+        CreateFramebuffer(width, height);
+    }
+
+    cout << "CubeMap environment: " << (environment_mode == ENVIRONMENT_PARABOLOID ? "dual paraboloid " : "cubemap ")
+        << GetFaceCount() << " x " << face_width << "x" << face_height << endl;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Function: BindEnvironment
+// Description: Binds the dynamic environment to the sampler of the current mode and tells the reflection
+//              shader which lookup to use (SampleEnvironment).
+// Parameters:
+//   - shader: Bound reflection program.
+//   - cubeUnit: Texture unit of texture_cubemap.
+//   - paraboloidUnit: Texture unit of texture_paraboloid.
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void CubeMap::BindEnvironment(const Shader* shader, int cubeUnit, int paraboloidUnit) const
+{
+    bool paraboloid = environment_mode == ENVIRONMENT_PARABOLOID;
+    glUniform1i(shader->GetUniformLocation("environment_mode"), environment_mode);
+    glUniform1i(shader->GetUniformLocation("texture_cubemap"), cubeUnit);
+    glUniform1i(shader->GetUniformLocation("texture_paraboloid"), paraboloidUnit);
+
+    glActiveTexture(GL_TEXTURE0 + (paraboloid ? paraboloidUnit : cubeUnit));
+    glBindTexture(paraboloid ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_CUBE_MAP, color_texture);
+}
+
+
+void CubeMap::SetLayeredRendering(bool enabled)
+{
+    if (enabled && !layered_supported)
+        cout << "CubeMap: no vertex shader gl_Layer support, using the geometry shader path" << endl;
+
+    layered_rendering = enabled && layered_supported;
+    cout << "CubeMap rendering: " << (layered_rendering ? "instanced layers" : "geometry shader") << endl;
+}
+
+
+void CubeMap::BindFaceBuffer() const
+{
+    glBindBufferBase(GL_UNIFORM_BUFFER, CM::FACE_BUFFER_BINDING, face_buffer);
+}
+
+
+unsigned int CubeMap::GetFaceMask(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const
+{
+    unsigned int faceMask = 0;
+    if (environment_mode == ENVIRONMENT_PARABOLOID)
+    {
+        // Hemispheres around the probe at the origin, split by the y = 0 plane
+        if (boundsMin.x > boundsMax.x || boundsMax.y >= 0)
+            faceMask |= 1u;
+        if (boundsMin.x > boundsMax.x || boundsMin.y <= 0)
+            faceMask |= 2u;
+        return faceMask;
+    }
+
+    for (int face = 0; face < 6; face++)
+    {
+        if (face_frustums[face].IsBoxVisible(boundsMin, boundsMax))
+            faceMask |= 1u << face;
+    }
+    return faceMask;
+}
+
+
+void CubeMap::SetFacesPerUpdate(int faces)
+{
+    faces_per_update = glm::clamp(faces, 1, 6);
+    cout << "CubeMap: " << faces_per_update << " face(s) per update at " << update_rate << " updates/s" << endl;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Function: BeginDynamicUpdate
+// Description: Picks the faces refreshed this frame: all of them right after a static bake, otherwise the next
+//              faces_per_update faces in round-robin order, at most update_rate times per second. The picked
+//              faces are reset to the static layer so only the dynamic geometry has to be drawn over them.
+// Parameters:
+//   - deltaTime: Frame time in seconds.
+// Returns:
+//   - Bit mask of the faces to draw, 0 when nothing is due.
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+unsigned int CubeMap::BeginDynamicUpdate(float deltaTime)
+{
+    int faceCount = GetFaceCount();
+    unsigned int faceMask = 0;
+    if (pending_faces)
+    {
+        faceMask = pending_faces & ((1u << faceCount) - 1);
+        pending_faces = 0;
+        update_timer = 0;
+    }
+    else
+    {
+        update_timer += deltaTime;
+        if (update_rate > 0)
+        {
+            float interval = 1.0f / update_rate;
+            if (update_timer < interval)
+                return 0;
+
+            // A long frame does not queue extra updates
+            update_timer = fmod(update_timer, interval);
+        }
+
+        for (int i = 0; i < faces_per_update; i++)
+        {
+            faceMask |= 1u << next_face;
+            next_face = (next_face + 1) % faceCount;
+        }
+    }
+
+    for (int face = 0; face < faceCount; face++)
+    {
+        if (faceMask & (1u << face))
+            ResetFace(face);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_object);
+    glViewport(0, 0, face_width, face_height);
+    if (environment_mode == ENVIRONMENT_PARABOLOID)
+        glEnable(GL_CLIP_DISTANCE0);
+    return faceMask;
+}
+
+
+void CubeMap::EndDynamicUpdate(unsigned int faceMask)
+{
+    glDisable(GL_CLIP_DISTANCE0);
+
+    if (mip_levels > 1)
+    {
+        for (int face = 0; face < GetFaceCount(); face++)
+        {
+            if (faceMask & (1u << face))
+                GenerateFaceMipmaps(face);
+        }
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+
+void CubeMap::AttachFace(GLenum target, GLenum attachment, GLuint texture, int level, int face) const
+{
+    if (environment_mode == ENVIRONMENT_PARABOLOID)
+        glFramebufferTextureLayer(target, attachment, texture, level, face);
+    else
+        glFramebufferTexture2D(target, attachment, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, texture, level);
+}
+
+
+void CubeMap::ResetFace(int face)
+{
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, copy_framebuffers[0]);
+    AttachFace(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, static_color_texture, 0, face);
+    AttachFace(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, static_depth_texture, 0, face);
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, copy_framebuffers[1]);
+    AttachFace(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, color_texture, 0, face);
+    AttachFace(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth_texture, 0, face);
+
+    glBlitFramebuffer(0, 0, face_width, face_height, 0, 0, face_width, face_height, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+}
+
+
+void CubeMap::GenerateFaceMipmaps(int face)
+{
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, copy_framebuffers[0]);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, 0, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, copy_framebuffers[1]);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, 0, 0);
+
+    int levelWidth = face_width, levelHeight = face_height;
+    for (int level = 1; level < mip_levels; level++)
+    {
+        int nextWidth = max(levelWidth / 2, 1);
+        int nextHeight = max(levelHeight / 2, 1);
+
+        AttachFace(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, color_texture, level - 1, face);
+        AttachFace(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, color_texture, level, face);
+        glBlitFramebuffer(0, 0, levelWidth, levelHeight, 0, 0, nextWidth, nextHeight, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+
+        levelWidth = nextWidth;
+        levelHeight = nextHeight;
+    }
 }
@@ -6,6 +6,7 @@
 #include "components/simple_scene.h"
 #include "core/gpu/shader.h"
 #include "core/gpu/frame_buffer.h"
+#include "core/gpu/frustum.h"
 #include "core/managers/resource_path.h"
 #include "core/window/window_object.h"
 #include "stb/stb_image.h"
@@ -40,8 +41,55 @@ public:
 	int GetWidth() const { return width; }
 	int GetHeight() const { return height; }
 
+    // ENVIRONMENT_CUBEMAP: six faces. ENVIRONMENT_PARABOLOID: two hemispheres (faces 0 - upper, 1 - lower)
+    // in the layers of a 2D array texture, see Constants::CubeMap::PARABOLOID_SIZE
+    void SetEnvironmentMode(int mode);
+    int GetEnvironmentMode() const { return environment_mode; }
+    int GetFaceCount() const { return environment_mode == ENVIRONMENT_PARABOLOID ? 2 : 6; }
+    int GetFaceHeight() const { return face_height; }
+    // Binds the captured environment for the reflection shaders (texture_cubemap / texture_paraboloid)
+    void BindEnvironment(const Shader* shader, int cubeUnit, int paraboloidUnit) const;
+
+    // Static layer (skybox, terrain): baked once, again after InvalidateStatic()
+    bool IsStaticDirty() const { return static_dirty; }
+    void InvalidateStatic() { static_dirty = true; }
+    void BeginStaticBake();
+    void EndStaticBake();
+
+    // Dynamic layer: returns the mask of the faces to redraw this frame (0 - none). Those faces are
+    // reset to the static layer and the cubemap framebuffer is left bound
+    unsigned int BeginDynamicUpdate(float deltaTime);
+    void EndDynamicUpdate(unsigned int faceMask);
+
+    // Faces (bit mask) whose view volume intersects a world space box, all of them for unknown bounds
+    unsigned int GetFaceMask(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const;
+
+    // Instanced rendering with gl_Layer from the vertex shader, falls back to the geometry shader
+    // when neither ARB_shader_viewport_layer_array nor AMD_vertex_shader_layer is available
+    void SetLayeredRendering(bool enabled);
+    bool IsLayeredRendering() const { return layered_rendering; }
+    // Per-face view-projection matrices read by the layered vertex shader
+    void BindFaceBuffer() const;
+
+    void SetFacesPerUpdate(int faces);
+    int GetFacesPerUpdate() const { return faces_per_update; }
+    void SetUpdateRate(float rate) { update_rate = rate; }
+    float GetUpdateRate() const { return update_rate; }
+
 private:
     void CreateFramebuffer(int width, int height);
+    void ReleaseBuffers();
+
+    // Cube map or 2-layer array texture of face_width x face_height, depending on the environment mode
+    GLuint CreateFaceTexture(GLenum format, int levels) const;
+    GLuint CreateLayeredFramebuffer(GLuint colorTexture, GLuint depthTexture) const;
+
+    // Attach one face (cube face or paraboloid layer) of a texture to a framebuffer
+    void AttachFace(GLenum target, GLenum attachment, GLuint texture, int level, int face) const;
+    // Copy a face of the static layer (color + depth) over the dynamic one
+    void ResetFace(int face);
+    // Downsample level 0 of a face into its mip chain
+    void GenerateFaceMipmaps(int face);
 
     // Load cubemap texture from 6 images
     GLuint UploadCubeMapTexture(
@@ -58,12 +106,31 @@ private:
     GLuint color_texture;
     GLuint depth_texture;
 
+    GLuint static_framebuffer;
+    GLuint static_color_texture;
+    GLuint static_depth_texture;
+    GLuint copy_framebuffers[2];
+    int mip_levels;
+    Frustum face_frustums[6];
+    GLuint face_buffer;
+    bool layered_supported;
+    bool layered_rendering;
+    int environment_mode;
+    int face_width, face_height;
+
+    bool static_dirty;
+    unsigned int pending_faces;
+    int faces_per_update;
+    float update_rate;
+    float update_timer;
+    int next_face;
+
     int width, height;
     float cube_angle;
     int shadow_type;
 
     glm::ivec2 resolution;
-    std::unordered_map<std::string, Mesh*> meshes;
+    AssetMap<Mesh> meshes;
 };
 
 #endif // CUBEMAP_H
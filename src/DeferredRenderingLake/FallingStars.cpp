@@ -110,18 +110,9 @@ void FallingStars::Render(
         glUniform1f(glGetUniformLocation(shader->program, "deltaTime"), deltaTime);
         glUniform2f(glGetUniformLocation(shader->program, "resolution"), camera->GetFieldOfViewX(), camera->GetFieldOfViewY());
 
-        auto texture = TextureManager::GetTexture("star.png");
-        if (texture)
-        {
-            texture->BindToTextureUnit(GL_TEXTURE0);
-
-            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-            glGenerateMipmap(GL_TEXTURE_2D);
-        }
+        // Sprite array bound by the particles pass
+        glUniform1i(shader->GetUniformLocation("texture_sprites"), 0);
+        glUniform1i(shader->GetUniformLocation("sprite_layer"), TextureManager::GetTextureLayer("star.png").layer);
 
         particle_effect->Render(camera, shader);
     }
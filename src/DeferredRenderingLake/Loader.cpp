@@ -1,5 +1,6 @@
-#include "Loader.h"
+﻿#include "Loader.h"
 
+#include "core/managers/asset_registry.h"
 #include "utils/gl_utils.h"
 
 #include <iostream>
@@ -20,120 +21,75 @@ Loader::~Loader()
 
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Function: LoadShader
-// Description: Loads a shader from a configuration and stores it in the provided map.
+// Function: DeclareShader
+// Description: Declares a shader from a configuration in the asset registry. Its sources are read and the program
+//              linked on the first lookup, or earlier when it's prefetched.
 // Parameters:
-//   - shaders: Map of shaders to store the loaded shader.
 //   - config: Configuration for loading the shader.
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-void Loader::LoadShader(
-    unordered_map<string, Shader*>& shaders,
-    const ShaderConfig& config)
+void Loader::DeclareShader(const ShaderConfig& config)
 {
     string baseShaderPath = PATH_JOIN(window->props.selfDir, SOURCE_PATH::PATH_PROJECT, "DeferredRenderingLake", "Shaders");
     string shaderFolder = PATH_JOIN(baseShaderPath, config.shaderName);
 
-    cout << "Trying to load shader: " << config.shaderName << endl;
-
-    string vertexPath = PATH_JOIN(shaderFolder, config.vertexShader + ".VS.glsl");
-    string fragmentPath = PATH_JOIN(shaderFolder, config.fragmentShader + ".FS.glsl");
-    string geometryPath = config.hasGeometry ? PATH_JOIN(shaderFolder, config.geometryShader + ".GS.glsl") : "";
-
-    cout << "Vertex Shader Path: " << vertexPath << endl;
-    cout << "Fragment Shader Path: " << fragmentPath << endl;
-    if (config.hasGeometry)
+    if (!config.computeShader.empty())
     {
-        cout << "Geometry Shader Path: " << geometryPath << endl;
+        AssetRegistry::DeclareShader(config.shaderName, { { PATH_JOIN(shaderFolder, config.computeShader + ".CS.glsl"), GL_COMPUTE_SHADER } });
+        return;
     }
 
-    Shader* shader = new Shader(config.shaderName);
-    shader->AddShader(vertexPath, GL_VERTEX_SHADER);
-    shader->AddShader(fragmentPath, GL_FRAGMENT_SHADER);
-    if (config.hasGeometry) 
+    vector<pair<string, GLenum>> files =
     {
-        shader->AddShader(geometryPath, GL_GEOMETRY_SHADER);
-    }
-
-    if (!shader->CreateAndLink())
+        { PATH_JOIN(shaderFolder, config.vertexShader + ".VS.glsl"), GL_VERTEX_SHADER },
+        { PATH_JOIN(shaderFolder, config.fragmentShader + ".FS.glsl"), GL_FRAGMENT_SHADER }
+    };
+    if (config.hasGeometry)
     {
-        cerr << "Error linking shader program: " << config.shaderName << endl;
-        delete shader;
-        return;
+        files.push_back({ PATH_JOIN(shaderFolder, config.geometryShader + ".GS.glsl"), GL_GEOMETRY_SHADER });
     }
 
-    shaders[config.shaderName] = shader;
-    cout << "Shader '" << config.shaderName << "' successfully loaded and linked!" << endl;
+    AssetRegistry::DeclareShader(config.shaderName, files);
 }
 
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Function: LoadAllShaders
-// Description: Loads all shaders from a list of configurations and stores them in the provided map.
+// Function: DeclareAllShaders
+// Description: Declares all shaders from a list of configurations, none of them is loaded yet.
 // Parameters:
-//   - shaders: Map of shaders to store the loaded shaders.
 //   - configs: List of configurations for loading shaders.
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-void Loader::LoadAllShaders(
-    unordered_map<string, Shader*>& shaders,
-    const vector<ShaderConfig>& configs)
+void Loader::DeclareAllShaders(const vector<ShaderConfig>& configs)
 {
     for (const auto& config : configs) 
     {
-        LoadShader(shaders, config);
+        DeclareShader(config);
     }
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Function: LoadMesh
-// Description: Loads a mesh from a file and stores it in the provided map.
+// Function: DeclareMesh
+// Description: Declares a mesh file in the asset registry. It's imported and uploaded on the first lookup, or
+//              earlier when it's prefetched. Configurations of the same file share one mesh.
 // Parameters:
-//   - meshes: Map of meshes to store the loaded mesh.
-//   - meshName: Name of the mesh to be loaded.
-//   - folderPath: Path to the folder containing the mesh file.
-//   - fileName: Name of the mesh file.
-//   - useMaterials: Flag indicating whether to use materials for the mesh.
+//   - config: Configuration for loading the mesh.
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-void Loader::LoadMesh(
-    unordered_map<string, Mesh*>& meshes,
-    const MeshConfig& config)
+void Loader::DeclareMesh(const MeshConfig& config)
 {
-    cout << "Loading mesh: " << config.meshName << endl;
-
-    if (meshes.find(config.meshName) != meshes.end())
-    {
-        cerr << "Warning: Mesh with name '" << config.meshName << "' already exists. Skipping load." << endl;
-        return;
-    }
-
-    Mesh* mesh = new Mesh(config.meshName);
-    string fullPath = PATH_JOIN(config.folderPath, config.fileName);
-
-    if (!mesh->LoadMesh(config.folderPath, config.fileName))
-    {
-        cerr << "Error: Failed to load mesh '" << config.meshName << "' from '" << fullPath << "'!" << endl;
-        delete mesh;
-        return;
-    }
-
-    mesh->UseMaterials(config.useMaterials);
-    meshes[mesh->GetMeshID()] = mesh;
-    cout << "Mesh '" << config.meshName << "' successfully loaded!" << endl;
+    AssetRegistry::DeclareMesh(config.meshName, config.folderPath, config.fileName, config.useMaterials,
+        config.compactIndices);
 }
 
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Function: LoadAllMeshes
-// Description: Loads all meshes from a list of configurations and stores them in the provided map.
+// Function: DeclareAllMeshes
+// Description: Declares all meshes from a list of configurations, none of them is loaded yet.
 // Parameters:
-//   - meshes: Map of meshes to store the loaded meshes.
 //   - configs: List of configurations for loading meshes.
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-void Loader::LoadAllMeshes(
-    unordered_map<string, Mesh*>& meshes,
-    const vector<MeshConfig>& configs)
+void Loader::DeclareAllMeshes(const vector<MeshConfig>& configs)
 {
     for (const auto& config : configs)
     {
-        LoadMesh(meshes, config);
+        DeclareMesh(config);
     }
 }
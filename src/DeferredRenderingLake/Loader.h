@@ -21,26 +21,19 @@ public:
     explicit Loader(WindowObject* window);
     ~Loader();
 
-    // Load all shaders using a matrix (list of ShaderConfig)
-    void LoadAllShaders(
-        std::unordered_map<std::string, Shader*>& shaders,
-        const std::vector<ShaderConfig>& configs);
+    // Declare all shaders using a matrix (list of ShaderConfig). Nothing is read here: a program is linked on its
+    // first lookup through the scene's shader map, or earlier when prefetched (AssetRegistry)
+    void DeclareAllShaders(const std::vector<ShaderConfig>& configs);
 
-    // Load all meshes using a list of configurations
-    void LoadAllMeshes(
-        std::unordered_map<std::string, Mesh*>& meshes,
-        const std::vector<MeshConfig>& configs);
+    // Declare all meshes using a list of configurations, loaded on first lookup or when prefetched
+    void DeclareAllMeshes(const std::vector<MeshConfig>& configs);
 
 private:
-    // Load a single shader program
-    void LoadShader(
-        std::unordered_map<std::string, Shader*>& shaders,
-        const ShaderConfig& config);
-
-    // Load a single mesh
-    void LoadMesh(
-        std::unordered_map<std::string, Mesh*>& meshes,
-        const MeshConfig& config);
+    // Declare a single shader program
+    void DeclareShader(const ShaderConfig& config);
+
+    // Declare a single mesh
+    void DeclareMesh(const MeshConfig& config);
 
 private:
     WindowObject* window;
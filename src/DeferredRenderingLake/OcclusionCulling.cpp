@@ -0,0 +1,390 @@
+﻿#include "OcclusionCulling.h"
+#include "Constants.h"
+#include "core/managers/sampler_manager.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+
+
+using namespace std;
+using DR = Constants::DeferredRender;
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Function: Build
+// Description: Builds the max-depth chain; odd rows/columns are folded into the last texel of the next level
+// Parameters:
+//   - depth: Level 0 depth values, bottom row first
+//   - width, height: Size of level 0
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void HiZPyramid::Build(const float* depth, int width, int height)
+{
+    levels.clear();
+    if (!depth || width <= 0 || height <= 0) return;
+
+    Level base;
+    base.width = width;
+    base.height = height;
+    base.depth.assign(depth, depth + width * height);
+    levels.push_back(base);
+
+    while (levels.back().width > 1 || levels.back().height > 1)
+    {
+        const Level& src = levels.back();
+        Level dst;
+        dst.width = max(1, src.width / 2);
+        dst.height = max(1, src.height / 2);
+        dst.depth.resize(dst.width * dst.height);
+
+        for (int y = 0; y < dst.height; y++)
+        {
+            int y0 = y * 2;
+            int y1 = (y == dst.height - 1) ? src.height - 1 : min(y0 + 1, src.height - 1);
+            for (int x = 0; x < dst.width; x++)
+            {
+                int x0 = x * 2;
+                int x1 = (x == dst.width - 1) ? src.width - 1 : min(x0 + 1, src.width - 1);
+
+                float value = 0.0f;
+                for (int sy = y0; sy <= y1; sy++)
+                    for (int sx = x0; sx <= x1; sx++)
+                        value = max(value, src.depth[sy * src.width + sx]);
+                dst.depth[y * dst.width + x] = value;
+            }
+        }
+
+        levels.push_back(dst);
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Function: ProjectBounds
+// Description: Projects the 8 corners of a world space box into [0, 1] screen space and depth
+// Parameters:
+//   - boundsMin, boundsMax: World space box
+//   - viewProjection: Matrix the depth was rendered with
+//   - uvMin, uvMax: Screen rectangle covered by the box
+//   - depthMin: Nearest [0, 1] depth of the box
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool HiZPyramid::ProjectBounds(
+    const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& viewProjection,
+    glm::vec2& uvMin, glm::vec2& uvMax, float& depthMin)
+{
+    if (boundsMin.x > boundsMax.x) return false;
+
+    uvMin = glm::vec2(FLT_MAX);
+    uvMax = glm::vec2(-FLT_MAX);
+    depthMin = FLT_MAX;
+
+    for (int i = 0; i < 8; i++)
+    {
+        glm::vec3 corner(
+            (i & 1) ? boundsMax.x : boundsMin.x,
+            (i & 2) ? boundsMax.y : boundsMin.y,
+            (i & 4) ? boundsMax.z : boundsMin.z);
+
+        glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+        if (clip.w <= 0.0f) return false;
+
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        glm::vec2 uv = glm::vec2(ndc) * 0.5f + 0.5f;
+        uvMin = glm::min(uvMin, uv);
+        uvMax = glm::max(uvMax, uv);
+        depthMin = min(depthMin, ndc.z * 0.5f + 0.5f);
+    }
+
+    return uvMin.x >= 0.0f && uvMin.y >= 0.0f && uvMax.x <= 1.0f && uvMax.y <= 1.0f;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Function: IsVisible
+// Description: Conservative test of a box against the pyramid, sampling the level where it covers at most 2x2 texels
+// Parameters:
+//   - boundsMin, boundsMax: World space box (inverted = unknown, always visible)
+//   - viewProjection: Matrix the depth was rendered with
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool HiZPyramid::IsVisible(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& viewProjection) const
+{
+    if (levels.empty()) return true;
+
+    glm::vec2 uvMin, uvMax;
+    float depthMin;
+    if (!ProjectBounds(boundsMin, boundsMax, viewProjection, uvMin, uvMax, depthMin)) return true;
+
+    const Level& base = levels.front();
+    glm::vec2 extent = (uvMax - uvMin) * glm::vec2(base.width, base.height);
+    int level = (int)ceil(log2(max(max(extent.x, extent.y), 1.0f)));
+    level = min(level, (int)levels.size() - 1);
+
+    // One extra texel on each side covers the odd-size folding of the coarser levels
+    const Level& hiZ = levels[level];
+    int x0 = max((int)floor(uvMin.x * hiZ.width) - 1, 0);
+    int y0 = max((int)floor(uvMin.y * hiZ.height) - 1, 0);
+    int x1 = min((int)floor(uvMax.x * hiZ.width) + 1, hiZ.width - 1);
+    int y1 = min((int)floor(uvMax.y * hiZ.height) + 1, hiZ.height - 1);
+
+    float depthMax = 0.0f;
+    for (int y = y0; y <= y1; y++)
+        for (int x = x0; x <= x1; x++)
+            depthMax = max(depthMax, hiZ.depth[y * hiZ.width + x]);
+
+    return depthMin <= depthMax;
+}
+
+
+OcclusionCulling::OcclusionCulling()
+{
+    width = height = 0;
+    nrLevels = 0;
+
+    hiZTexture = 0;
+    hasHiZ = false;
+
+    readbackBuffer = 0;
+    readbackFence = 0;
+    readbackLevel = 0;
+    readbackSize = glm::ivec2(0);
+
+    boxBuffer = commandBuffer = indirectBuffer = 0;
+    capacity = 0;
+}
+
+OcclusionCulling::~OcclusionCulling()
+{
+    Release();
+    if (boxBuffer) glDeleteBuffers(1, &boxBuffer);
+    if (commandBuffer) glDeleteBuffers(1, &commandBuffer);
+    if (indirectBuffer) glDeleteBuffers(1, &indirectBuffer);
+}
+
+
+void OcclusionCulling::Release()
+{
+    if (readbackFence) glDeleteSync(readbackFence);
+    if (readbackBuffer) glDeleteBuffers(1, &readbackBuffer);
+    if (hiZTexture) glDeleteTextures(1, &hiZTexture);
+
+    readbackFence = 0;
+    readbackBuffer = 0;
+    hiZTexture = 0;
+    hasHiZ = false;
+    pyramid.Clear();
+}
+
+
+void OcclusionCulling::Init(int width, int height)
+{
+    Resize(width, height);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Function: Resize
+// Description: Recreates the Hi-Z texture and the readback buffer; the previous frame's depth is dropped
+// Parameters:
+//   - width, height: Size of the depth buffer being culled against
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void OcclusionCulling::Resize(int width, int height)
+{
+    Release();
+
+    this->width = max(width, 1);
+    this->height = max(height, 1);
+    nrLevels = 1 + (int)floor(log2((float)max(this->width, this->height)));
+
+    glGenTextures(1, &hiZTexture);
+    glBindTexture(GL_TEXTURE_2D, hiZTexture);
+    glTexStorage2D(GL_TEXTURE_2D, nrLevels, GL_R32F, this->width, this->height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // The CPU path only reads a coarse level back
+    readbackLevel = 0;
+    readbackSize = glm::ivec2(this->width, this->height);
+    while (readbackSize.x > DR::HI_Z_READBACK_WIDTH && readbackLevel < nrLevels - 1)
+    {
+        readbackLevel++;
+        readbackSize = glm::max(readbackSize / 2, glm::ivec2(1));
+    }
+
+    glGenBuffers(1, &readbackBuffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffer);
+    glBufferData(GL_PIXEL_PACK_BUFFER, readbackSize.x * readbackSize.y * sizeof(float), nullptr, GL_STREAM_READ);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Function: BuildHiZ
+// Description: Copies the depth buffer into level 0 and max-reduces it down the mip chain with a compute shader
+// Parameters:
+//   - depthTexture: Depth of the frame that was just rendered
+//   - viewProjection: Matrix the depth was rendered with
+//   - buildShader: HiZBuild compute program
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void OcclusionCulling::BuildHiZ(const Texture2D* depthTexture, const glm::mat4& viewProjection, Shader* buildShader)
+{
+    if (!hiZTexture || !depthTexture || !buildShader) return;
+
+    buildShader->Use();
+    glUniform1i(glGetUniformLocation(buildShader->program, "source"), 0);
+    glActiveTexture(GL_TEXTURE0);
+    // A shared sampler left on the unit would make the single level depth texture incomplete
+    SamplerManager::BindSampler(GL_TEXTURE0, 0);
+
+    int levelWidth = width, levelHeight = height;
+    for (int level = 0; level < nrLevels; level++)
+    {
+        if (level == 0)
+        {
+            glBindTexture(GL_TEXTURE_2D, depthTexture->GetTextureID());
+            glUniform1i(glGetUniformLocation(buildShader->program, "source_level"), 0);
+            glUniform2i(glGetUniformLocation(buildShader->program, "source_size"), width, height);
+        }
+        else
+        {
+            glBindTexture(GL_TEXTURE_2D, hiZTexture);
+            glUniform1i(glGetUniformLocation(buildShader->program, "source_level"), level - 1);
+            glUniform2i(glGetUniformLocation(buildShader->program, "source_size"), levelWidth, levelHeight);
+            levelWidth = max(levelWidth / 2, 1);
+            levelHeight = max(levelHeight / 2, 1);
+        }
+        glUniform1i(glGetUniformLocation(buildShader->program, "reduce"), level > 0);
+        glUniform2i(glGetUniformLocation(buildShader->program, "destination_size"), levelWidth, levelHeight);
+
+        glBindImageTexture(0, hiZTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        glDispatchCompute((levelWidth + 7) / 8, (levelHeight + 7) / 8, 1);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    }
+
+    glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    hiZViewProjection = viewProjection;
+    hasHiZ = true;
+
+    // Queue the readback; a frame that is still in flight keeps its older request
+    if (!readbackFence)
+    {
+        glMemoryBarrier(GL_PIXEL_BUFFER_BARRIER_BIT);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffer);
+        glBindTexture(GL_TEXTURE_2D, hiZTexture);
+        glGetTexImage(GL_TEXTURE_2D, readbackLevel, GL_RED, GL_FLOAT, nullptr);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        readbackFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        readbackViewProjection = viewProjection;
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Function: BeginFrame
+// Description: Maps the pending readback if its fence has signaled, never waits on the GPU
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void OcclusionCulling::BeginFrame()
+{
+    if (!readbackFence) return;
+
+    GLenum status = glClientWaitSync(readbackFence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return;
+
+    glDeleteSync(readbackFence);
+    readbackFence = 0;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffer);
+    const float* data = (const float*)glMapBufferRange(
+        GL_PIXEL_PACK_BUFFER, 0, readbackSize.x * readbackSize.y * sizeof(float), GL_MAP_READ_BIT);
+    if (data)
+    {
+        pyramid.Build(data, readbackSize.x, readbackSize.y);
+        pyramidViewProjection = readbackViewProjection;
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+
+bool OcclusionCulling::IsVisible(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const
+{
+    return pyramid.IsVisible(boundsMin, boundsMax, pyramidViewProjection);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Function: CullIndirect
+// Description: Tests every box against the Hi-Z texture on the GPU and writes the matching draw commands
+//              into the indirect buffer, left bound to GL_DRAW_INDIRECT_BUFFER
+// Parameters:
+//   - boxes: World space bounds, one per command
+//   - commands: Draws to emit when visible
+//   - cullShader: HiZCull compute program
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void OcclusionCulling::CullIndirect(
+    const vector<CullingBox>& boxes,
+    const vector<DrawElementsIndirectCommand>& commands,
+    Shader* cullShader)
+{
+    if (!cullShader || commands.empty() || boxes.size() != commands.size()) return;
+
+    if (!boxBuffer)
+    {
+        glGenBuffers(1, &boxBuffer);
+        glGenBuffers(1, &commandBuffer);
+        glGenBuffers(1, &indirectBuffer);
+    }
+
+    if (commands.size() > capacity)
+    {
+        capacity = commands.size();
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, boxBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(CullingBox), nullptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(DrawElementsIndirectCommand), nullptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, indirectBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(DrawElementsIndirectCommand), nullptr, GL_DYNAMIC_COPY);
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, boxBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, boxes.size() * sizeof(CullingBox), boxes.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    cullShader->Use();
+    glUniform1i(glGetUniformLocation(cullShader->program, "draw_count"), (GLint)commands.size());
+    glUniform1i(glGetUniformLocation(cullShader->program, "has_hi_z"), hasHiZ);
+    glUniform1i(glGetUniformLocation(cullShader->program, "hi_z_levels"), nrLevels);
+    glUniform2i(glGetUniformLocation(cullShader->program, "hi_z_size"), width, height);
+    glUniformMatrix4fv(glGetUniformLocation(cullShader->program, "view_projection"), 1, GL_FALSE, glm::value_ptr(hiZViewProjection));
+
+    glActiveTexture(GL_TEXTURE0);
+    SamplerManager::BindSampler(GL_TEXTURE0, 0);
+    glBindTexture(GL_TEXTURE_2D, hiZTexture);
+    glUniform1i(glGetUniformLocation(cullShader->program, "hi_z"), 0);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, boxBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, commandBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, indirectBuffer);
+    glDispatchCompute(((GLuint)commands.size() + 63) / 64, 1, 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+}
+
+
+void OcclusionCulling::DrawIndirect(unsigned int index, GLenum indexType) const
+{
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+    glDrawElementsIndirect(GL_TRIANGLES, indexType,
+        (const void*)(size_t)(index * sizeof(DrawElementsIndirectCommand)));
+}
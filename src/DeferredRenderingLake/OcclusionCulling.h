@@ -0,0 +1,103 @@
+#pragma once
+
+#ifndef OCCLUSION_CULLING_H
+#define OCCLUSION_CULLING_H
+
+#include "core/gpu/shader.h"
+#include "core/gpu/texture2D.h"
+#include "utils/glm_utils.h"
+
+#include "Structures.h"
+
+#include <vector>
+
+
+// CPU max-depth pyramid, level 0 being the finest level that was provided
+class HiZPyramid
+{
+public:
+    // Build the chain from a depth image (GL row order, bottom row first)
+    void Build(const float* depth, int width, int height);
+    void Clear() { levels.clear(); }
+    bool IsEmpty() const { return levels.empty(); }
+
+    // False only when the world space box lies entirely behind the stored depth
+    bool IsVisible(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& viewProjection) const;
+
+    // Screen rectangle [0, 1] and nearest depth of a box; false if it cannot be tested
+    // (crosses the near plane or is not fully on screen)
+    static bool ProjectBounds(
+        const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& viewProjection,
+        glm::vec2& uvMin, glm::vec2& uvMax, float& depthMin);
+
+private:
+    struct Level
+    {
+        int width;
+        int height;
+        std::vector<float> depth;
+    };
+
+    std::vector<Level> levels;
+};
+
+
+// Hierarchical-Z occlusion culling against the previous frame's depth.
+// The pyramid is built on the GPU at the end of the geometry pass together with
+// the view-projection it was rendered with, so next frame's bounds are reprojected
+// into it. It is consumed either on the CPU (a coarse level read back
+// asynchronously) or by a compute pass writing glDrawElementsIndirect commands.
+class OcclusionCulling
+{
+public:
+    OcclusionCulling();
+    ~OcclusionCulling();
+
+    void Init(int width, int height);
+    void Resize(int width, int height);
+
+    // Downsample this frame's depth into the Hi-Z pyramid and queue the CPU readback
+    void BuildHiZ(const Texture2D* depthTexture, const glm::mat4& viewProjection, Shader* buildShader);
+
+    // Picks up the readback queued by the previous BuildHiZ once the GPU is done with it
+    void BeginFrame();
+
+    // CPU test against the last read back pyramid
+    bool IsVisible(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const;
+
+    // GPU test; commands of occluded boxes are written with instanceCount = 0
+    void CullIndirect(
+        const std::vector<CullingBox>& boxes,
+        const std::vector<DrawElementsIndirectCommand>& commands,
+        Shader* cullShader);
+
+    // Draw command `index` of the last CullIndirect with the bound VAO, indexType of the drawn MeshEntry
+    void DrawIndirect(unsigned int index, GLenum indexType = GL_UNSIGNED_INT) const;
+
+private:
+    void Release();
+
+private:
+    int width, height;
+    int nrLevels;
+
+    GLuint hiZTexture;
+    glm::mat4 hiZViewProjection;
+    bool hasHiZ;
+
+    GLuint readbackBuffer;
+    GLsync readbackFence;
+    int readbackLevel;
+    glm::ivec2 readbackSize;
+    glm::mat4 readbackViewProjection;
+
+    HiZPyramid pyramid;
+    glm::mat4 pyramidViewProjection;
+
+    GLuint boxBuffer;
+    GLuint commandBuffer;
+    GLuint indirectBuffer;
+    size_t capacity;
+};
+
+#endif // OCCLUSION_CULLING_H
@@ -6,6 +6,8 @@ layout(triangle_strip, max_vertices = 18) out;
 uniform mat4 View;
 uniform mat4 Projection;
 uniform mat4 viewMatrices[6];
+// Bit i set - emit to cube face i
+uniform int face_mask;
 
 in vec3 geom_position[3];
 in vec2 geom_texture_coord[3];
@@ -25,14 +27,31 @@ void main()
 
     for (int layer = 0; layer < 6; ++layer)
     {
+        if ((face_mask & (1 << layer)) == 0)
+            continue;
+
+        vec4 clip_position[3];
+        for (int i = 0; i < 3; i++)
+            clip_position[i] = Projection * viewMatrices[layer] * gl_in[i].gl_Position;
+
+        // Skip the face when the whole triangle is outside one of its clip planes
+        bvec3 outside_min = bvec3(true), outside_max = bvec3(true);
+        for (int i = 0; i < 3; i++)
+        {
+            outside_min = outside_min && lessThan(clip_position[i].xyz, vec3(-clip_position[i].w));
+            outside_max = outside_max && greaterThan(clip_position[i].xyz, vec3(clip_position[i].w));
+        }
+        if (any(outside_min) || any(outside_max))
+            continue;
+
         gl_Layer = layer;
         for (int i = 0; i < gl_in.length(); i++)
         {
             frag_position = geom_position[i];
             frag_texture_coord = geom_texture_coord[i];
-            gl_Position = Projection * viewMatrices[layer] * gl_in[i].gl_Position;
+            gl_Position = clip_position[i];
             EmitVertex();
         }
         EndPrimitive();
     }
-}
\ No newline at end of file
+}
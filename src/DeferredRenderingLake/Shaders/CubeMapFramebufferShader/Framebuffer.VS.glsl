@@ -15,8 +15,10 @@ out vec2 geom_texture_coord;
 
 void main()
 {
-    geom_position = v_position;
+    vec3 position = DecodePosition(v_position);
+
+    geom_position = position;
     geom_texture_coord = v_texture_coord;
 
-    gl_Position = Model * vec4(v_position, 1);
+    gl_Position = Model * vec4(position, 1);
 }
@@ -0,0 +1,40 @@
+#version 430
+#if defined(GL_ARB_shader_viewport_layer_array)
+#extension GL_ARB_shader_viewport_layer_array : require
+#elif defined(GL_AMD_vertex_shader_layer)
+#extension GL_AMD_vertex_shader_layer : require
+#endif
+
+// Input
+layout(location = 0) in vec3 v_position;
+layout(location = 1) in vec3 v_normal;
+layout(location = 2) in vec2 v_texture_coord;
+
+// Uniform properties
+uniform mat4 Model;
+
+// Projection * view of every cube face (binding mirrored by CM::FACE_BUFFER_BINDING)
+layout(std140, binding = 0) uniform CubeFaces
+{
+    mat4 face_view_projection[6];
+};
+
+// Cube face drawn by every instance, only the faces in the draw's mask are instanced
+uniform int instance_faces[6];
+
+out vec3 frag_position;
+out vec2 frag_texture_coord;
+
+
+void main()
+{
+    vec3 position = DecodePosition(v_position);
+
+    int face = instance_faces[gl_InstanceID];
+
+    frag_position = position;
+    frag_texture_coord = v_texture_coord;
+
+    gl_Position = face_view_projection[face] * Model * vec4(position, 1);
+    gl_Layer = face;
+}
@@ -13,9 +13,14 @@ uniform mat4 Projection;
 // Output
 layout(location = 0) out vec3 text_coord;
 
+// Must match the depth pre-pass
+invariant gl_Position;
+
 
 void main()
 {
-    text_coord = normalize(v_position);
-    gl_Position = Projection * View * Model * vec4(v_position, 1);
+    vec3 position = DecodePosition(v_position);
+
+    text_coord = normalize(position);
+    gl_Position = Projection * View * Model * vec4(position, 1);
 }
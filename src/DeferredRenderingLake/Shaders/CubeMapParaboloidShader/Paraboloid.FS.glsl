@@ -0,0 +1,37 @@
+#version 430
+
+layout(location = 0) out vec4 out_color;
+
+uniform sampler2D texture_1;
+uniform samplerCube texture_cubemap;
+uniform int cube_draw;
+
+in vec3 frag_position;
+in vec2 frag_texture_coord;
+
+
+// Inverse of the paraboloid projection: direction seen through point p of a hemisphere
+vec3 ParaboloidDirection(vec2 p, float hemisphere)
+{
+    float r2 = dot(p, p);
+    return vec3(2.0 * p.x, hemisphere * (1.0 - r2), hemisphere * 2.0 * p.y) / (1.0 + r2);
+}
+
+
+void main()
+{
+    vec3 color = vec3(0);
+
+    if (cube_draw == 0)
+    {
+        color = texture(texture_1, frag_texture_coord).xyz;
+    }
+
+    if (cube_draw == 1)
+    {
+        // frag_position: paraboloid coordinate, hemisphere sign
+        color = texture(texture_cubemap, ParaboloidDirection(frag_position.xy, frag_position.z)).xyz;
+    }
+
+    out_color = vec4(color, 1);
+}
@@ -0,0 +1,67 @@
+#version 430
+
+// One invocation per hemisphere: 0 - upper (+Y), 1 - lower (-Y)
+layout(triangles, invocations = 2) in;
+layout(triangle_strip, max_vertices = 3) out;
+
+uniform float near_plane;
+uniform float far_plane;
+// Bit i set - emit to hemisphere i
+uniform int face_mask;
+// 1 - fullscreen skybox quad, the direction is rebuilt per fragment
+uniform int cube_draw;
+
+in vec3 geom_position[3];
+in vec2 geom_texture_coord[3];
+
+out vec3 frag_position;
+out vec2 frag_texture_coord;
+
+// Just in front of the far plane, the cleared depth still passes the test
+const float SKY_DEPTH = 0.9999;
+
+void main()
+{
+    int layer = gl_InvocationID;
+    if ((face_mask & (1 << layer)) == 0)
+        return;
+
+    float hemisphere = layer == 0 ? 1.0 : -1.0;
+
+    vec4 clip_position[3];
+    float clip_distance[3];
+    for (int i = 0; i < 3; i++)
+    {
+        if (cube_draw == 1)
+        {
+            clip_position[i] = vec4(gl_in[i].gl_Position.xy, SKY_DEPTH, 1.0);
+            clip_distance[i] = 1.0;
+            continue;
+        }
+
+        // Paraboloid projection around the probe (world origin), linear depth
+        vec3 position = gl_in[i].gl_Position.xyz;
+        float dist = length(position);
+        vec3 direction = position / max(dist, 1e-6);
+
+        vec2 xy = vec2(direction.x, hemisphere * direction.z) / (1.0 + hemisphere * direction.y);
+        float depth = (dist - near_plane) / (far_plane - near_plane) * 2.0 - 1.0;
+        clip_position[i] = vec4(xy, depth, 1.0);
+        clip_distance[i] = hemisphere * direction.y;
+    }
+
+    // Skip the hemisphere when the whole triangle is on the other side
+    if (clip_distance[0] < 0.0 && clip_distance[1] < 0.0 && clip_distance[2] < 0.0)
+        return;
+
+    gl_Layer = layer;
+    for (int i = 0; i < gl_in.length(); i++)
+    {
+        frag_position = cube_draw == 1 ? vec3(gl_in[i].gl_Position.xy, hemisphere) : geom_position[i];
+        frag_texture_coord = geom_texture_coord[i];
+        gl_Position = clip_position[i];
+        gl_ClipDistance[0] = clip_distance[i];
+        EmitVertex();
+    }
+    EndPrimitive();
+}
@@ -5,6 +5,9 @@ layout(location = 1) in vec3 world_normal;
 layout(location = 2) in vec2 texture_coords;
 
 uniform samplerCube texture_cubemap;
+uniform sampler2DArray texture_paraboloid;
+// EnvironmentMode: 0 - cubemap, 1 - dual paraboloid
+uniform int environment_mode;
 uniform sampler2D texture_light;
 
 uniform vec3 camera_position;
@@ -13,9 +16,22 @@ uniform mat4 view_matrix;
 layout(location = 0) out vec4 out_color;
 
 
+// Matches the projection of Shaders/CubeMapParaboloidShader
+vec3 SampleEnvironment(vec3 direction)
+{
+    vec3 D = normalize(direction);
+    if (environment_mode == 0)
+        return texture(texture_cubemap, D).rgb;
+
+    float hemisphere = D.y >= 0.0 ? 1.0 : -1.0;
+    vec2 p = vec2(D.x, hemisphere * D.z) / (1.0 + hemisphere * D.y);
+    return texture(texture_paraboloid, vec3(p * 0.5 + 0.5, D.y >= 0.0 ? 0.0 : 1.0)).rgb;
+}
+
+
 vec3 reflectionS(vec3 DIR)
 {
-    vec3 cubemap_col = texture(texture_cubemap, normalize(DIR)).rgb;
+    vec3 cubemap_col = SampleEnvironment(DIR);
     vec2 uv_map = clamp(texture_coords, 0.0, 1.0);
     vec3 light_col = texture(texture_light, uv_map).rgb; // something arround the lake shape circle like
     return cubemap_col + light_col;
@@ -15,11 +15,17 @@ layout(location = 0) out vec3 world_position;
 layout(location = 1) out vec3 world_normal;
 layout(location = 2) out vec3 world_view;
 
+// Must match the depth pre-pass
+invariant gl_Position;
+
 void main()
 {
-    world_position = (Model * vec4(v_position, 1.0)).xyz;
-    world_normal = normalize(mat3(transpose(inverse(Model))) * v_normal);
+    vec3 position = DecodePosition(v_position);
+    vec3 normal = DecodeNormal(v_normal);
+
+    world_position = (Model * vec4(position, 1.0)).xyz;
+    world_normal = normalize(mat3(transpose(inverse(Model))) * normal);
     world_view = normalize(-world_position);
 
-    gl_Position = Projection * View * Model * vec4(v_position, 1.0);
+    gl_Position = Projection * View * Model * vec4(position, 1.0);
 }
@@ -15,13 +15,19 @@ layout(location = 0) out vec2 texture_coord;
 layout(location = 1) out vec3 world_position;
 layout(location = 2) out vec3 world_normal;
 
+// Must match the depth pre-pass
+invariant gl_Position;
+
 
 void main()
 {
+    vec3 position = DecodePosition(v_position);
+    vec3 normal = DecodeNormal(v_normal);
+
     texture_coord = vec2(v_texture_coord.x, v_texture_coord.y);
 
-    world_position = (Model * vec4(v_position, 1.0)).xyz;
-    world_normal = mat3(Model) * v_normal;
+    world_position = (Model * vec4(position, 1.0)).xyz;
+    world_normal = mat3(Model) * normal;
 
-    gl_Position = Projection * View * vec4(world_position, 1);
+    gl_Position = Projection * View * Model * vec4(position, 1);
 }
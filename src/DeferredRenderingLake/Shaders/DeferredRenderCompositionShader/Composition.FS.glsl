@@ -9,8 +9,16 @@ uniform sampler2D texture_normal;
 uniform sampler2D texture_color;
 uniform sampler2D texture_depth;
 uniform sampler2D texture_light;
+uniform sampler2D texture_particles;
+uniform sampler2D texture_particles_depth;
 
 uniform int output_type;
+uniform int light_scale;
+uniform ivec2 light_resolution;
+uniform ivec2 particle_resolution;
+
+// Depth delta above which a low resolution particle texel belongs to another surface
+const float PARTICLE_DEPTH_THRESHOLD = 1e-3;
 
 // Output
 layout(location = 0) out vec4 out_color;
@@ -41,12 +49,94 @@ vec3 world_position()
 }
 
 
+// Joint bilateral upsample of a reduced resolution light buffer.
+// The 4 low resolution texels around the fragment are weighted by the
+// bilinear footprint and by how close the G-buffer sample they were lit
+// with is to the full resolution position / normal of this fragment.
+vec3 light_upsample()
+{
+    vec2 texel = 1.0 / vec2(light_resolution);
+    vec2 coord = texture_coord * vec2(light_resolution) - 0.5;
+    vec2 base = floor(coord);
+    vec2 f = coord - base;
+
+    vec3 hi_pos = world_position();
+    vec3 hi_norm = normalize(world_normal());
+
+    vec3 sum = vec3(0);
+    float weight_sum = 0.0;
+
+    for (int i = 0; i < 4; i++)
+    {
+        vec2 offset = vec2(i & 1, i >> 1);
+        vec2 uv = (base + offset + 0.5) * texel;
+
+        vec3 lo_pos = texture(texture_position, uv).xyz;
+        vec3 lo_norm = normalize(texture(texture_normal, uv).xyz);
+
+        vec2 bw = mix(1.0 - f, f, offset);
+        float w = bw.x * bw.y;
+        w *= 1.0 / (1e-3 + distance(hi_pos, lo_pos));
+        w *= pow(max(dot(hi_norm, lo_norm), 0.0), 16.0);
+
+        sum += w * texture(texture_light, uv).xyz;
+        weight_sum += w;
+    }
+
+    // Every neighbour lies across an edge, keep the nearest sample
+    if (weight_sum < 1e-4)
+        return texture(texture_light, texture_coord).xyz;
+
+    return sum / weight_sum;
+}
+
+
 vec3 light_accumulation()
 {
+    if (light_scale > 1)
+        return light_upsample();
+
     return texture(texture_light, texture_coord).xyz;
 }
 
 
+// Nearest-depth upsample of the reduced resolution particle buffer.
+// Where the 4 low resolution depths agree with the full resolution depth
+// the result is plain bilinear, across depth edges the texel whose depth
+// matches this fragment best is used so particles do not leak over
+// foreground silhouettes.
+vec3 particles()
+{
+    vec2 texel = 1.0 / vec2(particle_resolution);
+    vec2 coord = texture_coord * vec2(particle_resolution) - 0.5;
+    vec2 base = floor(coord);
+
+    float hi_depth = texture(texture_depth, texture_coord).x;
+
+    float max_delta = 0.0;
+    float min_delta = 1.0;
+    vec2 nearest_uv = texture_coord;
+
+    for (int i = 0; i < 4; i++)
+    {
+        vec2 uv = (base + vec2(i & 1, i >> 1) + 0.5) * texel;
+        float delta = abs(texture(texture_particles_depth, uv).x - hi_depth);
+
+        max_delta = max(max_delta, delta);
+        if (delta < min_delta)
+        {
+            min_delta = delta;
+            nearest_uv = uv;
+        }
+    }
+
+    if (max_delta < PARTICLE_DEPTH_THRESHOLD)
+        return texture(texture_particles, texture_coord).xyz;
+
+    return texture(texture_particles, nearest_uv).xyz;
+}
+
+
 void main()
 {
     switch (output_type)
@@ -72,7 +162,11 @@ void main()
         break;
 
     case 6:
-        out_color = vec4(color() * light_accumulation(), 1);
+        out_color = vec4(color() * light_accumulation() + particles(), 1);
+        break;
+
+    case 7:
+        out_color = vec4(particles(), 1);
         break;
 
     default:
@@ -11,6 +11,8 @@ layout(location = 0) out vec2 texture_coord;
 
 void main()
 {
+    vec3 position = DecodePosition(v_position);
+
     texture_coord = v_texture_coord;
-    gl_Position = vec4(v_position, 1.0);
+    gl_Position = vec4(position, 1.0);
 }
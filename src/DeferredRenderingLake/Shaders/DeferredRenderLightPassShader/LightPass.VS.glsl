@@ -11,5 +11,7 @@ uniform mat4 Projection;
 
 void main()
 {
-    gl_Position = Projection * View * Model * vec4(v_position, 1.0);
+    vec3 position = DecodePosition(v_position);
+
+    gl_Position = Projection * View * Model * vec4(position, 1.0);
 }
@@ -0,0 +1,6 @@
+#version 430
+
+
+void main()
+{
+}
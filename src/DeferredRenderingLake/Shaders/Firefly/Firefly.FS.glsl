@@ -7,7 +7,8 @@ layout(location = 2) in vec3 p_pos;
 layout(location = 3) in float rot_angle;
 
 // Uniform properties
-uniform sampler2D texture_unit_0;
+uniform sampler2DArray texture_sprites;
+uniform int sprite_layer;
 uniform float offset;
 uniform float deltaTime;
 
@@ -60,7 +61,7 @@ void main()
     mat2 rot_mat = rot_matrix(rot_angle);
     vec2 rot_uv = rot_mat * (tex_coord - 0.5) + 0.5;
 
-    vec3 tex = texture(texture_unit_0, rot_uv).rgb;
+    vec3 tex = texture(texture_sprites, vec3(rot_uv, sprite_layer)).rgb;
     vec3 color = glow * light_col * tex;
 
     out_color = vec4(color, 1.0);
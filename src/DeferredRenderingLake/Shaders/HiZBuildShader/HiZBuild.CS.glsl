@@ -0,0 +1,45 @@
+#version 430
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+// Destination level of the Hi-Z pyramid
+layout(r32f, binding = 0) writeonly uniform image2D destination;
+
+// Uniform properties
+uniform sampler2D source;
+uniform int source_level;
+uniform ivec2 source_size;
+uniform ivec2 destination_size;
+uniform bool reduce;
+
+
+float Fetch(ivec2 texel)
+{
+    return texelFetch(source, clamp(texel, ivec2(0), source_size - 1), source_level).r;
+}
+
+
+void main()
+{
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(texel, destination_size))) return;
+
+    if (!reduce)
+    {
+        imageStore(destination, texel, vec4(Fetch(texel)));
+        return;
+    }
+
+    // 2x2 max, the last row/column also folds the odd texel of the source
+    ivec2 first = texel * 2;
+    ivec2 last = first + 1;
+    if (texel.x == destination_size.x - 1) last.x = source_size.x - 1;
+    if (texel.y == destination_size.y - 1) last.y = source_size.y - 1;
+
+    float depth = 0.0;
+    for (int y = first.y; y <= last.y; y++)
+        for (int x = first.x; x <= last.x; x++)
+            depth = max(depth, Fetch(ivec2(x, y)));
+
+    imageStore(destination, texel, vec4(depth));
+}
@@ -0,0 +1,88 @@
+#version 430
+
+layout(local_size_x = 64) in;
+
+struct Box
+{
+    vec4 bounds_min;
+    vec4 bounds_max;
+};
+
+struct DrawCommand
+{
+    uint count;
+    uint instance_count;
+    uint first_index;
+    int base_vertex;
+    uint base_instance;
+};
+
+layout(std430, binding = 0) readonly buffer Boxes { Box boxes[]; };
+layout(std430, binding = 1) readonly buffer Commands { DrawCommand commands[]; };
+layout(std430, binding = 2) writeonly buffer Visible { DrawCommand visible[]; };
+
+// Uniform properties
+uniform int draw_count;
+uniform bool has_hi_z;
+uniform int hi_z_levels;
+uniform ivec2 hi_z_size;
+uniform mat4 view_projection;
+uniform sampler2D hi_z;
+
+
+// Same test as HiZPyramid::IsVisible
+bool IsVisible(vec3 bounds_min, vec3 bounds_max)
+{
+    if (!has_hi_z || bounds_min.x > bounds_max.x) return true;
+
+    vec2 uv_min = vec2(1e30);
+    vec2 uv_max = vec2(-1e30);
+    float depth_min = 1e30;
+
+    for (int i = 0; i < 8; i++)
+    {
+        vec3 corner = vec3(
+            (i & 1) != 0 ? bounds_max.x : bounds_min.x,
+            (i & 2) != 0 ? bounds_max.y : bounds_min.y,
+            (i & 4) != 0 ? bounds_max.z : bounds_min.z);
+
+        vec4 clip = view_projection * vec4(corner, 1);
+        if (clip.w <= 0.0) return true;
+
+        vec3 ndc = clip.xyz / clip.w;
+        vec2 uv = ndc.xy * 0.5 + 0.5;
+        uv_min = min(uv_min, uv);
+        uv_max = max(uv_max, uv);
+        depth_min = min(depth_min, ndc.z * 0.5 + 0.5);
+    }
+
+    if (any(lessThan(uv_min, vec2(0))) || any(greaterThan(uv_max, vec2(1)))) return true;
+
+    vec2 extent = (uv_max - uv_min) * vec2(hi_z_size);
+    int level = int(ceil(log2(max(max(extent.x, extent.y), 1.0))));
+    level = min(level, hi_z_levels - 1);
+
+    ivec2 level_size = textureSize(hi_z, level);
+    ivec2 first = max(ivec2(floor(uv_min * vec2(level_size))) - 1, ivec2(0));
+    ivec2 last = min(ivec2(floor(uv_max * vec2(level_size))) + 1, level_size - 1);
+
+    float depth_max = 0.0;
+    for (int y = first.y; y <= last.y; y++)
+        for (int x = first.x; x <= last.x; x++)
+            depth_max = max(depth_max, texelFetch(hi_z, ivec2(x, y), level).r);
+
+    return depth_min <= depth_max;
+}
+
+
+void main()
+{
+    int id = int(gl_GlobalInvocationID.x);
+    if (id >= draw_count) return;
+
+    DrawCommand command = commands[id];
+    if (!IsVisible(boxes[id].bounds_min.xyz, boxes[id].bounds_max.xyz))
+        command.instance_count = 0u;
+
+    visible[id] = command;
+}
@@ -0,0 +1,16 @@
+#version 430
+
+// Uniform properties
+uniform uint draw_id;
+
+// Output
+layout(location = 0) out uint out_visibility;
+
+// Must match Constants::DeferredRender::VISIBILITY_TRIANGLE_BITS
+const uint TRIANGLE_BITS = 20;
+
+
+void main()
+{
+    out_visibility = (draw_id << TRIANGLE_BITS) | uint(gl_PrimitiveID);
+}
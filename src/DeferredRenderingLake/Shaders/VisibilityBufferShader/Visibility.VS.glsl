@@ -0,0 +1,17 @@
+#version 430
+
+// Input
+layout(location = 0) in vec3 v_position;
+
+// Uniform properties
+uniform mat4 Model;
+uniform mat4 View;
+uniform mat4 Projection;
+
+
+void main()
+{
+    vec3 position = DecodePosition(v_position);
+
+    gl_Position = Projection * View * Model * vec4(position, 1);
+}
@@ -0,0 +1,250 @@
+#version 430
+
+// Input
+layout(location = 0) in vec2 texture_coord;
+
+// Uniform properties
+uniform usampler2D texture_visibility;
+uniform sampler2D u_texture_0;
+uniform samplerCube texture_cubemap;
+uniform sampler2DArray texture_paraboloid;
+// EnvironmentMode: 0 - cubemap, 1 - dual paraboloid
+uniform int environment_mode;
+uniform samplerCube texture_skybox;
+uniform sampler2D texture_light;
+
+// Draws [draw_first, draw_first + draw_count) share mesh and material
+// (array sizes are Constants::DeferredRender::MAX_VISIBILITY_INSTANCES)
+uniform uint draw_first;
+uniform uint draw_count;
+uniform mat4 model_matrices[16];
+
+// Mesh entry of every draw inside the bound buffers
+uniform int base_indices[16];
+uniform int base_vertices[16];
+
+// Position, normal and texture coordinate layout, in floats
+uniform ivec3 attribute_stride;
+uniform ivec3 attribute_offset;
+uniform int has_texture_coord;
+
+// Interleaved vertices of a packed mesh instead: stride and offsets in uints (stride 0 for the float buffers),
+// position, normal and texture coordinate formats, and the position transform
+uniform int packed_stride;
+uniform ivec3 packed_offset;
+uniform ivec3 packed_format;
+uniform vec4 position_transform;
+
+uniform int material_type;
+uniform vec4 clear_normal;
+uniform vec4 clear_color;
+
+uniform mat4 inverse_view_projection;
+uniform mat4 view_matrix;
+uniform vec3 eye_position;
+
+// Mesh buffers uploaded by gpu_utils::UploadData
+layout(std430, binding = 0) readonly buffer Positions { float positions[]; };
+layout(std430, binding = 1) readonly buffer Normals { float normals[]; };
+layout(std430, binding = 2) readonly buffer TextureCoords { float text_coords[]; };
+layout(std430, binding = 3) readonly buffer Indices { uint indices[]; };
+layout(std430, binding = 4) readonly buffer PackedVertices { uint packed_vertices[]; };
+
+// Output
+layout(location = 0) out vec4 out_world_position;
+layout(location = 1) out vec4 out_world_normal;
+layout(location = 2) out vec4 out_color;
+
+// Must match Constants::DeferredRender::VISIBILITY_TRIANGLE_BITS
+const uint TRIANGLE_BITS = 20;
+const uint TRIANGLE_MASK = (1u << TRIANGLE_BITS) - 1u;
+
+// Must match SceneMaterial
+const int MATERIAL_TEXTURED = 0;
+const int MATERIAL_SKYBOX = 1;
+const int MATERIAL_REFLECTION = 2;
+
+// Must match VertexLayout
+const int POSITION_FLOAT = 0;
+const int POSITION_HALF = 1;
+const int NORMAL_FLOAT = 0;
+const int TEX_COORD_FLOAT = 0;
+const int TEX_COORD_HALF = 1;
+
+
+vec3 fetch_packed_float3(int i)
+{
+    return uintBitsToFloat(uvec3(packed_vertices[i], packed_vertices[i + 1], packed_vertices[i + 2]));
+}
+
+
+vec3 fetch_position(uint vertex)
+{
+    if (packed_stride != 0)
+    {
+        int i = int(vertex) * packed_stride + packed_offset.x;
+        vec3 p;
+        if (packed_format.x == POSITION_FLOAT)
+            p = fetch_packed_float3(i);
+        else if (packed_format.x == POSITION_HALF)
+            p = vec3(unpackHalf2x16(packed_vertices[i]), unpackHalf2x16(packed_vertices[i + 1]).x);
+        else
+            p = vec3(unpackSnorm2x16(packed_vertices[i]), unpackSnorm2x16(packed_vertices[i + 1]).x);
+        return p * position_transform.w + position_transform.xyz;
+    }
+
+    int i = int(vertex) * attribute_stride.x + attribute_offset.x;
+    return vec3(positions[i], positions[i + 1], positions[i + 2]);
+}
+
+
+vec3 fetch_normal(uint vertex)
+{
+    if (packed_stride != 0)
+    {
+        int i = int(vertex) * packed_stride + packed_offset.y;
+        if (packed_format.y == NORMAL_FLOAT)
+            return fetch_packed_float3(i);
+
+        // Octahedral, same as DecodeNormal in the vertex shaders
+        vec2 f = unpackSnorm2x16(packed_vertices[i]);
+        vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+        float t = max(-n.z, 0.0);
+        n.x += n.x >= 0.0 ? -t : t;
+        n.y += n.y >= 0.0 ? -t : t;
+        return normalize(n);
+    }
+
+    int i = int(vertex) * attribute_stride.y + attribute_offset.y;
+    return vec3(normals[i], normals[i + 1], normals[i + 2]);
+}
+
+
+vec2 fetch_texture_coord(uint vertex)
+{
+    if (has_texture_coord == 0)
+        return vec2(0);
+
+    if (packed_stride != 0)
+    {
+        int i = int(vertex) * packed_stride + packed_offset.z;
+        if (packed_format.z == TEX_COORD_FLOAT)
+            return fetch_packed_float3(i).xy;
+        if (packed_format.z == TEX_COORD_HALF)
+            return unpackHalf2x16(packed_vertices[i]);
+        return unpackUnorm2x16(packed_vertices[i]);
+    }
+
+    int i = int(vertex) * attribute_stride.z + attribute_offset.z;
+    return vec2(text_coords[i], text_coords[i + 1]);
+}
+
+
+// Perspective correct barycentrics of the camera ray through a pixel
+vec3 barycentrics(vec2 pixel, vec3 p0, vec3 p1, vec3 p2)
+{
+    vec2 ndc = pixel / vec2(textureSize(texture_visibility, 0)) * 2.0 - 1.0;
+    vec4 far_point = inverse_view_projection * vec4(ndc, 1, 1);
+    vec3 dir = normalize(far_point.xyz / far_point.w - eye_position);
+
+    vec3 e1 = p1 - p0;
+    vec3 e2 = p2 - p0;
+    vec3 pv = cross(dir, e2);
+    float det = dot(e1, pv);
+
+    // Triangle seen edge-on
+    if (abs(det) < 1e-12)
+        return vec3(1, 0, 0);
+
+    vec3 tv = eye_position - p0;
+    float u = dot(tv, pv) / det;
+    float v = dot(dir, cross(tv, e1)) / det;
+    return vec3(1.0 - u - v, u, v);
+}
+
+
+// Same lookup as Shaders/CubeMapReflectionShader
+vec3 SampleEnvironment(vec3 direction)
+{
+    vec3 D = normalize(direction);
+    if (environment_mode == 0)
+        return texture(texture_cubemap, D).rgb;
+
+    float hemisphere = D.y >= 0.0 ? 1.0 : -1.0;
+    vec2 p = vec2(D.x, hemisphere * D.z) / (1.0 + hemisphere * D.y);
+    return texture(texture_paraboloid, vec3(p * 0.5 + 0.5, D.y >= 0.0 ? 0.0 : 1.0)).rgb;
+}
+
+
+void main()
+{
+    uint visibility = texelFetch(texture_visibility, ivec2(gl_FragCoord.xy), 0).x;
+    uint draw = visibility >> TRIANGLE_BITS;
+    if (draw < draw_first || draw >= draw_first + draw_count)
+        discard;
+
+    uint instance = draw - draw_first;
+    mat4 model = model_matrices[instance];
+    int base_index = base_indices[instance];
+    int base_vertex = base_vertices[instance];
+
+    uint triangle = visibility & TRIANGLE_MASK;
+    uint i0 = indices[base_index + 3 * triangle + 0] + base_vertex;
+    uint i1 = indices[base_index + 3 * triangle + 1] + base_vertex;
+    uint i2 = indices[base_index + 3 * triangle + 2] + base_vertex;
+
+    vec3 v0 = fetch_position(i0);
+    vec3 v1 = fetch_position(i1);
+    vec3 v2 = fetch_position(i2);
+    vec3 p0 = (model * vec4(v0, 1)).xyz;
+    vec3 p1 = (model * vec4(v1, 1)).xyz;
+    vec3 p2 = (model * vec4(v2, 1)).xyz;
+
+    vec3 b = barycentrics(gl_FragCoord.xy, p0, p1, p2);
+    vec3 object_position = b.x * v0 + b.y * v1 + b.z * v2;
+    vec3 world_position = b.x * p0 + b.y * p1 + b.z * p2;
+    vec3 normal = b.x * fetch_normal(i0) + b.y * fetch_normal(i1) + b.z * fetch_normal(i2);
+
+    switch (material_type)
+    {
+    case MATERIAL_SKYBOX:
+    {
+        vec3 color = texture(texture_skybox, normalize(object_position)).xyz;
+        out_world_position = vec4(color, 0);
+        out_world_normal = clear_normal;
+        out_color = clear_color;
+        break;
+    }
+
+    case MATERIAL_REFLECTION:
+    {
+        vec3 world_normal = normalize(mat3(transpose(inverse(model))) * normal);
+        vec3 V = normalize(world_position - eye_position);
+        vec3 R = mat3(transpose(view_matrix)) * reflect(V, world_normal);
+        vec2 uv_map = clamp(normalize(-world_position).xy, 0.0, 1.0);
+        vec3 color = SampleEnvironment(R) + texture(texture_light, uv_map).rgb;
+        out_world_position = vec4(clamp(color, 0.0, 1.0), 1.0);
+        out_world_normal = clear_normal;
+        out_color = clear_color;
+        break;
+    }
+
+    default:
+    {
+        // Neighbour pixels intersect the same triangle plane, giving the
+        // texture coordinate derivatives a rasterizer would have produced
+        vec2 t0 = fetch_texture_coord(i0);
+        vec2 t1 = fetch_texture_coord(i1);
+        vec2 t2 = fetch_texture_coord(i2);
+        vec3 bx = barycentrics(gl_FragCoord.xy + vec2(1, 0), p0, p1, p2);
+        vec3 by = barycentrics(gl_FragCoord.xy + vec2(0, 1), p0, p1, p2);
+        vec2 uv = b.x * t0 + b.y * t1 + b.z * t2;
+        vec2 uv_dx = bx.x * t0 + bx.y * t1 + bx.z * t2 - uv;
+        vec2 uv_dy = by.x * t0 + by.y * t1 + by.z * t2 - uv;
+
+        out_world_position = vec4(world_position, 1);
+        out_world_normal = vec4(normalize(mat3(model) * normal), 0);
+        out_color = textureGrad(u_texture_0, uv, uv_dx, uv_dy);
+    }
+    }
+}
@@ -0,0 +1,18 @@
+#version 410
+
+// Input
+layout(location = 0) in vec3 v_position;
+layout(location = 1) in vec3 v_normal;
+layout(location = 2) in vec2 v_texture_coord;
+
+// Output
+layout(location = 0) out vec2 texture_coord;
+
+
+void main()
+{
+    vec3 position = DecodePosition(v_position);
+
+    texture_coord = v_texture_coord;
+    gl_Position = vec4(position, 1.0);
+}
@@ -4,7 +4,8 @@
 layout(location = 0) in vec2 texture_coord;
 
 // Uniform properties
-uniform sampler2D u_texture_0;
+uniform sampler2DArray texture_sprites;
+uniform int sprite_layer;
 
 // Output
 layout(location = 0) out vec4 out_color;
@@ -12,6 +13,6 @@ layout(location = 0) out vec4 out_color;
 
 void main()
 {
-    vec3 color = texture(u_texture_0, texture_coord).xyz;
+    vec3 color = texture(texture_sprites, vec3(texture_coord, sprite_layer)).xyz;
     out_color = vec4(color, 1);
 }
@@ -7,6 +7,9 @@
 
 #include <string>
 
+class Mesh;
+class Texture2D;
+
 
 struct Particle
 {
@@ -64,6 +67,7 @@ struct ShaderConfig
     std::string fragmentShader;
     std::string geometryShader;
     bool hasGeometry;
+    std::string computeShader;      // When set, the program is compute only
 };
 
 struct MeshConfig
@@ -72,6 +76,59 @@ struct MeshConfig
     std::string folderPath;
     std::string fileName;
     bool useMaterials;
+    bool compactIndices;            // 16 bit indices, the visibility buffer pass draws them through the G-buffer path
+};
+
+// Shading of an opaque scene draw (G-buffer shader or visibility buffer resolve)
+enum SceneMaterial
+{
+    SCENE_MATERIAL_TEXTURED,
+    SCENE_MATERIAL_SKYBOX,
+    SCENE_MATERIAL_REFLECTION
+};
+
+// One mesh entry of one instance of the opaque geometry
+struct SceneDraw
+{
+    const Mesh* mesh;
+    unsigned int entry;
+    // Level of detail of the entry, see MeshEntry::SelectLod
+    unsigned int lod;
+    glm::mat4 model;
+    SceneMaterial material;
+    Texture2D* texture;
+    float viewDepth;
+};
+
+enum OcclusionCullingMode
+{
+    OCCLUSION_CULLING_OFF,
+    OCCLUSION_CULLING_CPU,
+    OCCLUSION_CULLING_GPU
+};
+
+// How the reflection probe stores the environment
+enum EnvironmentMode
+{
+    ENVIRONMENT_CUBEMAP,
+    ENVIRONMENT_PARABOLOID
+};
+
+// Layout of glDrawElementsIndirect arguments
+struct DrawElementsIndirectCommand
+{
+    unsigned int count;
+    unsigned int instanceCount;
+    unsigned int firstIndex;
+    int baseVertex;
+    unsigned int baseInstance;
+};
+
+// World space AABB tested by the GPU culling (std430 layout)
+struct CullingBox
+{
+    glm::vec4 boundsMin;
+    glm::vec4 boundsMax;
 };
 
 #endif // !STRUCTURES_H
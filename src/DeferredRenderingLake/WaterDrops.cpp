@@ -160,7 +160,8 @@ void WaterDrops::Render(
         glUniform3fv(shader->GetUniformLocation("control_p3"), 1, glm::value_ptr(control_p3));
 
         glm::mat4 identityView = glm::mat4(1.0f);
-        TextureManager::GetTexture("rain.png")->BindToTextureUnit(GL_TEXTURE0);
+        glUniform1i(shader->GetUniformLocation("texture_sprites"), 0);
+        glUniform1i(shader->GetUniformLocation("sprite_layer"), TextureManager::GetTextureLayer("rain.png").layer);
         particle_effect->Render(camera, shader);
     }
 
@@ -1,6 +1,8 @@
 ﻿#include "DeferredRenderingLake/Waterfall.h"
 #include "Constants.h"
 #include "CreatePlane.h"
+#include "core/managers/asset_loader.h"
+#include "core/managers/asset_registry.h"
 #include "utils/text_utils.h"
 
 #include <iostream>
@@ -48,12 +50,33 @@ void Waterfall::Init()
     camera->Update();
 
     Random::InitRand();
+    TextureManager::SetMemoryBudget(LD::TEXTURE_MEMORY_BUDGET);
 
-    TextureManager::LoadTexture(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::TEXTURES), "default.png");
-    TextureManager::LoadTexture(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::TEXTURES), "ground.jpg");
-    TextureManager::LoadTexture(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::TEXTURES), "rain.png");
-	TextureManager::LoadTexture(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::TEXTURES), "star.png");
-	TextureManager::LoadTexture(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::TEXTURES), "butterfly.jpg");
+    // Assets are only declared here and load on their first lookup. The ones every frame needs are prefetched:
+    // decoded and parsed on the asset loader workers while the render thread builds what only it can, their GL
+    // objects are created as they finish and all of them by the Flush below
+    TextureManager::LoadTextureAsync(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::TEXTURES), "default.png");
+    TextureManager::LoadTextureAsync(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::TEXTURES), "ground.jpg");
+    TextureManager::DeclareTexture(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::TEXTURES), "rain.png");
+	TextureManager::DeclareTexture(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::TEXTURES), "star.png");
+	TextureManager::DeclareTexture(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::TEXTURES), "butterfly.jpg");
+
+    loader = new Loader(window);
+    loader->DeclareAllMeshes(LD::GetMeshConfigs(window));
+    loader->DeclareAllShaders(LD::GetShaderConfigs());
+
+    for (auto &name : LD::GetPrefetchMeshes())
+    {
+        AssetRegistry::PrefetchMesh(name);
+    }
+    for (auto &name : LD::GetPrefetchShaders())
+    {
+        AssetRegistry::PrefetchShader(name);
+    }
+
+    // Particle sprites share one clamped texture array, bound once for all the particle effects
+    TextureManager::BuildTextureArray("sprites", PATH_JOIN(window->props.selfDir, RESOURCE_PATH::TEXTURES),
+        { "rain.png", "star.png", "butterfly.jpg", "particle.png" }, WL::SPRITE_SIZE);
 
     std::string path = "ground.jpg";
     char* charPath = new char[path.length() + 1];
@@ -61,13 +84,11 @@ void Waterfall::Init()
     Mesh* dynamicPlane = Create::CreateGridMesh("dynamicPlane", 300, 300, 30.0f, 30.0f, charPath);
     meshes["dynamicPlane"] = dynamicPlane;
 
-    loader = new Loader(window);
-    loader->LoadAllMeshes(meshes, LD::GetMeshConfigs(window));
-    loader->LoadAllShaders(shaders, LD::GetShaderConfigs());
-
     cubeMap = new CubeMap(window);
     cubeMap->Init(window, CM::WIDTH, CM::HEIGHT);
 
+    AssetLoader::Flush();
+
     waterfallLake = new WaterfallLake(window);
     waterfallLake->Init(window, shaders, meshes, resolution.x, resolution.y, 0);
 
@@ -116,6 +137,71 @@ void Waterfall::OnKeyPress(int key, int mods)
     {
         waterfallLake->SetLightType(index);
     }
+
+    // Cycle light accumulation resolution: full -> half -> quarter
+    if (key == GLFW_KEY_L)
+    {
+        int scale = waterfallLake->GetLightResolutionScale() * 2;
+        waterfallLake->SetLightResolutionScale(scale > DR::MAX_LIGHT_RESOLUTION_SCALE ? 1 : scale);
+    }
+
+    // Toggle between the G-buffer and the visibility buffer geometry pass
+    if (key == GLFW_KEY_V)
+    {
+        waterfallLake->SetVisibilityBuffer(!waterfallLake->IsVisibilityBuffer());
+    }
+
+    // Toggle the depth pre-pass of the G-buffer path
+    if (key == GLFW_KEY_Z)
+    {
+        waterfallLake->SetDepthPrepass(!waterfallLake->IsDepthPrepass());
+    }
+
+    // Cycle occlusion culling: off -> CPU -> GPU
+    if (key == GLFW_KEY_O)
+    {
+        waterfallLake->SetOcclusionCulling((waterfallLake->GetOcclusionCulling() + 1) % 3);
+    }
+
+    // Cycle reflection probe faces per update: 1 -> 2 -> 3 -> 6 (C logs the camera)
+    if (key == GLFW_KEY_F)
+    {
+        int faces = cubeMap->GetFacesPerUpdate();
+        cubeMap->SetFacesPerUpdate(faces >= 6 ? 1 : (faces == 3 ? 6 : faces + 1));
+    }
+
+    // Toggle reflection probe rendering: instanced layers / geometry shader
+    if (key == GLFW_KEY_G)
+    {
+        cubeMap->SetLayeredRendering(!cubeMap->IsLayeredRendering());
+    }
+
+    // Toggle reflection probe environment: cubemap / dual paraboloid
+    if (key == GLFW_KEY_M)
+    {
+        cubeMap->SetEnvironmentMode(cubeMap->GetEnvironmentMode() == ENVIRONMENT_PARABOLOID ? ENVIRONMENT_CUBEMAP : ENVIRONMENT_PARABOLOID);
+    }
+
+    // Toggle the mesh levels of detail
+    if (key == GLFW_KEY_K)
+    {
+        waterfallLake->SetMeshLods(!waterfallLake->IsMeshLods());
+    }
+
+    // Print the GPU pass timers
+    if (key == GLFW_KEY_T)
+    {
+        waterfallLake->PrintPassTimers();
+        TextureManager::PrintMemoryStats();
+        AssetRegistry::PrintReport();
+    }
+
+    // Cycle particle resolution: full -> half -> quarter
+    if (key == GLFW_KEY_P)
+    {
+        int scale = waterfallLake->GetParticleResolutionScale() * 2;
+        waterfallLake->SetParticleResolutionScale(scale > DR::MAX_PARTICLE_RESOLUTION_SCALE ? 1 : scale);
+    }
 }
 
 void Waterfall::OnWindowResize(int width, int height)
@@ -9,6 +9,8 @@
 #include "utils/glm_utils.h"
 #include "utils/text_utils.h"
 
+#include <algorithm>
+#include <cfloat>
 #include <iostream>
 
 
@@ -19,8 +21,9 @@ using CM = Constants::CubeMap;
 
 
 WaterfallLake::WaterfallLake(WindowObject* window) :
-    window(window), meshes(nullptr),
-    frameBuffer(nullptr), lightBuffer(nullptr)
+    window(window), meshes(nullptr), occlusionCulling(nullptr),
+    frameBuffer(nullptr), lightBuffer(nullptr), particleBuffer(nullptr),
+    visibilityBuffer(nullptr)
 {
     control_p0 = WL::CONTROL_P0;
     control_p1 = WL::CONTROL_P1;
@@ -28,6 +31,16 @@ WaterfallLake::WaterfallLake(WindowObject* window) :
     control_p3 = WL::CONTROL_P3;
 
     light_type = 6;
+    light_scale = DR::LIGHT_RESOLUTION_SCALE;
+    particle_scale = DR::PARTICLE_RESOLUTION_SCALE;
+    visibility_buffer = false;
+    depth_prepass = false;
+    cube_layered = false;
+    mesh_lods = true;
+    sceneTriangles = fullTriangles = 0;
+    culling_mode = DR::OCCLUSION_CULLING_MODE;
+    culledDraws = culledLights = 0;
+    archer_angle = 0.0f;
     lights.clear();
 }
 
@@ -35,6 +48,12 @@ WaterfallLake::~WaterfallLake()
 {
     delete frameBuffer;
     delete lightBuffer;
+    delete particleBuffer;
+    delete visibilityBuffer;
+    delete occlusionCulling;
+
+    TextureManager::Release(groundTexture);
+    TextureManager::Release(archerTexture);
 
     lights.clear();
     meshes = nullptr;
@@ -45,35 +64,207 @@ void WaterfallLake::CreateFramebuffer(int width, int height)
 {
     if (!frameBuffer)
     {
+        // G-buffer: Position, Normal, Color
+        FrameBufferDesc gBuffer;
+        gBuffer.attachments.push_back(FrameBufferAttachment(DR::G_BUFFER_POSITION_FORMAT, GL_NEAREST, GL_NEAREST));
+        gBuffer.attachments.push_back(FrameBufferAttachment(DR::G_BUFFER_NORMAL_FORMAT, GL_NEAREST, GL_NEAREST));
+        gBuffer.attachments.push_back(FrameBufferAttachment(DR::G_BUFFER_COLOR_FORMAT));
+
         frameBuffer = new FrameBuffer();
-        frameBuffer->Generate(width, height, 3, 32); // G-buffer: Position, Normal, Color
+        frameBuffer->Generate(width, height, gBuffer);
     }
 
     if (!lightBuffer)
     {
+        // Light accumulation
+        FrameBufferDesc accumulation;
+        accumulation.hasDepthTexture = false;
+        accumulation.attachments.push_back(FrameBufferAttachment(DR::LIGHT_BUFFER_FORMAT));
+
         lightBuffer = new FrameBuffer();
-        lightBuffer->Generate(width, height, 1, false, 32); // Light accumulation 
+        lightBuffer->Generate(
+            glm::max(width / light_scale, 1),
+            glm::max(height / light_scale, 1),
+            accumulation);
+    }
+
+    if (!particleBuffer)
+    {
+        // Particles, depth tested against a downsampled copy of the G-buffer depth
+        FrameBufferDesc particles;
+        particles.attachments.push_back(FrameBufferAttachment(DR::PARTICLE_BUFFER_FORMAT, GL_LINEAR, GL_LINEAR, glm::vec4(0)));
+
+        particleBuffer = new FrameBuffer();
+        particleBuffer->Generate(
+            glm::max(width / particle_scale, 1),
+            glm::max(height / particle_scale, 1),
+            particles);
+    }
+
+    if (!visibilityBuffer)
+    {
+        // Visibility buffer: packed draw / triangle ID + depth
+        FrameBufferDesc visibility;
+        visibility.attachments.push_back(FrameBufferAttachment(DR::VISIBILITY_BUFFER_FORMAT, GL_NEAREST, GL_NEAREST, glm::vec4(0)));
+
+        visibilityBuffer = new FrameBuffer();
+        visibilityBuffer->Generate(width, height, visibility);
     }
+
+    size_t memorySize = frameBuffer->GetMemorySize() + lightBuffer->GetMemorySize() + particleBuffer->GetMemorySize();
+    cout << "Deferred targets: " << memorySize / (1024 * 1024) << " MB" << endl;
 }
 
 
 void WaterfallLake::ResizeBuffers(int width, int height)
 {
-    frameBuffer->Resize(width, height, 32);
-    lightBuffer->Resize(width, height, 32);
+    frameBuffer->Resize(width, height);
+    visibilityBuffer->Resize(width, height);
+    ResizeScaled(lightBuffer, light_scale);
+    ResizeScaled(particleBuffer, particle_scale);
+    occlusionCulling->Resize(width, height);
+}
+
+
+void WaterfallLake::ResizeScaled(FrameBuffer* buffer, int scale)
+{
+    glm::ivec2 resolution = frameBuffer->GetResolution();
+    buffer->Resize(glm::max(resolution.x / scale, 1), glm::max(resolution.y / scale, 1));
+}
+
+
+void WaterfallLake::SetLightResolutionScale(int scale)
+{
+    scale = glm::clamp(scale, 1, DR::MAX_LIGHT_RESOLUTION_SCALE);
+    if (scale == light_scale)
+        return;
+
+    light_scale = scale;
+    if (frameBuffer && lightBuffer)
+        ResizeScaled(lightBuffer, light_scale);
+    cout << "Light accumulation at 1/" << light_scale << " resolution" << endl;
+}
+
+
+void WaterfallLake::SetParticleResolutionScale(int scale)
+{
+    scale = glm::clamp(scale, 1, DR::MAX_PARTICLE_RESOLUTION_SCALE);
+    if (scale == particle_scale)
+        return;
+
+    particle_scale = scale;
+    if (frameBuffer && particleBuffer)
+        ResizeScaled(particleBuffer, particle_scale);
+    cout << "Particles at 1/" << particle_scale << " resolution" << endl;
+}
+
+
+void WaterfallLake::SetVisibilityBuffer(bool enabled)
+{
+    visibility_buffer = enabled;
+    cout << "Geometry pass: " << (visibility_buffer ? "visibility buffer" : "G-buffer") << endl;
+}
+
+
+void WaterfallLake::SetDepthPrepass(bool enabled)
+{
+    depth_prepass = enabled;
+    cout << "Depth pre-pass: " << (depth_prepass ? "on" : "off") << endl;
+}
+
+
+void WaterfallLake::SetMeshLods(bool enabled)
+{
+    mesh_lods = enabled;
+    cout << "Mesh LODs: " << (mesh_lods ? "on" : "off") << endl;
+}
+
+
+void WaterfallLake::SetOcclusionCulling(int mode)
+{
+    culling_mode = glm::clamp(mode, (int)OCCLUSION_CULLING_OFF, (int)OCCLUSION_CULLING_GPU);
+    const char* names[] = { "off", "CPU", "GPU" };
+    cout << "Occlusion culling: " << names[culling_mode] << endl;
+}
+
+
+void WaterfallLake::PrintPassTimers() const
+{
+    double total = 0;
+    for (const auto& timer : passTimers)
+    {
+        cout << timer.first << ": " << timer.second.GetAverageMilliseconds() << " ms" << endl;
+        total += timer.second.GetAverageMilliseconds();
+    }
+    cout << "Total: " << total << " ms" << endl;
+
+    // The GPU test result stays on the GPU, only the frustum part is counted there
+    cout << "Culled: " << culledDraws << "/" << sceneDraws.size() << " draws, "
+         << culledLights << "/" << lights.size() << " lights" << endl;
+    cout << "Scene triangles: " << sceneTriangles << " (" << fullTriangles << " at full detail)" << endl;
+}
+
+
+glm::mat4 WaterfallLake::ArcherModelMatrix(int index) const
+{
+    glm::mat4 modelMatrix = glm::mat4(1);
+    modelMatrix *= glm::rotate(glm::mat4(1), archer_angle + index * glm::radians(360.0f) / DR::NR_ARCHERS, glm::vec3(0, 1, 0));
+    modelMatrix *= glm::translate(glm::mat4(1), glm::vec3(10, 4, 0));
+    modelMatrix *= glm::rotate(glm::mat4(1), glm::radians(-90.0f), glm::vec3(0, 1, 0));
+    modelMatrix *= glm::scale(glm::mat4(1), glm::vec3(0.01f));
+    return modelMatrix;
+}
+
+
+unsigned int WaterfallLake::SelectLod(
+    const MeshEntry& entry,
+    const glm::mat4& modelMatrix,
+    const glm::vec3& eye,
+    float focalLength,
+    float maxPixelError) const
+{
+    if (!mesh_lods || entry.lods.empty() || entry.sphereRadius <= 0)
+        return 0;
+
+    // Bounding sphere in world space, under the largest scale of the model matrix
+    glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(entry.sphereCenter, 1.0f));
+    float scale = glm::max(glm::length(glm::vec3(modelMatrix[0])),
+        glm::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+    float radius = entry.sphereRadius * scale;
+    float distance = glm::distance(center, eye);
+    if (distance <= radius)
+        return 0;
+
+    return entry.SelectLod(2.0f * radius * focalLength / distance, maxPixelError);
+}
+
+
+glm::mat4 WaterfallLake::LightModelMatrix(const Light& lightInfo) const
+{
+    glm::mat4 modelMatrix = glm::mat4(1.0f);
+    modelMatrix = glm::translate(modelMatrix, lightInfo.position);
+    modelMatrix = glm::scale(modelMatrix, glm::vec3(2.0f * lightInfo.radius));
+    return modelMatrix;
 }
 
 
 void WaterfallLake::Init(
     WindowObject* windowObj,
-    std::unordered_map<std::string, Shader*>& shaders,
-    std::unordered_map<std::string, Mesh*>& meshesMap,
+    AssetMap<Shader>& shaders,
+    AssetMap<Mesh>& meshesMap,
     int width, int height, int light_type)
 {
     window = windowObj;
     meshes = &meshesMap;
     CreateFramebuffer(width, height);
 
+    occlusionCulling = new OcclusionCulling();
+    occlusionCulling->Init(width, height);
+
+    // Bound every probe update, resolved once instead of by name each frame
+    groundTexture = TextureManager::Acquire("ground.jpg");
+    archerTexture = TextureManager::Acquire("Akai_E_Espiritu.fbm\\akai_diffuse.png");
+
     int maxRetries = 5;
     float minOrbitDistance = 5.0f;
     float maxOrbitDistance = 15.0f;
@@ -140,8 +331,8 @@ void WaterfallLake::RenderCompose(
     Firefly* firefly,
     FallingStars* fallingStars,
 
-    std::unordered_map<std::string, Shader*>& shaders,
-    std::unordered_map<std::string, Mesh*>& meshes,
+    AssetMap<Shader>& shaders,
+    AssetMap<Mesh>& meshes,
 
     const glm::mat4& viewMatrix,
     const glm::mat4& projectionMatrix,
@@ -165,172 +356,85 @@ void WaterfallLake::RenderCompose(
     // Deferred rendering pass -- GEOMETRY SPACE
     if (cubeMap->GetFramebufferID())
     {
-        glBindFramebuffer(GL_FRAMEBUFFER, cubeMap->GetFramebufferID());
-        glViewport(0, 0, cubeMap->GetWidth(), cubeMap->GetHeight());
-        glClearColor(0, 0, 0, 1);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-		// ------------------------------------------------------------------------
-		// CubeMap pass
+        passTimers["Cubemap"].Begin();
+        // Static layer: skybox and terrain, baked once
+        if (cubeMap->IsStaticDirty())
         {
-            Shader* shader = shaders["CubeMapFramebufferShader"];
-            shader->Use();
-            glm::mat4 modelMatrix = glm::scale(glm::mat4(1), glm::vec3(30));
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap->GetCubeTexture());
-            glUniform1i(glGetUniformLocation(shader->program, "texture_cubemap"), 1);
-            glUniform1i(glGetUniformLocation(shader->program, "cube_draw"), 1);
-            glUniformMatrix4fv(shader->loc_view_matrix, 1, GL_FALSE, glm::value_ptr(CM::VIEW_MATRICES[0]));
-            glUniformMatrix4fv(shader->loc_projection_matrix, 1, GL_FALSE, glm::value_ptr(CM::PROJECTION_MATRIX));
-            glUniformMatrix4fv(shader->loc_model_matrix, 1, GL_FALSE, glm::value_ptr(modelMatrix));
-            meshes["cube"]->Render();
+            cubeMap->BeginStaticBake();
+            RenderCubeMapStatic(cubeMap, shaders, meshes);
+            cubeMap->EndStaticBake();
         }
-        // ------------------------------------------------------------------------
-        // Archers pass for CubeMap
+        // Dynamic layer: archers, redrawn over a few faces at a time
+        unsigned int faceMask = cubeMap->BeginDynamicUpdate(deltaTime);
+        if (faceMask)
         {
-            Shader* shader = shaders["CubeMapFramebufferShader"];
-            shader->Use();
-
-            static float angle = 0.0f;
-            constexpr float rotationSpeed = glm::radians(30.0f);
-            angle += rotationSpeed * deltaTime;
-
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, TextureManager::GetTexture("Akai_E_Espiritu.fbm\\akai_diffuse.png")->GetTextureID());
-            glUniform1i(glGetUniformLocation(shader->program, "texture_1"), 0);
-
-            for (int i = 0; i < 5; ++i) 
-              {
-                glm::mat4 modelMatrix = glm::mat4(1);
-                modelMatrix *= glm::rotate(glm::mat4(1), angle + i * glm::radians(360.0f) / 5, glm::vec3(0, 1, 0));
-                modelMatrix *= glm::translate(glm::mat4(1), glm::vec3(10, 4, 0));
-                modelMatrix *= glm::rotate(glm::mat4(1), glm::radians(-90.0f), glm::vec3(0, 1, 0));
-                modelMatrix *= glm::scale(glm::mat4(1), glm::vec3(0.01f));
-
-                glUniformMatrix4fv(shader->loc_model_matrix, 1, GL_FALSE, glm::value_ptr(modelMatrix));
-                glUniformMatrix4fv(shader->loc_projection_matrix, 1, GL_FALSE, glm::value_ptr(CM::PROJECTION_MATRIX));
-                glUniformMatrix4fv(glGetUniformLocation(shader->program, "viewMatrices"), 6, GL_FALSE, glm::value_ptr(CM::VIEW_MATRICES[0]));
-                glUniform1i(glGetUniformLocation(shader->program, "cube_draw"), 0);
-
-                meshes["archer"]->Render();
-            }
+            RenderCubeMapDynamic(cubeMap, shaders, meshes, faceMask);
+            cubeMap->EndDynamicUpdate(faceMask);
         }
-		// ------------------------------------------------------------------------
-        {
-            Shader* shader = shaders["CubeMapFramebufferShader"];
-            glm::mat4 modelMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -3.0F, 0.0f));
-            modelMatrix = glm::scale(modelMatrix, glm::vec3(1.f));
-            
-            shader->Use();
-            glUniformMatrix4fv(shader->loc_view_matrix, 1, GL_FALSE, glm::value_ptr(camera->GetViewMatrix()));
-            glUniformMatrix4fv(shader->loc_projection_matrix, 1, GL_FALSE, glm::value_ptr(CM::PROJECTION_MATRIX));
-            glUniformMatrix4fv(shader->loc_model_matrix, 1, GL_FALSE, glm::value_ptr(modelMatrix));
-            glUniformMatrix4fv(glGetUniformLocation(shader->GetProgramID(), "viewMatrices"), 6, GL_FALSE, glm::value_ptr(CM::VIEW_MATRICES[0]));
-
-            glUniform1i(glGetUniformLocation(shader->program, "cube_draw"), 0);
 
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, TextureManager::GetTexture("ground.jpg")->GetTextureID());
-            glUniform1i(glGetUniformLocation(shader->program, "texture_1"), 0);
-
-            meshes["dynamicPlane"]->Render();
-        }
-
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap->GetColorTextureID());
-        glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
         // Clear the screen
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         glViewport(0, 0, window->GetResolution().x, window->GetResolution().y);
+        passTimers["Cubemap"].End();
+    }
+    archer_angle += glm::radians(30.0f) * deltaTime;
+    BuildSceneDraws(camera, meshes);
+
+    passTimers["Culling"].Begin();
+    CullScene(camera, shaders, meshes);
+    passTimers["Culling"].End();
+    // ------------------------------------------------------------------------
+    // Visibility buffer pass, produces the same G-buffer as the pass below
+    if (visibility_buffer)
+    {
+        passTimers["Visibility buffer"].Begin();
+        RenderVisibilityBuffer(camera, cubeMap, shaders, meshes, cameraPos);
+        passTimers["Visibility buffer"].End();
     }
     // ------------------------------------------------------------------------
-    // CubeMap pass
+    // G-buffer pass
+    else
     {
         frameBuffer->Bind();
-        // ------------------------------------------------------------------------
-        // Reflection pass
+        glEnable(GL_DEPTH_TEST);
+        if (depth_prepass)
         {
-            Shader* shader = shaders["CubeMapReflectionShader"];
-            shader->Use();
-
-            // Set model matrix for the reflective plane
-            glm::mat4 modelMatrix = glm::translate(glm::mat4(1), glm::vec3(0, -1.5f, 0));
-            modelMatrix = glm::scale(modelMatrix, glm::vec3(0.3f));
-
-            glUniform3f(shader->GetUniformLocation("camera_position"), cameraPos.x, cameraPos.y, cameraPos.z);
-
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap->GetColorTextureID());
-            glUniform1i(glGetUniformLocation(shader->GetProgramID(), "texture_cubemap"), 0);
-
-            glActiveTexture(GL_TEXTURE1);
-            lightBuffer->BindTexture(0, GL_TEXTURE1);
-            glUniform1i(glGetUniformLocation(shader->GetProgramID(), "texture_light"), 1);
-
-            glUniformMatrix4fv(shader->GetUniformLocation("view_matrix"), 1, GL_FALSE, glm::value_ptr(camera->GetViewMatrix()));
-
-            glUniformMatrix4fv(shader->loc_view_matrix, 1, GL_FALSE, glm::value_ptr(camera->GetViewMatrix()));
-            glUniformMatrix4fv(shader->loc_projection_matrix, 1, GL_FALSE, glm::value_ptr(camera->GetProjectionMatrix()));
-            glUniformMatrix4fv(shader->loc_model_matrix, 1, GL_FALSE, glm::value_ptr(modelMatrix));
+            passTimers["Depth pre-pass"].Begin();
+            RenderDepthPrepass(camera, shaders);
+            passTimers["Depth pre-pass"].End();
 
-            meshes["plane"]->Render();
+            // Only the visible fragment of every pixel is shaded
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
         }
-        // ------------------------------------------------------------------------
-        // Archers pass
-        {
-            Shader* shader = shaders["DeferredRender2TextureShader"];
-            shader->Use();
-
-            static float angle = 0.0f;
-            constexpr float rotationSpeed = glm::radians(30.0f);
-            angle += rotationSpeed * deltaTime;
-
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, TextureManager::GetTexture("Akai_E_Espiritu.fbm\\akai_diffuse.png")->GetTextureID());
-            glUniform1i(glGetUniformLocation(shader->program, "texture_1"), 0);
-            for (size_t i = 0; i < 5; ++i)
-            {
-                glm::mat4 modelMatrix = glm::mat4(1);
-                modelMatrix *= glm::rotate(glm::mat4(1), angle + i * glm::radians(360.0f) / 5, glm::vec3(0, 1, 0));
-                modelMatrix *= glm::translate(glm::mat4(1), glm::vec3(10, 4, 0));
-                modelMatrix *= glm::rotate(glm::mat4(1), glm::radians(-90.0f), glm::vec3(0, 1, 0));
-                modelMatrix *= glm::scale(glm::mat4(1), glm::vec3(0.01f));
 
-                glUniformMatrix4fv(shader->loc_model_matrix, 1, GL_FALSE, glm::value_ptr(modelMatrix));
-                glUniformMatrix4fv(shader->loc_view_matrix, 1, GL_FALSE, glm::value_ptr(camera->GetViewMatrix()));
-                glUniformMatrix4fv(shader->loc_projection_matrix, 1, GL_FALSE, glm::value_ptr(camera->GetProjectionMatrix()));
+        passTimers["G-buffer"].Begin();
+        RenderGBuffer(camera, cubeMap, shaders, cameraPos, drawOrder);
+        passTimers["G-buffer"].End();
 
-                meshes["archer"]->Render();
-            }
-        }
-        // ------------------------------------------------------------------------
-        // Normal pass
-        {
-			Shader* shader = shaders["CubeMapNormalShader"];
-            shader->Use();
-            glm::mat4 modelMatrix = glm::scale(glm::mat4(1), glm::vec3(30));
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap->GetCubeTexture());
-            glUniform1i(shader->GetUniformLocation("texture_cubemap"), 0);
-            glUniformMatrix4fv(shader->loc_view_matrix, 1, GL_FALSE, glm::value_ptr(camera->GetViewMatrix()));
-            glUniformMatrix4fv(shader->loc_projection_matrix, 1, GL_FALSE, glm::value_ptr(camera->GetProjectionMatrix()));
-            glUniformMatrix4fv(shader->loc_model_matrix, 1, GL_FALSE, glm::value_ptr(modelMatrix));
-            meshes["cube"]->Render();
-        }
-        // ------------------------------------------------------------------------
-        // Deferred texture pass
-        {
-            Shader* shader = shaders["DeferredRender2TextureShader"];
-            glm::mat4 modelMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -3.0f, 0.0f));
-            modelMatrix = glm::scale(modelMatrix, glm::vec3(1.f));
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+    }
+    // ------------------------------------------------------------------------
+    // Hi-Z pass, the depth of this frame culls the next one
+    if (culling_mode != OCCLUSION_CULLING_OFF)
+    {
+        passTimers["Hi-Z"].Begin();
+        glm::mat4 viewProjection = camera->GetProjectionMatrix() * camera->GetViewMatrix();
+        occlusionCulling->BuildHiZ(frameBuffer->GetDepthTexture(), viewProjection, shaders["HiZBuildShader"]);
+        passTimers["Hi-Z"].End();
+    }
+    // ------------------------------------------------------------------------
+    // Particles pass
+    // Additive particles are fill bound, they go into a reduced resolution
+    // target whose depth is a downsampled copy of the scene depth
+    {
+        passTimers["Particles"].Begin();
+        particleBuffer->Bind();
+        frameBuffer->BlitDepth(particleBuffer);
+        TextureManager::BindTextureArray("sprites", GL_TEXTURE0);
 
-            shader->Use();
-            glUniformMatrix4fv(shader->loc_view_matrix, 1, GL_FALSE, glm::value_ptr(camera->GetViewMatrix()));
-            glUniformMatrix4fv(shader->loc_projection_matrix, 1, GL_FALSE, glm::value_ptr(camera->GetProjectionMatrix()));
-            glUniformMatrix4fv(shader->loc_model_matrix, 1, GL_FALSE, glm::value_ptr(modelMatrix));
-            meshes["dynamicPlane"]->Render();
-        }
-        // ------------------------------------------------------------------------
         // WaterDrops pass
         {
             Shader* shader = shaders["WaterDrops"];
@@ -346,10 +450,12 @@ void WaterfallLake::RenderCompose(
             Shader* shader = shaders["FallingStars"];
             fallingStars->Render(shader, camera, deltaTime);
         }
+        passTimers["Particles"].End();
     }
     // ------------------------------------------------------------------------
     // Lighting pass
     {
+        passTimers["Lighting"].Begin();
         glm::vec3 ambientLight(0.2f);
         lightBuffer->SetClearColor(glm::vec4(ambientLight.x, ambientLight.y, ambientLight.z, 1.0f));
         lightBuffer->Bind();
@@ -379,35 +485,53 @@ void WaterfallLake::RenderCompose(
         int loc_eyePosition = shader->GetUniformLocation("eye_position");
         glUniform3fv(loc_eyePosition, 1, glm::value_ptr(cameraPos));
         //
-        auto resolution = window->GetResolution();
+        auto resolution = lightBuffer->GetResolution();
         int loc_resolution = shader->GetUniformLocation("resolution");
         glUniform2i(shader->GetUniformLocation("resolution"), resolution.x, resolution.y);
         //Front face culling
         glEnable(GL_CULL_FACE);
         glCullFace(GL_FRONT);
-        for (auto& lightInfo : lights)
+        const Mesh* sphere = meshes["sphere"];
+        for (unsigned int i = 0; i < lights.size(); i++)
         {
+            if (!lightVisible[i])
+                continue;
+
+            const Light& lightInfo = lights[i];
             glUniform3fv(shader->GetUniformLocation("light_position"), 1, glm::value_ptr(lightInfo.position));
             glUniform3fv(shader->GetUniformLocation("light_color"), 1, glm::value_ptr(lightInfo.color));
             glUniform1f(shader->GetUniformLocation("light_radius"), lightInfo.radius);
-            glm::mat4 modelMatrix = glm::mat4(1.0f);
-            modelMatrix = glm::translate(modelMatrix, lightInfo.position);
-            modelMatrix = glm::scale(modelMatrix, glm::vec3(2.0f * lightInfo.radius));
+            glm::mat4 modelMatrix = LightModelMatrix(lightInfo);
             shader->Use();
             glUniformMatrix4fv(shader->loc_view_matrix, 1, GL_FALSE, glm::value_ptr(camera->GetViewMatrix()));
             glUniformMatrix4fv(shader->loc_projection_matrix, 1, GL_FALSE, glm::value_ptr(camera->GetProjectionMatrix()));
             glUniformMatrix4fv(shader->loc_model_matrix, 1, GL_FALSE, glm::value_ptr(modelMatrix));
-            meshes["sphere"]->Render();
+
+            if (culling_mode == OCCLUSION_CULLING_GPU)
+            {
+                // Light volume commands follow the scene draws, see CullScene
+                unsigned int first = static_cast<unsigned int>(sceneDraws.size() + i * sphere->meshEntries.size());
+                glBindVertexArray(sphere->GetBuffers()->m_VAO);
+                for (unsigned int entry = 0; entry < sphere->meshEntries.size(); entry++)
+                    occlusionCulling->DrawIndirect(first + entry, sphere->meshEntries[entry].indexType);
+                glBindVertexArray(0);
+            }
+            else
+            {
+                meshes["sphere"]->Render();
+            }
         }
         //Back face culling
         glDisable(GL_CULL_FACE);
         glDepthMask(GL_TRUE);
         glDisable(GL_BLEND);
+        passTimers["Lighting"].End();
     }
     // ------------------------------------------------------------------------
     // Composition pass
     {
-        FrameBuffer::BindDefault();
+        passTimers["Composition"].Begin();
+        FrameBuffer::BindDefault(window->GetResolution());
         glDisable(GL_DEPTH_TEST); /// maybe OUT
         glm::mat4 modelMatrix = glm::mat4(0);
         auto shader = shaders["DeferredRenderCompositionShader"];
@@ -423,9 +547,701 @@ void WaterfallLake::RenderCompose(
         frameBuffer->BindDepthTexture(GL_TEXTURE0 + 4);
         glUniform1i(shader->GetUniformLocation("texture_light"), 5);
         lightBuffer->BindTexture(0, GL_TEXTURE0 + 5);
+        glUniform1i(shader->GetUniformLocation("light_scale"), light_scale);
+        glUniform2iv(shader->GetUniformLocation("light_resolution"), 1, glm::value_ptr(lightBuffer->GetResolution()));
+        glUniform1i(shader->GetUniformLocation("texture_particles"), 6);
+        particleBuffer->BindTexture(0, GL_TEXTURE0 + 6);
+        glUniform1i(shader->GetUniformLocation("texture_particles_depth"), 7);
+        particleBuffer->BindDepthTexture(GL_TEXTURE0 + 7);
+        glUniform2iv(shader->GetUniformLocation("particle_resolution"), 1, glm::value_ptr(particleBuffer->GetResolution()));
         glUniformMatrix4fv(shader->loc_view_matrix, 1, GL_FALSE, glm::value_ptr(camera->GetViewMatrix()));
         glUniformMatrix4fv(shader->loc_projection_matrix, 1, GL_FALSE, glm::value_ptr(camera->GetProjectionMatrix()));
         glUniformMatrix4fv(shader->loc_model_matrix, 1, GL_FALSE, glm::value_ptr(modelMatrix));
         meshes["quad"]->Render();
+        passTimers["Composition"].End();
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Function: UseCubeMapShader
+// Description: Binds the program drawing into the reflection probe: the instanced layer shader when the probe
+//              renders layered and it compiled, the geometry shader one otherwise. The paraboloid mode always
+//              goes through its geometry shader (one invocation per hemisphere).
+// Parameters:
+//   - cubeMap: Reflection probe.
+//   - shaders: Map of shaders.
+// Returns:
+//   - The bound program.
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+Shader* WaterfallLake::UseCubeMapShader(
+    CubeMap* cubeMap,
+    AssetMap<Shader>& shaders)
+{
+    if (cubeMap->GetEnvironmentMode() == ENVIRONMENT_PARABOLOID)
+    {
+        cube_layered = false;
+        Shader* shader = shaders["CubeMapParaboloidShader"];
+        shader->Use();
+        glUniform1f(shader->GetUniformLocation("near_plane"), CM::NEAR_PLANE);
+        glUniform1f(shader->GetUniformLocation("far_plane"), CM::FAR_PLANE);
+        return shader;
+    }
+
+    cube_layered = cubeMap->IsLayeredRendering() && shaders.count("CubeMapLayeredShader");
+
+    Shader* shader = shaders[cube_layered ? "CubeMapLayeredShader" : "CubeMapFramebufferShader"];
+    shader->Use();
+    if (cube_layered)
+    {
+        cubeMap->BindFaceBuffer();
+    }
+    else
+    {
+        glUniformMatrix4fv(glGetUniformLocation(shader->program, "viewMatrices"), 6, GL_FALSE, glm::value_ptr(CM::VIEW_MATRICES[0]));
+        glUniformMatrix4fv(shader->loc_projection_matrix, 1, GL_FALSE, glm::value_ptr(CM::PROJECTION_MATRIX));
+    }
+    return shader;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Function: DrawCubeMapMesh
+// Description: Draws a mesh into the faces of the reflection probe its entries can be seen from, each entry at
+//              the level of detail its size on a face allows with the probe's coarser bias. The layered path
+//              instances every entry once per face; the geometry shader path passes the face mask.
+// Parameters:
+//   - cubeMap: Reflection probe.
+//   - shader: Program bound by UseCubeMapShader.
+//   - mesh: Mesh to draw.
+//   - modelMatrix: Model matrix of the mesh.
+//   - faceMask: Faces being drawn this frame.
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void WaterfallLake::DrawCubeMapMesh(
+    CubeMap* cubeMap,
+    Shader* shader,
+    const Mesh* mesh,
+    const glm::mat4& modelMatrix,
+    unsigned int faceMask) const
+{
+    glm::vec3 boundsMin, boundsMax;
+    TransformBounds(mesh->GetBoundsMin(), mesh->GetBoundsMax(), modelMatrix, boundsMin, boundsMax);
+    faceMask &= cubeMap->GetFaceMask(boundsMin, boundsMax);
+    if (!faceMask)
+        return;
+
+    glUniformMatrix4fv(shader->loc_model_matrix, 1, GL_FALSE, glm::value_ptr(modelMatrix));
+    int loc_faces = glGetUniformLocation(shader->program, cube_layered ? "instance_faces" : "face_mask");
+
+    glm::vec3 probeCenter = glm::vec3(glm::inverse(CM::VIEW_MATRICES[0])[3]);
+    float focalLength = CM::PROJECTION_MATRIX[1][1] * cubeMap->GetFaceHeight() * 0.5f;
+
+    glBindVertexArray(mesh->GetBuffers()->m_VAO);
+    for (const MeshEntry& entry : mesh->meshEntries)
+    {
+        TransformBounds(entry.boundsMin, entry.boundsMax, modelMatrix, boundsMin, boundsMax);
+        unsigned int entryMask = faceMask & cubeMap->GetFaceMask(boundsMin, boundsMax);
+        if (!entryMask)
+            continue;
+
+        // Same texture Mesh::Render() would bind for this entry
+        if (mesh->useMaterial)
+        {
+            unsigned int materialIndex = entry.materialIndex;
+            if (materialIndex != INVALID_MATERIAL && mesh->materials[materialIndex]->texture)
+                mesh->materials[materialIndex]->texture->BindToTextureUnit(GL_TEXTURE0);
+            else
+                TextureManager::GetTexture(static_cast<unsigned int>(0))->BindToTextureUnit(GL_TEXTURE0);
+        }
+
+        unsigned int lod = SelectLod(entry, modelMatrix, probeCenter, focalLength, DR::LOD_PIXEL_ERROR * CM::LOD_BIAS);
+        unsigned int nrIndices = entry.GetNrIndices(lod);
+        const void* firstIndex = entry.GetIndexOffset(lod);
+        if (cube_layered)
+        {
+            GLint faces[6];
+            GLsizei nrFaces = 0;
+            for (int face = 0; face < 6; face++)
+            {
+                if (entryMask & (1u << face))
+                    faces[nrFaces++] = face;
+            }
+            glUniform1iv(loc_faces, nrFaces, faces);
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, nrIndices, entry.indexType, firstIndex, nrFaces, entry.baseVertex);
+        }
+        else
+        {
+            glUniform1i(loc_faces, static_cast<GLint>(entryMask));
+            glDrawElementsBaseVertex(GL_TRIANGLES, nrIndices, entry.indexType, firstIndex, entry.baseVertex);
+        }
+    }
+    glBindVertexArray(0);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Function: RenderCubeMapStatic
+// Description: Bakes the static layer of the reflection probe (skybox and terrain) into all six faces. The
+//              terrain goes chunk by chunk, each one only to the faces it can be seen from.
+// Parameters:
+//   - cubeMap: Reflection probe, its static framebuffer is bound.
+//   - shaders: Map of shaders.
+//   - meshes: Map of meshes.
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void WaterfallLake::RenderCubeMapStatic(
+    CubeMap* cubeMap,
+    AssetMap<Shader>& shaders,
+    AssetMap<Mesh>& meshes)
+{
+    Shader* shader = UseCubeMapShader(cubeMap, shaders);
+    // ------------------------------------------------------------------------
+    // Skybox
+    {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap->GetCubeTexture());
+        glUniform1i(glGetUniformLocation(shader->program, "texture_cubemap"), 1);
+        glUniform1i(glGetUniformLocation(shader->program, "cube_draw"), 1);
+        if (cubeMap->GetEnvironmentMode() == ENVIRONMENT_PARABOLOID)
+        {
+            // A fullscreen quad per hemisphere, the cube mesh would bend along the paraboloid
+            glUniformMatrix4fv(shader->loc_model_matrix, 1, GL_FALSE, glm::value_ptr(glm::mat4(1)));
+            glUniform1i(glGetUniformLocation(shader->program, "face_mask"), CM::ALL_FACES);
+            meshes["quad"]->Render();
+        }
+        else
+        {
+            DrawCubeMapMesh(cubeMap, shader, meshes["cube"], glm::scale(glm::mat4(1), glm::vec3(30)), CM::ALL_FACES);
+        }
+    }
+    // ------------------------------------------------------------------------
+    // Terrain
+    {
+        glUniform1i(glGetUniformLocation(shader->program, "cube_draw"), 0);
+        TextureManager::Get(groundTexture)->BindToTextureUnit(GL_TEXTURE0);
+        glUniform1i(glGetUniformLocation(shader->program, "texture_1"), 0);
+        DrawCubeMapMesh(cubeMap, shader, meshes["dynamicPlane"], glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -3.0F, 0.0f)), CM::ALL_FACES);
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Function: RenderCubeMapDynamic
+// Description: Draws the moving geometry (archers) over the faces of the probe that were reset to the static
+//              layer this frame. Every archer is only emitted to the faces its bounds intersect.
+// Parameters:
+//   - cubeMap: Reflection probe, its framebuffer is bound.
+//   - shaders: Map of shaders.
+//   - meshes: Map of meshes.
+//   - faceMask: Faces being refreshed.
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void WaterfallLake::RenderCubeMapDynamic(
+    CubeMap* cubeMap,
+    AssetMap<Shader>& shaders,
+    AssetMap<Mesh>& meshes,
+    unsigned int faceMask)
+{
+    Shader* shader = UseCubeMapShader(cubeMap, shaders);
+    glUniform1i(glGetUniformLocation(shader->program, "cube_draw"), 0);
+
+    TextureManager::Get(archerTexture)->BindToTextureUnit(GL_TEXTURE0);
+    glUniform1i(glGetUniformLocation(shader->program, "texture_1"), 0);
+
+    for (int i = 0; i < DR::NR_ARCHERS; ++i)
+        DrawCubeMapMesh(cubeMap, shader, meshes["archer"], ArcherModelMatrix(i), faceMask);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Function: BuildSceneDraws
+// Description: Collects the opaque geometry of the frame (one draw per mesh entry and instance), picks the
+//              level of detail of every draw from its projected size and sorts them front to back by view
+//              depth, so early depth testing rejects as many hidden fragments as possible. The skybox
+//              encloses everything and always goes last.
+// Parameters:
+//   - camera: Scene camera.
+//   - meshes: Map of meshes.
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void WaterfallLake::BuildSceneDraws(
+    gfxc::Camera* camera,
+    AssetMap<Mesh>& meshes)
+{
+    std::vector<glm::mat4> archers;
+    for (int i = 0; i < DR::NR_ARCHERS; ++i)
+        archers.push_back(ArcherModelMatrix(i));
+
+    sceneDraws.clear();
+    AddSceneDraws(meshes["plane"], { glm::scale(glm::translate(glm::mat4(1), glm::vec3(0, -1.5f, 0)), glm::vec3(0.3f)) }, SCENE_MATERIAL_REFLECTION);
+    AddSceneDraws(meshes["archer"], archers, SCENE_MATERIAL_TEXTURED);
+    AddSceneDraws(meshes["cube"], { glm::scale(glm::mat4(1), glm::vec3(30)) }, SCENE_MATERIAL_SKYBOX);
+    AddSceneDraws(meshes["dynamicPlane"], { glm::translate(glm::mat4(1), glm::vec3(0, -3.0f, 0)) }, SCENE_MATERIAL_TEXTURED);
+
+    glm::mat4 view = camera->GetViewMatrix();
+    glm::vec3 eye = glm::vec3(glm::inverse(view)[3]);
+    float focalLength = camera->GetProjectionMatrix()[1][1] * frameBuffer->GetResolution().y * 0.5f;
+
+    sceneTriangles = fullTriangles = 0;
+    drawOrder.resize(sceneDraws.size());
+    for (unsigned int i = 0; i < sceneDraws.size(); i++)
+    {
+        SceneDraw& draw = sceneDraws[i];
+        draw.viewDepth = (draw.material == SCENE_MATERIAL_SKYBOX) ? FLT_MAX : -(view * draw.model[3]).z;
+        drawOrder[i] = i;
+
+        const MeshEntry& entry = draw.mesh->meshEntries[draw.entry];
+        draw.lod = SelectLod(entry, draw.model, eye, focalLength, DR::LOD_PIXEL_ERROR);
+        sceneTriangles += entry.GetNrIndices(draw.lod) / 3;
+        fullTriangles += entry.nrIndices / 3;
+    }
+
+    std::stable_sort(drawOrder.begin(), drawOrder.end(), [this](unsigned int a, unsigned int b) {
+        return sceneDraws[a].viewDepth < sceneDraws[b].viewDepth;
+    });
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Function: CullScene
+// Description: Every scene draw and light volume entry first goes through the batched frustum test. With
+//              occlusion culling on, the survivors are then tested against the Hi-Z pyramid of the previous
+//              frame, reprojected with the view-projection it was rendered with. The CPU path drops culled
+//              draws from the draw order; the GPU path writes one indirect command per draw and light volume
+//              entry, with no instances when culled.
+// Parameters:
+//   - camera: Scene camera.
+//   - shaders: Map of shaders.
+//   - meshes: Map of meshes.
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void WaterfallLake::CullScene(
+    gfxc::Camera* camera,
+    AssetMap<Shader>& shaders,
+    AssetMap<Mesh>& meshes)
+{
+    const Mesh* sphere = meshes["sphere"];
+    size_t nrDraws = sceneDraws.size();
+    size_t nrLightEntries = sphere->meshEntries.size();
+
+    // World bounds: scene draws first, then the entries of every light volume
+    std::vector<glm::vec3> boundsMin, boundsMax;
+    boundsMin.reserve(nrDraws + lights.size() * nrLightEntries);
+    boundsMax.reserve(boundsMin.capacity());
+    auto addBounds = [&](const MeshEntry& entry, const glm::mat4& modelMatrix) {
+        glm::vec3 worldMin, worldMax;
+        TransformBounds(entry.boundsMin, entry.boundsMax, modelMatrix, worldMin, worldMax);
+        boundsMin.push_back(worldMin);
+        boundsMax.push_back(worldMax);
+    };
+
+    for (const SceneDraw& draw : sceneDraws)
+        addBounds(draw.mesh->meshEntries[draw.entry], draw.model);
+    for (const Light& lightInfo : lights)
+        for (const MeshEntry& entry : sphere->meshEntries)
+            addBounds(entry, LightModelMatrix(lightInfo));
+
+    std::vector<unsigned char> visible(boundsMin.size());
+    Frustum(camera).CullBoxes(boundsMin.data(), boundsMax.data(), boundsMin.size(), visible.data());
+
+    if (culling_mode == OCCLUSION_CULLING_CPU)
+    {
+        occlusionCulling->BeginFrame();
+        for (size_t i = 0; i < visible.size(); i++)
+        {
+            if (visible[i] && !occlusionCulling->IsVisible(boundsMin[i], boundsMax[i]))
+                visible[i] = 0;
+        }
+    }
+    else if (culling_mode == OCCLUSION_CULLING_GPU)
+    {
+        std::vector<CullingBox> boxes;
+        std::vector<DrawElementsIndirectCommand> commands;
+        for (size_t i = 0; i < visible.size(); i++)
+        {
+            const MeshEntry& entry = (i < nrDraws) ?
+                sceneDraws[i].mesh->meshEntries[sceneDraws[i].entry] :
+                sphere->meshEntries[(i - nrDraws) % nrLightEntries];
+            unsigned int lod = (i < nrDraws) ? sceneDraws[i].lod : 0;
+
+            CullingBox box = { glm::vec4(boundsMin[i], 1), glm::vec4(boundsMax[i], 1) };
+            DrawElementsIndirectCommand command = { entry.GetNrIndices(lod), visible[i], entry.GetFirstIndex(lod), static_cast<int>(entry.baseVertex), 0 };
+            boxes.push_back(box);
+            commands.push_back(command);
+        }
+        occlusionCulling->CullIndirect(boxes, commands, shaders["HiZCullShader"]);
+    }
+
+    culledDraws = culledLights = 0;
+    drawVisible.assign(nrDraws, true);
+    lightVisible.assign(lights.size(), true);
+    for (size_t i = 0; i < nrDraws; i++)
+    {
+        drawVisible[i] = visible[i] != 0;
+        if (!drawVisible[i]) culledDraws++;
+    }
+    for (size_t i = 0; i < lights.size(); i++)
+    {
+        bool isVisible = false;
+        for (size_t entry = 0; entry < nrLightEntries; entry++)
+            isVisible = isVisible || visible[nrDraws + i * nrLightEntries + entry];
+        lightVisible[i] = isVisible;
+        if (!isVisible) culledLights++;
+    }
+
+    drawOrder.erase(std::remove_if(drawOrder.begin(), drawOrder.end(), [this](unsigned int index) {
+        return !drawVisible[index];
+    }), drawOrder.end());
+}
+
+
+void WaterfallLake::DrawSceneEntry(unsigned int index) const
+{
+    const SceneDraw& draw = sceneDraws[index];
+    const MeshEntry& entry = draw.mesh->meshEntries[draw.entry];
+    glBindVertexArray(draw.mesh->GetBuffers()->m_VAO);
+
+    // Occluded draws were written with no instances by the cull pass
+    if (culling_mode == OCCLUSION_CULLING_GPU)
+    {
+        occlusionCulling->DrawIndirect(index, entry.indexType);
+        return;
+    }
+
+    glDrawElementsBaseVertex(GL_TRIANGLES, entry.GetNrIndices(draw.lod), entry.indexType, entry.GetIndexOffset(draw.lod), entry.baseVertex);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Function: RenderDepthPrepass
+// Description: Lays down the depth of the opaque geometry, front to back, without touching the G-buffer
+//              color targets. The vertex shader only reads the position stream.
+// Parameters:
+//   - camera: Scene camera.
+//   - shaders: Map of shaders.
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void WaterfallLake::RenderDepthPrepass(
+    gfxc::Camera* camera,
+    AssetMap<Shader>& shaders)
+{
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+
+    Shader* shader = shaders["DepthPrepassShader"];
+    shader->Use();
+    glUniformMatrix4fv(shader->loc_view_matrix, 1, GL_FALSE, glm::value_ptr(camera->GetViewMatrix()));
+    glUniformMatrix4fv(shader->loc_projection_matrix, 1, GL_FALSE, glm::value_ptr(camera->GetProjectionMatrix()));
+
+    for (unsigned int index : drawOrder)
+    {
+        const SceneDraw& draw = sceneDraws[index];
+        glUniformMatrix4fv(shader->loc_model_matrix, 1, GL_FALSE, glm::value_ptr(draw.model));
+        DrawSceneEntry(index);
+    }
+    glBindVertexArray(0);
+
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Function: RenderGBuffer
+// Description: Fills the G-buffer with the opaque geometry, in the given order (front to back for the whole
+//              scene). Programs and material inputs are only rebound when the material changes between
+//              consecutive draws.
+// Parameters:
+//   - camera: Scene camera.
+//   - cubeMap: Environment used by the skybox and reflection materials.
+//   - shaders: Map of shaders.
+//   - cameraPos: Camera position in world space.
+//   - order: Indices of the scene draws to render.
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void WaterfallLake::RenderGBuffer(
+    gfxc::Camera* camera,
+    CubeMap* cubeMap,
+    AssetMap<Shader>& shaders,
+    const glm::vec3& cameraPos,
+    const std::vector<unsigned int>& order)
+{
+    Shader* shader = nullptr;
+    SceneMaterial material = SCENE_MATERIAL_TEXTURED;
+
+    for (unsigned int index : order)
+    {
+        const SceneDraw& draw = sceneDraws[index];
+
+        if (!shader || draw.material != material)
+        {
+            material = draw.material;
+            switch (material)
+            {
+            case SCENE_MATERIAL_REFLECTION:
+                shader = shaders["CubeMapReflectionShader"];
+                shader->Use();
+                glUniform3fv(shader->GetUniformLocation("camera_position"), 1, glm::value_ptr(cameraPos));
+                glUniformMatrix4fv(shader->GetUniformLocation("view_matrix"), 1, GL_FALSE, glm::value_ptr(camera->GetViewMatrix()));
+                cubeMap->BindEnvironment(shader, 1, 4);
+                lightBuffer->BindTexture(0, GL_TEXTURE0 + 2);
+                glUniform1i(shader->GetUniformLocation("texture_light"), 2);
+                break;
+
+            case SCENE_MATERIAL_SKYBOX:
+                shader = shaders["CubeMapNormalShader"];
+                shader->Use();
+                glActiveTexture(GL_TEXTURE0 + 3);
+                glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap->GetCubeTexture());
+                glUniform1i(shader->GetUniformLocation("texture_cubemap"), 3);
+                break;
+
+            default:
+                shader = shaders["DeferredRender2TextureShader"];
+                shader->Use();
+                glUniform1i(shader->GetUniformLocation("u_texture_0"), 0);
+            }
+
+            glUniformMatrix4fv(shader->loc_view_matrix, 1, GL_FALSE, glm::value_ptr(camera->GetViewMatrix()));
+            glUniformMatrix4fv(shader->loc_projection_matrix, 1, GL_FALSE, glm::value_ptr(camera->GetProjectionMatrix()));
+        }
+
+        if (material == SCENE_MATERIAL_TEXTURED)
+            draw.texture->BindToTextureUnit(GL_TEXTURE0);
+
+        glUniformMatrix4fv(shader->loc_model_matrix, 1, GL_FALSE, glm::value_ptr(draw.model));
+        DrawSceneEntry(index);
+    }
+    glBindVertexArray(0);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Function: AddSceneDraws
+// Description: Queues one scene draw for every entry of a mesh and every model matrix. Instances of the
+//              same entry are kept adjacent so the visibility resolve can shade them together.
+// Parameters:
+//   - mesh: Mesh to draw.
+//   - models: Model matrix of every instance.
+//   - material: How the G-buffer is filled for these draws.
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void WaterfallLake::AddSceneDraws(
+    const Mesh* mesh,
+    const std::vector<glm::mat4>& models,
+    SceneMaterial material)
+{
+    for (unsigned int entry = 0; entry < mesh->meshEntries.size(); entry++)
+    {
+        // Same texture Mesh::Render() would bind for this entry
+        Texture2D* texture = TextureManager::GetTexture(static_cast<unsigned int>(0));
+        unsigned int materialIndex = mesh->meshEntries[entry].materialIndex;
+        if (mesh->useMaterial && materialIndex != INVALID_MATERIAL && mesh->materials[materialIndex]->texture)
+            texture = mesh->materials[materialIndex]->texture;
+
+        for (const auto& model : models)
+        {
+            SceneDraw draw = { mesh, entry, 0, model, material, texture, 0.0f };
+            sceneDraws.push_back(draw);
+        }
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Function: IsResolvable
+// Description: The resolve reads the index buffer as 32 bit and needs the vertex streams recorded at upload,
+//              so entries with 16 bit indices (Mesh::UseCompactIndices) and meshes built from an external VAO
+//              are drawn through the G-buffer path instead.
+// Parameters:
+//   - draw: Scene draw to check.
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool WaterfallLake::IsResolvable(const SceneDraw& draw) const
+{
+    return draw.mesh->meshEntries[draw.entry].indexType == GL_UNSIGNED_INT &&
+        draw.mesh->GetBuffers()->m_streams != GPUBuffers::STREAMS_UNKNOWN;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Function: RenderVisibilityBuffer
+// Description: Alternative to the G-buffer pass. The geometry is rasterized once into a single R32UI target
+//              holding (draw ID, triangle ID); the resolve then fetches the vertex attributes straight from
+//              the mesh buffers and writes every G-buffer pixel exactly once, whatever the overdraw.
+// Parameters:
+//   - camera: Scene camera.
+//   - cubeMap: Environment used by the skybox and reflection materials.
+//   - shaders: Map of shaders.
+//   - meshes: Map of meshes.
+//   - cameraPos: Camera position in world space.
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void WaterfallLake::RenderVisibilityBuffer(
+    gfxc::Camera* camera,
+    CubeMap* cubeMap,
+    AssetMap<Shader>& shaders,
+    AssetMap<Mesh>& meshes,
+    const glm::vec3& cameraPos)
+{
+    size_t nrDraws = sceneDraws.size();
+    if (nrDraws >= (1u << (32 - DR::VISIBILITY_TRIANGLE_BITS)))
+    {
+        cerr << "Too many visibility draws: " << nrDraws << endl;
+        nrDraws = (1u << (32 - DR::VISIBILITY_TRIANGLE_BITS)) - 1;
+    }
+
+    // Draws the resolve can't fetch, rendered into the G-buffer after it
+    std::vector<unsigned int> fallbackDraws;
+
+    // ------------------------------------------------------------------------
+    // ID pass
+    {
+        visibilityBuffer->Bind();
+        glEnable(GL_DEPTH_TEST);
+
+        Shader* shader = shaders["VisibilityBufferShader"];
+        shader->Use();
+        glUniformMatrix4fv(shader->loc_view_matrix, 1, GL_FALSE, glm::value_ptr(camera->GetViewMatrix()));
+        glUniformMatrix4fv(shader->loc_projection_matrix, 1, GL_FALSE, glm::value_ptr(camera->GetProjectionMatrix()));
+        int loc_drawID = shader->GetUniformLocation("draw_id");
+
+        for (size_t i = 0; i < nrDraws; i++)
+        {
+            if (!drawVisible[i])
+                continue;
+
+            const SceneDraw& draw = sceneDraws[i];
+            if (!IsResolvable(draw))
+            {
+                fallbackDraws.push_back(static_cast<unsigned int>(i));
+                continue;
+            }
+
+            // 0 is left for empty pixels
+            glUniform1ui(loc_drawID, static_cast<GLuint>(i + 1));
+            glUniformMatrix4fv(shader->loc_model_matrix, 1, GL_FALSE, glm::value_ptr(draw.model));
+            DrawSceneEntry(static_cast<unsigned int>(i));
+        }
+        glBindVertexArray(0);
+    }
+    // ------------------------------------------------------------------------
+    // Resolve pass
+    {
+        frameBuffer->Bind();
+        visibilityBuffer->BlitDepth(frameBuffer);
+        glDisable(GL_DEPTH_TEST);
+        glDepthMask(GL_FALSE);
+
+        Shader* shader = shaders["VisibilityResolveShader"];
+        shader->Use();
+
+        glm::mat4 viewProjection = camera->GetProjectionMatrix() * camera->GetViewMatrix();
+        glUniformMatrix4fv(shader->GetUniformLocation("inverse_view_projection"), 1, GL_FALSE, glm::value_ptr(glm::inverse(viewProjection)));
+        glUniformMatrix4fv(shader->GetUniformLocation("view_matrix"), 1, GL_FALSE, glm::value_ptr(camera->GetViewMatrix()));
+        glUniform3fv(shader->GetUniformLocation("eye_position"), 1, glm::value_ptr(cameraPos));
+
+        const FrameBufferDesc& gBuffer = frameBuffer->GetDescription();
+        glUniform4fv(shader->GetUniformLocation("clear_normal"), 1, glm::value_ptr(gBuffer.attachments[1].clearValue));
+        glUniform4fv(shader->GetUniformLocation("clear_color"), 1, glm::value_ptr(gBuffer.attachments[2].clearValue));
+
+        glUniform1i(shader->GetUniformLocation("texture_visibility"), 1);
+        visibilityBuffer->BindTexture(0, GL_TEXTURE0 + 1);
+        cubeMap->BindEnvironment(shader, 2, 5);
+        glUniform1i(shader->GetUniformLocation("texture_skybox"), 3);
+        glActiveTexture(GL_TEXTURE0 + 3);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap->GetCubeTexture());
+        glUniform1i(shader->GetUniformLocation("texture_light"), 4);
+        lightBuffer->BindTexture(0, GL_TEXTURE0 + 4);
+        glUniform1i(shader->GetUniformLocation("u_texture_0"), 0);
+
+        int loc_drawFirst = shader->GetUniformLocation("draw_first");
+        int loc_drawCount = shader->GetUniformLocation("draw_count");
+        int loc_modelMatrices = shader->GetUniformLocation("model_matrices");
+
+        // Draws sharing mesh, material and texture are resolved by one fullscreen pass
+        size_t first = 0;
+        while (first < nrDraws)
+        {
+            const SceneDraw& draw = sceneDraws[first];
+
+            // Never written to the ID buffer
+            if (!IsResolvable(draw))
+            {
+                first++;
+                continue;
+            }
+
+            std::vector<glm::mat4> models;
+            std::vector<GLint> baseIndices, baseVertices;
+            size_t last = first;
+            while (last < nrDraws && models.size() < DR::MAX_VISIBILITY_INSTANCES &&
+                sceneDraws[last].mesh == draw.mesh && sceneDraws[last].material == draw.material &&
+                sceneDraws[last].texture == draw.texture && IsResolvable(sceneDraws[last]))
+            {
+                const MeshEntry& entry = draw.mesh->meshEntries[sceneDraws[last].entry];
+                models.push_back(sceneDraws[last].model);
+                baseIndices.push_back(entry.GetBaseIndex(sceneDraws[last].lod));
+                baseVertices.push_back(entry.baseVertex);
+                last++;
+            }
+
+            // Vertex buffers as recorded by gpu_utils::UploadData
+            const GPUBuffers* buffers = draw.mesh->GetBuffers();
+            unsigned int nrBuffers = buffers->GetNumberOfBuffers();
+            const VertexLayout& layout = buffers->m_layout;
+            bool packed = (buffers->m_streams == GPUBuffers::STREAMS_PACKED);
+            bool interleaved = (buffers->m_streams != GPUBuffers::STREAMS_SEPARATE);
+            bool hasTexCoords = buffers->m_hasTexCoords;
+
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffers->m_VBO[0]);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, buffers->m_VBO[interleaved ? 0 : 1]);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, buffers->m_VBO[interleaved || !hasTexCoords ? 0 : 2]);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, buffers->m_VBO[nrBuffers - 1]);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, buffers->m_VBO[0]);
+
+            // Packed meshes are decoded in the shader, the float layouts read straight
+            glUniform1i(shader->GetUniformLocation("packed_stride"), packed ? layout.GetStride() / 4 : 0);
+            if (packed)
+            {
+                glUniform3i(shader->GetUniformLocation("packed_offset"), 0, layout.GetNormalOffset() / 4,
+                    layout.GetTexCoordOffset() / 4);
+                glUniform3i(shader->GetUniformLocation("packed_format"), layout.position, layout.normal, layout.texCoord);
+                glUniform4fv(shader->GetUniformLocation("position_transform"), 1, glm::value_ptr(buffers->m_positionTransform));
+            }
+
+            const int vertexFloats = sizeof(VertexFormat) / sizeof(float);
+            if (interleaved)
+            {
+                glUniform3i(shader->GetUniformLocation("attribute_stride"), vertexFloats, vertexFloats, vertexFloats);
+                glUniform3i(shader->GetUniformLocation("attribute_offset"), 0, 3, 6);
+            }
+            else
+            {
+                glUniform3i(shader->GetUniformLocation("attribute_stride"), 3, 3, 2);
+                glUniform3i(shader->GetUniformLocation("attribute_offset"), 0, 0, 0);
+            }
+            glUniform1i(shader->GetUniformLocation("has_texture_coord"), hasTexCoords);
+
+            glUniform1iv(shader->GetUniformLocation("base_indices"), static_cast<GLsizei>(baseIndices.size()), baseIndices.data());
+            glUniform1iv(shader->GetUniformLocation("base_vertices"), static_cast<GLsizei>(baseVertices.size()), baseVertices.data());
+            glUniform1i(shader->GetUniformLocation("material_type"), draw.material);
+            draw.texture->BindToTextureUnit(GL_TEXTURE0);
+
+            glUniform1ui(loc_drawFirst, static_cast<GLuint>(first + 1));
+            glUniform1ui(loc_drawCount, static_cast<GLuint>(models.size()));
+            glUniformMatrix4fv(loc_modelMatrices, static_cast<GLsizei>(models.size()), GL_FALSE, glm::value_ptr(models[0]));
+
+            glm::mat4 modelMatrix = glm::mat4(1);
+            glUniformMatrix4fv(shader->loc_model_matrix, 1, GL_FALSE, glm::value_ptr(modelMatrix));
+            meshes["quad"]->Render();
+
+            first = last;
+        }
+
+        for (GLuint binding = 0; binding < 5; binding++)
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, 0);
+
+        glDepthMask(GL_TRUE);
+        glEnable(GL_DEPTH_TEST);
+    }
+    // ------------------------------------------------------------------------
+    // Fallback pass, depth tested against the blitted depth of the resolved draws
+    if (!fallbackDraws.empty())
+    {
+        glDepthFunc(GL_LESS);
+        RenderGBuffer(camera, cubeMap, shaders, cameraPos, fallbackDraws);
     }
 }
@@ -1,4 +1,4 @@
-#pragma once
+﻿#pragma once
 
 #ifndef WATERFALL_LAKE_H
 #define WATERFALL_LAKE_H
@@ -9,6 +9,9 @@
 #include "core/gpu/mesh.h"
 #include "core/gpu/shader.h"
 #include "core/gpu/frame_buffer.h"
+#include "core/gpu/frustum.h"
+#include "core/gpu/gpu_timer.h"
+#include "core/managers/texture_manager.h"
 #include "core/window/window_object.h"
 
 #include "Structures.h"
@@ -17,7 +20,9 @@
 #include "WaterDrops.h"
 #include "Firefly.h"
 #include "FallingStars.h"
+#include "OcclusionCulling.h"
 
+#include <map>
 #include <vector>
 #include <unordered_map>
 
@@ -30,14 +35,14 @@ public:
     explicit WaterfallLake(WindowObject* window);
     ~WaterfallLake();
 
-	// Resize the Framebuffers framebuffer and lightBuffer
+	// Resize the Framebuffers framebuffer, lightBuffer and particleBuffer
     void ResizeBuffers(int width, int height);
 
 	// Initialize the Light sources + Framebuffers
     void Init(
         WindowObject* window,
-        std::unordered_map<std::string, Shader*>& shaders,
-        std::unordered_map<std::string, Mesh*>& meshes,
+        AssetMap<Shader>& shaders,
+        AssetMap<Mesh>& meshes,
         int width, int height, int light_type);
 
 	// Render the WHOLE SCENE WITH DEFERRED RENDERING + CUBEMAP + PARTICLE EFFECTS
@@ -50,8 +55,8 @@ public:
         Firefly* firefly,
         FallingStars* fallingStars,
 
-        std::unordered_map<std::string, Shader*>& shaders,
-        std::unordered_map<std::string, Mesh*>& meshes,
+        AssetMap<Shader>& shaders,
+        AssetMap<Mesh>& meshes,
         const glm::mat4& viewMatrix,
         const glm::mat4& projectionMatrix,
         const glm::vec3& cameraPos);
@@ -59,21 +64,152 @@ public:
 	void SetLightType(int type) { light_type = type; }
 	int GetLightType() const { return light_type; }
 
+	// Light accumulation runs at 1 / scale of the G-buffer resolution
+	void SetLightResolutionScale(int scale);
+	int GetLightResolutionScale() const { return light_scale; }
+
+	// Particles render at 1 / scale of the G-buffer resolution
+	void SetParticleResolutionScale(int scale);
+	int GetParticleResolutionScale() const { return particle_scale; }
+
+	// Switch the geometry pass between the G-buffer and the visibility buffer
+	void SetVisibilityBuffer(bool enabled);
+	bool IsVisibilityBuffer() const { return visibility_buffer; }
+
+	// Depth-only pass before the G-buffer, which then runs with GL_EQUAL
+	void SetDepthPrepass(bool enabled);
+	bool IsDepthPrepass() const { return depth_prepass; }
+
+	// Scene and probe draws at the level of detail their screen size allows, or always at full detail
+	void SetMeshLods(bool enabled);
+	bool IsMeshLods() const { return mesh_lods; }
+
+	// Hi-Z occlusion culling of the scene draws and light volumes
+	void SetOcclusionCulling(int mode);
+	int GetOcclusionCulling() const { return culling_mode; }
+
+	// Print the GPU time of every pass, averaged over the last frames
+	void PrintPassTimers() const;
+
 private:
 	// Create the framebuffer for Deferred Rendering
     void CreateFramebuffer(int width, int height);
 
+	// Resize a reduced resolution target to match the G-buffer / scale
+    void ResizeScaled(FrameBuffer* buffer, int scale);
+
+	// Model matrix of the index-th archer on the orbit
+    glm::mat4 ArcherModelMatrix(int index) const;
+
+	// Model matrix of a light volume (unit sphere scaled to the light radius)
+    glm::mat4 LightModelMatrix(const Light& lightInfo) const;
+
+	// Level of detail of a mesh entry seen from eye, focalLength in pixels per unit at a distance of 1
+    unsigned int SelectLod(
+        const MeshEntry& entry,
+        const glm::mat4& modelMatrix,
+        const glm::vec3& eye,
+        float focalLength,
+        float maxPixelError) const;
+
+	// Bind the layered or geometry shader program of the reflection probe
+    Shader* UseCubeMapShader(
+        CubeMap* cubeMap,
+        AssetMap<Shader>& shaders);
+
+	// Draw the entries of a mesh into the probe faces they intersect
+    void DrawCubeMapMesh(
+        CubeMap* cubeMap,
+        Shader* shader,
+        const Mesh* mesh,
+        const glm::mat4& modelMatrix,
+        unsigned int faceMask) const;
+
+	// Bake the skybox and terrain into the static layer of the reflection probe
+    void RenderCubeMapStatic(
+        CubeMap* cubeMap,
+        AssetMap<Shader>& shaders,
+        AssetMap<Mesh>& meshes);
+
+	// Draw the archers into the probe faces refreshed this frame
+    void RenderCubeMapDynamic(
+        CubeMap* cubeMap,
+        AssetMap<Shader>& shaders,
+        AssetMap<Mesh>& meshes,
+        unsigned int faceMask);
+
+	// Queue one scene draw per mesh entry and model matrix
+    void AddSceneDraws(const Mesh* mesh, const std::vector<glm::mat4>& models, SceneMaterial material);
+
+	// Collect the opaque geometry of this frame and sort it front to back
+    void BuildSceneDraws(
+        gfxc::Camera* camera,
+        AssetMap<Mesh>& meshes);
+
+	// Frustum test the scene draws and light volumes, then the previous frame's Hi-Z
+    void CullScene(
+        gfxc::Camera* camera,
+        AssetMap<Shader>& shaders,
+        AssetMap<Mesh>& meshes);
+
+	// Issue the draw call of a single scene draw with the bound program
+    void DrawSceneEntry(unsigned int index) const;
+
+	// Depth only, position-only vertex shader
+    void RenderDepthPrepass(
+        gfxc::Camera* camera,
+        AssetMap<Shader>& shaders);
+
+	// Fill the G-buffer with the given scene draws, in order
+    void RenderGBuffer(
+        gfxc::Camera* camera,
+        CubeMap* cubeMap,
+        AssetMap<Shader>& shaders,
+        const glm::vec3& cameraPos,
+        const std::vector<unsigned int>& order);
+
+	// Whether the visibility resolve can fetch the vertices of a scene draw
+    bool IsResolvable(const SceneDraw& draw) const;
+
+	// Rasterize draw / triangle IDs, then resolve them into the G-buffer
+    void RenderVisibilityBuffer(
+        gfxc::Camera* camera,
+        CubeMap* cubeMap,
+        AssetMap<Shader>& shaders,
+        AssetMap<Mesh>& meshes,
+        const glm::vec3& cameraPos);
+
 private:
     ////////////////////////////////////
     WindowObject* window;
-    std::unordered_map<std::string, Mesh*>* meshes;
+    AssetMap<Mesh>* meshes;
     /////////////////////////////////////
     glm::vec3 control_p0, control_p1, control_p2, control_p3;
     ////////////////////////////////////
     int light_type = 6;
+    int light_scale;
+    int particle_scale;
+    bool visibility_buffer;
+    bool depth_prepass;
+    bool cube_layered;
+    bool mesh_lods;
+    unsigned int sceneTriangles, fullTriangles;
+    float archer_angle;
+    std::vector<SceneDraw> sceneDraws;
+    std::vector<unsigned int> drawOrder;
+    int culling_mode;
+    OcclusionCulling* occlusionCulling;
+    std::vector<bool> drawVisible;
+    std::vector<bool> lightVisible;
+    unsigned int culledDraws, culledLights;
+    std::map<std::string, GPUTimer> passTimers;
+    TextureHandle groundTexture;
+    TextureHandle archerTexture;
     std::vector<Light> lights;
     FrameBuffer* frameBuffer;
     FrameBuffer* lightBuffer;
+    FrameBuffer* particleBuffer;
+    FrameBuffer* visibilityBuffer;
 	//FrameBuffer* reflectionBuffer;
     ////////////////////////////////////
 };
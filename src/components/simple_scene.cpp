@@ -6,6 +6,7 @@
 #include "components/camera_input.h"
 #include "components/scene_input.h"
 #include "components/transform.h"
+#include "core/gpu/frustum.h"
 
 using namespace gfxc;
 
@@ -53,8 +54,10 @@ void SimpleScene::InitResources()
     SceneInput *SI = new SceneInput(this);
     (void)SI;
 
-    xozPlane = new Mesh("plane");
-    xozPlane->LoadMesh(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::MODELS, "primitives"), "plane50.obj");
+    // Loaded on first use, the ground plane only when it's drawn
+    std::string shaderPath = PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS);
+    AssetRegistry::DeclareMesh("plane", PATH_JOIN(window->props.selfDir, RESOURCE_PATH::MODELS, "primitives"), "plane50.obj", false);
+    xozPlane = nullptr;
 
     {
         std::vector<VertexFormat> vertices =
@@ -69,41 +72,25 @@ void SimpleScene::InitResources()
         simpleLine->SetDrawMode(GL_LINES);
     }
 
-    // Create a shader program for drawing face polygon with the color of the normal
-    {
-        Shader *shader = new Shader("Simple");
-        shader->AddShader(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS, "MVP.Texture.VS.glsl"), GL_VERTEX_SHADER);
-        shader->AddShader(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS, "Default.FS.glsl"), GL_FRAGMENT_SHADER);
-        shader->CreateAndLink();
-        shaders[shader->GetName()] = shader;
-    }
+    // Shader program for drawing face polygon with the color of the normal
+    AssetRegistry::DeclareShader("Simple", {
+        { PATH_JOIN(shaderPath, "MVP.Texture.VS.glsl"), GL_VERTEX_SHADER },
+        { PATH_JOIN(shaderPath, "Default.FS.glsl"), GL_FRAGMENT_SHADER } });
 
-    // Create a shader program for drawing vertex colors
-    {
-        Shader *shader = new Shader("Color");
-        shader->AddShader(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS, "MVP.Texture.VS.glsl"), GL_VERTEX_SHADER);
-        shader->AddShader(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS, "Color.FS.glsl"), GL_FRAGMENT_SHADER);
-        shader->CreateAndLink();
-        shaders[shader->GetName()] = shader;
-    }
+    // Shader program for drawing vertex colors
+    AssetRegistry::DeclareShader("Color", {
+        { PATH_JOIN(shaderPath, "MVP.Texture.VS.glsl"), GL_VERTEX_SHADER },
+        { PATH_JOIN(shaderPath, "Color.FS.glsl"), GL_FRAGMENT_SHADER } });
 
-    // Create a shader program for drawing face polygon with the color of the normal
-    {
-        Shader *shader = new Shader("VertexNormal");
-        shader->AddShader(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS, "MVP.Texture.VS.glsl"), GL_VERTEX_SHADER);
-        shader->AddShader(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS, "Normals.FS.glsl"), GL_FRAGMENT_SHADER);
-        shader->CreateAndLink();
-        shaders[shader->GetName()] = shader;
-    }
+    // Shader program for drawing face polygon with the color of the normal
+    AssetRegistry::DeclareShader("VertexNormal", {
+        { PATH_JOIN(shaderPath, "MVP.Texture.VS.glsl"), GL_VERTEX_SHADER },
+        { PATH_JOIN(shaderPath, "Normals.FS.glsl"), GL_FRAGMENT_SHADER } });
 
-    // Create a shader program for drawing vertex colors
-    {
-        Shader *shader = new Shader("VertexColor");
-        shader->AddShader(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS, "MVP.Texture.VS.glsl"), GL_VERTEX_SHADER);
-        shader->AddShader(PATH_JOIN(window->props.selfDir, RESOURCE_PATH::SHADERS, "VertexColor.FS.glsl"), GL_FRAGMENT_SHADER);
-        shader->CreateAndLink();
-        shaders[shader->GetName()] = shader;
-    }
+    // Shader program for drawing vertex colors
+    AssetRegistry::DeclareShader("VertexColor", {
+        { PATH_JOIN(shaderPath, "MVP.Texture.VS.glsl"), GL_VERTEX_SHADER },
+        { PATH_JOIN(shaderPath, "VertexColor.FS.glsl"), GL_FRAGMENT_SHADER } });
 
     // Default rendering mode will use depth buffer
     glDepthMask(GL_TRUE);
@@ -144,7 +131,10 @@ void SimpleScene::DrawCoordinateSystem(const glm::mat4 & viewMatrix, const glm::
             objectModel->SetWorldPosition(glm::vec3(0));
             glUniformMatrix4fv(shader->loc_model_matrix, 1, GL_FALSE, glm::value_ptr(objectModel->GetModel()));
             glUniform3f(shader->GetUniformLocation("color"), 0.5f, 0.5f, 0.5f);
-            xozPlane->Render();
+            if (xozPlane == nullptr)
+                xozPlane = AssetRegistry::GetMesh("plane");
+            if (xozPlane)
+                xozPlane->Render();
         }
 
         glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
@@ -178,14 +168,16 @@ void SimpleScene::RenderMesh(Mesh * mesh, Shader * shader, glm::vec3 position, g
     if (!mesh || !shader || !shader->program)
         return;
 
+    glm::mat4 model(1);
+    model = glm::translate(model, position);
+    model = glm::scale(model, scale);
+    if (!IsMeshVisible(mesh, model))
+        return;
+
     // Render an object using the specified shader and the specified position
     shader->Use();
     glUniformMatrix4fv(shader->loc_view_matrix, 1, GL_FALSE, glm::value_ptr(camera->GetViewMatrix()));
     glUniformMatrix4fv(shader->loc_projection_matrix, 1, GL_FALSE, glm::value_ptr(camera->GetProjectionMatrix()));
-
-    glm::mat4 model(1);
-    model = glm::translate(model, position);
-    model = glm::scale(model, scale);
     glUniformMatrix4fv(shader->loc_model_matrix, 1, GL_FALSE, glm::value_ptr(model));
     mesh->Render();
 }
@@ -248,6 +240,9 @@ void SimpleScene::RenderMesh(Mesh * mesh, Shader * shader, const glm::mat4 & mod
     if (!mesh || !shader || !shader->program)
         return;
 
+    if (!IsMeshVisible(mesh, modelMatrix))
+        return;
+
     // Render an object using the specified shader and the specified position
     shader->Use();
     glUniformMatrix4fv(shader->loc_view_matrix, 1, GL_FALSE, glm::value_ptr(camera->GetViewMatrix()));
@@ -258,6 +253,14 @@ void SimpleScene::RenderMesh(Mesh * mesh, Shader * shader, const glm::mat4 & mod
 }
 
 
+bool SimpleScene::IsMeshVisible(const Mesh * mesh, const glm::mat4 & modelMatrix) const
+{
+    glm::vec3 boundsMin, boundsMax;
+    TransformBounds(mesh->GetBoundsMin(), mesh->GetBoundsMax(), modelMatrix, boundsMin, boundsMax);
+    return Frustum(camera).IsBoxVisible(boundsMin, boundsMax);
+}
+
+
 void SimpleScene::ReloadShaders() const
 {
     std::cout << std::endl;
@@ -268,7 +271,8 @@ void SimpleScene::ReloadShaders() const
 
     for (auto &shader : shaders)
     {
-        shader.second->Reload();
+        if (shader.second)
+            shader.second->Reload();
     }
 }
 
@@ -10,6 +10,7 @@
 #include "core/gpu/mesh.h"
 #include "core/gpu/shader.h"
 #include "core/gpu/texture2D.h"
+#include "core/managers/asset_registry.h"
 #include "core/managers/resource_path.h"
 #include "core/managers/texture_manager.h"
 
@@ -45,6 +46,9 @@ namespace gfxc
 
         virtual void RenderMesh(Mesh *mesh, Shader *shader, const glm::mat4 &modelMatrix);
 
+        // Frustum test of the mesh bounds, meshes without bounds are always visible
+        bool IsMeshVisible(const Mesh *mesh, const glm::mat4 &modelMatrix) const;
+
         Camera *GetSceneCamera() const;
         InputController *GetCameraInput() const;
 
@@ -55,8 +59,8 @@ namespace gfxc
         void Update(float deltaTimeSeconds) override;
 
         protected:
-        std::unordered_map<std::string, Mesh *> meshes;
-        std::unordered_map<std::string, Shader *> shaders;
+        AssetMap<Mesh> meshes;
+        AssetMap<Shader> shaders;
 
         /*
          * The OpenGL implementation of `glLineWidth` on Apple devices
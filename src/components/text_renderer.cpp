@@ -8,6 +8,8 @@
 ******************************************************************/
 #include "components/text_renderer.h"
 
+#include "core/managers/sampler_manager.h"
+
 #include <iostream>
 
 #include "utils/text_utils.h"
@@ -139,6 +141,8 @@ void gfxc::TextRenderer::RenderText(std::string text, GLfloat x, GLfloat y, GLfl
     glUniform3f(loc_text_color, color.r, color.g, color.b);
 
     glActiveTexture(GL_TEXTURE0);
+    // Glyphs are sampled with their own texture parameters
+    SamplerManager::BindSampler(GL_TEXTURE0, 0);
     glBindVertexArray(this->VAO);
 
     // Iterate through all characters
@@ -2,7 +2,10 @@
 
 #include <iostream>
 
+#include "core/managers/animator.h"
+#include "core/managers/asset_loader.h"
 #include "core/managers/texture_manager.h"
+#include "core/managers/texture_streamer.h"
 #include "utils/gl_utils.h"
 
 
@@ -26,6 +29,8 @@ WindowObject* Engine::Init(const WindowProperties & props)
         exit(0);
     }
 
+    AssetLoader::Init();
+    TextureStreamer::Init();
     TextureManager::Init(window->props.selfDir);
 
     return window;
@@ -42,6 +47,9 @@ void Engine::Exit()
 {
     std::cout << "=====================================================" << std::endl;
     std::cout << "Engine closed. Exit" << std::endl;
+    AssetLoader::Shutdown();
+    Animator::Shutdown();
+    TextureStreamer::Shutdown();
     glfwTerminate();
 }
 
@@ -11,6 +11,18 @@
 glm::vec4 FrameBuffer::defaultClearColor = glm::vec4(0);
 
 
+FrameBufferDesc FrameBufferDesc::Uniform(int nrTextures, bool hasDepthTexture, int precision)
+{
+    static const GLenum formats[] = { GL_RGBA8, GL_RGBA16, GL_RGBA16F, GL_RGBA32F };
+    precision = (precision / 8) * 8;
+
+    FrameBufferDesc desc;
+    desc.hasDepthTexture = hasDepthTexture;
+    desc.attachments.assign(nrTextures, FrameBufferAttachment(formats[precision / 8 - 1]));
+    return desc;
+}
+
+
 FrameBuffer::FrameBuffer()
 {
     FBO = 0;
@@ -31,16 +43,25 @@ void FrameBuffer::Clean()
 {
     if (FBO)
         glDeleteFramebuffers(1, &FBO);
+    FBO = 0;
     SAFE_FREE_ARRAY(textures);
     SAFE_FREE_ARRAY(DrawBuffers)
+    SAFE_FREE(depthTexture);
 }
 
 
 void FrameBuffer::Generate(int width, int height, int nrTextures, bool hasDepthTexture, int precision)
+{
+    Generate(width, height, FrameBufferDesc::Uniform(nrTextures, hasDepthTexture, precision));
+}
+
+
+void FrameBuffer::Generate(int width, int height, const FrameBufferDesc &desc)
 {
     Clean();
 
-    precision = (precision / 8) * 8;
+    int nrTextures = static_cast<int>(desc.attachments.size());
+    bool hasDepthTexture = desc.hasDepthTexture;
 
     #ifdef DEBUG_INFO
         cout << "FBO: " << width << " * " << height << " textures attached: " << nrTextures << endl;
@@ -49,6 +70,7 @@ void FrameBuffer::Generate(int width, int height, int nrTextures, bool hasDepthT
     this->width = width;
     this->height = height;
     this->nrTextures = nrTextures;
+    this->desc = desc;
 
     // Create FrameBufferObject
     glGenFramebuffers(1, &FBO);
@@ -65,7 +87,8 @@ void FrameBuffer::Generate(int width, int height, int nrTextures, bool hasDepthT
         textures = new Texture2D[nrTextures];
         for (int i = 0; i < nrTextures; i++)
         {
-            textures[i].CreateFrameBufferTexture(width, height, i, precision);
+            const FrameBufferAttachment &attachment = desc.attachments[i];
+            textures[i].CreateRenderTargetTexture(width, height, i, attachment.sizedFormat, attachment.minFilter, attachment.magFilter);
         }
 
         glDrawBuffers(nrTextures, DrawBuffers);
@@ -85,22 +108,38 @@ void FrameBuffer::Generate(int width, int height, int nrTextures, bool hasDepthT
 }
 
 
-void FrameBuffer::Resize(int width, int height, int precision)
+void FrameBuffer::Resize(int width, int height)
 {
     this->width = width;
     this->height = height;
-    precision = (precision / 8) * 8;
 
     glBindFramebuffer(GL_FRAMEBUFFER, FBO);
 
     for (unsigned int i = 0; i < nrTextures; i++)
     {
-        textures[i].CreateFrameBufferTexture(width, height, i, precision);
+        const FrameBufferAttachment &attachment = desc.attachments[i];
+        textures[i].CreateRenderTargetTexture(width, height, i, attachment.sizedFormat, attachment.minFilter, attachment.magFilter);
     }
 
     if (depthTexture) {
         depthTexture->CreateDepthBufferTexture(width, height);
     }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    CheckOpenGLError();
+}
+
+
+void FrameBuffer::Resize(int width, int height, int precision)
+{
+    FrameBufferDesc uniform = FrameBufferDesc::Uniform(nrTextures, desc.hasDepthTexture, precision);
+    for (unsigned int i = 0; i < nrTextures; i++)
+    {
+        uniform.attachments[i].clearValue = desc.attachments[i].clearValue;
+    }
+
+    desc = uniform;
+    Resize(width, height);
 }
 
 
@@ -109,8 +148,19 @@ void FrameBuffer::Bind(bool clearBuffer) const
     glBindFramebuffer(GL_FRAMEBUFFER, FBO);
     glViewport(0, 0, width, height);
     if (clearBuffer) {
-        glClearColor(clearColor.r, clearColor.g, clearColor.b, clearColor.a);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glClear(GL_DEPTH_BUFFER_BIT);
+
+        // Each attachment is cleared with its own value and in its own component type
+        for (unsigned int i = 0; i < nrTextures; i++)
+        {
+            const FrameBufferAttachment &attachment = desc.attachments[i];
+            if (Texture2D::IsIntegerFormat(attachment.sizedFormat)) {
+                glm::uvec4 value(attachment.clearValue);
+                glClearBufferuiv(GL_COLOR, i, glm::value_ptr(value));
+            } else {
+                glClearBufferfv(GL_COLOR, i, glm::value_ptr(attachment.clearValue));
+            }
+        }
     }
 }
 
@@ -124,6 +174,43 @@ void FrameBuffer::SendResolution(Shader *shader) const
 void FrameBuffer::SetClearColor(glm::vec4 clearColor)
 {
     this->clearColor = std::move(clearColor);
+    for (auto &attachment : desc.attachments)
+    {
+        attachment.clearValue = this->clearColor;
+    }
+}
+
+
+void FrameBuffer::SetClearValue(unsigned int index, glm::vec4 clearValue)
+{
+    if (index < desc.attachments.size())
+    {
+        desc.attachments[index].clearValue = clearValue;
+    }
+}
+
+
+const FrameBufferDesc &FrameBuffer::GetDescription() const
+{
+    return desc;
+}
+
+
+size_t FrameBuffer::GetMemorySize() const
+{
+    size_t texels = static_cast<size_t>(width) * height;
+    size_t bytes = 0;
+
+    for (const auto &attachment : desc.attachments)
+    {
+        bytes += texels * Texture2D::GetBytesPerPixel(attachment.sizedFormat);
+    }
+    if (depthTexture)
+    {
+        bytes += texels * Texture2D::GetBytesPerPixel(GL_DEPTH_COMPONENT32F);
+    }
+
+    return bytes;
 }
 
 
@@ -150,6 +237,17 @@ void FrameBuffer::BindDepthTexture(unsigned int TextureUnit) const
 }
 
 
+// Copies (and rescales) the depth buffer into target, leaves target bound
+void FrameBuffer::BlitDepth(const FrameBuffer *target) const
+{
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target->FBO);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, target->width, target->height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, target->FBO);
+    CheckOpenGLError();
+}
+
+
 Texture2D* FrameBuffer::GetTexture(unsigned int index) const
 {
     return &textures[index];
@@ -7,6 +7,34 @@
 #include "utils/glm_utils.h"
 
 
+// Description of a single color attachment
+struct FrameBufferAttachment
+{
+    FrameBufferAttachment(GLenum sizedFormat = GL_RGBA8,
+        GLenum minFilter = GL_LINEAR,
+        GLenum magFilter = GL_LINEAR,
+        glm::vec4 clearValue = glm::vec4(0, 0, 0, 1))
+        : sizedFormat(sizedFormat), minFilter(minFilter), magFilter(magFilter), clearValue(clearValue) { }
+
+    GLenum sizedFormat;
+    GLenum minFilter;
+    GLenum magFilter;
+    glm::vec4 clearValue;
+};
+
+
+// Layout of a framebuffer, kept by the FrameBuffer so that Resize() recreates the same targets
+struct FrameBufferDesc
+{
+    FrameBufferDesc() : hasDepthTexture(true) { }
+
+    static FrameBufferDesc Uniform(int nrTextures, bool hasDepthTexture = true, int precision = 32);
+
+    std::vector<FrameBufferAttachment> attachments;
+    bool hasDepthTexture;
+};
+
+
 class FrameBuffer
 {
  public:
@@ -14,12 +42,15 @@ class FrameBuffer
     ~FrameBuffer();
     void Clean();
     void Generate(int width, int height, int nrTextures, bool hasDepthTexture = true, int precision = 32);
-    void Resize(int width, int height, int precision = 32);
+    void Generate(int width, int height, const FrameBufferDesc &desc);
+    void Resize(int width, int height);
+    void Resize(int width, int height, int precision);
 
     void Bind(bool clearBuffer = true) const;
     void BindTexture(int textureID, unsigned int TextureUnit) const;
     void BindAllTextures() const;
     void BindDepthTexture(unsigned int TextureUnit) const;
+    void BlitDepth(const FrameBuffer *target) const;
 
     Texture2D* GetTexture(unsigned int index) const;
     Texture2D* GetDepthTexture() const;
@@ -30,6 +61,10 @@ class FrameBuffer
 
     void SendResolution(Shader *shader) const;
     void SetClearColor(glm::vec4 clearColor);
+    void SetClearValue(unsigned int index, glm::vec4 clearValue);
+
+    const FrameBufferDesc &GetDescription() const;
+    size_t GetMemorySize() const;
 
     static void Clear();
     static void BindDefault();
@@ -47,6 +82,7 @@ class FrameBuffer
     int width;
     int height;
     unsigned int nrTextures;
+    FrameBufferDesc desc;
     glm::vec4 clearColor;
     static glm::vec4 defaultClearColor;
 };
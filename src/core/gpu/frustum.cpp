@@ -0,0 +1,179 @@
+#include "core/gpu/frustum.h"
+
+#include "components/camera.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#   define FRUSTUM_SSE
+#   include <xmmintrin.h>
+#endif
+
+
+void TransformBounds(const glm::vec3 &localMin, const glm::vec3 &localMax, const glm::mat4 &model,
+                     glm::vec3 &worldMin, glm::vec3 &worldMax)
+{
+    worldMin = localMin;
+    worldMax = localMax;
+    if (localMin.x > localMax.x)
+        return;
+
+    // Arvo: the extent of every world axis is the sum of the absolute model axes
+    glm::vec3 center = glm::vec3(model * glm::vec4((localMin + localMax) * 0.5f, 1));
+    glm::vec3 extent = (localMax - localMin) * 0.5f;
+    glm::vec3 worldExtent =
+        glm::abs(glm::vec3(model[0])) * extent.x +
+        glm::abs(glm::vec3(model[1])) * extent.y +
+        glm::abs(glm::vec3(model[2])) * extent.z;
+
+    worldMin = center - worldExtent;
+    worldMax = center + worldExtent;
+}
+
+
+Frustum::Frustum()
+{
+    for (int i = 0; i < 6; i++)
+        planes[i] = glm::vec4(0, 0, 0, 1);
+}
+
+
+Frustum::Frustum(const glm::mat4 &viewProjection)
+{
+    Extract(viewProjection);
+}
+
+
+Frustum::Frustum(const gfxc::Camera *camera)
+{
+    Extract(camera->GetProjectionMatrix() * camera->GetViewMatrix());
+}
+
+
+void Frustum::Extract(const glm::mat4 &viewProjection)
+{
+    // Gribb & Hartmann, rows of the (column major) matrix
+    glm::vec4 row[4];
+    for (int i = 0; i < 4; i++)
+        row[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+    planes[0] = row[3] + row[0];
+    planes[1] = row[3] - row[0];
+    planes[2] = row[3] + row[1];
+    planes[3] = row[3] - row[1];
+    planes[4] = row[3] + row[2];
+    planes[5] = row[3] - row[2];
+
+    for (int i = 0; i < 6; i++)
+    {
+        float length = glm::length(glm::vec3(planes[i]));
+        if (length > 0)
+            planes[i] /= length;
+    }
+}
+
+
+bool Frustum::IsBoxVisible(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax) const
+{
+    if (boundsMin.x > boundsMax.x)
+        return true;
+
+    glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+    glm::vec3 extent = (boundsMax - boundsMin) * 0.5f;
+    for (int i = 0; i < 6; i++)
+    {
+        glm::vec3 normal = glm::vec3(planes[i]);
+        if (glm::dot(normal, center) + glm::dot(glm::abs(normal), extent) + planes[i].w < 0)
+            return false;
+    }
+    return true;
+}
+
+
+bool Frustum::IsSphereVisible(const glm::vec3 &center, float radius) const
+{
+    if (radius < 0)
+        return true;
+
+    for (int i = 0; i < 6; i++)
+    {
+        if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius)
+            return false;
+    }
+    return true;
+}
+
+
+size_t Frustum::CullBoxes(const glm::vec3 *boundsMin, const glm::vec3 *boundsMax, size_t count,
+                          unsigned char *visible) const
+{
+    size_t nrVisible = 0;
+
+    for (size_t first = 0; first < count; first += BATCH_SIZE)
+    {
+        // Center / extent of the batch in SoA layout, unknown boxes get a zero box and are forced visible
+        alignas(16) float cx[BATCH_SIZE], cy[BATCH_SIZE], cz[BATCH_SIZE];
+        alignas(16) float ex[BATCH_SIZE], ey[BATCH_SIZE], ez[BATCH_SIZE];
+        bool unknown[BATCH_SIZE];
+
+        for (unsigned int i = 0; i < BATCH_SIZE; i++)
+        {
+            size_t index = first + i;
+            unknown[i] = (index >= count) || (boundsMin[index].x > boundsMax[index].x);
+
+            glm::vec3 center(0), extent(0);
+            if (!unknown[i])
+            {
+                center = (boundsMin[index] + boundsMax[index]) * 0.5f;
+                extent = (boundsMax[index] - boundsMin[index]) * 0.5f;
+            }
+            cx[i] = center.x; cy[i] = center.y; cz[i] = center.z;
+            ex[i] = extent.x; ey[i] = extent.y; ez[i] = extent.z;
+        }
+
+        unsigned int outside = 0;
+#ifdef FRUSTUM_SSE
+        for (unsigned int half = 0; half < BATCH_SIZE; half += 4)
+        {
+            __m128 centerX = _mm_load_ps(cx + half), centerY = _mm_load_ps(cy + half), centerZ = _mm_load_ps(cz + half);
+            __m128 extentX = _mm_load_ps(ex + half), extentY = _mm_load_ps(ey + half), extentZ = _mm_load_ps(ez + half);
+            __m128 culled = _mm_setzero_ps();
+
+            for (int p = 0; p < 6; p++)
+            {
+                const glm::vec4 &plane = planes[p];
+                __m128 distance = _mm_set1_ps(plane.w);
+                distance = _mm_add_ps(distance, _mm_mul_ps(centerX, _mm_set1_ps(plane.x)));
+                distance = _mm_add_ps(distance, _mm_mul_ps(centerY, _mm_set1_ps(plane.y)));
+                distance = _mm_add_ps(distance, _mm_mul_ps(centerZ, _mm_set1_ps(plane.z)));
+                distance = _mm_add_ps(distance, _mm_mul_ps(extentX, _mm_set1_ps(glm::abs(plane.x))));
+                distance = _mm_add_ps(distance, _mm_mul_ps(extentY, _mm_set1_ps(glm::abs(plane.y))));
+                distance = _mm_add_ps(distance, _mm_mul_ps(extentZ, _mm_set1_ps(glm::abs(plane.z))));
+                culled = _mm_or_ps(culled, _mm_cmplt_ps(distance, _mm_setzero_ps()));
+            }
+
+            outside |= static_cast<unsigned int>(_mm_movemask_ps(culled)) << half;
+        }
+#else
+        for (int p = 0; p < 6; p++)
+        {
+            const glm::vec4 &plane = planes[p];
+            glm::vec3 absNormal = glm::abs(glm::vec3(plane));
+            for (unsigned int i = 0; i < BATCH_SIZE; i++)
+            {
+                float distance = plane.x * cx[i] + plane.y * cy[i] + plane.z * cz[i] + plane.w +
+                    absNormal.x * ex[i] + absNormal.y * ey[i] + absNormal.z * ez[i];
+                if (distance < 0)
+                    outside |= 1u << i;
+            }
+        }
+#endif
+
+        for (unsigned int i = 0; i < BATCH_SIZE && first + i < count; i++)
+        {
+            bool isVisible = unknown[i] || !(outside & (1u << i));
+            visible[first + i] = isVisible ? 1 : 0;
+            nrVisible += isVisible ? 1 : 0;
+        }
+    }
+
+    return nrVisible;
+}
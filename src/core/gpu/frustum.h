@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+
+#include "utils/glm_utils.h"
+
+
+namespace gfxc
+{
+    class Camera;
+}
+
+
+// World space AABB of a transformed object space AABB; inverted (unknown) boxes stay inverted
+void TransformBounds(const glm::vec3 &localMin, const glm::vec3 &localMax, const glm::mat4 &model,
+                     glm::vec3 &worldMin, glm::vec3 &worldMax);
+
+
+// The six planes of a view-projection volume, normals pointing inwards
+// Order: left, right, bottom, top, near, far
+class Frustum
+{
+ public:
+    Frustum();
+    explicit Frustum(const glm::mat4 &viewProjection);
+    explicit Frustum(const gfxc::Camera *camera);
+
+    void Extract(const glm::mat4 &viewProjection);
+    const glm::vec4 &GetPlane(int index) const { return planes[index]; }
+
+    // Conservative tests, inverted boxes and negative radii count as visible
+    bool IsBoxVisible(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax) const;
+    bool IsSphereVisible(const glm::vec3 &center, float radius) const;
+
+    // Tests count boxes, 8 per iteration, writing 1 (visible) or 0 (outside) to visible[i]
+    // Returns the number of visible boxes
+    size_t CullBoxes(const glm::vec3 *boundsMin, const glm::vec3 *boundsMax, size_t count,
+                     unsigned char *visible) const;
+
+ public:
+    static const unsigned int BATCH_SIZE = 8;
+
+ private:
+    glm::vec4 planes[6];
+};
@@ -1,6 +1,8 @@
 #include "core/gpu/gpu_buffers.h"
 #include "core/gpu/vertex_format.h"
 
+#include <cstddef>
+
 
 enum VERTEX_ATTRIBUTE_LOC
 {
@@ -8,15 +10,54 @@ enum VERTEX_ATTRIBUTE_LOC
     NORMAL,
     TEX_COORD,
     BONE,
-    WEIGHT
+    WEIGHT,
+    // VertexConstants of packed meshes, see gpu_utils::GetVertexDecodeSource
+    POSITION_TRANSFORM,
+    OCTAHEDRAL_NORMAL
 };
 
 
+// Constants of a float mesh: positions and normals read as they are
+static VertexConstants GetIdentityConstants()
+{
+    VertexConstants constants = {};
+    constants.positionTransform = glm::vec4(0, 0, 0, 1);
+    return constants;
+}
+
+
+// Fills the bound array buffer with the vertex data followed by the constants
+static void BufferVertexData(const void *data, size_t size, const VertexConstants &constants)
+{
+    glBufferData(GL_ARRAY_BUFFER, size + sizeof(constants), nullptr, GL_STATIC_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, data);
+    glBufferSubData(GL_ARRAY_BUFFER, size, sizeof(constants), &constants);
+}
+
+
+// Zero stride binding of the constants at offset in buffer, every vertex of the bound VAO reads the same values
+static void BindVertexConstants(GLuint buffer, size_t offset)
+{
+    glBindVertexBuffer(VERTEX_ATTRIBUTE_LOC::POSITION_TRANSFORM, buffer, offset, 0);
+    glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOC::POSITION_TRANSFORM);
+    glVertexAttribFormat(VERTEX_ATTRIBUTE_LOC::POSITION_TRANSFORM, 4, GL_FLOAT, GL_FALSE,
+                         offsetof(VertexConstants, positionTransform));
+    glVertexAttribBinding(VERTEX_ATTRIBUTE_LOC::POSITION_TRANSFORM, VERTEX_ATTRIBUTE_LOC::POSITION_TRANSFORM);
+    glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOC::OCTAHEDRAL_NORMAL);
+    glVertexAttribFormat(VERTEX_ATTRIBUTE_LOC::OCTAHEDRAL_NORMAL, 1, GL_FLOAT, GL_FALSE,
+                         offsetof(VertexConstants, octahedralNormal));
+    glVertexAttribBinding(VERTEX_ATTRIBUTE_LOC::OCTAHEDRAL_NORMAL, VERTEX_ATTRIBUTE_LOC::POSITION_TRANSFORM);
+}
+
+
 GPUBuffers::GPUBuffers()
 {
     m_size = 0;
     m_VAO = 0;
     memset(m_VBO, 0, 6 * sizeof(int));
+    m_streams = STREAMS_UNKNOWN;
+    m_hasTexCoords = false;
+    m_positionTransform = glm::vec4(0, 0, 0, 1);
 }
 
 
@@ -36,6 +77,8 @@ void GPUBuffers::ReleaseMemory()
         glDeleteBuffers(m_size, m_VBO);
         m_size = 0;
     }
+    m_streams = STREAMS_UNKNOWN;
+    m_hasTexCoords = false;
 }
 
 
@@ -45,13 +88,16 @@ GPUBuffers gpu_utils::UploadData(const std::vector<glm::vec3> &positions,
 {
     GPUBuffers buffers;
     buffers.CreateBuffers(3);
+    buffers.m_streams = GPUBuffers::STREAMS_SEPARATE;
     glBindVertexArray(buffers.m_VAO);
 
-    // Generate and populate the buffers with vertex attributes and the indices
+    // Generate and populate the buffers with vertex attributes and the indices, the positions followed by the
+    // constants every vertex reads
     glBindBuffer(GL_ARRAY_BUFFER, buffers.m_VBO[0]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(positions[0]) * positions.size(), &positions[0], GL_STATIC_DRAW);
+    BufferVertexData(&positions[0], sizeof(positions[0]) * positions.size(), GetIdentityConstants());
     glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOC::POS);
     glVertexAttribPointer(VERTEX_ATTRIBUTE_LOC::POS, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    BindVertexConstants(buffers.m_VBO[0], sizeof(positions[0]) * positions.size());
 
     glBindBuffer(GL_ARRAY_BUFFER, buffers.m_VBO[1]);
     glBufferData(GL_ARRAY_BUFFER, sizeof(normals[0]) * normals.size(), &normals[0], GL_STATIC_DRAW);
@@ -78,13 +124,17 @@ GPUBuffers gpu_utils::UploadData(const std::vector<glm::vec3> &positions,
     // Create the VAO
     GPUBuffers buffers;
     buffers.CreateBuffers(4);
+    buffers.m_streams = GPUBuffers::STREAMS_SEPARATE;
+    buffers.m_hasTexCoords = true;
     glBindVertexArray(buffers.m_VAO);
 
-    // Generate and populate the buffers with vertex attributes and the indices
+    // Generate and populate the buffers with vertex attributes and the indices, the positions followed by the
+    // constants every vertex reads
     glBindBuffer(GL_ARRAY_BUFFER, buffers.m_VBO[0]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(positions[0]) * positions.size(), &positions[0], GL_STATIC_DRAW);
+    BufferVertexData(&positions[0], sizeof(positions[0]) * positions.size(), GetIdentityConstants());
     glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOC::POS);
     glVertexAttribPointer(VERTEX_ATTRIBUTE_LOC::POS, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    BindVertexConstants(buffers.m_VBO[0], sizeof(positions[0]) * positions.size());
 
     glBindBuffer(GL_ARRAY_BUFFER, buffers.m_VBO[1]);
     glBufferData(GL_ARRAY_BUFFER, sizeof(normals[0]) * normals.size(), &normals[0], GL_STATIC_DRAW);
@@ -111,37 +161,54 @@ GPUBuffers gpu_utils::UploadData(const std::vector<glm::vec3>& positions,
     const std::vector<glm::vec2>& text_coords,
     const std::vector<VertexBoneData>& bones,
     const std::vector<unsigned int>& indices)
+{
+    return UploadData(positions.data(), normals.data(), text_coords.data(), bones.data(), positions.size(),
+                      indices.data(), indices.size());
+}
+
+
+GPUBuffers gpu_utils::UploadData(const glm::vec3 *positions,
+    const glm::vec3 *normals,
+    const glm::vec2 *text_coords,
+    const VertexBoneData *bones,
+    size_t nrVertices,
+    const unsigned int *indices,
+    size_t nrIndices)
 {
     // Create the VAO
     GPUBuffers buffers;
     buffers.CreateBuffers(5);
+    buffers.m_streams = GPUBuffers::STREAMS_SEPARATE;
+    buffers.m_hasTexCoords = true;
     glBindVertexArray(buffers.m_VAO);
 
-    // Generate and populate the buffers with vertex attributes and the indices
+    // Generate and populate the buffers with vertex attributes and the indices, the positions followed by the
+    // constants every vertex reads
     glBindBuffer(GL_ARRAY_BUFFER, buffers.m_VBO[0]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(positions[0]) * positions.size(), &positions[0], GL_STATIC_DRAW);
+    BufferVertexData(positions, sizeof(glm::vec3) * nrVertices, GetIdentityConstants());
     glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOC::POS);
     glVertexAttribPointer(VERTEX_ATTRIBUTE_LOC::POS, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    BindVertexConstants(buffers.m_VBO[0], sizeof(glm::vec3) * nrVertices);
 
     glBindBuffer(GL_ARRAY_BUFFER, buffers.m_VBO[1]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(normals[0]) * normals.size(), &normals[0], GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * nrVertices, normals, GL_STATIC_DRAW);
     glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOC::NORMAL);
     glVertexAttribPointer(VERTEX_ATTRIBUTE_LOC::NORMAL, 3, GL_FLOAT, GL_FALSE, 0, 0);
 
     glBindBuffer(GL_ARRAY_BUFFER, buffers.m_VBO[2]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(text_coords[0]) * text_coords.size(), &text_coords[0], GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec2) * nrVertices, text_coords, GL_STATIC_DRAW);
     glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOC::TEX_COORD);
     glVertexAttribPointer(VERTEX_ATTRIBUTE_LOC::TEX_COORD, 2, GL_FLOAT, GL_FALSE, 0, 0);
 
     glBindBuffer(GL_ARRAY_BUFFER, buffers.m_VBO[3]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(bones[0]) * bones.size(), &bones[0], GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(VertexBoneData) * nrVertices, bones, GL_STATIC_DRAW);
     glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOC::BONE);
     glVertexAttribIPointer(VERTEX_ATTRIBUTE_LOC::BONE, 4, GL_INT, sizeof(VertexBoneData), (const GLvoid*)0);
     glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOC::WEIGHT);
     glVertexAttribPointer(VERTEX_ATTRIBUTE_LOC::WEIGHT, 4, GL_FLOAT, GL_FALSE, sizeof(VertexBoneData), (const GLvoid*)16);
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.m_VBO[4]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices[0]) * indices.size(), &indices[0], GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * nrIndices, indices, GL_STATIC_DRAW);
 
     // Make sure the VAO is not changed from the outside
     glBindVertexArray(0);
@@ -157,11 +224,15 @@ GPUBuffers gpu_utils::UploadData(const std::vector<VertexFormat> &vertices,
         // Create the VAO
         GPUBuffers buffers;
         buffers.CreateBuffers(2);
+        buffers.m_streams = GPUBuffers::STREAMS_VERTEX_FORMAT;
+        buffers.m_hasTexCoords = true;
         glBindVertexArray(buffers.m_VAO);
 
-        // Generate and populate the buffers with vertex attributes and the indices
+        // Generate and populate the buffers with vertex attributes and the indices, the vertices followed by the
+        // constants every vertex reads
         glBindBuffer(GL_ARRAY_BUFFER, buffers.m_VBO[0]);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(vertices[0]) * vertices.size(), &vertices[0], GL_STATIC_DRAW);
+        BufferVertexData(&vertices[0], sizeof(vertices[0]) * vertices.size(), GetIdentityConstants());
+        BindVertexConstants(buffers.m_VBO[0], sizeof(vertices[0]) * vertices.size());
 
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(VertexFormat), 0);
@@ -184,3 +255,104 @@ GPUBuffers gpu_utils::UploadData(const std::vector<VertexFormat> &vertices,
 
         return buffers;
     }
+
+
+GPUBuffers gpu_utils::UploadData(const PackedVertices &vertices,
+                                 const unsigned int *indices,
+                                 size_t nrIndices)
+{
+    const VertexLayout &layout = vertices.layout;
+    const GLsizei stride = layout.GetStride();
+
+    VertexConstants constants = {};
+    constants.positionTransform = vertices.positionTransform;
+    constants.octahedralNormal = layout.normal == VertexLayout::NORMAL_OCTAHEDRAL ? 1.0f : 0.0f;
+
+    // Create the VAO
+    GPUBuffers buffers;
+    buffers.CreateBuffers(2);
+    buffers.m_streams = GPUBuffers::STREAMS_PACKED;
+    buffers.m_hasTexCoords = true;
+    buffers.m_layout = layout;
+    buffers.m_positionTransform = vertices.positionTransform;
+    glBindVertexArray(buffers.m_VAO);
+
+    // The vertices, then the constants every vertex reads
+    glBindBuffer(GL_ARRAY_BUFFER, buffers.m_VBO[0]);
+    BufferVertexData(vertices.data.data(), vertices.data.size(), constants);
+
+    glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOC::POS);
+    switch (layout.position)
+    {
+    case VertexLayout::POSITION_FLOAT:
+        glVertexAttribPointer(VERTEX_ATTRIBUTE_LOC::POS, 3, GL_FLOAT, GL_FALSE, stride, (const GLvoid*)0);
+        break;
+    case VertexLayout::POSITION_HALF:
+        glVertexAttribPointer(VERTEX_ATTRIBUTE_LOC::POS, 3, GL_HALF_FLOAT, GL_FALSE, stride, (const GLvoid*)0);
+        break;
+    case VertexLayout::POSITION_SNORM16:
+        glVertexAttribPointer(VERTEX_ATTRIBUTE_LOC::POS, 3, GL_SHORT, GL_TRUE, stride, (const GLvoid*)0);
+        break;
+    }
+
+    const GLvoid *normalOffset = (const GLvoid*)(size_t)layout.GetNormalOffset();
+    glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOC::NORMAL);
+    if (layout.normal == VertexLayout::NORMAL_FLOAT)
+        glVertexAttribPointer(VERTEX_ATTRIBUTE_LOC::NORMAL, 3, GL_FLOAT, GL_FALSE, stride, normalOffset);
+    else
+        glVertexAttribPointer(VERTEX_ATTRIBUTE_LOC::NORMAL, 2, GL_SHORT, GL_TRUE, stride, normalOffset);
+
+    const GLvoid *texCoordOffset = (const GLvoid*)(size_t)layout.GetTexCoordOffset();
+    glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOC::TEX_COORD);
+    switch (layout.texCoord)
+    {
+    case VertexLayout::TEX_COORD_FLOAT:
+        glVertexAttribPointer(VERTEX_ATTRIBUTE_LOC::TEX_COORD, 2, GL_FLOAT, GL_FALSE, stride, texCoordOffset);
+        break;
+    case VertexLayout::TEX_COORD_HALF:
+        glVertexAttribPointer(VERTEX_ATTRIBUTE_LOC::TEX_COORD, 2, GL_HALF_FLOAT, GL_FALSE, stride, texCoordOffset);
+        break;
+    case VertexLayout::TEX_COORD_UNORM16:
+        glVertexAttribPointer(VERTEX_ATTRIBUTE_LOC::TEX_COORD, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, texCoordOffset);
+        break;
+    }
+
+    // Without bones the two attributes stay disabled, reading as no bone and no weight
+    size_t bonesOffset = layout.GetBonesOffset();
+    if (layout.bones == VertexLayout::BONES_FLOAT)
+    {
+        glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOC::BONE);
+        glVertexAttribIPointer(VERTEX_ATTRIBUTE_LOC::BONE, 4, GL_INT, stride, (const GLvoid*)bonesOffset);
+        glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOC::WEIGHT);
+        glVertexAttribPointer(VERTEX_ATTRIBUTE_LOC::WEIGHT, 4, GL_FLOAT, GL_FALSE, stride, (const GLvoid*)(bonesOffset + 16));
+    }
+    else if (layout.bones == VertexLayout::BONES_UNORM8)
+    {
+        glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOC::BONE);
+        glVertexAttribIPointer(VERTEX_ATTRIBUTE_LOC::BONE, 4, GL_UNSIGNED_BYTE, stride, (const GLvoid*)bonesOffset);
+        glEnableVertexAttribArray(VERTEX_ATTRIBUTE_LOC::WEIGHT);
+        glVertexAttribPointer(VERTEX_ATTRIBUTE_LOC::WEIGHT, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (const GLvoid*)(bonesOffset + 4));
+    }
+
+    BindVertexConstants(buffers.m_VBO[0], vertices.data.size());
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.m_VBO[1]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * nrIndices, indices, GL_STATIC_DRAW);
+
+    // Make sure the VAO is not changed from the outside
+    glBindVertexArray(0);
+    CheckOpenGLError();
+
+    return buffers;
+}
+
+
+void gpu_utils::UploadIndices(const GPUBuffers &buffers, const void *data, size_t size)
+{
+    // The element array binding is VAO state
+    glBindVertexArray(buffers.m_VAO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.m_VBO[buffers.GetNumberOfBuffers() - 1]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
+    glBindVertexArray(0);
+    CheckOpenGLError();
+}
@@ -3,6 +3,7 @@
 #include <vector>
 
 #include "core/gpu/vertex_format.h"
+#include "core/gpu/vertex_layout.h"
 #include "utils/gl_utils.h"
 #include "utils/glm_utils.h"
 
@@ -12,15 +13,38 @@
 class GPUBuffers
 {
  public:
+    // Vertex streams behind m_VBO, recorded by every gpu_utils::UploadData
+    enum VertexStreams
+    {
+        // Nothing uploaded, or a VAO made elsewhere (Mesh::InitFromBuffer)
+        STREAMS_UNKNOWN,
+        // One float buffer per attribute: positions, normals, then texture coordinates and bones when present
+        STREAMS_SEPARATE,
+        // Interleaved VertexFormat
+        STREAMS_VERTEX_FORMAT,
+        // Interleaved PackedVertices, see m_layout
+        STREAMS_PACKED
+    };
+
     GPUBuffers();
 
     void CreateBuffers(unsigned int size);
     void ReleaseMemory();
 
+    // Vertex buffers (see m_streams) followed by the index buffer
+    unsigned int GetNumberOfBuffers() const { return m_size; }
+
  public:
     GLuint m_VAO;
     GLuint m_VBO[6];
 
+    VertexStreams m_streams;
+    bool m_hasTexCoords;
+
+    // Float unless uploaded from PackedVertices
+    VertexLayout m_layout;
+    glm::vec4 m_positionTransform;
+
  private:
     unsigned int m_size;
 };
@@ -43,6 +67,23 @@ namespace gpu_utils
                           const std::vector<VertexBoneData>& bones,
                           const std::vector<unsigned int>& indices);
 
+    // Same layout as above from raw streams (e.g. a mapped cache file)
+    GPUBuffers UploadData(const glm::vec3 *positions,
+                          const glm::vec3 *normals,
+                          const glm::vec2 *text_coords,
+                          const VertexBoneData *bones,
+                          size_t nrVertices,
+                          const unsigned int *indices,
+                          size_t nrIndices);
+
     GPUBuffers UploadData(const std::vector<VertexFormat> &vertices,
                           const std::vector<unsigned int>& indices);
+
+    // One interleaved buffer with the VertexConstants after the vertices
+    GPUBuffers UploadData(const PackedVertices &vertices,
+                          const unsigned int *indices,
+                          size_t nrIndices);
+
+    // Replaces the contents of the index buffer (the last one), e.g. with mixed 16 and 32 bit entries
+    void UploadIndices(const GPUBuffers &buffers, const void *data, size_t size);
 }   // namespace gpu_utils
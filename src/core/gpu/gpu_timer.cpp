@@ -0,0 +1,81 @@
+#include "core/gpu/gpu_timer.h"
+
+#include <cstring>
+
+
+GPUTimer::GPUTimer()
+{
+    glGenQueries(2 * LATENCY, &queries[0][0]);
+    memset(pending, 0, sizeof(pending));
+    current = 0;
+    milliseconds = 0;
+    average = 0;
+}
+
+
+GPUTimer::~GPUTimer()
+{
+    glDeleteQueries(2 * LATENCY, &queries[0][0]);
+}
+
+
+void GPUTimer::Begin()
+{
+    // Every slot is still in flight, drop this measurement rather than stall
+    if (pending[current])
+        Collect();
+    if (pending[current])
+        return;
+
+    glQueryCounter(queries[current][0], GL_TIMESTAMP);
+}
+
+
+void GPUTimer::End()
+{
+    if (pending[current])
+        return;
+
+    glQueryCounter(queries[current][1], GL_TIMESTAMP);
+    pending[current] = true;
+    current = (current + 1) % LATENCY;
+
+    Collect();
+}
+
+
+void GPUTimer::Collect()
+{
+    // Oldest first, stop at the first result that is not ready yet
+    for (unsigned int i = 0; i < LATENCY; i++)
+    {
+        unsigned int slot = (current + i) % LATENCY;
+        if (!pending[slot])
+            continue;
+
+        GLint available = 0;
+        glGetQueryObjectiv(queries[slot][1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+
+        GLuint64 start = 0, end = 0;
+        glGetQueryObjectui64v(queries[slot][0], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(queries[slot][1], GL_QUERY_RESULT, &end);
+        pending[slot] = false;
+
+        milliseconds = (end - start) / 1000000.0;
+        average = average == 0 ? milliseconds : average * 0.95 + milliseconds * 0.05;
+    }
+}
+
+
+double GPUTimer::GetMilliseconds() const
+{
+    return milliseconds;
+}
+
+
+double GPUTimer::GetAverageMilliseconds() const
+{
+    return average;
+}
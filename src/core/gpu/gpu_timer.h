@@ -0,0 +1,36 @@
+#pragma once
+
+#include "utils/gl_utils.h"
+
+
+// GPU time spent between Begin() and End(), measured with timestamp queries.
+// Results are read back a few frames later so the CPU never waits on the GPU.
+class GPUTimer
+{
+ public:
+    GPUTimer();
+    ~GPUTimer();
+
+    void Begin();
+    void End();
+
+    // Last resolved measurement and its exponential moving average, in milliseconds
+    double GetMilliseconds() const;
+    double GetAverageMilliseconds() const;
+
+ private:
+    GPUTimer(const GPUTimer &) = delete;
+    GPUTimer &operator=(const GPUTimer &) = delete;
+
+    void Collect();
+
+ private:
+    static const unsigned int LATENCY = 4;
+
+    GLuint queries[LATENCY][2];
+    bool pending[LATENCY];
+    unsigned int current;
+
+    double milliseconds;
+    double average;
+};
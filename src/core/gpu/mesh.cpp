@@ -1,5 +1,10 @@
 #include "core/gpu/mesh.h"
 
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <iostream>
+#include <sstream>
 #include <utility>
 
 #include "assimp/Importer.hpp"          // C++ importer interface
@@ -7,6 +12,11 @@
 
 #include "core/gpu/gpu_buffers.h"
 #include "core/gpu/texture2D.h"
+#include "core/managers/animator.h"
+#include "core/managers/mesh_cache.h"
+#include "core/managers/mesh_optimizer.h"
+#include "core/managers/mesh_simplifier.h"
+#include "core/managers/obj_loader.h"
 #include "core/managers/texture_manager.h"
 
 #include "utils/memory_utils.h"
@@ -20,8 +30,22 @@ Mesh::Mesh(std::string meshID)
     this->meshID = std::move(meshID);
 
     useMaterial = true;
+    compactIndices = false;
+    keepCpuData = false;
+    vertexLayout = VertexLayout::Compact();
     glDrawMode = GL_TRIANGLES;
     buffers = new GPUBuffers();
+
+    anim = nullptr;
+    rootNode = nullptr;
+    numAnim = 0;
+    cachedStreams = nullptr;
+    skeleton = nullptr;
+
+    boundsMin = glm::vec3(FLT_MAX);
+    boundsMax = glm::vec3(-FLT_MAX);
+    sphereCenter = glm::vec3(0);
+    sphereRadius = -1;
 }
 
 
@@ -30,9 +54,6 @@ Mesh::~Mesh()
     ClearData();
     meshEntries.clear();
     SAFE_FREE(buffers);
-
-    ClearAnimations(anim, numAnim);
-    ClearRootNode(rootNode);
 }
 
 
@@ -53,6 +74,12 @@ void Mesh::ClearData()
     for (unsigned int i = 0 ; i < materials.size() ; i++) {
         SAFE_FREE(materials[i]);
     }
+    materialTextures.clear();
+    SAFE_FREE(cachedStreams);
+    packedVertices = PackedVertices();
+    SAFE_FREE(skeleton);
+    ReleaseSceneCopies();
+    importReport.clear();
 
     positions.clear();
     texCoords.clear();
@@ -64,49 +91,40 @@ void Mesh::ClearData()
     m_BoneInfo.clear();
 }
 
-void Mesh::DeleteAnimationKeys(aiNodeAnim* nodeAnim) {
-    delete[] nodeAnim->mPositionKeys;
-    delete[] nodeAnim->mRotationKeys;
-    delete[] nodeAnim->mScalingKeys;
-}
-
 void Mesh::ClearAnimations(aiAnimation** animations, unsigned int numAnimations)
 {
+    // aiAnimation frees its channels and aiNodeAnim its keys
     for (unsigned int animIndex = 0; animIndex < numAnimations; ++animIndex) {
-        aiAnimation* animation = animations[animIndex];
-
-        for (unsigned int channelIndex = 0; channelIndex < animation->mNumChannels; ++channelIndex) {
-            DeleteAnimationKeys(animation->mChannels[channelIndex]);
-            delete animation->mChannels[channelIndex];
-        }
-
-        delete[] animation->mChannels;
-        delete animation;
+        delete animations[animIndex];
     }
 
     delete[] animations;
-}   
+}
 
 void Mesh::ClearRootNode(aiNode* node)
 {
-    for (unsigned int childIndex = 0; childIndex < node->mNumChildren; ++childIndex) {
-        ClearRootNode(node->mChildren[childIndex]);
-    }
-
-    // Release memory for mMeshes array
-    delete[] node->mMeshes;
-
-    // Release memory for mChildren array and the node itself
-    for (unsigned int childIndex = 0; childIndex < node->mNumChildren; ++childIndex) {
-        delete node->mChildren[childIndex];
-    }
-
-    delete[] node->mChildren;
+    // aiNode frees its mMeshes array and its children
     delete node;
 }
 
+void Mesh::ReleaseSceneCopies()
+{
+    ClearAnimations(anim, numAnim);
+    ClearRootNode(rootNode);
+    anim = nullptr;
+    rootNode = nullptr;
+    numAnim = 0;
+}
+
 bool Mesh::LoadMesh(const std::string& fileLocation,
     const std::string& fileName)
+{
+    return ImportMesh(fileLocation, fileName) && UploadMesh();
+}
+
+
+bool Mesh::ImportMesh(const std::string& fileLocation,
+    const std::string& fileName)
 {
     ClearData();
     this->fileLocation = fileLocation;
@@ -117,17 +135,212 @@ bool Mesh::LoadMesh(const std::string& fileLocation,
     unsigned int flags = aiProcess_GenSmoothNormals | aiProcess_FlipUVs;
     if (glDrawMode == GL_TRIANGLES) flags |= aiProcess_Triangulate;
 
-    const aiScene* pScene = Importer.ReadFile(file, flags);
+    // Repeat loads of an unchanged file skip the parse and the optimizer
+    uint64_t sourceHash = 0;
+    bool cacheable = MeshCache::IsEnabled() && MeshCache::HashFile(file, sourceHash);
+    if (cacheable && MeshCache::Load(this, file, sourceHash, flags))
+    {
+        PackVertices();
+        ReportPackedVertices();
+        Animator::BuildSkeleton(this);
+        ReleaseSceneCopies();
+        return true;
+    }
+
+    // Plain OBJ files skip the importer
+    bool imported = glDrawMode == GL_TRIANGLES && ObjLoader::IsObjFile(fileName) && ObjLoader::Load(this, file);
+    if (!imported)
+    {
+        const aiScene* pScene = Importer.ReadFile(file, flags);
+        // pScene is freed when returning because of Importer
+        if (!pScene) {
+            printf("Error parsing '%s': '%s'\n", file.c_str(), Importer.GetErrorString());
+            return false;
+        }
 
-    if (pScene) {
         m_GlobalInverseTransform = glm::inverse(ConvertMatrix(pScene->mRootNode->mTransformation));
-        return InitFromScene(pScene);
+        if (!InitFromScene(pScene))
+            return false;
+    }
+
+    // Stored optimized and with the levels of detail, cache hits skip both
+    MeshOptimizer::Optimize(this);
+    MeshSimplifier::GenerateLods(this);
+    if (cacheable)
+        MeshCache::Store(this, file, sourceHash, flags);
+    PackVertices();
+    ReportPackedVertices();
+    Animator::BuildSkeleton(this);
+    ReleaseSceneCopies();
+    return true;
+}
+
+
+bool Mesh::UploadMesh()
+{
+    if (useMaterial)
+    {
+        for (unsigned int i = 0; i < materials.size() && i < materialTextures.size(); i++)
+        {
+            if (materials[i] && !materialTextures[i].empty())
+                materials[i]->texture = TextureManager::StreamTexture(fileLocation, materialTextures[i].c_str());
+        }
+    }
+
+    buffers->ReleaseMemory();
+    const unsigned int *uploadIndices = cachedStreams ? cachedStreams->indices : indices.data();
+    size_t nrUploadIndices = cachedStreams ? cachedStreams->nrIndices : indices.size();
+
+    std::vector<unsigned char> packed;
+    bool compact = compactIndices && PackIndices(uploadIndices, nrUploadIndices, packed);
+    if (compact)
+        nrUploadIndices = 0;
+
+    // Kept CPU data uploaded again
+    if (vertexLayout.interleaved && packedVertices.nrVertices == 0)
+        PackVertices();
+
+    if (packedVertices.nrVertices)
+    {
+        *buffers = gpu_utils::UploadData(packedVertices, uploadIndices, nrUploadIndices);
+        packedVertices = PackedVertices();
+        SAFE_FREE(cachedStreams);
+    }
+    else if (cachedStreams)
+    {
+        // Straight from the mapped cache file, unmapped once the GL has its copy
+        *buffers = gpu_utils::UploadData(cachedStreams->positions, cachedStreams->normals, cachedStreams->texCoords,
+                                         cachedStreams->bones, cachedStreams->nrVertices, uploadIndices,
+                                         nrUploadIndices);
+        SAFE_FREE(cachedStreams);
+    }
+    else
+    {
+        *buffers = gpu_utils::UploadData(positions.data(), normals.data(), texCoords.data(), bones.data(),
+                                         positions.size(), uploadIndices, nrUploadIndices);
+    }
+
+    if (compact)
+        gpu_utils::UploadIndices(*buffers, packed.data(), packed.size());
+    if (!keepCpuData)
+        ReleaseCpuData();
+    CheckOpenGLError();
+    return buffers->m_VAO != 0;
+}
+
+
+void Mesh::PackVertices()
+{
+    packedVertices = PackedVertices();
+    if (!vertexLayout.interleaved)
+        return;
+
+    size_t nrVertices = cachedStreams ? cachedStreams->nrVertices : positions.size();
+    if (nrVertices == 0)
+        return;
+
+    if (cachedStreams)
+    {
+        gpu_utils::PackVertices(vertexLayout, cachedStreams->positions, cachedStreams->normals,
+                                cachedStreams->texCoords, cachedStreams->bones, nrVertices, packedVertices);
+    }
+    else
+    {
+        gpu_utils::PackVertices(vertexLayout, positions.data(),
+                                normals.size() == nrVertices ? normals.data() : nullptr,
+                                texCoords.size() == nrVertices ? texCoords.data() : nullptr,
+                                bones.size() == nrVertices ? bones.data() : nullptr,
+                                nrVertices, packedVertices);
+    }
+}
+
+
+void Mesh::ReportPackedVertices()
+{
+    if (packedVertices.nrVertices == 0)
+        return;
+
+    // Against the buffer per float attribute, bones included
+    const size_t floatSize = 2 * sizeof(glm::vec3) + sizeof(glm::vec2) + sizeof(VertexBoneData);
+    std::ostringstream report;
+    report << "Packed: " << packedVertices.nrVertices << " vertices, " << floatSize << " -> "
+           << packedVertices.layout.GetStride() << " bytes each";
+    importReport.push_back(report.str());
+}
+
+
+void Mesh::ReleaseCpuData()
+{
+    // Swapped out, clear() keeps the capacity
+    std::vector<glm::vec3>().swap(positions);
+    std::vector<glm::vec3>().swap(normals);
+    std::vector<glm::vec2>().swap(texCoords);
+    std::vector<VertexBoneData>().swap(bones);
+    std::vector<VertexFormat>().swap(vertices);
+    std::vector<unsigned int>().swap(indices);
+}
+
+
+bool Mesh::PackIndices(const unsigned int *indices, size_t nrIndices, std::vector<unsigned char> &packed)
+{
+    // 32 bit entries keep their place at the start, so their first index stays baseIndex. Levels of detail use the
+    // vertices of their entry and follow its index type
+    std::vector<bool> shortEntry(meshEntries.size(), false);
+    size_t end32 = 0, nrShort = 0;
+    for (size_t i = 0; i < meshEntries.size(); i++)
+    {
+        const MeshEntry &entry = meshEntries[i];
+        unsigned int maxIndex = 0;
+        size_t nrEntryIndices = 0, entryEnd = 0;
+        for (unsigned int lod = 0; lod < entry.GetNrLods(); lod++)
+        {
+            size_t base = entry.GetBaseIndex(lod), count = entry.GetNrIndices(lod);
+            if (base + count > nrIndices)
+                return false;
+
+            for (size_t j = 0; j < count; j++)
+            {
+                maxIndex = std::max(maxIndex, indices[base + j]);
+            }
+            nrEntryIndices += count;
+            entryEnd = std::max(entryEnd, base + count);
+        }
+
+        shortEntry[i] = entry.nrIndices > 0 && maxIndex <= 0xFFFF;
+        if (shortEntry[i])
+            nrShort += nrEntryIndices;
+        else
+            end32 = std::max(end32, entryEnd);
     }
 
-    // pScene is freed when returning because of Importer
+    if (nrShort == 0)
+        return false;
+
+    packed.resize(end32 * sizeof(unsigned int) + nrShort * sizeof(unsigned short));
+    memcpy(packed.data(), indices, end32 * sizeof(unsigned int));
+
+    unsigned short *shortIndices = reinterpret_cast<unsigned short *>(packed.data() + end32 * sizeof(unsigned int));
+    unsigned int nrPacked = 0;
+    for (size_t i = 0; i < meshEntries.size(); i++)
+    {
+        MeshEntry &entry = meshEntries[i];
+        if (!shortEntry[i])
+            continue;
+
+        entry.indexType = GL_UNSIGNED_SHORT;
+        for (unsigned int lod = 0; lod < entry.GetNrLods(); lod++)
+        {
+            unsigned int &firstIndex = lod ? entry.lods[lod - 1].packedFirstIndex : entry.packedFirstIndex;
+            firstIndex = static_cast<unsigned int>(end32 * 2) + nrPacked;
 
-    printf("Error parsing '%s': '%s'\n", file.c_str(), Importer.GetErrorString());
-    return false;
+            const unsigned int *source = indices + entry.GetBaseIndex(lod);
+            for (unsigned int j = 0; j < entry.GetNrIndices(lod); j++)
+            {
+                shortIndices[nrPacked++] = static_cast<unsigned short>(source[j]);
+            }
+        }
+    }
+    return true;
 }
 
 
@@ -139,6 +352,7 @@ void Mesh::InitFromData()
 
     M.nrIndices = (unsigned int)indices.size();
     meshEntries.push_back(M);
+    ComputeBounds();
 
     buffers->ReleaseMemory();
 }
@@ -212,6 +426,7 @@ bool Mesh::InitFromScene(const aiScene* pScene)
 
     meshEntries.resize(pScene->mNumMeshes);
     materials.resize(pScene->mNumMaterials);
+    materialTextures.resize(pScene->mNumMaterials);
 
     unsigned int nrVertices = 0;
     unsigned int nrIndices = 0;
@@ -241,13 +456,9 @@ bool Mesh::InitFromScene(const aiScene* pScene)
         const aiMesh* paiMesh = pScene->mMeshes[i];
         InitMesh(i, paiMesh);
     }
+    ComputeBounds();
 
-    if (useMaterial && !InitMaterials(pScene))
-        return false;
-
-    buffers->ReleaseMemory();
-    *buffers = gpu_utils::UploadData(positions, normals, texCoords, bones, indices);
-    return buffers->m_VAO != 0;
+    return !useMaterial || InitMaterials(pScene);
 }
 
 void Mesh::CopyAnimations(const aiScene* pScene)
@@ -299,7 +510,9 @@ void Mesh::CopyAnimations(const aiScene* pScene)
             anim[i]->mMeshChannels[j] = new aiMeshAnim();
             anim[i]->mMeshChannels[j]->mName = pScene->mAnimations[i]->mMeshChannels[j]->mName;
             anim[i]->mMeshChannels[j]->mNumKeys = pScene->mAnimations[i]->mMeshChannels[j]->mNumKeys;
-            anim[i]->mMeshChannels[j]->mKeys = new aiMeshKey(pScene->mAnimations[i]->mMeshChannels[j]->mKeys->mTime,
+            // Array allocated, aiMeshAnim frees it with delete[]
+            anim[i]->mMeshChannels[j]->mKeys = new aiMeshKey[1];
+            anim[i]->mMeshChannels[j]->mKeys[0] = aiMeshKey(pScene->mAnimations[i]->mMeshChannels[j]->mKeys->mTime,
                 pScene->mAnimations[i]->mMeshChannels[j]->mKeys->mValue);
         }
     }
@@ -408,12 +621,13 @@ bool Mesh::InitMaterials(const aiScene* pScene)
         const aiMaterial* pMaterial = pScene->mMaterials[i];
         materials[i] = new Material();
 
+        // Only the name here, the texture is requested by UploadMesh on the render thread
         if (pMaterial->GetTextureCount(aiTextureType_DIFFUSE) > 0)
         {
             aiString Path;
             if (pMaterial->GetTexture(aiTextureType_DIFFUSE, 0, &Path, NULL, NULL, NULL, NULL, NULL) == AI_SUCCESS)
             {
-                materials[i]->texture = TextureManager::LoadTexture(fileLocation, Path.data);
+                materialTextures[i] = Path.data;
             }
         }
 
@@ -430,7 +644,6 @@ bool Mesh::InitMaterials(const aiScene* pScene)
             memcpy((void *)&materials[i]->emissive, &color, sizeof(color));
     }
 
-    CheckOpenGLError();
     return ret;
 }
 
@@ -453,6 +666,80 @@ void Mesh::UseMaterials(bool value)
 }
 
 
+void Mesh::UseCompactIndices(bool value)
+{
+    compactIndices = value;
+}
+
+
+void Mesh::SetVertexLayout(const VertexLayout &layout)
+{
+    vertexLayout = layout;
+}
+
+
+void Mesh::KeepCpuData(bool value)
+{
+    keepCpuData = value;
+}
+
+
+void Mesh::ComputeBounds()
+{
+    boundsMin = glm::vec3(FLT_MAX);
+    boundsMax = glm::vec3(-FLT_MAX);
+
+    std::vector<glm::vec3> entryPositions;
+    for (auto &entry : meshEntries)
+    {
+        entryPositions.clear();
+        for (unsigned int i = entry.baseIndex; i < entry.baseIndex + entry.nrIndices && i < indices.size(); i++)
+        {
+            unsigned int vertex = entry.baseVertex + indices[i];
+            if (vertex < positions.size())
+                entryPositions.push_back(positions[vertex]);
+            else if (vertex < vertices.size())
+                entryPositions.push_back(vertices[vertex].position);
+        }
+
+        // Without CPU data the box stays inverted (min > max), meaning unknown bounds
+        entry.boundsMin = glm::vec3(FLT_MAX);
+        entry.boundsMax = glm::vec3(-FLT_MAX);
+        entry.sphereCenter = glm::vec3(0);
+        entry.sphereRadius = -1;
+        if (entryPositions.empty())
+            continue;
+
+        for (const auto &position : entryPositions)
+        {
+            entry.boundsMin = glm::min(entry.boundsMin, position);
+            entry.boundsMax = glm::max(entry.boundsMax, position);
+        }
+
+        // Centered on the box, tighter than its half diagonal
+        entry.sphereCenter = (entry.boundsMin + entry.boundsMax) * 0.5f;
+        entry.sphereRadius = 0;
+        for (const auto &position : entryPositions)
+            entry.sphereRadius = std::max(entry.sphereRadius, glm::distance(entry.sphereCenter, position));
+
+        boundsMin = glm::min(boundsMin, entry.boundsMin);
+        boundsMax = glm::max(boundsMax, entry.boundsMax);
+    }
+
+    sphereCenter = glm::vec3(0);
+    sphereRadius = -1;
+    if (boundsMin.x > boundsMax.x)
+        return;
+
+    sphereCenter = (boundsMin + boundsMax) * 0.5f;
+    for (const auto &entry : meshEntries)
+    {
+        if (entry.sphereRadius >= 0)
+            sphereRadius = std::max(sphereRadius, glm::distance(sphereCenter, entry.sphereCenter) + entry.sphereRadius);
+    }
+}
+
+
 void Mesh::Render() const
 {
     glBindVertexArray(buffers->m_VAO);
@@ -470,7 +757,7 @@ void Mesh::Render() const
         }
 
         glDrawElementsBaseVertex(glDrawMode, meshEntries[i].nrIndices,
-            GL_UNSIGNED_INT, (void*)(sizeof(unsigned int) * meshEntries[i].baseIndex),
+            meshEntries[i].indexType, meshEntries[i].GetIndexOffset(),
             meshEntries[i].baseVertex);
     }
     glBindVertexArray(0);
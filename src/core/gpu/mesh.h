@@ -7,9 +7,13 @@
 #include "core/gpu/vertex_format.h"
 #include "core/gpu/texture2D.h"
 #include "core/gpu/gpu_buffers.h"
+#include "core/gpu/vertex_layout.h"
 
 #include "assimp/scene.h"   // Output data structure
 
+struct MappedMeshStreams;
+struct Skeleton;
+
 class Material {
 public:
     Material() : texture(nullptr) {}
@@ -25,18 +29,87 @@ public:
 
 static const unsigned int INVALID_MATERIAL = std::numeric_limits<unsigned int>::max();
 
+// Simplified index list of an entry over the entry's own vertices, see MeshSimplifier
+class MeshLod {
+public:
+    MeshLod() : nrIndices(0), baseIndex(0), packedFirstIndex(0), error(0) {}
+
+    unsigned int nrIndices;
+    // Into the CPU indices, after the indices of every entry
+    unsigned int baseIndex;
+    unsigned int packedFirstIndex;
+    // Object space deviation from the full detail entry
+    float error;
+};
+
 class MeshEntry {
 public:
-     MeshEntry() : nrIndices(0), baseVertex(0), baseIndex(0), materialIndex(INVALID_MATERIAL) {}
+     MeshEntry() : nrIndices(0), baseVertex(0), baseIndex(0), materialIndex(INVALID_MATERIAL),
+         indexType(GL_UNSIGNED_INT), packedFirstIndex(0),
+         boundsMin(std::numeric_limits<float>::max()), boundsMax(-std::numeric_limits<float>::max()),
+         sphereCenter(0), sphereRadius(-1) {}
+
+    // Level 0 is the full detail entry, the simplified levels follow
+    unsigned int GetNrLods() const { return static_cast<unsigned int>(lods.size()) + 1; }
+    unsigned int GetNrIndices(unsigned int lod = 0) const { return lod ? lods[lod - 1].nrIndices : nrIndices; }
+    unsigned int GetBaseIndex(unsigned int lod = 0) const { return lod ? lods[lod - 1].baseIndex : baseIndex; }
+
+    // First index in the GPU index buffer, in elements of indexType, and its byte offset for glDrawElements*
+    unsigned int GetFirstIndex(unsigned int lod = 0) const
+    {
+        if (indexType != GL_UNSIGNED_SHORT)
+            return GetBaseIndex(lod);
+        return lod ? lods[lod - 1].packedFirstIndex : packedFirstIndex;
+    }
+    const void *GetIndexOffset(unsigned int lod = 0) const
+    {
+        return reinterpret_cast<const void *>(static_cast<size_t>(GetFirstIndex(lod)) *
+                                              (indexType == GL_UNSIGNED_SHORT ? 2 : 4));
+    }
+
+    // Coarsest level whose error stays under maxPixelError pixels while the bounding sphere covers
+    // screenDiameter pixels
+    unsigned int SelectLod(float screenDiameter, float maxPixelError) const
+    {
+        unsigned int lod = 0;
+        if (sphereRadius <= 0)
+            return lod;
+
+        float pixelsPerUnit = screenDiameter / (2 * sphereRadius);
+        while (lod < lods.size() && lods[lod].error * pixelsPerUnit <= maxPixelError)
+            lod++;
+        return lod;
+    }
 
     unsigned int nrIndices;
     unsigned int baseVertex;
+    // Into the CPU indices, which are always 32 bit
     unsigned int baseIndex;
     unsigned int materialIndex;
+
+    // GL_UNSIGNED_SHORT when UploadMesh packed the entry's indices to 16 bits, see Mesh::UseCompactIndices
+    GLenum indexType;
+    unsigned int packedFirstIndex;
+
+    // Object space AABB of the vertices referenced by this entry, inverted when unknown
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+
+    // Bounding sphere around the AABB center, negative radius when unknown
+    glm::vec3 sphereCenter;
+    float sphereRadius;
+
+    // Coarser levels, increasing error
+    std::vector<MeshLod> lods;
 };
 
 class Mesh {
     typedef unsigned int GLenum;
+    friend class MeshCache;
+    friend class ObjLoader;
+    friend class MeshOptimizer;
+    friend class MeshSimplifier;
+    friend class Animator;
 
  public:
     explicit Mesh(std::string meshID);
@@ -66,8 +139,25 @@ class Mesh {
     bool LoadMesh(const std::string& fileLocation,
                   const std::string& fileName);
 
+    // The two halves of LoadMesh. ImportMesh reads the mesh cache or parses, optimizes and simplifies the file
+    // (plain OBJ natively, anything else with Assimp) without touching GL and may run on a loader thread,
+    // UploadMesh creates the buffers and requests the textures on the render thread
+    bool ImportMesh(const std::string& fileLocation,
+                    const std::string& fileName);
+    bool UploadMesh();
+
     glm::mat4 ConvertMatrix(const aiMatrix4x4& aiMat);
     void UseMaterials(bool value);
+    // Entries with few enough vertices get 16 bit indices at upload. Only for meshes drawn through MeshEntry's
+    // index type and offset. The visibility buffer resolve reads the index buffer as 32 bit, so those entries
+    // skip it and are drawn into the G-buffer directly
+    void UseCompactIndices(bool value);
+    // Storage of the imported vertices on the GPU, VertexLayout::Compact unless set before the import. Shaders
+    // drawing the mesh go through DecodePosition and DecodeNormal
+    void SetVertexLayout(const VertexLayout &layout);
+    // Keeps the CPU copy of the vertices and indices after UploadMesh, e.g. for ComputeBounds. Released by default,
+    // the GPU buffers and the entries are all that's drawn
+    void KeepCpuData(bool value);
 
     // GL_POINTS, GL_TRIANGLES, GL_LINES, GL_LINE_STRIP, GL_LINE_LOOP, GL_LINE_STRIP_ADJACENCY, GL_LINES_ADJACENCY,
     // GL_TRIANGLE_STRIP, GL_TRIANGLE_FAN, GL_TRIANGLE_STRIP_ADJACENCY, GL_TRIANGLES_ADJACENCY
@@ -76,11 +166,31 @@ class Mesh {
 
     void Render() const;
 
+    // Recompute the bounds of the mesh and of every entry from the CPU copy of the vertex data, see KeepCpuData
+    void ComputeBounds();
+
+    // Bounds of all the entries, in object space
+    const glm::vec3& GetBoundsMin() const { return boundsMin; }
+    const glm::vec3& GetBoundsMax() const { return boundsMax; }
+    const glm::vec3& GetSphereCenter() const { return sphereCenter; }
+    float GetSphereRadius() const { return sphereRadius; }
+
     const GPUBuffers* GetBuffers() const;
+    // Flattened bones and animations for Animator, nullptr when the mesh has no animated bones
+    const Skeleton* GetSkeleton() const { return skeleton; }
     const char* GetMeshID() const;
+    // One line per import step that reshaped the mesh, printed under it by the asset report
+    const std::vector<std::string>& GetImportReport() const { return importReport; }
 
  protected:
     void InitFromData();
+    // Index buffer contents with the compact entries packed after the 32 bit ones, empty when none qualifies
+    bool PackIndices(const unsigned int *indices, size_t nrIndices, std::vector<unsigned char> &packed);
+    // Interleaved vertices of the imported streams (CPU copy or mapped cache file) for UploadMesh
+    void PackVertices();
+    // Size saving of the packed vertices, once per import: UploadMesh packs kept CPU data again
+    void ReportPackedVertices();
+    void ReleaseCpuData();
 
     void InitMesh(int index, const aiMesh* paiMesh);
     void LoadBones(int MeshIndex, const aiMesh* pMesh);
@@ -90,9 +200,10 @@ class Mesh {
     aiNode* CopyRoot(const aiNode* sourceNode);
     void CopyAnimations(const aiScene* pScene);
 
-    void DeleteAnimationKeys(aiNodeAnim* nodeAnim);
     void ClearAnimations(aiAnimation** animations, unsigned int numAnimations);
     void ClearRootNode(aiNode* node);
+    // The node tree and animations copied from the scene, once the skeleton and the mesh cache are built from them
+    void ReleaseSceneCopies();
 
  private:
     std::string meshID;
@@ -122,10 +233,27 @@ class Mesh {
     std::vector<Material*> materials;
     std::vector<MeshEntry> meshEntries;
     bool useMaterial;
+    bool compactIndices;
+    bool keepCpuData;
+    VertexLayout vertexLayout;
 
  protected:
     std::string fileLocation;
+    // Diffuse texture of each material, resolved by UploadMesh
+    std::vector<std::string> materialTextures;
+    // Streams of a mesh cache hit waiting for UploadMesh
+    MappedMeshStreams* cachedStreams;
+    // Staging copy for UploadMesh when the layout is interleaved
+    PackedVertices packedVertices;
+    Skeleton* skeleton;
+    // Written by the thread importing the mesh, single lines so concurrent loads don't interleave on stdout
+    std::vector<std::string> importReport;
 
     GLenum glDrawMode;
     GPUBuffers* buffers;
+
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    glm::vec3 sphereCenter;
+    float sphereRadius;
 };
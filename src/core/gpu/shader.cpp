@@ -3,6 +3,8 @@
 #include <fstream>
 #include <iostream>
 
+#include "core/gpu/vertex_layout.h"
+
 
 Shader::Shader(const std::string &name)
 {
@@ -129,13 +131,29 @@ void Shader::AddShaderCode(const std::string &shaderCode, GLenum shaderType)
 }
 
 
+bool Shader::ReadShaderFiles()
+{
+    for (auto &S : shaderFiles) {
+        if (!ReadShaderFile(S.file, S.code)) {
+            std::cout << "\tCould not open file: " << S.file << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+
+static std::string InjectDefines(const std::string &shaderCode, GLenum shaderType);
+
+
 unsigned int Shader::CreateAndLink()
 {
     std::vector<unsigned int> shaders;
 
-    // Compile shaders
-    for (auto S : shaderFiles) {
-        auto shaderID = Shader::CreateShader(S.file, S.type);
+    // Compile shaders, from the file contents read ahead when there are any (a Reload reads the files again)
+    for (auto &S : shaderFiles) {
+        auto shaderID = S.code.empty() ? Shader::CreateShader(S.file, S.type) : Shader::CompileShader(InjectDefines(S.code, S.type), S.type);
+        S.code.clear();
         if (shaderID) {
             shaders.push_back(shaderID);
         } else {
@@ -177,10 +195,36 @@ void Shader::ClearShaders()
 }
 
 
-static std::string InjectDefines(const std::string &shaderCode)
+// Packed mesh decoding for vertex shaders, after the leading preprocessor lines (#extension must come before any
+// declaration) and followed by a #line so compile errors keep the line numbers of the file
+static std::string InjectVertexDecode(const std::string &shaderCode)
 {
-    std::string defines;
     size_t pos = shaderCode.find_first_of("\n");
+    unsigned int line = 2;
+    while (pos != std::string::npos)
+    {
+        size_t start = shaderCode.find_first_not_of(" \t\r", pos + 1);
+        if (start == std::string::npos)
+            return shaderCode;
+        if (shaderCode[start] != '#' && shaderCode[start] != '\n' && shaderCode.compare(start, 2, "//") != 0)
+            break;
+
+        pos = shaderCode.find_first_of("\n", pos + 1);
+        line++;
+    }
+    if (pos == std::string::npos)
+        return shaderCode;
+
+    return shaderCode.substr(0, pos + 1) + gpu_utils::GetVertexDecodeSource() + "#line " + std::to_string(line) +
+        "\n" + shaderCode.substr(pos + 1, std::string::npos);
+}
+
+
+static std::string InjectDefines(const std::string &shaderCode, GLenum shaderType)
+{
+    std::string defines;
+    std::string code = shaderType == GL_VERTEX_SHADER ? InjectVertexDecode(shaderCode) : shaderCode;
+    size_t pos = code.find_first_of("\n");
 
 #ifdef SOLVED
     defines += "\n#define SOLVED";
@@ -188,33 +232,43 @@ static std::string InjectDefines(const std::string &shaderCode)
 
     if (pos == std::string::npos)
     {
-        return shaderCode + defines;
+        return code + defines;
     }
 
-    return shaderCode.substr(0, pos) + defines + shaderCode.substr(pos, std::string::npos);
+    return code.substr(0, pos) + defines + code.substr(pos, std::string::npos);
 }
 
 
-unsigned int Shader::CreateShader(const std::string &shaderFile, GLenum shaderType)
+bool Shader::ReadShaderFile(const std::string &shaderFile, std::string &shaderCode)
 {
-    std::string shader_code;
     std::ifstream file(shaderFile.c_str(), std::ios::in);
 
     if (!file.good()) {
-        std::cout << "\tCould not open file: " << shaderFile << std::endl;
-        std::terminate();
+        return false;
     }
 
-    std::cout << "\tFILE = " << shaderFile;
-
     // Get file content
     file.seekg(0, std::ios::end);
-    shader_code.resize((unsigned int)file.tellg());
+    shaderCode.resize((unsigned int)file.tellg());
     file.seekg(0, std::ios::beg);
-    file.read(&shader_code[0], shader_code.size());
+    file.read(&shaderCode[0], shaderCode.size());
     file.close();
+    return true;
+}
+
+
+unsigned int Shader::CreateShader(const std::string &shaderFile, GLenum shaderType)
+{
+    std::string shader_code;
+
+    if (!ReadShaderFile(shaderFile, shader_code)) {
+        std::cout << "\tCould not open file: " << shaderFile << std::endl;
+        std::terminate();
+    }
+
+    std::cout << "\tFILE = " << shaderFile;
 
-    return CompileShader(InjectDefines(shader_code), shaderType);
+    return CompileShader(InjectDefines(shader_code, shaderType), shaderType);
 }
 
 
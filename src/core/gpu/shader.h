@@ -26,6 +26,8 @@ class Shader
 
     void AddShader(const std::string &shaderFile, GLenum shaderType);
     void AddShaderCode(const std::string &shaderCode, GLenum shaderType);
+    // Reads the files added with AddShader ahead of CreateAndLink. No GL calls, may run on a loader thread
+    bool ReadShaderFiles();
     void ClearShaders();
     unsigned int CreateAndLink();
 
@@ -36,6 +38,7 @@ class Shader
 
  private:
     void GetUniforms();
+    static bool ReadShaderFile(const std::string &shaderFile, std::string &shaderCode);
     static unsigned int CreateShader(const std::string &shaderFile, GLenum shaderType);
     static unsigned int CompileShader(const std::string shaderCode, GLenum shaderType);
     static unsigned int CreateProgram(const std::vector<unsigned int> &shaderObjects);
@@ -74,6 +77,8 @@ class Shader
     {
         std::string file;
         GLenum type;
+        // Contents read by ReadShaderFiles, consumed by the next CreateAndLink
+        std::string code;
     };
 
     std::string shaderName;
@@ -8,8 +8,14 @@
 #include "stb/stb_image.h"
 #include "stb/stb_image_write.h"
 
+#include "core/managers/sampler_manager.h"
+#include "core/managers/texture_cache.h"
+#include "utils/image_utils.h"
 #include "utils/memory_utils.h"
 
+#include <algorithm>
+#include <cmath>
+
 
 void write_image_thread(const char* fileName, unsigned int width, unsigned int height, unsigned int channels, const unsigned char *data)
 {
@@ -27,6 +33,9 @@ const GLint internalFormat[][5] = {
 };
 
 
+unsigned int Texture2D::currentFrame = 0;
+
+
 Texture2D::Texture2D()
 {
     width = 0;
@@ -36,9 +45,15 @@ Texture2D::Texture2D()
     bitsPerPixel = 8;
     cacheInMemory = false;
     targetType = GL_TEXTURE_2D;
+    sizedFormat = GL_RGBA8;
     wrappingMode = GL_REPEAT;
     textureMinFilter = GL_LINEAR;
     textureMagFilter = GL_LINEAR;
+    sharedSampler = false;
+    sampler = 0;
+    nrLevels = 1;
+    placeholder = nullptr;
+    lastBindFrame = 0;
 }
 
 
@@ -52,6 +67,204 @@ GLuint Texture2D::GetTextureID() const
 }
 
 
+GLenum Texture2D::GetInternalFormat() const
+{
+    return sizedFormat;
+}
+
+
+void Texture2D::SetPlaceholder(const Texture2D *texture)
+{
+    placeholder = texture;
+}
+
+
+bool Texture2D::IsResident() const
+{
+    return placeholder == nullptr && textureID != 0;
+}
+
+
+size_t Texture2D::GetMemorySize() const
+{
+    if (!textureID)
+        return 0;
+
+    size_t bytes = 0;
+    for (int level = 0; level < nrLevels; level++)
+    {
+        int levelWidth = std::max(static_cast<int>(width) >> level, 1);
+        int levelHeight = std::max(static_cast<int>(height) >> level, 1);
+        bytes += IsCompressedFormat(sizedFormat) ? image_utils::GetBlockCompressedSize(levelWidth, levelHeight, channels)
+            : static_cast<size_t>(levelWidth) * levelHeight * GetBytesPerPixel(sizedFormat);
+    }
+    return targetType == GL_TEXTURE_CUBE_MAP ? bytes * 6 : bytes;
+}
+
+
+bool Texture2D::DropTopLevel()
+{
+    // Only image textures: render targets are attached by name and have a single level
+    if (!textureID || placeholder || !sharedSampler || targetType != GL_TEXTURE_2D || nrLevels < 2)
+        return false;
+
+    unsigned int newWidth = std::max(width / 2, 1u);
+    unsigned int newHeight = std::max(height / 2, 1u);
+
+    GLuint newTextureID = 0;
+    glGenTextures(1, &newTextureID);
+    glBindTexture(targetType, newTextureID);
+    glTexStorage2D(targetType, nrLevels - 1, sizedFormat, newWidth, newHeight);
+    glBindTexture(targetType, 0);
+
+    for (int level = 1; level < nrLevels; level++)
+    {
+        int levelWidth = std::max(static_cast<int>(width) >> level, 1);
+        int levelHeight = std::max(static_cast<int>(height) >> level, 1);
+        glCopyImageSubData(textureID, targetType, level, 0, 0, 0,
+                           newTextureID, targetType, level - 1, 0, 0, 0, levelWidth, levelHeight, 1);
+    }
+
+    glDeleteTextures(1, &textureID);
+    textureID = newTextureID;
+    width = newWidth;
+    height = newHeight;
+    nrLevels--;
+    CheckOpenGLError();
+    return true;
+}
+
+
+void Texture2D::Unload(const Texture2D *placeholder)
+{
+    if (textureID)
+    {
+        glDeleteTextures(1, &textureID);
+        textureID = 0;
+    }
+    this->placeholder = placeholder;
+}
+
+
+void Texture2D::AdvanceFrame()
+{
+    currentFrame++;
+}
+
+
+unsigned int Texture2D::GetCurrentFrame()
+{
+    return currentFrame;
+}
+
+
+unsigned int Texture2D::GetLastBindFrame() const
+{
+    return lastBindFrame;
+}
+
+
+GLuint Texture2D::GetSampler() const
+{
+    return sampler;
+}
+
+
+GLenum Texture2D::GetPixelFormat(GLenum sizedFormat)
+{
+    switch (sizedFormat)
+    {
+    case GL_R8: case GL_R16: case GL_R16F: case GL_R32F:
+        return GL_RED;
+    case GL_RG8: case GL_RG16: case GL_RG16F: case GL_RG32F:
+        return GL_RG;
+    case GL_RGB8: case GL_RGB16: case GL_RGB16F: case GL_RGB32F: case GL_R11F_G11F_B10F:
+        return GL_RGB;
+    case GL_R32UI: case GL_R32I:
+        return GL_RED_INTEGER;
+    case GL_RG32UI: case GL_RG32I:
+        return GL_RG_INTEGER;
+    case GL_RGBA32UI: case GL_RGBA32I:
+        return GL_RGBA_INTEGER;
+    case GL_DEPTH_COMPONENT16: case GL_DEPTH_COMPONENT24: case GL_DEPTH_COMPONENT32F:
+        return GL_DEPTH_COMPONENT;
+    default:
+        return GL_RGBA;
+    }
+}
+
+
+GLenum Texture2D::GetPixelType(GLenum sizedFormat)
+{
+    switch (sizedFormat)
+    {
+    case GL_R32UI: case GL_RG32UI: case GL_RGBA32UI:
+        return GL_UNSIGNED_INT;
+    case GL_R32I: case GL_RG32I: case GL_RGBA32I:
+        return GL_INT;
+    case GL_R16F: case GL_RG16F: case GL_RGB16F: case GL_RGBA16F:
+    case GL_R32F: case GL_RG32F: case GL_RGB32F: case GL_RGBA32F:
+    case GL_R11F_G11F_B10F: case GL_DEPTH_COMPONENT32F:
+        return GL_FLOAT;
+    default:
+        return GL_UNSIGNED_BYTE;
+    }
+}
+
+
+unsigned int Texture2D::GetBytesPerPixel(GLenum sizedFormat)
+{
+    switch (sizedFormat)
+    {
+    case GL_R8:
+        return 1;
+    case GL_R16: case GL_R16F: case GL_RG8: case GL_DEPTH_COMPONENT16:
+        return 2;
+    case GL_RGB8:
+        return 3;
+    case GL_R32F: case GL_R32UI: case GL_R32I: case GL_RG16: case GL_RG16F: case GL_RGBA8:
+    case GL_RGB10_A2: case GL_R11F_G11F_B10F: case GL_DEPTH_COMPONENT24: case GL_DEPTH_COMPONENT32F:
+        return 4;
+    case GL_RGB16: case GL_RGB16F:
+        return 6;
+    case GL_RG32F: case GL_RG32UI: case GL_RG32I: case GL_RGBA16: case GL_RGBA16F:
+        return 8;
+    case GL_RGB32F:
+        return 12;
+    case GL_RGBA32F: case GL_RGBA32UI: case GL_RGBA32I:
+        return 16;
+    default:
+        return 4;
+    }
+}
+
+
+bool Texture2D::IsIntegerFormat(GLenum sizedFormat)
+{
+    GLenum format = GetPixelFormat(sizedFormat);
+    return format == GL_RED_INTEGER || format == GL_RG_INTEGER || format == GL_RGBA_INTEGER;
+}
+
+
+bool Texture2D::IsCompressedFormat(GLenum sizedFormat)
+{
+    switch (sizedFormat)
+    {
+    case GL_COMPRESSED_RED_RGTC1: case GL_COMPRESSED_RG_RGTC2:
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+
+GLenum Texture2D::GetImageFormat(unsigned int channels)
+{
+    return internalFormat[0][channels];
+}
+
+
 void Texture2D::Init(GLuint gpuTextureID, unsigned int width, unsigned int height, unsigned int channels)
 {
     this->textureID = gpuTextureID;
@@ -63,6 +276,12 @@ void Texture2D::Init(GLuint gpuTextureID, unsigned int width, unsigned int heigh
 
 bool Texture2D::Load2D(const char *fileName, GLenum wrapping_mode)
 {
+    // Baked block compressed mips, unless the decoded pixels have to stay in memory
+    if (cacheInMemory == false && TextureCache::IsEnabled() && LoadCompressed(fileName, wrapping_mode))
+    {
+        return true;
+    }
+
     int width, height, chn;
     imageData = stbi_load(fileName, &width, &height, &chn, 0);
 
@@ -80,9 +299,14 @@ bool Texture2D::Load2D(const char *fileName, GLenum wrapping_mode)
 
     textureMinFilter = GL_LINEAR_MIPMAP_LINEAR;
     wrappingMode = wrapping_mode;
+    sharedSampler = true;
 
+    // Immutable storage with the full mip chain, built once here
+    sizedFormat = internalFormat[0][chn];
+    nrLevels = 1 + static_cast<int>(std::floor(std::log2(static_cast<float>(std::max(width, height)))));
     Init2DTexture(width, height, chn);
-    glTexImage2D(targetType, 0, internalFormat[0][chn], width, height, 0, pixelFormat[chn], GL_UNSIGNED_BYTE, imageData);
+    glTexStorage2D(targetType, nrLevels, sizedFormat, width, height);
+    glTexSubImage2D(targetType, 0, 0, 0, width, height, pixelFormat[chn], GL_UNSIGNED_BYTE, imageData);
     glGenerateMipmap(targetType);
     glBindTexture(targetType, 0);
     CheckOpenGLError();
@@ -96,6 +320,67 @@ bool Texture2D::Load2D(const char *fileName, GLenum wrapping_mode)
 }
 
 
+bool Texture2D::LoadCompressed(const char *fileName, GLenum wrapping_mode)
+{
+    std::vector<unsigned char> source;
+    uint64_t hash;
+    if (!TextureCache::ReadSource(fileName, source, hash))
+        return false;
+
+    CompressedTexture baked;
+    if (!TextureCache::LoadOrBake(fileName, source, hash, baked))
+        return false;
+
+    Upload2D(baked, wrapping_mode);
+    return true;
+}
+
+
+void Texture2D::Upload2D(const CompressedTexture &image, GLenum wrapping_mode)
+{
+    wrappingMode = wrapping_mode;
+    imageData = nullptr;
+
+    CreateImageStorage(image.format, image.width, image.height, image.channels, static_cast<int>(image.levels.size()));
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int level = 0; level < nrLevels; level++)
+    {
+        UploadLevel(level, image.levels[level].data(), image.levels[level].size());
+    }
+    glBindTexture(targetType, 0);
+    CheckOpenGLError();
+}
+
+
+void Texture2D::CreateImageStorage(GLenum sizedFormat, int width, int height, int chn, int levels)
+{
+    textureMinFilter = levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR;
+    sharedSampler = true;
+
+    this->sizedFormat = sizedFormat;
+    nrLevels = levels;
+    Init2DTexture(width, height, chn);
+    glTexStorage2D(targetType, nrLevels, sizedFormat, width, height);
+}
+
+
+void Texture2D::UploadLevel(int level, const void *pixels, size_t size)
+{
+    int levelWidth = std::max(static_cast<int>(width) >> level, 1);
+    int levelHeight = std::max(static_cast<int>(height) >> level, 1);
+
+    glBindTexture(targetType, textureID);
+    if (IsCompressedFormat(sizedFormat))
+    {
+        glCompressedTexSubImage2D(targetType, level, 0, 0, levelWidth, levelHeight, sizedFormat, static_cast<GLsizei>(size), pixels);
+    }
+    else
+    {
+        glTexSubImage2D(targetType, level, 0, 0, levelWidth, levelHeight, pixelFormat[channels], GL_UNSIGNED_BYTE, pixels);
+    }
+}
+
+
 void Texture2D::SaveToFile(const char *fileName)
 {
     if (imageData == nullptr)
@@ -119,7 +404,8 @@ void Texture2D::UploadNewData(const unsigned char *img)
 {
     Bind();
     glTexSubImage2D(targetType, 0, 0, 0, width, height, pixelFormat[channels], GL_UNSIGNED_BYTE, img);
-    glGenerateMipmap(targetType);
+    if (nrLevels > 1)
+        glGenerateMipmap(targetType);
     UnBind();
 }
 
@@ -128,23 +414,34 @@ void Texture2D::UploadNewData(const unsigned int *img)
 {
     Bind();
     glTexSubImage2D(targetType, 0, 0, 0, width, height, pixelFormat[channels], GL_UNSIGNED_INT, img);
-    glGenerateMipmap(targetType);
+    if (nrLevels > 1)
+        glGenerateMipmap(targetType);
     UnBind();
 }
 
 
 void Texture2D::Create(const unsigned char *img, int width, int height, int chn)
 {
+    sharedSampler = true;
+    sizedFormat = internalFormat[0][chn];
+    nrLevels = 1;
     Init2DTexture(width, height, chn);
-    glTexImage2D(targetType, 0, internalFormat[0][chn], width, height, 0, pixelFormat[chn], GL_UNSIGNED_BYTE, (void *)img);
+    glTexStorage2D(targetType, 1, sizedFormat, width, height);
+    if (img)
+        glTexSubImage2D(targetType, 0, 0, 0, width, height, pixelFormat[chn], GL_UNSIGNED_BYTE, (void *)img);
     UnBind();
 }
 
 
 void Texture2D::CreateU16(const unsigned int *img, int width, int height, int chn)
 {
+    sharedSampler = true;
+    sizedFormat = internalFormat[1][chn];
+    nrLevels = 1;
     Init2DTexture(width, height, chn);
-    glTexImage2D(targetType, 0, internalFormat[1][chn], width, height, 0, pixelFormat[chn], GL_UNSIGNED_INT, (void *)img);
+    glTexStorage2D(targetType, 1, sizedFormat, width, height);
+    if (img)
+        glTexSubImage2D(targetType, 0, 0, 0, width, height, pixelFormat[chn], GL_UNSIGNED_INT, (void *)img);
     UnBind();
 }
 
@@ -154,6 +451,9 @@ void Texture2D::CreateCubeTexture(const float *data, unsigned int width, unsigne
     this->width = width;
     this->height = height;
     targetType = GL_TEXTURE_CUBE_MAP;
+    sharedSampler = false;
+    sampler = 0;
+    nrLevels = 1;
 
     glDeleteTextures(1, &textureID);
     glGenTextures(1, &textureID);
@@ -165,14 +465,8 @@ void Texture2D::CreateCubeTexture(const float *data, unsigned int width, unsigne
     glTexParameteri(targetType, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(targetType, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
-#if 0
-    glTexStorage2D(GL_TEXTURE_CUBE_MAP, 1, internalFormat[3][chn], width, height);
-#endif
-
-    for (int i = 0; i < 6; i++)
-    {
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, internalFormat[3][chn], width, height, 0, pixelFormat[chn], GL_FLOAT, NULL);
-    }
+    sizedFormat = internalFormat[3][chn];
+    glTexStorage2D(GL_TEXTURE_CUBE_MAP, 1, sizedFormat, width, height);
 
     UnBind();
 }
@@ -180,10 +474,29 @@ void Texture2D::CreateCubeTexture(const float *data, unsigned int width, unsigne
 
 void Texture2D::CreateFrameBufferTexture(unsigned int width, unsigned int height, unsigned int targetID, unsigned int precision)
 {
-    bitsPerPixel = precision;
     int prec = precision / 8 - 1;
+    CreateRenderTargetTexture(width, height, targetID, internalFormat[prec][4]);
+}
+
+
+void Texture2D::CreateRenderTargetTexture(unsigned int width, unsigned int height, unsigned int targetID, GLenum sizedFormat,
+                                          GLenum minFilter, GLenum magFilter)
+{
+    this->sizedFormat = sizedFormat;
+    bitsPerPixel = GetBytesPerPixel(sizedFormat) * 8;
+
+    // Integer targets can't be filtered, fall back to nearest sampling
+    if (IsIntegerFormat(sizedFormat)) {
+        minFilter = magFilter = GL_NEAREST;
+    }
+    textureMinFilter = minFilter;
+    textureMagFilter = magFilter;
+    wrappingMode = GL_CLAMP_TO_EDGE;
+    sharedSampler = false;
+    nrLevels = 1;
+
     Init2DTexture(width, height, 4);
-    glTexImage2D(targetType, 0, internalFormat[prec][4], width, height, 0, pixelFormat[4], GL_UNSIGNED_BYTE, 0);
+    glTexStorage2D(targetType, 1, sizedFormat, width, height);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + targetID, GL_TEXTURE_2D, textureID, 0);
     UnBind();
 }
@@ -191,8 +504,11 @@ void Texture2D::CreateFrameBufferTexture(unsigned int width, unsigned int height
 
 void Texture2D::CreateDepthBufferTexture(unsigned int width, unsigned int height)
 {
+    sizedFormat = GL_DEPTH_COMPONENT32F;
+    sharedSampler = false;
+    nrLevels = 1;
     Init2DTexture(width, height, 1);
-    glTexImage2D(targetType, 0, GL_DEPTH_COMPONENT32F, width, height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_BYTE, 0);
+    glTexStorage2D(targetType, 1, GL_DEPTH_COMPONENT32F, width, height);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, textureID, 0);
     UnBind();
 }
@@ -206,9 +522,17 @@ void Texture2D::Bind() const
 
 void Texture2D::BindToTextureUnit(GLenum TextureUnit) const
 {
+    lastBindFrame = currentFrame;
+    if (placeholder)
+    {
+        placeholder->BindToTextureUnit(TextureUnit);
+        return;
+    }
+
     if (!textureID) return;
     glActiveTexture(TextureUnit);
     glBindTexture(GL_TEXTURE_2D, textureID);
+    SamplerManager::BindSampler(TextureUnit, sampler);
 }
 
 
@@ -231,6 +555,12 @@ void Texture2D::SetTextureParameters()
 }
 
 
+void Texture2D::UpdateSampler()
+{
+    sampler = sharedSampler ? SamplerManager::GetSampler(textureMinFilter, textureMagFilter, wrappingMode) : 0;
+}
+
+
 unsigned int Texture2D::GetWidth() const
 {
     return width;
@@ -269,6 +599,12 @@ void Texture2D::SetWrappingMode(GLenum mode)
 
     wrappingMode = mode;
 
+    if (sharedSampler)
+    {
+        UpdateSampler();
+        return;
+    }
+
     if (textureID)
     {
         glBindTexture(targetType, textureID);
@@ -280,8 +616,22 @@ void Texture2D::SetWrappingMode(GLenum mode)
 }
 
 
+GLenum Texture2D::GetWrappingMode() const
+{
+    return wrappingMode;
+}
+
+
 void Texture2D::SetFiltering(GLenum minFilter, GLenum magFilter)
 {
+    if (sharedSampler)
+    {
+        textureMinFilter = minFilter;
+        textureMagFilter = magFilter;
+        UpdateSampler();
+        return;
+    }
+
     if (textureID)
     {
         glBindTexture(targetType, textureID);
@@ -311,7 +661,11 @@ void Texture2D::Init2DTexture(unsigned int width, unsigned int height, unsigned
         glDeleteTextures(1, &textureID);
     glGenTextures(1, &textureID);
     glBindTexture(targetType, textureID);
-    SetTextureParameters();
+
+    // Image textures sample through a shared sampler object, render targets keep their own state
+    UpdateSampler();
+    if (!sharedSampler)
+        SetTextureParameters();
     glPixelStorei(GL_PACK_ALIGNMENT, 1);
     CheckOpenGLError();
 }
@@ -2,6 +2,8 @@
 
 #include "utils/gl_utils.h"
 
+struct CompressedTexture;
+
 
 class Texture2D
 {
@@ -22,9 +24,17 @@ class Texture2D
 
     void CreateCubeTexture(const float *data, unsigned int width, unsigned int height, unsigned int chn);
     void CreateFrameBufferTexture(unsigned int width, unsigned int height, unsigned int targetID, unsigned int precision = 32);
+    void CreateRenderTargetTexture(unsigned int width, unsigned int height, unsigned int targetID, GLenum sizedFormat,
+                                   GLenum minFilter = GL_LINEAR, GLenum magFilter = GL_LINEAR);
     void CreateDepthBufferTexture(unsigned int width, unsigned int height);
 
     bool Load2D(const char* fileName, GLenum wrappingMode = GL_REPEAT);
+    // Immutable image storage (plain or block compressed sizedFormat), filled level by level with UploadLevel.
+    // Pixels may be an offset into the bound GL_PIXEL_UNPACK_BUFFER
+    void CreateImageStorage(GLenum sizedFormat, int width, int height, int chn, int levels);
+    void UploadLevel(int level, const void *pixels, size_t size);
+    // GL half of a texture load, all the levels of an image decoded off the render thread (TextureCache::Decode)
+    void Upload2D(const CompressedTexture &image, GLenum wrappingMode = GL_REPEAT);
     void SaveToFile(const char* fileName);
     void CacheInMemory(bool state);
 
@@ -36,12 +46,41 @@ class Texture2D
     unsigned int GetNrChannels() const;
 
     void SetWrappingMode(GLenum mode);
+    GLenum GetWrappingMode() const;
     void SetFiltering(GLenum minFilter, GLenum magFilter = GL_LINEAR);
 
+    // Bound instead of this texture until its data is resident (streamed textures), nullptr once ready
+    void SetPlaceholder(const Texture2D *texture);
+    bool IsResident() const;
+
+    // Residency control for the texture budget: GPU bytes of all levels, dropping the top mip in place
+    // (GPU copy of the remaining levels) and freeing the storage behind a placeholder
+    size_t GetMemorySize() const;
+    bool DropTopLevel();
+    void Unload(const Texture2D *placeholder);
+
+    // Frame stamp of the last bind, for least recently used ordering
+    static void AdvanceFrame();
+    static unsigned int GetCurrentFrame();
+    unsigned int GetLastBindFrame() const;
+
     GLuint GetTextureID() const;
+    GLenum GetInternalFormat() const;
+    // Shared sampler object of image textures, 0 for render targets (sampled through their own state)
+    GLuint GetSampler() const;
+
+    // Helpers for describing sized internal formats (GL_RGBA16F, GL_R32UI, ...)
+    static GLenum GetPixelFormat(GLenum sizedFormat);
+    static GLenum GetPixelType(GLenum sizedFormat);
+    static unsigned int GetBytesPerPixel(GLenum sizedFormat);
+    static bool IsIntegerFormat(GLenum sizedFormat);
+    static bool IsCompressedFormat(GLenum sizedFormat);
+    static GLenum GetImageFormat(unsigned int channels);
 
  private:
     void SetTextureParameters();
+    bool LoadCompressed(const char* fileName, GLenum wrappingMode);
+    void UpdateSampler();
     void Init2DTexture(unsigned int width, unsigned int height, unsigned int channels);
 
  private:
@@ -53,9 +92,17 @@ class Texture2D
 
     GLuint targetType;
     GLuint textureID;
+    GLenum sizedFormat;
     GLenum wrappingMode;
     GLenum textureMinFilter;
     GLenum textureMagFilter;
+    bool sharedSampler;
+    GLuint sampler;
+    int nrLevels;
+    const Texture2D *placeholder;
+    mutable unsigned int lastBindFrame;
+
+    static unsigned int currentFrame;
 
     unsigned char *imageData;
 };
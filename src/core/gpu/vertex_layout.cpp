@@ -0,0 +1,250 @@
+#include "core/gpu/vertex_layout.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#include "core/gpu/vertex_bone_data.h"
+
+
+VertexLayout VertexLayout::Float()
+{
+    return VertexLayout();
+}
+
+
+VertexLayout VertexLayout::Compact()
+{
+    VertexLayout layout;
+    layout.position = POSITION_SNORM16;
+    layout.normal = NORMAL_OCTAHEDRAL;
+    layout.texCoord = TEX_COORD_UNORM16;
+    layout.bones = BONES_UNORM8;
+    layout.interleaved = true;
+    return layout;
+}
+
+
+unsigned int VertexLayout::GetPositionSize() const
+{
+    // The quantized ones carry a fourth component to stay 4 byte aligned
+    return position == POSITION_FLOAT ? 12 : 8;
+}
+
+
+unsigned int VertexLayout::GetNormalSize() const
+{
+    return normal == NORMAL_FLOAT ? 12 : 4;
+}
+
+
+unsigned int VertexLayout::GetTexCoordSize() const
+{
+    return texCoord == TEX_COORD_FLOAT ? 8 : 4;
+}
+
+
+unsigned int VertexLayout::GetBonesSize() const
+{
+    switch (bones)
+    {
+    case BONES_NONE:    return 0;
+    case BONES_UNORM8:  return 8;
+    default:            return sizeof(VertexBoneData);
+    }
+}
+
+
+static void WriteUint(unsigned char *destination, unsigned int value)
+{
+    memcpy(destination, &value, sizeof(value));
+}
+
+
+static glm::vec2 OctahedralEncode(const glm::vec3 &normal)
+{
+    float length = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+    if (length == 0)
+        return glm::vec2(0);
+
+    glm::vec2 p = glm::vec2(normal.x, normal.y) / length;
+    if (normal.z < 0)
+    {
+        // Lower half folded over the diagonals
+        glm::vec2 folded = glm::vec2(1 - std::abs(p.y), 1 - std::abs(p.x));
+        p.x = p.x >= 0 ? folded.x : -folded.x;
+        p.y = p.y >= 0 ? folded.y : -folded.y;
+    }
+    return p;
+}
+
+
+// Rounded to sum to exactly 255 like the float weights sum to 1, the rounding error goes to the largest weight
+static unsigned int PackWeights(const float weights[NUM_BONES_PER_VEREX])
+{
+    float sum = 0;
+    for (int i = 0; i < NUM_BONES_PER_VEREX; i++)
+        sum += std::max(weights[i], 0.0f);
+    if (sum <= 0)
+        return 0;
+
+    int quantized[NUM_BONES_PER_VEREX];
+    int total = 0, largest = 0;
+    for (int i = 0; i < NUM_BONES_PER_VEREX; i++)
+    {
+        quantized[i] = static_cast<int>(std::floor(std::max(weights[i], 0.0f) / sum * 255 + 0.5f));
+        total += quantized[i];
+        if (weights[i] > weights[largest])
+            largest = i;
+    }
+    quantized[largest] = std::min(std::max(quantized[largest] + 255 - total, 0), 255);
+
+    unsigned int packed = 0;
+    for (int i = 0; i < NUM_BONES_PER_VEREX; i++)
+        packed |= static_cast<unsigned int>(quantized[i]) << (8 * i);
+    return packed;
+}
+
+
+void gpu_utils::PackVertices(const VertexLayout &requested,
+                             const glm::vec3 *positions,
+                             const glm::vec3 *normals,
+                             const glm::vec2 *text_coords,
+                             const VertexBoneData *bones,
+                             size_t nrVertices,
+                             PackedVertices &packed)
+{
+    // Ranges deciding the fallbacks and the position transform
+    glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+    bool unitTexCoords = true, weighted = false, smallBoneIDs = true;
+    for (size_t i = 0; i < nrVertices; i++)
+    {
+        boundsMin = glm::min(boundsMin, positions[i]);
+        boundsMax = glm::max(boundsMax, positions[i]);
+        if (text_coords)
+        {
+            const glm::vec2 &uv = text_coords[i];
+            unitTexCoords &= uv.x >= 0 && uv.x <= 1 && uv.y >= 0 && uv.y <= 1;
+        }
+        if (bones)
+        {
+            for (int j = 0; j < NUM_BONES_PER_VEREX; j++)
+            {
+                if (bones[i].Weights[j] == 0)
+                    continue;
+                weighted = true;
+                smallBoneIDs &= bones[i].IDs[j] < 256;
+            }
+        }
+    }
+
+    VertexLayout layout = requested;
+    layout.interleaved = true;
+    if (layout.texCoord == VertexLayout::TEX_COORD_UNORM16 && !unitTexCoords)
+        layout.texCoord = VertexLayout::TEX_COORD_HALF;
+    if (!weighted)
+        layout.bones = VertexLayout::BONES_NONE;
+    else if (layout.bones == VertexLayout::BONES_UNORM8 && !smallBoneIDs)
+        layout.bones = VertexLayout::BONES_FLOAT;
+
+    glm::vec4 transform(0, 0, 0, 1);
+    if (layout.position != VertexLayout::POSITION_FLOAT && nrVertices)
+    {
+        glm::vec3 halfExtent = (boundsMax - boundsMin) * 0.5f;
+        float scale = std::max(halfExtent.x, std::max(halfExtent.y, halfExtent.z));
+        transform = glm::vec4((boundsMin + boundsMax) * 0.5f, scale > 0 ? scale : 1.0f);
+    }
+
+    unsigned int stride = layout.GetStride();
+    packed.layout = layout;
+    packed.positionTransform = transform;
+    packed.nrVertices = nrVertices;
+    packed.data.assign(nrVertices * stride, 0);
+
+    for (size_t i = 0; i < nrVertices; i++)
+    {
+        unsigned char *vertex = packed.data.data() + i * stride;
+
+        glm::vec3 position = positions[i];
+        switch (layout.position)
+        {
+        case VertexLayout::POSITION_FLOAT:
+            memcpy(vertex, &position, sizeof(position));
+            break;
+        case VertexLayout::POSITION_HALF:
+            position = (position - glm::vec3(transform)) / transform.w;
+            WriteUint(vertex, glm::packHalf2x16(glm::vec2(position.x, position.y)));
+            WriteUint(vertex + 4, glm::packHalf2x16(glm::vec2(position.z, 0)));
+            break;
+        case VertexLayout::POSITION_SNORM16:
+            position = (position - glm::vec3(transform)) / transform.w;
+            WriteUint(vertex, glm::packSnorm2x16(glm::vec2(position.x, position.y)));
+            WriteUint(vertex + 4, glm::packSnorm2x16(glm::vec2(position.z, 0)));
+            break;
+        }
+
+        glm::vec3 normal = normals ? normals[i] : glm::vec3(0);
+        unsigned char *normalData = vertex + layout.GetNormalOffset();
+        if (layout.normal == VertexLayout::NORMAL_FLOAT)
+            memcpy(normalData, &normal, sizeof(normal));
+        else
+            WriteUint(normalData, glm::packSnorm2x16(OctahedralEncode(normal)));
+
+        glm::vec2 uv = text_coords ? text_coords[i] : glm::vec2(0);
+        unsigned char *texCoordData = vertex + layout.GetTexCoordOffset();
+        switch (layout.texCoord)
+        {
+        case VertexLayout::TEX_COORD_FLOAT:
+            memcpy(texCoordData, &uv, sizeof(uv));
+            break;
+        case VertexLayout::TEX_COORD_HALF:
+            WriteUint(texCoordData, glm::packHalf2x16(uv));
+            break;
+        case VertexLayout::TEX_COORD_UNORM16:
+            WriteUint(texCoordData, glm::packUnorm2x16(uv));
+            break;
+        }
+
+        unsigned char *bonesData = vertex + layout.GetBonesOffset();
+        if (layout.bones == VertexLayout::BONES_FLOAT)
+        {
+            memcpy(bonesData, &bones[i], sizeof(VertexBoneData));
+        }
+        else if (layout.bones == VertexLayout::BONES_UNORM8)
+        {
+            unsigned int ids = 0;
+            for (int j = 0; j < NUM_BONES_PER_VEREX; j++)
+            {
+                if (bones[i].Weights[j] != 0)
+                    ids |= bones[i].IDs[j] << (8 * j);
+            }
+            WriteUint(bonesData, ids);
+            WriteUint(bonesData + 4, PackWeights(bones[i].Weights));
+        }
+    }
+}
+
+
+const char *gpu_utils::GetVertexDecodeSource()
+{
+    // Locations 5 and 6 must match VERTEX_ATTRIBUTE_LOC in gpu_buffers.cpp
+    return
+        "// Packed mesh vertices, see VertexLayout\n"
+        "layout(location = 5) in vec4 v_position_transform;\n"
+        "layout(location = 6) in float v_octahedral_normal;\n"
+        "vec3 DecodePosition(vec3 position)\n"
+        "{\n"
+        "    return position * v_position_transform.w + v_position_transform.xyz;\n"
+        "}\n"
+        "vec3 DecodeNormal(vec3 normal)\n"
+        "{\n"
+        "    if (v_octahedral_normal == 0.0)\n"
+        "        return normal;\n"
+        "    vec3 n = vec3(normal.xy, 1.0 - abs(normal.x) - abs(normal.y));\n"
+        "    float t = max(-n.z, 0.0);\n"
+        "    n.x += n.x >= 0.0 ? -t : t;\n"
+        "    n.y += n.y >= 0.0 ? -t : t;\n"
+        "    return normalize(n);\n"
+        "}\n";
+}
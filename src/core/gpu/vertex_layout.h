@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "utils/glm_utils.h"
+
+struct VertexBoneData;
+
+
+// How mesh vertices are stored on the GPU. The float layout keeps one buffer per attribute (gpu_utils::UploadData),
+// an interleaved one packs every attribute of a vertex together in a single buffer with the formats below. Every
+// format but the snorm16 positions and the octahedral normals reads back as plain floats and ints in the shaders,
+// those two are undone by DecodePosition and DecodeNormal, which Shader adds to every vertex shader
+struct VertexLayout
+{
+    enum PositionFormat
+    {
+        POSITION_FLOAT,
+        // Both rescaled to the bounding box of the mesh, see PackedVertices::positionTransform
+        POSITION_HALF,
+        POSITION_SNORM16
+    };
+
+    enum NormalFormat
+    {
+        NORMAL_FLOAT,
+        // Unit vector folded onto the octahedron, 2 x snorm16
+        NORMAL_OCTAHEDRAL
+    };
+
+    enum TexCoordFormat
+    {
+        TEX_COORD_FLOAT,
+        TEX_COORD_HALF,
+        // Only when every coordinate is in [0, 1], half floats otherwise
+        TEX_COORD_UNORM16
+    };
+
+    enum BoneFormat
+    {
+        // Dropped when no vertex has a weight
+        BONES_NONE,
+        BONES_FLOAT,
+        // 4 x u8 ids and 4 x unorm8 weights, float when a bone id doesn't fit
+        BONES_UNORM8
+    };
+
+    VertexLayout() : position(POSITION_FLOAT), normal(NORMAL_FLOAT), texCoord(TEX_COORD_FLOAT),
+        bones(BONES_FLOAT), interleaved(false) {}
+
+    // One buffer per float attribute
+    static VertexLayout Float();
+    // Interleaved snorm16 positions, octahedral normals, unorm16 coordinates and 8 bit bones
+    static VertexLayout Compact();
+
+    // Bytes of each attribute in an interleaved vertex, all multiples of 4
+    unsigned int GetPositionSize() const;
+    unsigned int GetNormalSize() const;
+    unsigned int GetTexCoordSize() const;
+    unsigned int GetBonesSize() const;
+
+    unsigned int GetNormalOffset() const { return GetPositionSize(); }
+    unsigned int GetTexCoordOffset() const { return GetNormalOffset() + GetNormalSize(); }
+    unsigned int GetBonesOffset() const { return GetTexCoordOffset() + GetTexCoordSize(); }
+    unsigned int GetStride() const { return GetBonesOffset() + GetBonesSize(); }
+
+    PositionFormat position;
+    NormalFormat normal;
+    TexCoordFormat texCoord;
+    BoneFormat bones;
+    bool interleaved;
+};
+
+
+// Interleaved vertices ready for gpu_utils::UploadData, followed in the buffer by the VertexConstants
+struct PackedVertices
+{
+    PackedVertices() : positionTransform(0, 0, 0, 1), nrVertices(0) {}
+
+    // Formats actually used, after the fallbacks of the requested layout
+    VertexLayout layout;
+    // Object space position = stored position * w + xyz
+    glm::vec4 positionTransform;
+    size_t nrVertices;
+    std::vector<unsigned char> data;
+};
+
+
+// Read by every vertex of a mesh through a zero stride binding after its vertex data, identity for a float mesh
+struct VertexConstants
+{
+    glm::vec4 positionTransform;
+    float octahedralNormal;
+    float padding[3];
+};
+
+
+namespace gpu_utils
+{
+    // Interleaves and quantizes the float streams, normals, texCoords and bones may be null. Doesn't touch GL, runs
+    // on loader threads
+    void PackVertices(const VertexLayout &layout,
+                      const glm::vec3 *positions,
+                      const glm::vec3 *normals,
+                      const glm::vec2 *text_coords,
+                      const VertexBoneData *bones,
+                      size_t nrVertices,
+                      PackedVertices &packed);
+
+    // GLSL added to vertex shaders after the version and extension lines: DecodePosition and DecodeNormal
+    const char *GetVertexDecodeSource();
+}   // namespace gpu_utils
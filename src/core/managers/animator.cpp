@@ -0,0 +1,464 @@
+#include "core/managers/animator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <unordered_map>
+
+#include "core/gpu/mesh.h"
+#include "utils/memory_utils.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#   define ANIMATOR_SSE
+#   include <xmmintrin.h>
+#endif
+
+
+// Instances taken by a thread at a time
+static const size_t BATCH_SIZE = 4;
+// Below this many instances the workers aren't woken up
+static const size_t MIN_PARALLEL_INSTANCES = 2 * BATCH_SIZE;
+// Assimp's default when the file doesn't say
+static const float DEFAULT_TICKS_PER_SECOND = 25.0f;
+
+std::vector<std::thread> Animator::workers;
+std::mutex Animator::mutex;
+std::condition_variable Animator::workAvailable;
+std::condition_variable Animator::workFinished;
+bool Animator::running = false;
+
+Animator::Job Animator::job = {};
+unsigned int Animator::generation = 0;
+unsigned int Animator::busyWorkers = 0;
+std::atomic<size_t> Animator::nextInstance(0);
+
+
+// Local transform of a node, decomposed so poses blend per channel
+struct NodePose
+{
+    glm::vec3 position;
+    glm::quat rotation;
+    glm::vec3 scaling;
+};
+
+
+void Animator::Init(unsigned int nrWorkers)
+{
+    if (running)
+        return;
+
+    if (nrWorkers == 0)
+    {
+        unsigned int hardwareThreads = std::thread::hardware_concurrency();
+        nrWorkers = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+    }
+
+    running = true;
+    for (unsigned int i = 0; i < nrWorkers; i++)
+    {
+        workers.emplace_back(WorkerLoop);
+    }
+}
+
+
+void Animator::Shutdown()
+{
+    if (!running)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    workAvailable.notify_all();
+
+    for (auto &worker : workers)
+    {
+        if (worker.joinable())
+        {
+            worker.join();
+        }
+    }
+    workers.clear();
+}
+
+
+static void FlattenNodes(Mesh *mesh, const aiNode *node, int parent, Skeleton &skeleton,
+                         std::unordered_map<std::string, unsigned int> &nodeIndices)
+{
+    unsigned int index = static_cast<unsigned int>(skeleton.parents.size());
+    glm::mat4 transform = mesh->ConvertMatrix(node->mTransformation);
+    skeleton.parents.push_back(parent);
+    skeleton.bindPose.push_back(transform);
+
+    // Decomposed for blending, shear is lost
+    glm::vec3 scaling(glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])),
+                      glm::length(glm::vec3(transform[2])));
+    glm::mat3 rotation(glm::vec3(transform[0]) / (scaling.x > 0 ? scaling.x : 1.0f),
+                       glm::vec3(transform[1]) / (scaling.y > 0 ? scaling.y : 1.0f),
+                       glm::vec3(transform[2]) / (scaling.z > 0 ? scaling.z : 1.0f));
+    skeleton.bindPositions.push_back(glm::vec3(transform[3]));
+    skeleton.bindRotations.push_back(glm::normalize(glm::quat_cast(rotation)));
+    skeleton.bindScalings.push_back(scaling);
+    nodeIndices[node->mName.C_Str()] = index;
+
+    auto bone = mesh->m_BoneMapping.find(node->mName.C_Str());
+    skeleton.nodeBones.push_back(bone != mesh->m_BoneMapping.end() ? bone->second : -1);
+    if (bone != mesh->m_BoneMapping.end())
+        skeleton.boneNodes[bone->second] = index;
+
+    // Children after their parent
+    for (unsigned int i = 0; i < node->mNumChildren; i++)
+        FlattenNodes(mesh, node->mChildren[i], static_cast<int>(index), skeleton, nodeIndices);
+}
+
+
+void Animator::BuildSkeleton(Mesh *mesh)
+{
+    SAFE_FREE(mesh->skeleton);
+    if (mesh->rootNode == nullptr || mesh->m_BoneInfo.empty() || mesh->numAnim <= 0)
+        return;
+
+    Skeleton *skeleton = new Skeleton();
+    skeleton->globalInverse = mesh->m_GlobalInverseTransform;
+    skeleton->boneNodes.assign(mesh->m_BoneInfo.size(), 0);
+    for (const auto &bone : mesh->m_BoneInfo)
+        skeleton->boneOffsets.push_back(bone.boneOffset);
+
+    std::unordered_map<std::string, unsigned int> nodeIndices;
+    FlattenNodes(mesh, mesh->rootNode, -1, *skeleton, nodeIndices);
+
+    size_t nrKeys = 0;
+    for (int i = 0; i < mesh->numAnim; i++)
+    {
+        const aiAnimation *animation = mesh->anim[i];
+        AnimationClip clip;
+        clip.name = animation->mName.C_Str();
+        clip.duration = static_cast<float>(animation->mDuration);
+        clip.ticksPerSecond = animation->mTicksPerSecond > 0 ? static_cast<float>(animation->mTicksPerSecond) :
+            DEFAULT_TICKS_PER_SECOND;
+
+        for (unsigned int j = 0; j < animation->mNumChannels; j++)
+        {
+            const aiNodeAnim *channel = animation->mChannels[j];
+            auto node = nodeIndices.find(channel->mNodeName.C_Str());
+            if (node == nodeIndices.end())
+                continue;
+
+            AnimationTrack track;
+            track.node = node->second;
+            for (unsigned int k = 0; k < channel->mNumPositionKeys; k++)
+            {
+                const aiVectorKey &key = channel->mPositionKeys[k];
+                track.positionTimes.push_back(static_cast<float>(key.mTime));
+                track.positions.push_back(glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z));
+            }
+            for (unsigned int k = 0; k < channel->mNumRotationKeys; k++)
+            {
+                const aiQuatKey &key = channel->mRotationKeys[k];
+                track.rotationTimes.push_back(static_cast<float>(key.mTime));
+                track.rotations.push_back(glm::quat(key.mValue.w, key.mValue.x, key.mValue.y, key.mValue.z));
+            }
+            for (unsigned int k = 0; k < channel->mNumScalingKeys; k++)
+            {
+                const aiVectorKey &key = channel->mScalingKeys[k];
+                track.scalingTimes.push_back(static_cast<float>(key.mTime));
+                track.scalings.push_back(glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z));
+            }
+            nrKeys += track.positions.size() + track.rotations.size() + track.scalings.size();
+            clip.tracks.push_back(std::move(track));
+        }
+        skeleton->clips.push_back(std::move(clip));
+    }
+
+    mesh->skeleton = skeleton;
+    std::ostringstream report;
+    report << "Skeleton: " << skeleton->parents.size() << " nodes, " << skeleton->boneOffsets.size() << " bones, "
+           << skeleton->clips.size() << " clips, " << nrKeys << " keys";
+    mesh->importReport.push_back(report.str());
+}
+
+
+// Key before time, resuming from the one found last time: playback moves forward a key or none per frame, a
+// loop or a jump back starts over
+static unsigned int FindKey(const std::vector<float> &times, float time, unsigned int &cached)
+{
+    unsigned int key = cached;
+    if (key >= times.size() || times[key] > time)
+        key = 0;
+    while (key + 1 < times.size() && times[key + 1] <= time)
+        key++;
+    cached = key;
+    return key;
+}
+
+
+static float KeyFactor(const std::vector<float> &times, unsigned int key, float time)
+{
+    if (key + 1 >= times.size())
+        return 0;
+
+    float span = times[key + 1] - times[key];
+    return span > 0 ? glm::clamp((time - times[key]) / span, 0.0f, 1.0f) : 0;
+}
+
+
+// Normalized lerp along the shorter arc
+static glm::quat Nlerp(const glm::quat &a, const glm::quat &b, float t)
+{
+    glm::quat result;
+#ifdef ANIMATOR_SSE
+    // Component order doesn't matter for a dot product, a lerp and a normalization
+    __m128 qa = _mm_loadu_ps(reinterpret_cast<const float*>(&a));
+    __m128 qb = _mm_loadu_ps(reinterpret_cast<const float*>(&b));
+    __m128 products = _mm_mul_ps(qa, qb);
+    products = _mm_add_ps(products, _mm_movehl_ps(products, products));
+    products = _mm_add_ss(products, _mm_shuffle_ps(products, products, 1));
+    float sign = _mm_cvtss_f32(products) < 0 ? -1.0f : 1.0f;
+
+    __m128 q = _mm_add_ps(_mm_mul_ps(qa, _mm_set1_ps(1 - t)), _mm_mul_ps(qb, _mm_set1_ps(sign * t)));
+    __m128 squares = _mm_mul_ps(q, q);
+    squares = _mm_add_ps(squares, _mm_movehl_ps(squares, squares));
+    squares = _mm_add_ss(squares, _mm_shuffle_ps(squares, squares, 1));
+    float length = std::sqrt(_mm_cvtss_f32(squares));
+    q = _mm_mul_ps(q, _mm_set1_ps(length > 0 ? 1 / length : 0));
+    _mm_storeu_ps(reinterpret_cast<float*>(&result), q);
+#else
+    float sign = glm::dot(a, b) < 0 ? -1.0f : 1.0f;
+    result = glm::normalize(a * (1 - t) + b * (sign * t));
+#endif
+    return result;
+}
+
+
+// a * b, column by column
+static void MultiplyMatrices(const glm::mat4 &a, const glm::mat4 &b, glm::mat4 &result)
+{
+#ifdef ANIMATOR_SSE
+    __m128 a0 = _mm_loadu_ps(&a[0][0]), a1 = _mm_loadu_ps(&a[1][0]);
+    __m128 a2 = _mm_loadu_ps(&a[2][0]), a3 = _mm_loadu_ps(&a[3][0]);
+    for (int i = 0; i < 4; i++)
+    {
+        __m128 column = _mm_mul_ps(a0, _mm_set1_ps(b[i][0]));
+        column = _mm_add_ps(column, _mm_mul_ps(a1, _mm_set1_ps(b[i][1])));
+        column = _mm_add_ps(column, _mm_mul_ps(a2, _mm_set1_ps(b[i][2])));
+        column = _mm_add_ps(column, _mm_mul_ps(a3, _mm_set1_ps(b[i][3])));
+        _mm_storeu_ps(&result[i][0], column);
+    }
+#else
+    result = a * b;
+#endif
+}
+
+
+// Pose of every animated node of the clip at time (seconds), keys found from cache
+static void SampleClip(const AnimationClip &clip, float time, std::vector<unsigned int> &cache, NodePose *poses,
+                       unsigned char *animated)
+{
+    float ticks = time * clip.ticksPerSecond;
+    ticks = clip.duration > 0 ? std::fmod(ticks, clip.duration) : 0;
+    if (ticks < 0)
+        ticks += clip.duration;
+
+    // Position, rotation and scaling key of every track
+    if (cache.size() != 3 * clip.tracks.size())
+        cache.assign(3 * clip.tracks.size(), 0);
+
+    for (size_t i = 0; i < clip.tracks.size(); i++)
+    {
+        const AnimationTrack &track = clip.tracks[i];
+        NodePose &pose = poses[track.node];
+        animated[track.node] = 1;
+
+        pose.position = glm::vec3(0);
+        if (!track.positions.empty())
+        {
+            unsigned int key = FindKey(track.positionTimes, ticks, cache[3 * i]);
+            unsigned int next = std::min<unsigned int>(key + 1, static_cast<unsigned int>(track.positions.size()) - 1);
+            pose.position = glm::mix(track.positions[key], track.positions[next],
+                                     KeyFactor(track.positionTimes, key, ticks));
+        }
+
+        pose.rotation = glm::quat(1, 0, 0, 0);
+        if (!track.rotations.empty())
+        {
+            unsigned int key = FindKey(track.rotationTimes, ticks, cache[3 * i + 1]);
+            unsigned int next = std::min<unsigned int>(key + 1, static_cast<unsigned int>(track.rotations.size()) - 1);
+            pose.rotation = Nlerp(track.rotations[key], track.rotations[next],
+                                  KeyFactor(track.rotationTimes, key, ticks));
+        }
+
+        pose.scaling = glm::vec3(1);
+        if (!track.scalings.empty())
+        {
+            unsigned int key = FindKey(track.scalingTimes, ticks, cache[3 * i + 2]);
+            unsigned int next = std::min<unsigned int>(key + 1, static_cast<unsigned int>(track.scalings.size()) - 1);
+            pose.scaling = glm::mix(track.scalings[key], track.scalings[next],
+                                    KeyFactor(track.scalingTimes, key, ticks));
+        }
+    }
+}
+
+
+// Translation * rotation * scaling
+static glm::mat4 ComposePose(const NodePose &pose)
+{
+    glm::mat4 matrix = glm::mat4_cast(pose.rotation);
+    matrix[0] *= pose.scaling.x;
+    matrix[1] *= pose.scaling.y;
+    matrix[2] *= pose.scaling.z;
+    matrix[3] = glm::vec4(pose.position, 1);
+    return matrix;
+}
+
+
+void Animator::EvaluateInstance(AnimationInstance &instance, glm::mat4 *boneMatrices)
+{
+    const Skeleton &skeleton = *instance.skeleton;
+    size_t nrNodes = skeleton.parents.size();
+
+    // Scratch of the thread, reused across instances and frames
+    static thread_local std::vector<NodePose> poses, blendPoses;
+    static thread_local std::vector<unsigned char> animated, blendAnimated;
+    static thread_local std::vector<glm::mat4> globals;
+    poses.resize(nrNodes);
+    animated.assign(nrNodes, 0);
+    globals.resize(nrNodes);
+
+    if (instance.clip < skeleton.clips.size())
+        SampleClip(skeleton.clips[instance.clip], instance.time, instance.keyCache[0], poses.data(), animated.data());
+
+    bool blend = instance.blendClip >= 0 && static_cast<size_t>(instance.blendClip) < skeleton.clips.size() &&
+        instance.blendWeight > 0;
+    if (blend)
+    {
+        blendPoses.resize(nrNodes);
+        blendAnimated.assign(nrNodes, 0);
+        SampleClip(skeleton.clips[instance.blendClip], instance.blendTime, instance.keyCache[1], blendPoses.data(),
+                   blendAnimated.data());
+    }
+
+    for (size_t i = 0; i < nrNodes; i++)
+    {
+        glm::mat4 local;
+        if (blend && blendAnimated[i])
+        {
+            // A node only the second clip animates blends from its bind pose
+            NodePose from = poses[i];
+            if (!animated[i])
+            {
+                from.position = skeleton.bindPositions[i];
+                from.rotation = skeleton.bindRotations[i];
+                from.scaling = skeleton.bindScalings[i];
+            }
+
+            const NodePose &to = blendPoses[i];
+            NodePose pose;
+            pose.position = glm::mix(from.position, to.position, instance.blendWeight);
+            pose.rotation = Nlerp(from.rotation, to.rotation, instance.blendWeight);
+            pose.scaling = glm::mix(from.scaling, to.scaling, instance.blendWeight);
+            local = ComposePose(pose);
+        }
+        else
+        {
+            local = animated[i] ? ComposePose(poses[i]) : skeleton.bindPose[i];
+        }
+
+        // Parents come first, their global transform is final
+        int parent = skeleton.parents[i];
+        if (parent < 0)
+            globals[i] = local;
+        else
+            MultiplyMatrices(globals[parent], local, globals[i]);
+    }
+
+    glm::mat4 nodeTransform;
+    for (size_t bone = 0; bone < skeleton.boneOffsets.size(); bone++)
+    {
+        MultiplyMatrices(skeleton.globalInverse, globals[skeleton.boneNodes[bone]], nodeTransform);
+        MultiplyMatrices(nodeTransform, skeleton.boneOffsets[bone], boneMatrices[bone]);
+    }
+}
+
+
+void Animator::Evaluate(AnimationInstance *instances, size_t count, std::vector<glm::mat4> &boneMatrices)
+{
+    size_t nrBones = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        instances[i].firstBone = nrBones;
+        nrBones += instances[i].skeleton ? instances[i].skeleton->boneOffsets.size() : 0;
+    }
+    boneMatrices.resize(nrBones);
+
+    Job current = { instances, count, boneMatrices.data() };
+    if (count < MIN_PARALLEL_INSTANCES)
+    {
+        nextInstance = 0;
+        RunBatches(current);
+        return;
+    }
+
+    Init();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = current;
+        nextInstance = 0;
+        busyWorkers = static_cast<unsigned int>(workers.size());
+        generation++;
+    }
+    workAvailable.notify_all();
+
+    // The calling thread takes batches too, then waits for the workers still on theirs
+    RunBatches(current);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    workFinished.wait(lock, [] { return busyWorkers == 0; });
+}
+
+
+void Animator::RunBatches(const Job &batchJob)
+{
+    while (true)
+    {
+        size_t first = nextInstance.fetch_add(BATCH_SIZE);
+        if (first >= batchJob.count)
+            return;
+
+        size_t last = std::min(first + BATCH_SIZE, batchJob.count);
+        for (size_t i = first; i < last; i++)
+        {
+            AnimationInstance &instance = batchJob.instances[i];
+            if (instance.skeleton)
+                EvaluateInstance(instance, batchJob.boneMatrices + instance.firstBone);
+        }
+    }
+}
+
+
+void Animator::WorkerLoop()
+{
+    unsigned int seen = 0;
+    while (true)
+    {
+        Job current;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            workAvailable.wait(lock, [&seen] { return !running || generation != seen; });
+            if (!running)
+                return;
+
+            seen = generation;
+            current = job;
+        }
+
+        RunBatches(current);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busyWorkers--;
+        }
+        workFinished.notify_all();
+    }
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "utils/glm_utils.h"
+
+class Mesh;
+
+
+// Keys of one animated node, one time array per channel
+struct AnimationTrack
+{
+    unsigned int node;
+    std::vector<float> positionTimes;
+    std::vector<glm::vec3> positions;
+    std::vector<float> rotationTimes;
+    std::vector<glm::quat> rotations;
+    std::vector<float> scalingTimes;
+    std::vector<glm::vec3> scalings;
+};
+
+
+struct AnimationClip
+{
+    std::string name;
+    // In ticks
+    float duration;
+    float ticksPerSecond;
+    std::vector<AnimationTrack> tracks;
+};
+
+
+// Node tree of a skinned mesh flattened parents first, so a single pass in index order sees every parent before its
+// children. Bone and track lookups by name are resolved once when it's built
+struct Skeleton
+{
+    // -1 for the root
+    std::vector<int> parents;
+    // Node transformations, the pose of the nodes no track animates, and their decomposition for blending
+    std::vector<glm::mat4> bindPose;
+    std::vector<glm::vec3> bindPositions;
+    std::vector<glm::quat> bindRotations;
+    std::vector<glm::vec3> bindScalings;
+    // Bone of every node, -1 when it doesn't deform the mesh, and the node of every bone
+    std::vector<int> nodeBones;
+    std::vector<unsigned int> boneNodes;
+    // Mesh space to bone space of every bone
+    std::vector<glm::mat4> boneOffsets;
+    glm::mat4 globalInverse;
+
+    std::vector<AnimationClip> clips;
+};
+
+
+// One animated copy of a skinned mesh: a clip at a time, optionally blended towards a second one
+struct AnimationInstance
+{
+    AnimationInstance() : skeleton(nullptr), clip(0), time(0), blendClip(-1), blendTime(0), blendWeight(0),
+        firstBone(0) {}
+
+    const Skeleton *skeleton;
+    unsigned int clip;
+    // Seconds, clips loop
+    float time;
+    // -1: none. blendWeight 0 is clip alone, 1 blendClip alone
+    int blendClip;
+    float blendTime;
+    float blendWeight;
+
+    // Written by Evaluate: first bone matrix of the instance in the output
+    size_t firstBone;
+    // Key reached by every track and channel at the last evaluation of each clip, the next sample resumes from it
+    std::vector<unsigned int> keyCache[2];
+};
+
+
+// Runtime skeletal animation. Skeletons are built from the node tree and the animations a mesh imported (or read
+// from its cache), Evaluate samples every instance in parallel and writes the final bone matrices (global inverse *
+// node * bone offset) of all of them to one contiguous array, ready for a shader storage buffer
+class Animator
+{
+ public:
+    // 0 workers: one per hardware thread, minus the calling thread. Called by the first Evaluate with enough instances
+    // to split, scenes without animations never start the workers
+    static void Init(unsigned int nrWorkers = 0);
+    static void Shutdown();
+
+    // Doesn't touch GL, runs on loader threads. Leaves meshes without bones or animations alone
+    static void BuildSkeleton(Mesh *mesh);
+
+    // Instances are split across the workers and the calling thread, boneMatrices is resized to hold them all
+    static void Evaluate(AnimationInstance *instances, size_t count, std::vector<glm::mat4> &boneMatrices);
+
+    // Pose of one instance, bones written from boneMatrices[instance.firstBone]
+    static void EvaluateInstance(AnimationInstance &instance, glm::mat4 *boneMatrices);
+
+ protected:
+    Animator() = delete;
+    ~Animator() = delete;
+
+ private:
+    struct Job
+    {
+        AnimationInstance *instances;
+        size_t count;
+        glm::mat4 *boneMatrices;
+    };
+
+    static void WorkerLoop();
+    static void RunBatches(const Job &job);
+
+ private:
+    static std::vector<std::thread> workers;
+    static std::mutex mutex;
+    static std::condition_variable workAvailable;
+    static std::condition_variable workFinished;
+    static bool running;
+
+    // Current Evaluate: a new generation wakes every worker, each one checks out once it runs out of batches
+    static Job job;
+    static unsigned int generation;
+    static unsigned int busyWorkers;
+    static std::atomic<size_t> nextInstance;
+};
@@ -0,0 +1,184 @@
+#include "core/managers/asset_loader.h"
+
+
+std::vector<std::thread> AssetLoader::workers;
+std::mutex AssetLoader::mutex;
+std::condition_variable AssetLoader::workAvailable;
+std::condition_variable AssetLoader::jobFinished;
+std::deque<AssetLoader::Job*> AssetLoader::requests;
+bool AssetLoader::running = false;
+thread_local bool AssetLoader::workerThread = false;
+
+std::atomic<AssetLoader::Job*> AssetLoader::finished(nullptr);
+std::atomic<size_t> AssetLoader::pendingCount(0);
+
+
+void AssetLoader::Init(unsigned int nrWorkers)
+{
+    if (running)
+        return;
+
+    if (nrWorkers == 0)
+    {
+        unsigned int hardwareThreads = std::thread::hardware_concurrency();
+        nrWorkers = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+    }
+
+    running = true;
+    for (unsigned int i = 0; i < nrWorkers; i++)
+    {
+        workers.emplace_back(WorkerLoop);
+    }
+}
+
+
+void AssetLoader::Shutdown()
+{
+    if (!running)
+        return;
+
+    // Jobs already submitted still complete, their uploads need the context that's about to go away
+    Flush();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    workAvailable.notify_all();
+
+    for (auto &worker : workers)
+    {
+        if (worker.joinable())
+        {
+            worker.join();
+        }
+    }
+    workers.clear();
+}
+
+
+void AssetLoader::Submit(std::function<bool()> load, std::function<void(bool)> upload)
+{
+    if (!running)
+    {
+        bool result = load();
+        if (upload)
+            upload(result);
+        return;
+    }
+
+    Job *job = new Job();
+    job->load = std::move(load);
+    job->upload = std::move(upload);
+    job->result = false;
+    job->next = nullptr;
+
+    pendingCount++;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        requests.push_back(job);
+    }
+    workAvailable.notify_one();
+}
+
+
+void AssetLoader::Update()
+{
+    Job *job = TakeFinished();
+    while (job)
+    {
+        Job *next = job->next;
+        if (job->upload)
+            job->upload(job->result);
+        delete job;
+        pendingCount--;
+        job = next;
+    }
+}
+
+
+void AssetLoader::Flush()
+{
+    WaitUntil([]() { return false; });
+}
+
+
+void AssetLoader::WaitUntil(const std::function<bool()> &condition)
+{
+    while (true)
+    {
+        Update();
+        if (pendingCount == 0 || condition())
+            return;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        jobFinished.wait(lock, [] { return finished.load() != nullptr; });
+    }
+}
+
+
+size_t AssetLoader::GetPendingCount()
+{
+    return pendingCount;
+}
+
+
+bool AssetLoader::IsWorkerThread()
+{
+    return workerThread;
+}
+
+
+void AssetLoader::WorkerLoop()
+{
+    workerThread = true;
+    while (true)
+    {
+        Job *job = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            workAvailable.wait(lock, [] { return !running || !requests.empty(); });
+            if (requests.empty())
+                return;
+
+            job = requests.front();
+            requests.pop_front();
+        }
+
+        job->result = job->load();
+        PushFinished(job);
+
+        // Taking the lock orders the push before a Flush() checking for finished jobs
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+        }
+        jobFinished.notify_all();
+    }
+}
+
+
+void AssetLoader::PushFinished(Job *job)
+{
+    Job *head = finished.load(std::memory_order_relaxed);
+    do
+    {
+        job->next = head;
+    } while (!finished.compare_exchange_weak(head, job, std::memory_order_release, std::memory_order_relaxed));
+}
+
+
+AssetLoader::Job *AssetLoader::TakeFinished()
+{
+    Job *list = finished.exchange(nullptr, std::memory_order_acquire);
+
+    // Pushed newest first, reversed so uploads run in completion order
+    Job *ordered = nullptr;
+    while (list)
+    {
+        Job *next = list->next;
+        list->next = ordered;
+        ordered = list;
+        list = next;
+    }
+    return ordered;
+}
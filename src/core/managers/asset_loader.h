@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Worker pool for asset loading. The load half of a job (file I/O, decoding, parsing) runs on a worker, the
+// finished job is pushed on a lock-free queue and its upload half (GL object creation) runs on the render thread
+// in Update() or Flush(). Without workers both halves run inline in Submit().
+class AssetLoader
+{
+ public:
+    // 0 workers: one per hardware thread, minus the render thread
+    static void Init(unsigned int nrWorkers = 0);
+    static void Shutdown();
+
+    // load must not touch GL, upload receives its result on the render thread
+    static void Submit(std::function<bool()> load, std::function<void(bool)> upload);
+
+    // Render thread: runs the uploads of the jobs finished so far
+    static void Update();
+    // Render thread: blocks until every submitted job is loaded and uploaded, e.g. the end of a loading stage
+    static void Flush();
+    // Render thread: like Flush, but returns as soon as the condition holds (checked after each batch of uploads)
+    static void WaitUntil(const std::function<bool()> &condition);
+
+    static size_t GetPendingCount();
+
+    // True on a worker. The workers already load in parallel, so their jobs shouldn't spread out on threads of their
+    // own
+    static bool IsWorkerThread();
+
+ protected:
+    AssetLoader() = delete;
+    ~AssetLoader() = delete;
+
+ private:
+    struct Job
+    {
+        std::function<bool()> load;
+        std::function<void(bool)> upload;
+        bool result;
+        Job *next;
+    };
+
+    static void WorkerLoop();
+    // Multiple producers push with a CAS on the head, the single consumer takes the whole list at once
+    static void PushFinished(Job *job);
+    static Job *TakeFinished();
+
+ private:
+    static std::vector<std::thread> workers;
+    static std::mutex mutex;
+    static std::condition_variable workAvailable;
+    static std::condition_variable jobFinished;
+    static std::deque<Job*> requests;
+    static bool running;
+    static thread_local bool workerThread;
+
+    static std::atomic<Job*> finished;
+    static std::atomic<size_t> pendingCount;
+};
@@ -0,0 +1,263 @@
+#include "core/managers/asset_registry.h"
+
+#include "core/gpu/mesh.h"
+#include "core/gpu/shader.h"
+#include "core/managers/asset_loader.h"
+#include "core/managers/texture_manager.h"
+
+#include <iomanip>
+#include <iostream>
+
+
+AssetRegistry::AssetTable<Mesh> AssetRegistry::meshes;
+AssetRegistry::AssetTable<Shader> AssetRegistry::shaders;
+unsigned int AssetRegistry::frame = 0;
+
+
+// Import steps of a loaded mesh, below its row
+static void PrintDetails(const Mesh *mesh)
+{
+    for (auto &line : mesh->GetImportReport())
+    {
+        std::cout << "\t\t" << line << std::endl;
+    }
+}
+
+
+static void PrintDetails(const Shader *)
+{
+}
+
+
+void AssetRegistry::DeclareMesh(const std::string &name, const std::string &fileLocation, const std::string &fileName,
+                                bool useMaterials, bool compactIndices)
+{
+    // Same file imported with the same flags, aliases share the mesh
+    std::string source = fileLocation + '/' + fileName + (useMaterials ? "" : " (no materials)") +
+        (compactIndices ? " (16 bit)" : "");
+
+    size_t index;
+    if (!Declare(meshes, name, source, index))
+        return;
+
+    Asset<Mesh> &asset = meshes.assets[index];
+    // Set before the import so materials nobody renders aren't read
+    Mesh *mesh = new Mesh(name);
+    mesh->UseMaterials(useMaterials);
+    mesh->UseCompactIndices(compactIndices);
+    asset.object = mesh;
+    asset.import = [mesh, fileLocation, fileName]() { return mesh->ImportMesh(fileLocation, fileName); };
+    asset.upload = [mesh]() { return mesh->UploadMesh(); };
+}
+
+
+void AssetRegistry::DeclareShader(const std::string &name, const std::vector<std::pair<std::string, GLenum>> &files)
+{
+    std::string source;
+    for (auto &file : files)
+    {
+        source += (source.empty() ? "" : " + ") + file.first;
+    }
+
+    size_t index;
+    if (!Declare(shaders, name, source, index))
+        return;
+
+    Asset<Shader> &asset = shaders.assets[index];
+    Shader *shader = new Shader(name);
+    for (auto &file : files)
+    {
+        shader->AddShader(file.first, file.second);
+    }
+    asset.object = shader;
+    asset.import = [shader]() { return shader->ReadShaderFiles(); };
+    asset.upload = [shader]() { return shader->CreateAndLink() != 0; };
+}
+
+
+Mesh *AssetRegistry::GetMesh(const std::string &name)
+{
+    return Resolve(meshes, name);
+}
+
+
+Shader *AssetRegistry::GetShader(const std::string &name)
+{
+    return Resolve(shaders, name);
+}
+
+
+void AssetRegistry::PrefetchMesh(const std::string &name)
+{
+    Prefetch(meshes, name);
+}
+
+
+void AssetRegistry::PrefetchShader(const std::string &name)
+{
+    Prefetch(shaders, name);
+}
+
+
+void AssetRegistry::Update()
+{
+    if (++frame == REPORT_FRAME)
+    {
+        PrintReport();
+    }
+}
+
+
+void AssetRegistry::PrintReport()
+{
+    std::cout << "=====================================================" << std::endl;
+    std::cout << "Assets after " << frame << " frames" << std::endl;
+    PrintTable(meshes, "Meshes");
+    PrintTable(shaders, "Shaders");
+    TextureManager::PrintUsageReport();
+}
+
+
+template <typename T>
+bool AssetRegistry::Declare(AssetTable<T> &table, const std::string &name, const std::string &source, size_t &index)
+{
+    auto declared = table.mapNames.find(name);
+    if (declared != table.mapNames.end())
+    {
+        // Declaring the same thing twice is fine, a name can't point to two sources though
+        if (table.assets[declared->second].source != source)
+            std::cerr << "Warning: asset '" << name << "' is already declared. Skipping." << std::endl;
+        return false;
+    }
+
+    auto it = table.mapSources.find(source);
+    if (it != table.mapSources.end())
+    {
+        table.assets[it->second].names.push_back(name);
+        table.mapNames[name] = it->second;
+        return false;
+    }
+
+    index = table.assets.size();
+    table.assets.emplace_back();
+    table.assets[index].source = source;
+    table.assets[index].names.push_back(name);
+    table.mapNames[name] = index;
+    table.mapSources[source] = index;
+    return true;
+}
+
+
+template <typename T>
+T *AssetRegistry::Resolve(AssetTable<T> &table, const std::string &name)
+{
+    auto it = table.mapNames.find(name);
+    if (it == table.mapNames.end())
+        return nullptr;
+
+    size_t index = it->second;
+    Asset<T> &asset = table.assets[index];
+    asset.used = true;
+
+    if (asset.state == ASSET_DECLARED)
+    {
+        // First use without a prefetch, loaded here on the render thread
+        asset.requestTime = std::chrono::steady_clock::now();
+        bool loaded = asset.import() && asset.upload();
+        Finish(asset, loaded);
+    }
+    else if (asset.state == ASSET_QUEUED)
+    {
+        AssetLoader::WaitUntil([&table, index]() { return table.assets[index].state != ASSET_QUEUED; });
+    }
+
+    return asset.state == ASSET_RESIDENT ? asset.object : nullptr;
+}
+
+
+template <typename T>
+void AssetRegistry::Prefetch(AssetTable<T> &table, const std::string &name)
+{
+    auto it = table.mapNames.find(name);
+    if (it == table.mapNames.end())
+    {
+        std::cerr << "Warning: prefetch of undeclared asset '" << name << "'" << std::endl;
+        return;
+    }
+
+    size_t index = it->second;
+    Asset<T> &asset = table.assets[index];
+    if (asset.state != ASSET_DECLARED)
+        return;
+
+    asset.state = ASSET_QUEUED;
+    asset.prefetched = true;
+    asset.requestTime = std::chrono::steady_clock::now();
+    AssetLoader::Submit(asset.import, [&table, index](bool imported)
+    {
+        Asset<T> &queued = table.assets[index];
+        Finish(queued, imported && queued.upload());
+    });
+}
+
+
+template <typename T>
+void AssetRegistry::Finish(Asset<T> &asset, bool loaded)
+{
+    asset.state = loaded ? ASSET_RESIDENT : ASSET_FAILED;
+    asset.loadMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - asset.requestTime).count();
+
+    // The load functions hold copies of the paths, not needed anymore
+    asset.import = nullptr;
+    asset.upload = nullptr;
+
+    if (!loaded)
+    {
+        std::cerr << "Error: failed to load '" << asset.names[0] << "' from '" << asset.source << "'" << std::endl;
+    }
+}
+
+
+template <typename T>
+void AssetRegistry::PrintTable(const AssetTable<T> &table, const char *kind)
+{
+    size_t loaded = 0, unused = 0;
+    for (auto &asset : table.assets)
+    {
+        if (asset.state == ASSET_RESIDENT)
+            loaded++;
+        if (!asset.used)
+            unused++;
+    }
+
+    std::cout << kind << ": " << table.mapNames.size() << " names, " << table.assets.size() << " sources, "
+              << loaded << " loaded, " << unused << " never used" << std::endl;
+
+    for (auto &asset : table.assets)
+    {
+        std::string names;
+        for (auto &name : asset.names)
+        {
+            names += (names.empty() ? "" : ", ") + name;
+        }
+
+        const char *state = "not loaded";
+        if (asset.state == ASSET_QUEUED)
+            state = "queued";
+        else if (asset.state == ASSET_FAILED)
+            state = "failed";
+        else if (asset.state == ASSET_RESIDENT)
+            state = asset.prefetched ? "prefetched" : "on demand";
+
+        std::cout << "\t" << std::left << std::setw(40) << names << std::setw(12) << state;
+        if (asset.state == ASSET_RESIDENT || asset.state == ASSET_FAILED)
+            std::cout << std::right << std::setw(9) << std::fixed << std::setprecision(1) << asset.loadMilliseconds << " ms";
+        else
+            std::cout << std::setw(12) << "";
+        std::cout << (asset.used ? "" : "  (unused)") << std::endl;
+
+        if (asset.state == ASSET_RESIDENT)
+            PrintDetails(asset.object);
+    }
+    std::cout << std::defaultfloat;
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "utils/gl_utils.h"
+
+class Mesh;
+class Shader;
+
+
+// Named meshes and shaders declared up front and loaded on their first lookup, or ahead of it when prefetched on
+// the asset loader. Declarations of the same source (files and load flags) share one object, so aliases and
+// repeated declarations load once, and declared assets nobody looks up are never read.
+class AssetRegistry
+{
+ public:
+    static void DeclareMesh(const std::string &name, const std::string &fileLocation, const std::string &fileName,
+                            bool useMaterials = true, bool compactIndices = false);
+    // Source files of the program with their stage (GL_VERTEX_SHADER, GL_COMPUTE_SHADER, ...)
+    static void DeclareShader(const std::string &name, const std::vector<std::pair<std::string, GLenum>> &files);
+
+    // Render thread: loads on first use, or waits for the prefetch in flight. nullptr when the name isn't
+    // declared or the load failed
+    static Mesh *GetMesh(const std::string &name);
+    static Shader *GetShader(const std::string &name);
+
+    // Hints, queue the load on the asset loader so the first use finds the asset resident
+    static void PrefetchMesh(const std::string &name);
+    static void PrefetchShader(const std::string &name);
+
+    template <typename T>
+    static T *Get(const std::string &name);
+
+    // Render thread, once per frame: prints the usage report once the startup frames are over
+    static void Update();
+    // What was declared, loaded (on demand or prefetched) and used, with the load times
+    static void PrintReport();
+
+ protected:
+    AssetRegistry() = delete;
+    ~AssetRegistry() = delete;
+
+ private:
+    enum AssetState
+    {
+        ASSET_DECLARED,
+        ASSET_QUEUED,
+        ASSET_RESIDENT,
+        ASSET_FAILED
+    };
+
+    template <typename T>
+    struct Asset
+    {
+        T *object = nullptr;
+        std::string source;
+        std::vector<std::string> names;
+        AssetState state = ASSET_DECLARED;
+
+        // CPU half (any thread) and GL half (render thread) of the load
+        std::function<bool()> import;
+        std::function<bool()> upload;
+
+        bool prefetched = false;
+        bool used = false;
+        std::chrono::steady_clock::time_point requestTime;
+        double loadMilliseconds = 0;
+    };
+
+    template <typename T>
+    struct AssetTable
+    {
+        std::vector<Asset<T>> assets;
+        std::unordered_map<std::string, size_t> mapNames;
+        std::unordered_map<std::string, size_t> mapSources;
+    };
+
+    template <typename T>
+    static bool Declare(AssetTable<T> &table, const std::string &name, const std::string &source, size_t &index);
+    template <typename T>
+    static T *Resolve(AssetTable<T> &table, const std::string &name);
+    template <typename T>
+    static void Prefetch(AssetTable<T> &table, const std::string &name);
+    template <typename T>
+    static void Finish(Asset<T> &asset, bool loaded);
+    template <typename T>
+    static void PrintTable(const AssetTable<T> &table, const char *kind);
+
+    // Frames after which the startup report is printed
+    static const unsigned int REPORT_FRAME = 300;
+
+ private:
+    static AssetTable<Mesh> meshes;
+    static AssetTable<Shader> shaders;
+    static unsigned int frame;
+};
+
+
+template <>
+inline Mesh *AssetRegistry::Get<Mesh>(const std::string &name)
+{
+    return GetMesh(name);
+}
+
+
+template <>
+inline Shader *AssetRegistry::Get<Shader>(const std::string &name)
+{
+    return GetShader(name);
+}
+
+
+// Name -> asset map of a scene. Looking up a name missing from the map resolves its registry declaration and keeps
+// the result, entries stored directly (procedural meshes, ...) behave as in a plain map. Iteration only visits the
+// assets resolved so far.
+template <typename T>
+class AssetMap : public std::unordered_map<std::string, T*>
+{
+    typedef std::unordered_map<std::string, T*> Base;
+
+ public:
+    T *&operator[](const std::string &name)
+    {
+        T *&slot = Base::operator[](name);
+        if (slot == nullptr)
+            slot = AssetRegistry::Get<T>(name);
+        return slot;
+    }
+
+    T *at(const std::string &name)
+    {
+        Resolve(name);
+        return Base::at(name);
+    }
+
+    // Const lookups can't keep what they resolve, the registry returns the same object each time
+    T *at(const std::string &name) const
+    {
+        auto it = Base::find(name);
+        if (it != Base::end() && it->second)
+            return it->second;
+
+        T *object = AssetRegistry::Get<T>(name);
+        return object ? object : Base::at(name);
+    }
+
+    typename Base::iterator find(const std::string &name)
+    {
+        Resolve(name);
+        return Base::find(name);
+    }
+
+    size_t count(const std::string &name)
+    {
+        Resolve(name);
+        return Base::count(name);
+    }
+
+ private:
+    void Resolve(const std::string &name)
+    {
+        auto it = Base::find(name);
+        if (it != Base::end() && it->second)
+            return;
+
+        // Failed or undeclared names don't stay behind as null entries
+        T *object = AssetRegistry::Get<T>(name);
+        if (object)
+            Base::operator[](name) = object;
+        else if (it != Base::end())
+            Base::erase(it);
+    }
+};
@@ -0,0 +1,642 @@
+#include "core/managers/mesh_cache.h"
+
+#include "core/gpu/mesh.h"
+#include "utils/image_utils.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+
+static const uint32_t CACHE_MAGIC = 0x4348534D;     // "MSHC"
+// Bumped whenever the layout or the import post-processing change, older files are rebuilt
+static const uint32_t CACHE_VERSION = 3;
+static const size_t SECTION_ALIGNMENT = 16;
+
+enum CacheSection
+{
+    SECTION_POSITIONS,
+    SECTION_NORMALS,
+    SECTION_TEX_COORDS,
+    SECTION_BONES,
+    SECTION_INDICES,
+    SECTION_ENTRIES,
+    SECTION_LODS,
+    SECTION_MATERIALS,
+    SECTION_BONE_INFO,
+    SECTION_NODES,
+    SECTION_NODE_MESHES,
+    SECTION_ANIMATIONS,
+    SECTION_CHANNELS,
+    SECTION_KEYS,
+    SECTION_STRINGS,
+    SECTION_COUNT
+};
+
+struct CacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t importFlags;
+    uint32_t drawMode;
+    uint64_t sourceHash;
+    uint64_t sectionOffset[SECTION_COUNT];
+    uint64_t sectionSize[SECTION_COUNT];
+    glm::mat4 globalInverseTransform;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    glm::vec3 sphereCenter;
+    float sphereRadius;
+};
+
+// Offset / length in the string section
+struct CacheString
+{
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct CacheEntry
+{
+    uint32_t nrIndices;
+    uint32_t baseVertex;
+    uint32_t baseIndex;
+    uint32_t materialIndex;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    glm::vec3 sphereCenter;
+    float sphereRadius;
+    uint32_t firstLod;
+    uint32_t nrLods;
+};
+
+struct CacheLod
+{
+    uint32_t nrIndices;
+    uint32_t baseIndex;
+    float error;
+};
+
+struct CacheMaterial
+{
+    glm::vec4 ambient;
+    glm::vec4 diffuse;
+    glm::vec4 specular;
+    glm::vec4 emissive;
+    float shininess;
+    uint32_t present;
+    CacheString texture;
+};
+
+struct CacheBone
+{
+    glm::mat4 offset;
+    CacheString name;
+};
+
+// Nodes in pre-order, the parent always comes first
+struct CacheNode
+{
+    aiMatrix4x4 transformation;
+    CacheString name;
+    int32_t parent;
+    uint32_t firstMesh;
+    uint32_t nrMeshes;
+};
+
+struct CacheAnimation
+{
+    double duration;
+    double ticksPerSecond;
+    CacheString name;
+    uint32_t firstChannel;
+    uint32_t nrChannels;
+};
+
+struct CacheChannel
+{
+    CacheString nodeName;
+    uint32_t preState;
+    uint32_t postState;
+    uint32_t firstPositionKey;
+    uint32_t nrPositionKeys;
+    uint32_t firstRotationKey;
+    uint32_t nrRotationKeys;
+    uint32_t firstScalingKey;
+    uint32_t nrScalingKeys;
+};
+
+// Position, rotation (w last) and scaling keys share one layout
+struct CacheKey
+{
+    double time;
+    float value[4];
+};
+
+
+// Builds the file in memory: the header, then every section aligned so it can be used in place once mapped
+class CacheWriter
+{
+ public:
+    CacheWriter() : blob(sizeof(CacheHeader), 0)
+    {
+        memset(&header, 0, sizeof(header));
+    }
+
+    template <typename T>
+    void WriteSection(CacheSection section, const std::vector<T> &items)
+    {
+        WriteSection(section, items.data(), items.size() * sizeof(T));
+    }
+
+    void WriteSection(CacheSection section, const void *data, size_t size)
+    {
+        blob.resize((blob.size() + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT, 0);
+        header.sectionOffset[section] = blob.size();
+        header.sectionSize[section] = size;
+        if (size)
+        {
+            const unsigned char *bytes = static_cast<const unsigned char *>(data);
+            blob.insert(blob.end(), bytes, bytes + size);
+        }
+    }
+
+    CacheString AddString(const std::string &text)
+    {
+        CacheString entry = { static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(text.size()) };
+        strings += text;
+        return entry;
+    }
+
+    bool Save(const std::string &fileName)
+    {
+        WriteSection(SECTION_STRINGS, strings.data(), strings.size());
+        memcpy(blob.data(), &header, sizeof(header));
+
+        std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+            return false;
+        file.write(reinterpret_cast<const char *>(blob.data()), blob.size());
+        return file.good();
+    }
+
+ public:
+    CacheHeader header;
+
+ private:
+    std::vector<unsigned char> blob;
+    std::string strings;
+};
+
+
+// Typed view of a section of the mapped file, null when it doesn't fit the file
+template <typename T>
+static const T *GetSection(const MappedFile &file, const CacheHeader &header, CacheSection section, size_t &count)
+{
+    uint64_t offset = header.sectionOffset[section];
+    uint64_t size = header.sectionSize[section];
+    count = 0;
+    if (offset % SECTION_ALIGNMENT || size % sizeof(T) || offset > file.GetSize() || size > file.GetSize() - offset)
+        return nullptr;
+
+    count = static_cast<size_t>(size / sizeof(T));
+    return reinterpret_cast<const T *>(file.GetData() + offset);
+}
+
+
+static std::string GetString(const char *strings, size_t stringsSize, CacheString entry)
+{
+    if (strings == nullptr || static_cast<size_t>(entry.offset) + entry.length > stringsSize)
+        return std::string();
+    return std::string(strings + entry.offset, entry.length);
+}
+
+
+static void FlattenNodes(const aiNode *node, int parent, CacheWriter &writer,
+                         std::vector<CacheNode> &nodes, std::vector<uint32_t> &nodeMeshes)
+{
+    CacheNode entry;
+    entry.transformation = node->mTransformation;
+    entry.name = writer.AddString(node->mName.C_Str());
+    entry.parent = parent;
+    entry.firstMesh = static_cast<uint32_t>(nodeMeshes.size());
+    entry.nrMeshes = node->mNumMeshes;
+    nodeMeshes.insert(nodeMeshes.end(), node->mMeshes, node->mMeshes + node->mNumMeshes);
+
+    int index = static_cast<int>(nodes.size());
+    nodes.push_back(entry);
+    for (unsigned int i = 0; i < node->mNumChildren; i++)
+    {
+        FlattenNodes(node->mChildren[i], index, writer, nodes, nodeMeshes);
+    }
+}
+
+
+bool MeshCache::enabled = true;
+
+
+void MeshCache::SetEnabled(bool state)
+{
+    enabled = state;
+}
+
+
+bool MeshCache::IsEnabled()
+{
+    return enabled;
+}
+
+
+std::string MeshCache::GetCachePath(const std::string &sourcePath)
+{
+    return sourcePath + ".mcache";
+}
+
+
+bool MeshCache::HashFile(const std::string &sourcePath, uint64_t &hash)
+{
+    MappedFile file;
+    if (!file.Open(sourcePath))
+        return false;
+
+    hash = image_utils::Hash(file.GetData(), file.GetSize());
+    return true;
+}
+
+
+bool MeshCache::Load(Mesh *mesh, const std::string &sourcePath, uint64_t hash, unsigned int importFlags)
+{
+    std::unique_ptr<MappedMeshStreams> streams(new MappedMeshStreams());
+    MappedFile &file = streams->file;
+    if (!file.Open(GetCachePath(sourcePath)) || file.GetSize() < sizeof(CacheHeader))
+        return false;
+
+    CacheHeader header;
+    memcpy(&header, file.GetData(), sizeof(header));
+    if (header.magic != CACHE_MAGIC || header.version != CACHE_VERSION || header.sourceHash != hash ||
+        header.importFlags != importFlags || header.drawMode != mesh->glDrawMode)
+    {
+        return false;
+    }
+
+    size_t nrPositions, nrNormals, nrTexCoords, nrBones, nrIndices, nrEntries, nrLods, nrMaterials, nrBoneInfo;
+    size_t nrNodes, nrNodeMeshes, nrAnimations, nrChannels, nrKeys, stringsSize;
+    auto positions = GetSection<glm::vec3>(file, header, SECTION_POSITIONS, nrPositions);
+    auto normals = GetSection<glm::vec3>(file, header, SECTION_NORMALS, nrNormals);
+    auto texCoords = GetSection<glm::vec2>(file, header, SECTION_TEX_COORDS, nrTexCoords);
+    auto bones = GetSection<VertexBoneData>(file, header, SECTION_BONES, nrBones);
+    auto indices = GetSection<unsigned int>(file, header, SECTION_INDICES, nrIndices);
+    auto entries = GetSection<CacheEntry>(file, header, SECTION_ENTRIES, nrEntries);
+    auto lods = GetSection<CacheLod>(file, header, SECTION_LODS, nrLods);
+    auto materials = GetSection<CacheMaterial>(file, header, SECTION_MATERIALS, nrMaterials);
+    auto boneInfo = GetSection<CacheBone>(file, header, SECTION_BONE_INFO, nrBoneInfo);
+    auto nodes = GetSection<CacheNode>(file, header, SECTION_NODES, nrNodes);
+    auto nodeMeshes = GetSection<uint32_t>(file, header, SECTION_NODE_MESHES, nrNodeMeshes);
+    auto animations = GetSection<CacheAnimation>(file, header, SECTION_ANIMATIONS, nrAnimations);
+    auto channels = GetSection<CacheChannel>(file, header, SECTION_CHANNELS, nrChannels);
+    auto keys = GetSection<CacheKey>(file, header, SECTION_KEYS, nrKeys);
+    auto strings = GetSection<char>(file, header, SECTION_STRINGS, stringsSize);
+
+    if (!positions || !normals || !texCoords || !bones || !indices || !entries || !lods || !materials || !boneInfo ||
+        !nodes || !nodeMeshes || !animations || !channels || !keys || !strings || nrNodes == 0 ||
+        nrNormals != nrPositions || nrTexCoords != nrPositions || nrBones != nrPositions)
+    {
+        return false;
+    }
+
+    // Everything the rebuild indexes is checked up front, a damaged file is a miss rather than a crash
+    for (size_t i = 0; i < nrEntries; i++)
+    {
+        if (static_cast<size_t>(entries[i].baseIndex) + entries[i].nrIndices > nrIndices ||
+            static_cast<size_t>(entries[i].firstLod) + entries[i].nrLods > nrLods)
+            return false;
+    }
+    for (size_t i = 0; i < nrLods; i++)
+    {
+        if (static_cast<size_t>(lods[i].baseIndex) + lods[i].nrIndices > nrIndices)
+            return false;
+    }
+    for (size_t i = 0; i < nrMaterials; i++)
+    {
+        // Baked without materials, Render() expects one per slot when they're used
+        if (mesh->useMaterial && !materials[i].present)
+            return false;
+    }
+    for (size_t i = 0; i < nrNodes; i++)
+    {
+        if (nodes[i].parent >= static_cast<int32_t>(i) || (i > 0 && nodes[i].parent < 0) ||
+            static_cast<size_t>(nodes[i].firstMesh) + nodes[i].nrMeshes > nrNodeMeshes)
+            return false;
+    }
+    for (size_t i = 0; i < nrAnimations; i++)
+    {
+        if (static_cast<size_t>(animations[i].firstChannel) + animations[i].nrChannels > nrChannels)
+            return false;
+    }
+    for (size_t i = 0; i < nrChannels; i++)
+    {
+        const CacheChannel &channel = channels[i];
+        if (static_cast<size_t>(channel.firstPositionKey) + channel.nrPositionKeys > nrKeys ||
+            static_cast<size_t>(channel.firstRotationKey) + channel.nrRotationKeys > nrKeys ||
+            static_cast<size_t>(channel.firstScalingKey) + channel.nrScalingKeys > nrKeys)
+            return false;
+    }
+
+    mesh->m_GlobalInverseTransform = header.globalInverseTransform;
+    mesh->boundsMin = header.boundsMin;
+    mesh->boundsMax = header.boundsMax;
+    mesh->sphereCenter = header.sphereCenter;
+    mesh->sphereRadius = header.sphereRadius;
+
+    mesh->meshEntries.resize(nrEntries);
+    for (size_t i = 0; i < nrEntries; i++)
+    {
+        MeshEntry &entry = mesh->meshEntries[i];
+        entry.nrIndices = entries[i].nrIndices;
+        entry.baseVertex = entries[i].baseVertex;
+        entry.baseIndex = entries[i].baseIndex;
+        entry.materialIndex = entries[i].materialIndex;
+        entry.boundsMin = entries[i].boundsMin;
+        entry.boundsMax = entries[i].boundsMax;
+        entry.sphereCenter = entries[i].sphereCenter;
+        entry.sphereRadius = entries[i].sphereRadius;
+
+        entry.lods.resize(entries[i].nrLods);
+        for (size_t j = 0; j < entry.lods.size(); j++)
+        {
+            const CacheLod &lod = lods[entries[i].firstLod + j];
+            entry.lods[j].nrIndices = lod.nrIndices;
+            entry.lods[j].baseIndex = lod.baseIndex;
+            entry.lods[j].error = lod.error;
+        }
+    }
+
+    // Bones
+    mesh->m_NumBones = static_cast<int>(nrBoneInfo);
+    mesh->m_BoneInfo.resize(nrBoneInfo);
+    for (size_t i = 0; i < nrBoneInfo; i++)
+    {
+        mesh->m_BoneInfo[i].boneOffset = boneInfo[i].offset;
+        mesh->m_BoneMapping[GetString(strings, stringsSize, boneInfo[i].name)] = static_cast<int>(i);
+    }
+
+    // Node tree, children counted first so every array is allocated once
+    std::vector<aiNode*> treeNodes(nrNodes);
+    std::vector<unsigned int> nrChildren(nrNodes, 0);
+    for (size_t i = 1; i < nrNodes; i++)
+    {
+        nrChildren[nodes[i].parent]++;
+    }
+    for (size_t i = 0; i < nrNodes; i++)
+    {
+        aiNode *node = new aiNode();
+        node->mName.Set(GetString(strings, stringsSize, nodes[i].name));
+        node->mTransformation = nodes[i].transformation;
+        node->mNumMeshes = nodes[i].nrMeshes;
+        node->mMeshes = new unsigned int[nodes[i].nrMeshes];
+        memcpy(node->mMeshes, nodeMeshes + nodes[i].firstMesh, nodes[i].nrMeshes * sizeof(unsigned int));
+        node->mChildren = new aiNode*[nrChildren[i]];
+        node->mNumChildren = 0;
+        node->mParent = nullptr;
+        treeNodes[i] = node;
+
+        if (i > 0)
+        {
+            aiNode *parent = treeNodes[nodes[i].parent];
+            node->mParent = parent;
+            parent->mChildren[parent->mNumChildren++] = node;
+        }
+    }
+    mesh->rootNode = treeNodes[0];
+
+    // Animations, the same structures CopyAnimations builds from the scene
+    mesh->numAnim = static_cast<int>(nrAnimations);
+    mesh->anim = new aiAnimation*[nrAnimations];
+    for (size_t i = 0; i < nrAnimations; i++)
+    {
+        aiAnimation *animation = new aiAnimation();
+        animation->mName.Set(GetString(strings, stringsSize, animations[i].name));
+        animation->mDuration = animations[i].duration;
+        animation->mTicksPerSecond = animations[i].ticksPerSecond;
+        animation->mNumChannels = animations[i].nrChannels;
+        animation->mChannels = new aiNodeAnim*[animation->mNumChannels];
+
+        for (unsigned int c = 0; c < animation->mNumChannels; c++)
+        {
+            const CacheChannel &source = channels[animations[i].firstChannel + c];
+            aiNodeAnim *channel = new aiNodeAnim();
+            channel->mNodeName.Set(GetString(strings, stringsSize, source.nodeName));
+            channel->mPreState = static_cast<aiAnimBehaviour>(source.preState);
+            channel->mPostState = static_cast<aiAnimBehaviour>(source.postState);
+
+            channel->mNumPositionKeys = source.nrPositionKeys;
+            channel->mPositionKeys = new aiVectorKey[source.nrPositionKeys];
+            for (unsigned int k = 0; k < source.nrPositionKeys; k++)
+            {
+                const CacheKey &key = keys[source.firstPositionKey + k];
+                channel->mPositionKeys[k] = aiVectorKey(key.time, aiVector3D(key.value[0], key.value[1], key.value[2]));
+            }
+
+            channel->mNumRotationKeys = source.nrRotationKeys;
+            channel->mRotationKeys = new aiQuatKey[source.nrRotationKeys];
+            for (unsigned int k = 0; k < source.nrRotationKeys; k++)
+            {
+                const CacheKey &key = keys[source.firstRotationKey + k];
+                channel->mRotationKeys[k] = aiQuatKey(key.time, aiQuaternion(key.value[3], key.value[0], key.value[1], key.value[2]));
+            }
+
+            channel->mNumScalingKeys = source.nrScalingKeys;
+            channel->mScalingKeys = new aiVectorKey[source.nrScalingKeys];
+            for (unsigned int k = 0; k < source.nrScalingKeys; k++)
+            {
+                const CacheKey &key = keys[source.firstScalingKey + k];
+                channel->mScalingKeys[k] = aiVectorKey(key.time, aiVector3D(key.value[0], key.value[1], key.value[2]));
+            }
+
+            animation->mChannels[c] = channel;
+        }
+
+        animation->mNumMeshChannels = 0;
+        animation->mMeshChannels = nullptr;
+        mesh->anim[i] = animation;
+    }
+
+    // Materials, the textures are requested by Mesh::UploadMesh as on a regular import
+    mesh->materials.resize(nrMaterials, nullptr);
+    mesh->materialTextures.resize(nrMaterials);
+    if (mesh->useMaterial)
+    {
+        for (size_t i = 0; i < nrMaterials; i++)
+        {
+            Material *material = new Material();
+            material->ambient = materials[i].ambient;
+            material->diffuse = materials[i].diffuse;
+            material->specular = materials[i].specular;
+            material->emissive = materials[i].emissive;
+            material->shininess = materials[i].shininess;
+            mesh->materials[i] = material;
+            mesh->materialTextures[i] = GetString(strings, stringsSize, materials[i].texture);
+        }
+    }
+
+    // The streams stay in the mapping, no CPU copy is made
+    streams->positions = positions;
+    streams->normals = normals;
+    streams->texCoords = texCoords;
+    streams->bones = bones;
+    streams->indices = indices;
+    streams->nrVertices = nrPositions;
+    streams->nrIndices = nrIndices;
+    delete mesh->cachedStreams;
+    mesh->cachedStreams = streams.release();
+    return true;
+}
+
+
+bool MeshCache::Store(const Mesh *mesh, const std::string &sourcePath, uint64_t hash, unsigned int importFlags)
+{
+    if (mesh->rootNode == nullptr || mesh->positions.empty() || mesh->bones.size() != mesh->positions.size())
+        return false;
+
+    CacheWriter writer;
+    CacheHeader &header = writer.header;
+    header.magic = CACHE_MAGIC;
+    header.version = CACHE_VERSION;
+    header.importFlags = importFlags;
+    header.drawMode = mesh->glDrawMode;
+    header.sourceHash = hash;
+    header.globalInverseTransform = mesh->m_GlobalInverseTransform;
+    header.boundsMin = mesh->boundsMin;
+    header.boundsMax = mesh->boundsMax;
+    header.sphereCenter = mesh->sphereCenter;
+    header.sphereRadius = mesh->sphereRadius;
+
+    writer.WriteSection(SECTION_POSITIONS, mesh->positions);
+    writer.WriteSection(SECTION_NORMALS, mesh->normals);
+    writer.WriteSection(SECTION_TEX_COORDS, mesh->texCoords);
+    writer.WriteSection(SECTION_BONES, mesh->bones);
+    writer.WriteSection(SECTION_INDICES, mesh->indices);
+
+    std::vector<CacheEntry> entries;
+    std::vector<CacheLod> lods;
+    for (auto &meshEntry : mesh->meshEntries)
+    {
+        CacheEntry entry;
+        entry.nrIndices = meshEntry.nrIndices;
+        entry.baseVertex = meshEntry.baseVertex;
+        entry.baseIndex = meshEntry.baseIndex;
+        entry.materialIndex = meshEntry.materialIndex;
+        entry.boundsMin = meshEntry.boundsMin;
+        entry.boundsMax = meshEntry.boundsMax;
+        entry.sphereCenter = meshEntry.sphereCenter;
+        entry.sphereRadius = meshEntry.sphereRadius;
+        entry.firstLod = static_cast<uint32_t>(lods.size());
+        entry.nrLods = static_cast<uint32_t>(meshEntry.lods.size());
+        entries.push_back(entry);
+
+        for (auto &meshLod : meshEntry.lods)
+        {
+            CacheLod lod = { meshLod.nrIndices, meshLod.baseIndex, meshLod.error };
+            lods.push_back(lod);
+        }
+    }
+    writer.WriteSection(SECTION_ENTRIES, entries);
+    writer.WriteSection(SECTION_LODS, lods);
+
+    std::vector<CacheMaterial> materials;
+    for (size_t i = 0; i < mesh->materials.size(); i++)
+    {
+        const Material *material = mesh->materials[i];
+        CacheMaterial entry;
+        memset(&entry, 0, sizeof(entry));
+        if (material)
+        {
+            entry.ambient = material->ambient;
+            entry.diffuse = material->diffuse;
+            entry.specular = material->specular;
+            entry.emissive = material->emissive;
+            entry.shininess = material->shininess;
+            entry.present = 1;
+            entry.texture = writer.AddString(i < mesh->materialTextures.size() ? mesh->materialTextures[i] : "");
+        }
+        materials.push_back(entry);
+    }
+    writer.WriteSection(SECTION_MATERIALS, materials);
+
+    std::vector<CacheBone> boneInfo(mesh->m_BoneInfo.size());
+    for (auto &bone : mesh->m_BoneMapping)
+    {
+        boneInfo[bone.second].offset = mesh->m_BoneInfo[bone.second].boneOffset;
+        boneInfo[bone.second].name = writer.AddString(bone.first);
+    }
+    writer.WriteSection(SECTION_BONE_INFO, boneInfo);
+
+    std::vector<CacheNode> nodes;
+    std::vector<uint32_t> nodeMeshes;
+    FlattenNodes(mesh->rootNode, -1, writer, nodes, nodeMeshes);
+    writer.WriteSection(SECTION_NODES, nodes);
+    writer.WriteSection(SECTION_NODE_MESHES, nodeMeshes);
+
+    std::vector<CacheAnimation> animations;
+    std::vector<CacheChannel> channels;
+    std::vector<CacheKey> keys;
+    for (int i = 0; i < mesh->numAnim; i++)
+    {
+        const aiAnimation *animation = mesh->anim[i];
+        CacheAnimation entry;
+        entry.duration = animation->mDuration;
+        entry.ticksPerSecond = animation->mTicksPerSecond;
+        entry.name = writer.AddString(animation->mName.C_Str());
+        entry.firstChannel = static_cast<uint32_t>(channels.size());
+        entry.nrChannels = animation->mNumChannels;
+        animations.push_back(entry);
+
+        for (unsigned int c = 0; c < animation->mNumChannels; c++)
+        {
+            const aiNodeAnim *source = animation->mChannels[c];
+            CacheChannel channel;
+            channel.nodeName = writer.AddString(source->mNodeName.C_Str());
+            channel.preState = source->mPreState;
+            channel.postState = source->mPostState;
+
+            channel.firstPositionKey = static_cast<uint32_t>(keys.size());
+            channel.nrPositionKeys = source->mNumPositionKeys;
+            for (unsigned int k = 0; k < source->mNumPositionKeys; k++)
+            {
+                const aiVectorKey &key = source->mPositionKeys[k];
+                keys.push_back({ key.mTime, { key.mValue.x, key.mValue.y, key.mValue.z, 0.0f } });
+            }
+
+            channel.firstRotationKey = static_cast<uint32_t>(keys.size());
+            channel.nrRotationKeys = source->mNumRotationKeys;
+            for (unsigned int k = 0; k < source->mNumRotationKeys; k++)
+            {
+                const aiQuatKey &key = source->mRotationKeys[k];
+                keys.push_back({ key.mTime, { key.mValue.x, key.mValue.y, key.mValue.z, key.mValue.w } });
+            }
+
+            channel.firstScalingKey = static_cast<uint32_t>(keys.size());
+            channel.nrScalingKeys = source->mNumScalingKeys;
+            for (unsigned int k = 0; k < source->mNumScalingKeys; k++)
+            {
+                const aiVectorKey &key = source->mScalingKeys[k];
+                keys.push_back({ key.mTime, { key.mValue.x, key.mValue.y, key.mValue.z, 0.0f } });
+            }
+
+            channels.push_back(channel);
+        }
+    }
+    writer.WriteSection(SECTION_ANIMATIONS, animations);
+    writer.WriteSection(SECTION_CHANNELS, channels);
+    writer.WriteSection(SECTION_KEYS, keys);
+
+    std::string cachePath = GetCachePath(sourcePath);
+    if (!writer.Save(cachePath))
+    {
+        std::cerr << "Mesh cache: can't write " << cachePath << std::endl;
+        return false;
+    }
+    return true;
+}
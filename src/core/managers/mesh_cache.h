@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "core/gpu/vertex_bone_data.h"
+#include "utils/mapped_file.h"
+
+class Mesh;
+
+
+// Vertex streams of a cache hit, pointing into the mapped file until Mesh::UploadMesh copies them to the GPU
+struct MappedMeshStreams
+{
+    MappedFile file;
+    const glm::vec3 *positions = nullptr;
+    const glm::vec3 *normals = nullptr;
+    const glm::vec2 *texCoords = nullptr;
+    const VertexBoneData *bones = nullptr;
+    const unsigned int *indices = nullptr;
+    size_t nrVertices = 0;
+    size_t nrIndices = 0;
+};
+
+
+// Imported and optimized meshes stored next to the model (<model>.mcache): vertex streams, entries with their
+// bounds and levels of detail, materials, bones, the node tree and the animation keys. Keyed by the hash of the source file and the
+// import flags, a hit maps the file instead of running the importer and the streams are uploaded straight from it.
+// Neither Load nor Store touch GL, both run on loader threads.
+class MeshCache
+{
+ public:
+    static void SetEnabled(bool state);
+    static bool IsEnabled();
+
+    static bool HashFile(const std::string &sourcePath, uint64_t &hash);
+    static bool Load(Mesh *mesh, const std::string &sourcePath, uint64_t hash, unsigned int importFlags);
+    static bool Store(const Mesh *mesh, const std::string &sourcePath, uint64_t hash, unsigned int importFlags);
+
+ protected:
+    MeshCache() = delete;
+    ~MeshCache() = delete;
+
+ private:
+    static std::string GetCachePath(const std::string &sourcePath);
+
+ private:
+    static bool enabled;
+};
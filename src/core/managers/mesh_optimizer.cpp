@@ -0,0 +1,449 @@
+#include "core/managers/mesh_optimizer.h"
+
+#include "core/gpu/mesh.h"
+#include "utils/image_utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+
+bool MeshOptimizer::enabled = true;
+const unsigned int MeshOptimizer::NO_VERTEX;
+const unsigned int MeshOptimizer::FIFO_CACHE_SIZE;
+
+// Size of the LRU cache the triangle order is scored against
+static const unsigned int LRU_CACHE_SIZE = 32;
+// Clusters shorter than this aren't split off, sorting tiny ones costs more cache misses than the overdraw it saves
+static const size_t MIN_CLUSTER_TRIANGLES = 64;
+
+
+void MeshOptimizer::SetEnabled(bool state)
+{
+    enabled = state;
+}
+
+
+bool MeshOptimizer::IsEnabled()
+{
+    return enabled;
+}
+
+
+// Forsyth's vertex score: the last triangle's vertices get a fixed score (they are about to be reused anyway),
+// older cache entries decay, and vertices with few triangles left are boosted so they get finished off
+static float VertexScore(int cachePosition, unsigned int liveTriangles)
+{
+    if (liveTriangles == 0)
+        return -1.0f;
+
+    float score = 0;
+    if (cachePosition >= 0)
+    {
+        if (cachePosition < 3)
+            score = 0.75f;
+        else
+            score = std::pow(1.0f - (cachePosition - 3) / static_cast<float>(LRU_CACHE_SIZE - 3), 1.5f);
+    }
+
+    return score + 2.0f / std::sqrt(static_cast<float>(liveTriangles));
+}
+
+
+void MeshOptimizer::OptimizeVertexCache(unsigned int *indices, size_t nrIndices, size_t nrVertices)
+{
+    size_t nrTriangles = nrIndices / 3;
+    if (nrTriangles < 2)
+        return;
+
+    // Triangles around each vertex, the live ones first
+    std::vector<unsigned int> liveTriangles(nrVertices, 0);
+    for (size_t i = 0; i < nrTriangles * 3; i++)
+    {
+        liveTriangles[indices[i]]++;
+    }
+
+    std::vector<unsigned int> firstTriangle(nrVertices + 1, 0);
+    for (size_t v = 0; v < nrVertices; v++)
+    {
+        firstTriangle[v + 1] = firstTriangle[v] + liveTriangles[v];
+    }
+
+    std::vector<unsigned int> adjacency(nrTriangles * 3);
+    std::vector<unsigned int> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+    for (size_t i = 0; i < nrTriangles * 3; i++)
+    {
+        adjacency[filled[indices[i]]++] = static_cast<unsigned int>(i / 3);
+    }
+
+    std::vector<int> cachePosition(nrVertices, -1);
+    std::vector<float> vertexScore(nrVertices);
+    for (size_t v = 0; v < nrVertices; v++)
+    {
+        vertexScore[v] = VertexScore(-1, liveTriangles[v]);
+    }
+
+    std::vector<float> triangleScore(nrTriangles);
+    for (size_t t = 0; t < nrTriangles; t++)
+    {
+        triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+    }
+
+    std::vector<unsigned int> output;
+    output.reserve(nrTriangles * 3);
+    std::vector<bool> emitted(nrTriangles, false);
+
+    unsigned int cache[LRU_CACHE_SIZE + 3];
+    unsigned int newCache[LRU_CACHE_SIZE + 3];
+    size_t cacheSize = 0;
+    size_t cursor = 0;
+    size_t best = 0;
+
+    while (true)
+    {
+        emitted[best] = true;
+        const unsigned int *triangle = indices + best * 3;
+        output.insert(output.end(), triangle, triangle + 3);
+
+        // The emitted triangle leaves the live lists of its vertices
+        for (int corner = 0; corner < 3; corner++)
+        {
+            unsigned int v = triangle[corner];
+            unsigned int *begin = &adjacency[firstTriangle[v]];
+            unsigned int *end = begin + liveTriangles[v];
+            unsigned int *found = std::find(begin, end, static_cast<unsigned int>(best));
+            if (found != end)
+            {
+                std::swap(*found, *(end - 1));
+                liveTriangles[v]--;
+            }
+        }
+
+        // Its vertices move to the front of the cache, pushing the others back
+        size_t newSize = 0;
+        for (int corner = 0; corner < 3; corner++)
+        {
+            if (std::find(newCache, newCache + newSize, triangle[corner]) == newCache + newSize)
+                newCache[newSize++] = triangle[corner];
+        }
+        for (size_t i = 0; i < cacheSize; i++)
+        {
+            if (std::find(newCache, newCache + newSize, cache[i]) == newCache + newSize)
+                newCache[newSize++] = cache[i];
+        }
+
+        // Rescore what moved or fell out, the next triangle is the best one around the cached vertices
+        float bestScore = -1;
+        size_t next = nrTriangles;
+        for (size_t i = 0; i < newSize; i++)
+        {
+            unsigned int v = newCache[i];
+            int position = i < LRU_CACHE_SIZE ? static_cast<int>(i) : -1;
+            cachePosition[v] = position;
+
+            float score = VertexScore(position, liveTriangles[v]);
+            float delta = score - vertexScore[v];
+            vertexScore[v] = score;
+
+            for (unsigned int j = 0; j < liveTriangles[v]; j++)
+            {
+                unsigned int t = adjacency[firstTriangle[v] + j];
+                triangleScore[t] += delta;
+                if (position >= 0 && triangleScore[t] > bestScore)
+                {
+                    bestScore = triangleScore[t];
+                    next = t;
+                }
+            }
+        }
+
+        cacheSize = std::min<size_t>(newSize, LRU_CACHE_SIZE);
+        memcpy(cache, newCache, cacheSize * sizeof(unsigned int));
+
+        if (next == nrTriangles)
+        {
+            // Nothing left around the cache, continue with the first triangle not emitted yet
+            while (cursor < nrTriangles && emitted[cursor])
+                cursor++;
+            if (cursor == nrTriangles)
+                break;
+            next = cursor;
+        }
+        best = next;
+    }
+
+    std::copy(output.begin(), output.end(), indices);
+}
+
+
+void MeshOptimizer::OptimizeOverdraw(unsigned int *indices, size_t nrIndices, const float *positions, size_t stride,
+                                     size_t nrVertices)
+{
+    size_t nrTriangles = nrIndices / 3;
+    auto position = [positions, stride](unsigned int v)
+    {
+        const float *p = reinterpret_cast<const float *>(reinterpret_cast<const char *>(positions) + v * stride);
+        return glm::vec3(p[0], p[1], p[2]);
+    };
+
+    // Clusters start where the cache order restarts: a triangle whose three vertices all miss the cache
+    std::vector<size_t> clusterStarts;
+    std::vector<unsigned int> stamp(nrVertices, 0);
+    unsigned int time = 0;
+    for (size_t t = 0; t < nrTriangles; t++)
+    {
+        int misses = 0;
+        for (int corner = 0; corner < 3; corner++)
+        {
+            unsigned int v = indices[t * 3 + corner];
+            if (stamp[v] == 0 || time - stamp[v] >= FIFO_CACHE_SIZE)
+            {
+                stamp[v] = ++time;
+                misses++;
+            }
+        }
+
+        if (clusterStarts.empty() || (misses == 3 && t - clusterStarts.back() >= MIN_CLUSTER_TRIANGLES))
+            clusterStarts.push_back(t);
+    }
+
+    if (clusterStarts.size() < 2)
+        return;
+    clusterStarts.push_back(nrTriangles);
+
+    // Area weighted centroid and normal of every cluster and centroid of the whole mesh
+    struct Cluster
+    {
+        size_t first;
+        size_t last;
+        float sortKey;
+    };
+    std::vector<Cluster> clusters;
+    std::vector<glm::vec3> centroids, normals;
+    glm::vec3 meshCentroid(0);
+    float meshArea = 0;
+
+    for (size_t c = 0; c + 1 < clusterStarts.size(); c++)
+    {
+        glm::vec3 centroid(0), normal(0);
+        float area = 0;
+        for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++)
+        {
+            glm::vec3 a = position(indices[t * 3]);
+            glm::vec3 b = position(indices[t * 3 + 1]);
+            glm::vec3 d = position(indices[t * 3 + 2]);
+
+            glm::vec3 cross = glm::cross(b - a, d - a);
+            float triangleArea = glm::length(cross);
+            centroid += (a + b + d) * (triangleArea / 3.0f);
+            normal += cross;
+            area += triangleArea;
+        }
+
+        meshCentroid += centroid;
+        meshArea += area;
+        centroids.push_back(area > 0 ? centroid / area : centroid);
+        normals.push_back(normal);
+        clusters.push_back({ clusterStarts[c], clusterStarts[c + 1], 0.0f });
+    }
+
+    if (meshArea > 0)
+        meshCentroid /= meshArea;
+
+    // Outward facing, outer clusters occlude the inner ones from most views
+    for (size_t c = 0; c < clusters.size(); c++)
+    {
+        float length = glm::length(normals[c]);
+        clusters[c].sortKey = length > 0 ? glm::dot(centroids[c] - meshCentroid, normals[c] / length) : 0.0f;
+    }
+
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster &a, const Cluster &b)
+    {
+        return a.sortKey > b.sortKey;
+    });
+
+    std::vector<unsigned int> sorted;
+    sorted.reserve(nrTriangles * 3);
+    for (auto &cluster : clusters)
+    {
+        sorted.insert(sorted.end(), indices + cluster.first * 3, indices + cluster.last * 3);
+    }
+    std::copy(sorted.begin(), sorted.end(), indices);
+}
+
+
+size_t MeshOptimizer::OptimizeVertexFetchRemap(const unsigned int *indices, size_t nrIndices, size_t nrVertices,
+                                               std::vector<unsigned int> &remap)
+{
+    remap.assign(nrVertices, NO_VERTEX);
+
+    unsigned int nrUsed = 0;
+    for (size_t i = 0; i < nrIndices; i++)
+    {
+        if (remap[indices[i]] == NO_VERTEX)
+            remap[indices[i]] = nrUsed++;
+    }
+    return nrUsed;
+}
+
+
+void MeshOptimizer::RemapIndices(unsigned int *indices, size_t nrIndices, const std::vector<unsigned int> &remap)
+{
+    for (size_t i = 0; i < nrIndices; i++)
+    {
+        indices[i] = remap[indices[i]];
+    }
+}
+
+
+float MeshOptimizer::ComputeACMR(const unsigned int *indices, size_t nrIndices, size_t nrVertices,
+                                 unsigned int cacheSize)
+{
+    if (nrIndices < 3)
+        return 0;
+
+    // A vertex is cached while fewer than cacheSize misses happened since its own
+    std::vector<unsigned int> stamp(nrVertices, 0);
+    unsigned int misses = 0;
+    for (size_t i = 0; i < nrIndices; i++)
+    {
+        unsigned int v = indices[i];
+        if (stamp[v] == 0 || misses - stamp[v] >= cacheSize)
+            stamp[v] = ++misses;
+    }
+
+    return misses / static_cast<float>(nrIndices / 3);
+}
+
+
+static uint64_t HashVertex(const Mesh *mesh, size_t v)
+{
+    uint64_t hash = image_utils::Hash(&mesh->positions[v], sizeof(glm::vec3));
+    hash = image_utils::Hash(&mesh->normals[v], sizeof(glm::vec3), hash);
+    hash = image_utils::Hash(&mesh->texCoords[v], sizeof(glm::vec2), hash);
+    return image_utils::Hash(&mesh->bones[v], sizeof(VertexBoneData), hash);
+}
+
+
+static bool SameVertex(const Mesh *mesh, size_t a, size_t b)
+{
+    return memcmp(&mesh->positions[a], &mesh->positions[b], sizeof(glm::vec3)) == 0 &&
+        memcmp(&mesh->normals[a], &mesh->normals[b], sizeof(glm::vec3)) == 0 &&
+        memcmp(&mesh->texCoords[a], &mesh->texCoords[b], sizeof(glm::vec2)) == 0 &&
+        memcmp(&mesh->bones[a], &mesh->bones[b], sizeof(VertexBoneData)) == 0;
+}
+
+
+void MeshOptimizer::Optimize(Mesh *mesh)
+{
+    if (!enabled || mesh->glDrawMode != GL_TRIANGLES)
+        return;
+
+    size_t nrVertices = mesh->positions.size();
+    if (nrVertices == 0 || mesh->normals.size() != nrVertices || mesh->texCoords.size() != nrVertices ||
+        mesh->bones.size() != nrVertices)
+        return;
+
+    // Every entry must own the vertices from its base up to the next entry's
+    auto &entries = mesh->meshEntries;
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        size_t rangeEnd = i + 1 < entries.size() ? entries[i + 1].baseVertex : nrVertices;
+        if (rangeEnd <= entries[i].baseVertex || rangeEnd > nrVertices || entries[i].nrIndices % 3 ||
+            static_cast<size_t>(entries[i].baseIndex) + entries[i].nrIndices > mesh->indices.size())
+            return;
+
+        const unsigned int *indices = &mesh->indices[entries[i].baseIndex];
+        for (size_t j = 0; j < entries[i].nrIndices; j++)
+        {
+            if (indices[j] >= rangeEnd - entries[i].baseVertex)
+                return;
+        }
+    }
+
+    std::vector<glm::vec3> positions, normals;
+    std::vector<glm::vec2> texCoords;
+    std::vector<VertexBoneData> bones;
+    positions.reserve(nrVertices);
+    normals.reserve(nrVertices);
+    texCoords.reserve(nrVertices);
+    bones.reserve(nrVertices);
+
+    double missesBefore = 0, missesAfter = 0;
+    size_t nrTriangles = 0;
+    std::vector<unsigned int> unique, table, remap;
+
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        MeshEntry &entry = entries[i];
+        size_t base = entry.baseVertex;
+        size_t rangeSize = (i + 1 < entries.size() ? entries[i + 1].baseVertex : nrVertices) - base;
+        unsigned int *indices = mesh->indices.data() + entry.baseIndex;
+        size_t nrIndices = entry.nrIndices;
+
+        missesBefore += ComputeACMR(indices, nrIndices, rangeSize) * (nrIndices / 3);
+        nrTriangles += nrIndices / 3;
+
+        // The importer isn't asked to join identical vertices, done here with a hash over all the attributes
+        size_t tableSize = 1;
+        while (tableSize < rangeSize * 2)
+            tableSize <<= 1;
+        table.assign(tableSize, NO_VERTEX);
+        unique.resize(rangeSize);
+        for (size_t v = 0; v < rangeSize; v++)
+        {
+            size_t slot = HashVertex(mesh, base + v) & (tableSize - 1);
+            while (table[slot] != NO_VERTEX && !SameVertex(mesh, base + table[slot], base + v))
+            {
+                slot = (slot + 1) & (tableSize - 1);
+            }
+
+            if (table[slot] == NO_VERTEX)
+                table[slot] = static_cast<unsigned int>(v);
+            unique[v] = table[slot];
+        }
+        RemapIndices(indices, nrIndices, unique);
+
+        OptimizeVertexCache(indices, nrIndices, rangeSize);
+        OptimizeOverdraw(indices, nrIndices, &mesh->positions[base].x, sizeof(glm::vec3), rangeSize);
+
+        // Duplicates and unused vertices aren't referenced anymore and are dropped here
+        size_t nrUsed = OptimizeVertexFetchRemap(indices, nrIndices, rangeSize, remap);
+        RemapIndices(indices, nrIndices, remap);
+
+        size_t newBase = positions.size();
+        positions.resize(newBase + nrUsed);
+        normals.resize(newBase + nrUsed);
+        texCoords.resize(newBase + nrUsed);
+        bones.resize(newBase + nrUsed);
+        for (size_t v = 0; v < rangeSize; v++)
+        {
+            if (remap[v] == NO_VERTEX)
+                continue;
+
+            positions[newBase + remap[v]] = mesh->positions[base + v];
+            normals[newBase + remap[v]] = mesh->normals[base + v];
+            texCoords[newBase + remap[v]] = mesh->texCoords[base + v];
+            bones[newBase + remap[v]] = mesh->bones[base + v];
+        }
+        entry.baseVertex = static_cast<unsigned int>(newBase);
+
+        missesAfter += ComputeACMR(indices, nrIndices, nrUsed) * (nrIndices / 3);
+    }
+
+    mesh->positions.swap(positions);
+    mesh->normals.swap(normals);
+    mesh->texCoords.swap(texCoords);
+    mesh->bones.swap(bones);
+    mesh->ComputeBounds();
+
+    if (nrTriangles)
+    {
+        std::ostringstream report;
+        report << "Optimized: " << nrVertices << " -> " << mesh->positions.size() << " vertices, ACMR " << std::fixed
+               << std::setprecision(3) << missesBefore / nrTriangles << " -> " << missesAfter / nrTriangles;
+        mesh->importReport.push_back(report.str());
+    }
+}
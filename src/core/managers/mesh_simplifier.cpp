@@ -0,0 +1,633 @@
+#include "core/managers/mesh_simplifier.h"
+
+#include "core/gpu/mesh.h"
+#include "core/managers/mesh_optimizer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+
+bool MeshSimplifier::enabled = true;
+
+// Coarser levels per entry, and the smallest entry that gets any
+static const unsigned int MAX_LODS = 3;
+static const size_t MIN_LOD_TRIANGLES = 512;
+// A level has to drop this share of the previous level's triangles, the entry stops at the last one that did
+static const float MIN_LOD_REDUCTION = 0.2f;
+// No collapse past this deviation, relative to the extent of the entry
+static const float MAX_LOD_ERROR = 0.05f;
+
+// Attribute changes against the relative geometric deviation: at weight 1, changing an attribute by 0.01 costs as
+// much as moving the surface by 1% of the extent
+static const float NORMAL_WEIGHT = 0.1f;
+static const float TEXCOORD_WEIGHT = 0.5f;
+static const float BONE_WEIGHT = 1.0f;
+// Cosine of the largest rotation (45 degrees) a collapse may give a triangle. Small steps also keep the rotations
+// adding up over many collapses from flipping one
+static const float MIN_NORMAL_COS = 0.7f;
+
+
+// Area weighted squared distances to a set of planes, Q(p) = p'Ap + 2b'p + c
+struct Quadric
+{
+    double a00, a01, a02, a11, a12, a22;
+    double b0, b1, b2;
+    double c;
+    double weight;
+};
+
+// Collapse of vertex 'from' into its neighbour 'to'
+struct Collapse
+{
+    unsigned int from;
+    unsigned int to;
+    float cost;
+};
+
+
+static Quadric PlaneQuadric(const glm::vec3 &normal, float distance, double weight)
+{
+    double a = normal.x, b = normal.y, c = normal.z, d = distance;
+
+    Quadric quadric;
+    quadric.a00 = a * a * weight;
+    quadric.a01 = a * b * weight;
+    quadric.a02 = a * c * weight;
+    quadric.a11 = b * b * weight;
+    quadric.a12 = b * c * weight;
+    quadric.a22 = c * c * weight;
+    quadric.b0 = a * d * weight;
+    quadric.b1 = b * d * weight;
+    quadric.b2 = c * d * weight;
+    quadric.c = d * d * weight;
+    quadric.weight = weight;
+    return quadric;
+}
+
+
+static void AddQuadric(Quadric &quadric, const Quadric &other)
+{
+    quadric.a00 += other.a00;
+    quadric.a01 += other.a01;
+    quadric.a02 += other.a02;
+    quadric.a11 += other.a11;
+    quadric.a12 += other.a12;
+    quadric.a22 += other.a22;
+    quadric.b0 += other.b0;
+    quadric.b1 += other.b1;
+    quadric.b2 += other.b2;
+    quadric.c += other.c;
+    quadric.weight += other.weight;
+}
+
+
+// Mean squared distance of a point to the planes
+static double QuadricError(const Quadric &quadric, const glm::vec3 &point)
+{
+    double x = point.x, y = point.y, z = point.z;
+    double error = quadric.a00 * x * x + quadric.a11 * y * y + quadric.a22 * z * z +
+                   2 * (quadric.a01 * x * y + quadric.a02 * x * z + quadric.a12 * y * z) +
+                   2 * (quadric.b0 * x + quadric.b1 * y + quadric.b2 * z) + quadric.c;
+    return quadric.weight > 0 ? std::max(error, 0.0) / quadric.weight : 0;
+}
+
+
+// Barycentric coordinates of the projection of p on the plane of a triangle
+static void Barycentric(const glm::vec3 &p, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c,
+                        float weights[3])
+{
+    glm::vec3 v0 = b - a, v1 = c - a, v2 = p - a;
+    float d00 = glm::dot(v0, v0), d01 = glm::dot(v0, v1), d11 = glm::dot(v1, v1);
+    float d20 = glm::dot(v2, v0), d21 = glm::dot(v2, v1);
+    float denominator = d00 * d11 - d01 * d01;
+    if (denominator <= 0)
+    {
+        weights[0] = weights[1] = weights[2] = -FLT_MAX;
+        return;
+    }
+
+    weights[1] = (d11 * d20 - d01 * d21) / denominator;
+    weights[2] = (d00 * d21 - d01 * d20) / denominator;
+    weights[0] = 1 - weights[1] - weights[2];
+}
+
+
+// Squared difference between the skin weights interpolated over a triangle and the ones of a vertex
+static float BoneWeightDistance(const VertexBoneData *bones, const unsigned int corners[3], const float weights[3],
+                                unsigned int vertex)
+{
+    unsigned int ids[4 * NUM_BONES_PER_VEREX];
+    float difference[4 * NUM_BONES_PER_VEREX];
+    unsigned int count = 0;
+
+    auto add = [&](unsigned int id, float weight) {
+        if (weight == 0)
+            return;
+        for (unsigned int i = 0; i < count; i++)
+        {
+            if (ids[i] == id)
+            {
+                difference[i] += weight;
+                return;
+            }
+        }
+        ids[count] = id;
+        difference[count++] = weight;
+    };
+
+    for (int corner = 0; corner < 3; corner++)
+    {
+        for (int i = 0; i < NUM_BONES_PER_VEREX; i++)
+            add(bones[corners[corner]].IDs[i], weights[corner] * bones[corners[corner]].Weights[i]);
+    }
+    for (int i = 0; i < NUM_BONES_PER_VEREX; i++)
+        add(bones[vertex].IDs[i], -bones[vertex].Weights[i]);
+
+    float distance = 0;
+    for (unsigned int i = 0; i < count; i++)
+        distance += difference[i] * difference[i];
+    return distance;
+}
+
+
+// Greedy edge collapse in passes: every pass scores each edge in its cheaper direction, then collapses in order of
+// cost while the fans it touches stay untouched by the collapses before it, so the adjacency built at the start of
+// the pass stays exact. Kept between the levels of an entry, the quadrics go on measuring from the full detail
+class EdgeCollapser
+{
+ public:
+    EdgeCollapser(const unsigned int *sourceIndices, size_t nrIndices, const glm::vec3 *positions,
+                  const glm::vec3 *normals, const glm::vec2 *texCoords, const VertexBoneData *bones,
+                  size_t nrVertices);
+
+    // Down to targetIndices, or until the cheapest collapse left costs more than maxError
+    void Reduce(size_t targetIndices, float maxError);
+
+    const std::vector<unsigned int> &GetIndices() const { return indices; }
+    // Object space deviation of the collapses so far
+    float GetError() const { return std::sqrt(maxCost) * extent; }
+
+ private:
+    void LockSeams();
+    void BuildAdjacency();
+    float CollapseCost(unsigned int from, unsigned int to) const;
+    float AttributeCost(unsigned int from, unsigned int to) const;
+    bool CanCollapse(unsigned int from, unsigned int to, size_t &nrShared);
+
+ private:
+    const glm::vec3 *normals;
+    const glm::vec2 *texCoords;
+    const VertexBoneData *bones;
+    size_t nrVertices;
+
+    // Positions scaled to the unit box, errors are relative to the extent
+    std::vector<glm::vec3> points;
+    float extent;
+    float maxCost;
+
+    std::vector<unsigned int> indices;
+    std::vector<Quadric> quadrics;
+    std::vector<unsigned char> locked;
+
+    // Triangles around every vertex, rebuilt every pass
+    std::vector<unsigned int> firstTriangle;
+    std::vector<unsigned int> adjacency;
+    std::vector<unsigned int> neighbours;
+    std::vector<unsigned int> shared;
+};
+
+
+EdgeCollapser::EdgeCollapser(const unsigned int *sourceIndices, size_t nrIndices, const glm::vec3 *positions,
+                             const glm::vec3 *normals, const glm::vec2 *texCoords, const VertexBoneData *bones,
+                             size_t nrVertices)
+    : normals(normals), texCoords(texCoords), bones(bones), nrVertices(nrVertices), extent(1), maxCost(0)
+{
+    indices.reserve(nrIndices);
+    for (size_t i = 0; i + 2 < nrIndices; i += 3)
+    {
+        unsigned int a = sourceIndices[i], b = sourceIndices[i + 1], c = sourceIndices[i + 2];
+        if (a != b && b != c && c != a && a < nrVertices && b < nrVertices && c < nrVertices)
+        {
+            indices.push_back(a);
+            indices.push_back(b);
+            indices.push_back(c);
+        }
+    }
+
+    points.assign(nrVertices, glm::vec3(0));
+    quadrics.assign(nrVertices, Quadric());
+    locked.assign(nrVertices, 0);
+    if (indices.empty())
+        return;
+
+    glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+    for (unsigned int v : indices)
+    {
+        boundsMin = glm::min(boundsMin, positions[v]);
+        boundsMax = glm::max(boundsMax, positions[v]);
+    }
+    glm::vec3 size = boundsMax - boundsMin;
+    extent = std::max(size.x, std::max(size.y, size.z));
+    if (extent <= 0)
+        extent = 1;
+
+    for (unsigned int v : indices)
+        points[v] = (positions[v] - boundsMin) / extent;
+
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        const glm::vec3 &p0 = points[indices[i]];
+        glm::vec3 normal = glm::cross(points[indices[i + 1]] - p0, points[indices[i + 2]] - p0);
+        float length = glm::length(normal);
+        if (length <= 0)
+            continue;
+
+        normal /= length;
+        Quadric quadric = PlaneQuadric(normal, -glm::dot(normal, p0), length * 0.5);
+        for (int corner = 0; corner < 3; corner++)
+            AddQuadric(quadrics[indices[i + corner]], quadric);
+    }
+
+    LockSeams();
+}
+
+
+void EdgeCollapser::LockSeams()
+{
+    // Open and non-manifold edges: every directed edge needs exactly one twin going the other way
+    std::unordered_map<uint64_t, unsigned int> edges;
+    edges.reserve(indices.size());
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        unsigned int a = indices[i], b = indices[i - i % 3 + (i + 1) % 3];
+        edges[(static_cast<uint64_t>(a) << 32) | b]++;
+    }
+
+    for (const auto &edge : edges)
+    {
+        unsigned int a = static_cast<unsigned int>(edge.first >> 32);
+        unsigned int b = static_cast<unsigned int>(edge.first & 0xFFFFFFFFu);
+        auto twin = edges.find((static_cast<uint64_t>(b) << 32) | a);
+        if (edge.second != 1 || twin == edges.end() || twin->second != 1)
+            locked[a] = locked[b] = 1;
+    }
+
+    // Vertices split on a normal, texture or skinning seam share their position
+    std::vector<unsigned char> used(nrVertices, 0);
+    for (unsigned int v : indices)
+        used[v] = 1;
+
+    std::vector<unsigned int> order;
+    for (size_t v = 0; v < nrVertices; v++)
+    {
+        if (used[v])
+            order.push_back(static_cast<unsigned int>(v));
+    }
+
+    std::sort(order.begin(), order.end(), [this](unsigned int a, unsigned int b) {
+        const glm::vec3 &p = points[a], &q = points[b];
+        return p.x != q.x ? p.x < q.x : (p.y != q.y ? p.y < q.y : p.z < q.z);
+    });
+
+    for (size_t i = 1; i < order.size(); i++)
+    {
+        if (points[order[i]] == points[order[i - 1]])
+            locked[order[i]] = locked[order[i - 1]] = 1;
+    }
+}
+
+
+void EdgeCollapser::BuildAdjacency()
+{
+    firstTriangle.assign(nrVertices + 1, 0);
+    for (unsigned int v : indices)
+        firstTriangle[v + 1]++;
+    for (size_t v = 0; v < nrVertices; v++)
+        firstTriangle[v + 1] += firstTriangle[v];
+
+    adjacency.resize(indices.size());
+    std::vector<unsigned int> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++)
+        adjacency[filled[indices[i]]++] = static_cast<unsigned int>(i / 3);
+}
+
+
+float EdgeCollapser::CollapseCost(unsigned int from, unsigned int to) const
+{
+    Quadric quadric = quadrics[from];
+    AddQuadric(quadric, quadrics[to]);
+    return static_cast<float>(QuadricError(quadric, points[to])) + AttributeCost(from, to);
+}
+
+
+// The attributes at the removed vertex are now interpolated over the triangle of the new fan it projects into,
+// the cost is how far that lands from its own
+float EdgeCollapser::AttributeCost(unsigned int from, unsigned int to) const
+{
+    if (!normals && !texCoords && !bones)
+        return 0;
+
+    float best = -FLT_MAX;
+    unsigned int corners[3] = { to, to, to };
+    float weights[3] = { 1, 0, 0 };
+    for (unsigned int k = firstTriangle[from]; k < firstTriangle[from + 1]; k++)
+    {
+        const unsigned int *triangle = &indices[adjacency[k] * 3];
+        if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+            continue;
+
+        unsigned int moved[3];
+        float barycentric[3];
+        for (int corner = 0; corner < 3; corner++)
+            moved[corner] = triangle[corner] == from ? to : triangle[corner];
+        Barycentric(points[from], points[moved[0]], points[moved[1]], points[moved[2]], barycentric);
+
+        float inside = std::min(barycentric[0], std::min(barycentric[1], barycentric[2]));
+        if (inside > best)
+        {
+            best = inside;
+            std::copy(moved, moved + 3, corners);
+            std::copy(barycentric, barycentric + 3, weights);
+        }
+    }
+
+    // Clamped to the triangle when the vertex projects outside of every one
+    float sum = 0;
+    for (int corner = 0; corner < 3; corner++)
+    {
+        weights[corner] = std::max(weights[corner], 0.0f);
+        sum += weights[corner];
+    }
+    if (sum <= 0)
+        return 0;
+    for (int corner = 0; corner < 3; corner++)
+        weights[corner] /= sum;
+
+    float cost = 0;
+    if (normals)
+    {
+        glm::vec3 normal = weights[0] * normals[corners[0]] + weights[1] * normals[corners[1]] +
+                           weights[2] * normals[corners[2]];
+        float length = glm::length(normal);
+        if (length > 0)
+            normal /= length;
+        glm::vec3 difference = normal - normals[from];
+        cost += NORMAL_WEIGHT * NORMAL_WEIGHT * glm::dot(difference, difference);
+    }
+    if (texCoords)
+    {
+        glm::vec2 difference = weights[0] * texCoords[corners[0]] + weights[1] * texCoords[corners[1]] +
+                               weights[2] * texCoords[corners[2]] - texCoords[from];
+        cost += TEXCOORD_WEIGHT * TEXCOORD_WEIGHT * glm::dot(difference, difference);
+    }
+    if (bones)
+        cost += BONE_WEIGHT * BONE_WEIGHT * BoneWeightDistance(bones, corners, weights, from);
+    return cost;
+}
+
+
+// The link condition (the two fans share no vertex besides the ones across the edge, else the surface would fold
+// into a non-manifold one) and no triangle of the fan turning over. nrShared gets the triangles on the edge
+bool EdgeCollapser::CanCollapse(unsigned int from, unsigned int to, size_t &nrShared)
+{
+    nrShared = 0;
+    neighbours.clear();
+    for (unsigned int k = firstTriangle[from]; k < firstTriangle[from + 1]; k++)
+    {
+        const unsigned int *triangle = &indices[adjacency[k] * 3];
+        for (int corner = 0; corner < 3; corner++)
+        {
+            if (triangle[corner] != from)
+                neighbours.push_back(triangle[corner]);
+        }
+
+        if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+        {
+            nrShared++;
+            continue;
+        }
+
+        glm::vec3 p[3], q[3];
+        for (int corner = 0; corner < 3; corner++)
+        {
+            p[corner] = points[triangle[corner]];
+            q[corner] = triangle[corner] == from ? points[to] : p[corner];
+        }
+
+        glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+        glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+        float lengths = glm::length(before) * glm::length(after);
+        if (glm::dot(before, before) > 0 && glm::dot(before, after) <= MIN_NORMAL_COS * lengths)
+            return false;
+    }
+
+    std::sort(neighbours.begin(), neighbours.end());
+    shared.clear();
+    for (unsigned int k = firstTriangle[to]; k < firstTriangle[to + 1]; k++)
+    {
+        const unsigned int *triangle = &indices[adjacency[k] * 3];
+        for (int corner = 0; corner < 3; corner++)
+        {
+            unsigned int v = triangle[corner];
+            if (v != to && v != from && std::binary_search(neighbours.begin(), neighbours.end(), v))
+                shared.push_back(v);
+        }
+    }
+
+    std::sort(shared.begin(), shared.end());
+    size_t nrCommon = std::unique(shared.begin(), shared.end()) - shared.begin();
+    return nrShared > 0 && nrCommon <= nrShared;
+}
+
+
+void EdgeCollapser::Reduce(size_t targetIndices, float maxError)
+{
+    float costLimit = maxError * maxError;
+    std::vector<Collapse> collapses;
+    std::vector<unsigned int> remap;
+    std::vector<unsigned char> frozen;
+
+    while (indices.size() > targetIndices)
+    {
+        BuildAdjacency();
+
+        // Interior edges show up once each way, the a < b one stands for both
+        collapses.clear();
+        for (size_t i = 0; i < indices.size(); i++)
+        {
+            unsigned int a = indices[i], b = indices[i - i % 3 + (i + 1) % 3];
+            if (a > b || (locked[a] && locked[b]))
+                continue;
+
+            Collapse collapse = { a, b, FLT_MAX };
+            if (!locked[a])
+                collapse.cost = CollapseCost(a, b);
+            if (!locked[b])
+            {
+                float cost = CollapseCost(b, a);
+                if (cost < collapse.cost)
+                    collapse = { b, a, cost };
+            }
+            collapses.push_back(collapse);
+        }
+
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse &x, const Collapse &y) {
+            return x.cost < y.cost;
+        });
+
+        size_t trianglesToRemove = (indices.size() - targetIndices + 2) / 3;
+        size_t removed = 0;
+        remap.resize(nrVertices);
+        std::iota(remap.begin(), remap.end(), 0u);
+        frozen.assign(nrVertices, 0);
+
+        for (const Collapse &collapse : collapses)
+        {
+            if (removed >= trianglesToRemove || collapse.cost > costLimit)
+                break;
+            if (frozen[collapse.from] || frozen[collapse.to])
+                continue;
+
+            size_t nrShared;
+            if (!CanCollapse(collapse.from, collapse.to, nrShared))
+                continue;
+
+            remap[collapse.from] = collapse.to;
+            AddQuadric(quadrics[collapse.to], quadrics[collapse.from]);
+            maxCost = std::max(maxCost, collapse.cost);
+            removed += nrShared;
+
+            // The whole fan changed, none of its vertices moves again this pass
+            for (unsigned int k = firstTriangle[collapse.from]; k < firstTriangle[collapse.from + 1]; k++)
+            {
+                const unsigned int *triangle = &indices[adjacency[k] * 3];
+                frozen[triangle[0]] = frozen[triangle[1]] = frozen[triangle[2]] = 1;
+            }
+        }
+
+        if (removed == 0)
+            break;
+
+        size_t nrKept = 0;
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            unsigned int a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+            if (a == b || b == c || c == a)
+                continue;
+
+            indices[nrKept++] = a;
+            indices[nrKept++] = b;
+            indices[nrKept++] = c;
+        }
+        indices.resize(nrKept);
+    }
+}
+
+
+void MeshSimplifier::SetEnabled(bool state)
+{
+    enabled = state;
+}
+
+
+bool MeshSimplifier::IsEnabled()
+{
+    return enabled;
+}
+
+
+size_t MeshSimplifier::Simplify(unsigned int *destination, const unsigned int *indices, size_t nrIndices,
+                                const glm::vec3 *positions, const glm::vec3 *normals, const glm::vec2 *texCoords,
+                                const VertexBoneData *bones, size_t nrVertices, size_t targetIndices,
+                                float maxError, float &error)
+{
+    EdgeCollapser collapser(indices, nrIndices, positions, normals, texCoords, bones, nrVertices);
+    collapser.Reduce(targetIndices, maxError);
+
+    const std::vector<unsigned int> &result = collapser.GetIndices();
+    std::copy(result.begin(), result.end(), destination);
+    error = collapser.GetError();
+    return result.size();
+}
+
+
+void MeshSimplifier::GenerateLods(Mesh *mesh)
+{
+    if (!enabled || mesh->glDrawMode != GL_TRIANGLES)
+        return;
+
+    size_t nrVertices = mesh->positions.size();
+    if (nrVertices == 0 || mesh->normals.size() != nrVertices || mesh->texCoords.size() != nrVertices ||
+        mesh->bones.size() != nrVertices)
+        return;
+
+    // Triangles drawn with every entry at a level, or at its coarsest one
+    size_t levelTriangles[MAX_LODS + 1] = {};
+    unsigned int nrLevels = 0;
+    float maxError = 0;
+    std::vector<unsigned int> lodIndices;
+
+    auto &entries = mesh->meshEntries;
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        MeshEntry &entry = entries[i];
+        entry.lods.clear();
+
+        // Same vertex ranges as MeshOptimizer::Optimize
+        size_t base = entry.baseVertex;
+        size_t rangeEnd = i + 1 < entries.size() ? entries[i + 1].baseVertex : nrVertices;
+        size_t nrTriangles = entry.nrIndices / 3;
+        bool valid = rangeEnd > base && rangeEnd <= nrVertices && entry.nrIndices % 3 == 0 &&
+                     static_cast<size_t>(entry.baseIndex) + entry.nrIndices <= mesh->indices.size();
+        for (size_t j = 0; valid && j < entry.nrIndices; j++)
+            valid = mesh->indices[entry.baseIndex + j] < rangeEnd - base;
+
+        if (valid && nrTriangles >= MIN_LOD_TRIANGLES)
+        {
+            EdgeCollapser collapser(&mesh->indices[entry.baseIndex], entry.nrIndices, &mesh->positions[base],
+                                    &mesh->normals[base], &mesh->texCoords[base], &mesh->bones[base],
+                                    rangeEnd - base);
+
+            size_t previous = entry.nrIndices;
+            for (unsigned int level = 1; level <= MAX_LODS; level++)
+            {
+                collapser.Reduce((nrTriangles >> level) * 3, MAX_LOD_ERROR);
+                lodIndices = collapser.GetIndices();
+                if (lodIndices.empty() || lodIndices.size() > previous * (1 - MIN_LOD_REDUCTION))
+                    break;
+
+                MeshOptimizer::OptimizeVertexCache(lodIndices.data(), lodIndices.size(), rangeEnd - base);
+
+                MeshLod lod;
+                lod.nrIndices = static_cast<unsigned int>(lodIndices.size());
+                lod.baseIndex = static_cast<unsigned int>(mesh->indices.size());
+                lod.error = collapser.GetError();
+                mesh->indices.insert(mesh->indices.end(), lodIndices.begin(), lodIndices.end());
+                entry.lods.push_back(lod);
+
+                previous = lodIndices.size();
+                maxError = std::max(maxError, lod.error);
+            }
+        }
+
+        nrLevels = std::max(nrLevels, static_cast<unsigned int>(entry.lods.size()));
+        for (unsigned int level = 0; level <= MAX_LODS; level++)
+            levelTriangles[level] += entry.GetNrIndices(std::min(level, entry.GetNrLods() - 1)) / 3;
+    }
+
+    if (nrLevels)
+    {
+        std::ostringstream report;
+        report << "Simplified: " << levelTriangles[0];
+        for (unsigned int level = 1; level <= nrLevels; level++)
+            report << " -> " << levelTriangles[level];
+        report << " triangles, error up to " << maxError;
+        mesh->importReport.push_back(report.str());
+    }
+}
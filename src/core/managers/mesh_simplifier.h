@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+
+#include "utils/glm_utils.h"
+
+class Mesh;
+struct VertexBoneData;
+
+
+// Levels of detail by edge collapse on quadric error metrics (Garland-Heckbert), generated on import after the
+// optimizer and stored in the mesh cache with it. Vertices are never moved or added: every level is an index list
+// over the entry's own vertices, so the levels share the vertex buffer and keep the skin weights. A collapse also
+// pays for the normals, texture coordinates and bone weights it changes where the removed vertex was, seams and
+// open or non-manifold edges stay locked.
+class MeshSimplifier
+{
+ public:
+    static void SetEnabled(bool state);
+    static bool IsEnabled();
+
+    // Appends up to three coarser levels of every large enough entry to the mesh indices, about half the triangles
+    // of the previous level each. Doesn't touch GL, runs on loader threads
+    static void GenerateLods(Mesh *mesh);
+
+    // One triangle list of indices below nrVertices, down to targetIndices or until a collapse would cost more than
+    // maxError (relative to the extent of the vertices). normals, texCoords and bones may be null. Returns the number
+    // of indices written to destination, at most nrIndices, error gets the object space deviation
+    static size_t Simplify(unsigned int *destination, const unsigned int *indices, size_t nrIndices,
+                           const glm::vec3 *positions, const glm::vec3 *normals, const glm::vec2 *texCoords,
+                           const VertexBoneData *bones, size_t nrVertices, size_t targetIndices, float maxError,
+                           float &error);
+
+ protected:
+    MeshSimplifier() = delete;
+    ~MeshSimplifier() = delete;
+
+ private:
+    static bool enabled;
+};
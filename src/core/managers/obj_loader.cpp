@@ -0,0 +1,578 @@
+#include "core/managers/obj_loader.h"
+
+#include "core/gpu/mesh.h"
+#include "core/managers/asset_loader.h"
+#include "utils/mapped_file.h"
+
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+
+// Below this much text per thread the parse isn't worth a thread
+static const size_t MIN_CHUNK_SIZE = 256 << 10;
+static const int NO_INDEX = INT_MIN;
+static const uint32_t EMPTY_SLOT = UINT32_MAX;
+
+enum CornerComponent
+{
+    CORNER_POSITION = 1,
+    CORNER_TEX_COORD = 2,
+    CORNER_NORMAL = 4
+};
+
+// Indices of one triangle corner into the position, texcoord and normal lists of the file, 0-based
+struct ObjCorner
+{
+    int position;
+    int texCoord;
+    int normal;
+
+    bool operator==(const ObjCorner &other) const
+    {
+        return position == other.position && texCoord == other.texCoord && normal == other.normal;
+    }
+};
+
+// Corner written with negative (relative) indices, which are local to the chunk until its base offsets are known
+struct ObjFixup
+{
+    uint32_t corner;
+    uint32_t components;
+};
+
+struct ObjChunk
+{
+    const char *begin;
+    const char *end;
+
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> texCoords;
+    std::vector<glm::vec3> normals;
+    // Triangulated, three per triangle
+    std::vector<ObjCorner> corners;
+    std::vector<ObjFixup> fixups;
+
+    bool missingNormals = false;
+    bool hasMaterialLibrary = false;
+    bool valid = true;
+};
+
+
+static inline bool IsDigit(char c)
+{
+    return static_cast<unsigned char>(c - '0') < 10;
+}
+
+
+static inline bool IsSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+
+static inline const char *SkipSpaces(const char *p, const char *end)
+{
+    while (p < end && IsSpace(*p))
+        p++;
+    return p;
+}
+
+
+static double Pow10(int exponent)
+{
+    static const double powers[] =
+    {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    return exponent <= 22 ? powers[exponent] : std::pow(10.0, exponent);
+}
+
+
+// Decimal and scientific notation. Up to 19 significant digits are accumulated in an integer and scaled once,
+// exact to float precision without the locale and stream overhead of strtof
+static const char *ParseFloat(const char *p, const char *end, float &value)
+{
+    p = SkipSpaces(p, end);
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool anyDigit = false;
+
+    for (; p < end && IsDigit(*p); p++)
+    {
+        anyDigit = true;
+        if (digits < 19)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            digits += mantissa != 0;
+        }
+        else
+        {
+            exponent++;
+        }
+    }
+
+    if (p < end && *p == '.')
+    {
+        for (p++; p < end && IsDigit(*p); p++)
+        {
+            anyDigit = true;
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += mantissa != 0;
+                exponent--;
+            }
+        }
+    }
+
+    if (!anyDigit)
+        return nullptr;
+
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        p++;
+        bool negativeExponent = false;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negativeExponent = *p == '-';
+            p++;
+        }
+
+        if (p == end || !IsDigit(*p))
+            return nullptr;
+
+        int written = 0;
+        for (; p < end && IsDigit(*p); p++)
+        {
+            written = std::min(written * 10 + (*p - '0'), 1000);
+        }
+        exponent += negativeExponent ? -written : written;
+    }
+
+    double result = static_cast<double>(mantissa);
+    if (mantissa != 0)
+        result = exponent < 0 ? result / Pow10(-exponent) : result * Pow10(exponent);
+
+    value = static_cast<float>(negative ? -result : result);
+    return p;
+}
+
+
+static const char *ParseIndex(const char *p, const char *end, int &value)
+{
+    bool negative = false;
+    if (p < end && *p == '-')
+    {
+        negative = true;
+        p++;
+    }
+
+    if (p == end || !IsDigit(*p))
+        return nullptr;
+
+    int64_t result = 0;
+    for (; p < end && IsDigit(*p); p++)
+    {
+        result = result * 10 + (*p - '0');
+        if (result > INT_MAX)
+            return nullptr;
+    }
+
+    value = static_cast<int>(negative ? -result : result);
+    return p;
+}
+
+
+// Converts an index as written (1-based, or negative from the end of the list so far) to a 0-based one. Relative
+// indices stay local to the chunk and are flagged
+static inline bool ResolveIndex(int written, size_t localCount, uint32_t component, int &index, uint32_t &relative)
+{
+    if (written > 0)
+    {
+        index = written - 1;
+        return true;
+    }
+    if (written < 0)
+    {
+        index = static_cast<int>(localCount) + written;
+        relative |= component;
+        return true;
+    }
+    return false;
+}
+
+
+static bool ParseFace(const char *p, const char *end, ObjChunk &chunk, std::vector<ObjCorner> &polygon,
+                      std::vector<uint32_t> &polygonRelative)
+{
+    polygon.clear();
+    polygonRelative.clear();
+
+    while (true)
+    {
+        p = SkipSpaces(p, end);
+        if (p == end)
+            break;
+
+        ObjCorner corner = { NO_INDEX, NO_INDEX, NO_INDEX };
+        uint32_t relative = 0;
+        int written;
+
+        p = ParseIndex(p, end, written);
+        if (!p || !ResolveIndex(written, chunk.positions.size(), CORNER_POSITION, corner.position, relative))
+            return false;
+
+        if (p < end && *p == '/')
+        {
+            p++;
+            if (p < end && *p != '/')
+            {
+                p = ParseIndex(p, end, written);
+                if (!p || !ResolveIndex(written, chunk.texCoords.size(), CORNER_TEX_COORD, corner.texCoord, relative))
+                    return false;
+            }
+
+            if (p < end && *p == '/')
+            {
+                p = ParseIndex(p + 1, end, written);
+                if (!p || !ResolveIndex(written, chunk.normals.size(), CORNER_NORMAL, corner.normal, relative))
+                    return false;
+            }
+        }
+
+        if (p < end && !IsSpace(*p))
+            return false;
+
+        polygon.push_back(corner);
+        polygonRelative.push_back(relative);
+    }
+
+    // Points and lines can't go in a triangle mesh
+    if (polygon.size() < 3)
+        return false;
+
+    for (size_t i = 1; i + 1 < polygon.size(); i++)
+    {
+        const size_t fan[3] = { 0, i, i + 1 };
+        for (size_t corner : fan)
+        {
+            if (polygonRelative[corner])
+                chunk.fixups.push_back({ static_cast<uint32_t>(chunk.corners.size()), polygonRelative[corner] });
+            if (polygon[corner].normal == NO_INDEX)
+                chunk.missingNormals = true;
+            chunk.corners.push_back(polygon[corner]);
+        }
+    }
+    return true;
+}
+
+
+static bool StartsWith(const char *p, const char *end, const char *keyword)
+{
+    size_t length = strlen(keyword);
+    return static_cast<size_t>(end - p) > length && memcmp(p, keyword, length) == 0 && IsSpace(p[length]);
+}
+
+
+static void ParseChunk(ObjChunk &chunk)
+{
+    std::vector<ObjCorner> polygon;
+    std::vector<uint32_t> polygonRelative;
+
+    const char *line = chunk.begin;
+    while (line < chunk.end && chunk.valid)
+    {
+        const char *lineEnd = static_cast<const char *>(memchr(line, '\n', chunk.end - line));
+        if (!lineEnd)
+            lineEnd = chunk.end;
+
+        const char *p = SkipSpaces(line, lineEnd);
+        if (p + 1 < lineEnd && IsSpace(p[1]))
+        {
+            switch (*p)
+            {
+            case 'v':
+            {
+                glm::vec3 position;
+                chunk.valid = (p = ParseFloat(p + 1, lineEnd, position.x)) && (p = ParseFloat(p, lineEnd, position.y)) &&
+                    ParseFloat(p, lineEnd, position.z);
+                chunk.positions.push_back(position);
+                break;
+            }
+            case 'f':
+                chunk.valid = ParseFace(p + 1, lineEnd, chunk, polygon, polygonRelative);
+                break;
+            case 'l':
+            case 'p':
+                chunk.valid = false;
+                break;
+            default:
+                break;
+            }
+        }
+        else if (p + 2 < lineEnd && p[0] == 'v' && IsSpace(p[2]))
+        {
+            if (p[1] == 't')
+            {
+                // The V coordinate is optional, flipped to the GL convention
+                glm::vec2 texCoord(0);
+                p = ParseFloat(p + 2, lineEnd, texCoord.x);
+                chunk.valid = p != nullptr;
+                if (p)
+                    ParseFloat(p, lineEnd, texCoord.y);
+                texCoord.y = 1.0f - texCoord.y;
+                chunk.texCoords.push_back(texCoord);
+            }
+            else if (p[1] == 'n')
+            {
+                glm::vec3 normal;
+                chunk.valid = (p = ParseFloat(p + 2, lineEnd, normal.x)) && (p = ParseFloat(p, lineEnd, normal.y)) &&
+                    ParseFloat(p, lineEnd, normal.z);
+                chunk.normals.push_back(normal);
+            }
+        }
+        else if (StartsWith(p, lineEnd, "mtllib"))
+        {
+            chunk.hasMaterialLibrary = true;
+        }
+
+        line = lineEnd + 1;
+    }
+}
+
+
+static inline size_t HashCorner(const ObjCorner &corner)
+{
+    uint64_t hash = static_cast<uint32_t>(corner.position) * 0x9E3779B97F4A7C15ull;
+    hash ^= static_cast<uint32_t>(corner.texCoord) * 0xC2B2AE3D27D4EB4Full;
+    hash ^= static_cast<uint32_t>(corner.normal) * 0x165667B19E3779F9ull;
+    return static_cast<size_t>(hash ^ (hash >> 29));
+}
+
+
+bool ObjLoader::IsObjFile(const std::string &fileName)
+{
+    if (fileName.size() < 4)
+        return false;
+
+    std::string extension = fileName.substr(fileName.size() - 4);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension == ".obj";
+}
+
+
+bool ObjLoader::Load(Mesh *mesh, const std::string &sourcePath)
+{
+    MappedFile file;
+    if (!file.Open(sourcePath))
+        return false;
+
+    // Chunks end after a line break so every thread sees whole lines. A loader worker parses alone, the other
+    // workers are busy with the other files
+    const char *text = reinterpret_cast<const char *>(file.GetData());
+    const char *textEnd = text + file.GetSize();
+    size_t nrThreads = AssetLoader::IsWorkerThread() ? 1 : std::thread::hardware_concurrency();
+    size_t nrChunks = std::max<size_t>(1, std::min<size_t>(nrThreads, file.GetSize() / MIN_CHUNK_SIZE));
+
+    std::vector<ObjChunk> chunks(nrChunks);
+    const char *chunkBegin = text;
+    for (size_t i = 0; i < nrChunks; i++)
+    {
+        const char *chunkEnd = textEnd;
+        if (i + 1 < nrChunks)
+        {
+            chunkEnd = std::max(chunkBegin, text + file.GetSize() * (i + 1) / nrChunks);
+            const char *lineBreak = static_cast<const char *>(memchr(chunkEnd, '\n', textEnd - chunkEnd));
+            chunkEnd = lineBreak ? lineBreak + 1 : textEnd;
+        }
+
+        chunks[i].begin = chunkBegin;
+        chunks[i].end = chunkEnd;
+        chunkBegin = chunkEnd;
+    }
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < nrChunks; i++)
+    {
+        threads.emplace_back(ParseChunk, std::ref(chunks[i]));
+    }
+    ParseChunk(chunks[0]);
+
+    for (auto &thread : threads)
+    {
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+
+    // The element counts before each chunk turn its relative indices into absolute ones
+    size_t nrPositions = 0, nrTexCoords = 0, nrNormals = 0, nrCorners = 0;
+    bool generateNormals = false;
+    bool hasMaterialLibrary = false;
+    for (auto &chunk : chunks)
+    {
+        if (!chunk.valid)
+            return false;
+
+        for (auto &fixup : chunk.fixups)
+        {
+            ObjCorner &corner = chunk.corners[fixup.corner];
+            if (fixup.components & CORNER_POSITION)
+                corner.position += static_cast<int>(nrPositions);
+            if (fixup.components & CORNER_TEX_COORD)
+                corner.texCoord += static_cast<int>(nrTexCoords);
+            if (fixup.components & CORNER_NORMAL)
+                corner.normal += static_cast<int>(nrNormals);
+        }
+
+        nrPositions += chunk.positions.size();
+        nrTexCoords += chunk.texCoords.size();
+        nrNormals += chunk.normals.size();
+        nrCorners += chunk.corners.size();
+        generateNormals |= chunk.missingNormals;
+        hasMaterialLibrary |= chunk.hasMaterialLibrary;
+    }
+
+    // Materials are the importer's job
+    if (nrCorners == 0 || (hasMaterialLibrary && mesh->useMaterial))
+        return false;
+
+    std::vector<glm::vec3> positions, normals;
+    std::vector<glm::vec2> texCoords;
+    positions.reserve(nrPositions);
+    texCoords.reserve(nrTexCoords);
+    normals.reserve(nrNormals);
+    for (auto &chunk : chunks)
+    {
+        positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+        texCoords.insert(texCoords.end(), chunk.texCoords.begin(), chunk.texCoords.end());
+        normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+        std::vector<glm::vec3>().swap(chunk.positions);
+        std::vector<glm::vec2>().swap(chunk.texCoords);
+        std::vector<glm::vec3>().swap(chunk.normals);
+    }
+
+    // One vertex per distinct corner, open addressing over a power of two table at most half full
+    size_t tableSize = 1;
+    while (tableSize < nrCorners * 2)
+        tableSize <<= 1;
+    std::vector<uint32_t> table(tableSize, EMPTY_SLOT);
+
+    std::vector<ObjCorner> vertices;
+    std::vector<unsigned int> indices;
+    vertices.reserve(nrCorners / 4);
+    indices.reserve(nrCorners);
+
+    for (auto &chunk : chunks)
+    {
+        for (ObjCorner corner : chunk.corners)
+        {
+            // Generated normals follow the position, so the file's partial ones don't split vertices
+            if (generateNormals)
+                corner.normal = NO_INDEX;
+
+            if (corner.position < 0 || static_cast<size_t>(corner.position) >= nrPositions ||
+                (corner.texCoord != NO_INDEX && (corner.texCoord < 0 || static_cast<size_t>(corner.texCoord) >= nrTexCoords)) ||
+                (corner.normal != NO_INDEX && (corner.normal < 0 || static_cast<size_t>(corner.normal) >= nrNormals)))
+            {
+                return false;
+            }
+
+            size_t slot = HashCorner(corner) & (tableSize - 1);
+            while (table[slot] != EMPTY_SLOT && !(vertices[table[slot]] == corner))
+            {
+                slot = (slot + 1) & (tableSize - 1);
+            }
+
+            if (table[slot] == EMPTY_SLOT)
+            {
+                table[slot] = static_cast<uint32_t>(vertices.size());
+                vertices.push_back(corner);
+            }
+            indices.push_back(table[slot]);
+        }
+        std::vector<ObjCorner>().swap(chunk.corners);
+    }
+    std::vector<uint32_t>().swap(table);
+
+    // Same as the importer's smooth normals: the normalized face normals around each position, averaged
+    std::vector<glm::vec3> positionNormals;
+    if (generateNormals)
+    {
+        positionNormals.assign(nrPositions, glm::vec3(0));
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            int a = vertices[indices[i]].position;
+            int b = vertices[indices[i + 1]].position;
+            int c = vertices[indices[i + 2]].position;
+
+            glm::vec3 normal = glm::cross(positions[b] - positions[a], positions[c] - positions[a]);
+            float length = glm::length(normal);
+            if (length > 0)
+            {
+                normal /= length;
+                positionNormals[a] += normal;
+                positionNormals[b] += normal;
+                positionNormals[c] += normal;
+            }
+        }
+    }
+
+    mesh->positions.resize(vertices.size());
+    mesh->texCoords.resize(vertices.size());
+    mesh->normals.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        const ObjCorner &vertex = vertices[i];
+        mesh->positions[i] = positions[vertex.position];
+        mesh->texCoords[i] = vertex.texCoord == NO_INDEX ? glm::vec2(0) : texCoords[vertex.texCoord];
+
+        glm::vec3 normal = generateNormals ? positionNormals[vertex.position] : normals[vertex.normal];
+        float length = glm::length(normal);
+        mesh->normals[i] = generateNormals && length > 0 ? normal / length : normal;
+    }
+    mesh->bones.resize(vertices.size());
+    mesh->indices = std::move(indices);
+
+    // One entry and one default material, what the importer makes of an OBJ without materials
+    MeshEntry entry;
+    entry.nrIndices = static_cast<unsigned int>(mesh->indices.size());
+    entry.materialIndex = 0;
+    mesh->meshEntries.assign(1, entry);
+
+    mesh->materials.assign(1, nullptr);
+    mesh->materialTextures.assign(1, std::string());
+    if (mesh->useMaterial)
+    {
+        Material *material = new Material();
+        material->ambient = glm::vec4(0, 0, 0, 1);
+        material->diffuse = glm::vec4(0.6f, 0.6f, 0.6f, 1);
+        material->specular = glm::vec4(0, 0, 0, 1);
+        material->emissive = glm::vec4(0, 0, 0, 1);
+        material->shininess = 0;
+        mesh->materials[0] = material;
+    }
+
+    // A bare root node, enough for the mesh cache to store the result
+    mesh->rootNode = new aiNode();
+    mesh->m_GlobalInverseTransform = glm::mat4(1);
+    mesh->ComputeBounds();
+    return true;
+}
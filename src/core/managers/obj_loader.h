@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+
+class Mesh;
+
+
+// Native loader for plain Wavefront OBJ files (v, vt, vn, f), tried by Mesh::ImportMesh on a mesh cache miss before
+// Assimp. The file is mapped, split at line boundaries and parsed across threads, polygons are triangulated as fans
+// and the position/texcoord/normal triplets are de-duplicated into the mesh streams. The result matches the importer
+// flags Mesh uses: smooth normals when the file has none and flipped V coordinates.
+// Anything else (points and lines, materials from an mtllib when the mesh wants them, malformed lines) returns
+// false before the mesh is touched and is left to Assimp. Doesn't touch GL, runs on loader threads.
+class ObjLoader
+{
+ public:
+    static bool IsObjFile(const std::string &fileName);
+    static bool Load(Mesh *mesh, const std::string &sourcePath);
+
+ protected:
+    ObjLoader() = delete;
+    ~ObjLoader() = delete;
+};
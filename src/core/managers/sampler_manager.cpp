@@ -0,0 +1,41 @@
+#include "core/managers/sampler_manager.h"
+
+
+std::map<std::tuple<GLenum, GLenum, GLenum>, GLuint> SamplerManager::mapSamplers;
+
+
+GLuint SamplerManager::GetSampler(GLenum minFilter, GLenum magFilter, GLenum wrappingMode)
+{
+    auto key = std::make_tuple(minFilter, magFilter, wrappingMode);
+    auto it = mapSamplers.find(key);
+    if (it != mapSamplers.end())
+        return it->second;
+
+    GLuint sampler = 0;
+    glGenSamplers(1, &sampler);
+    glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, minFilter);
+    glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, magFilter);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, wrappingMode);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, wrappingMode);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_R, wrappingMode);
+
+    if (wrappingMode == GL_CLAMP_TO_BORDER) {
+        GLfloat borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+        glSamplerParameterfv(sampler, GL_TEXTURE_BORDER_COLOR, borderColor);
+    }
+
+    bool mipmapped = minFilter != GL_LINEAR && minFilter != GL_NEAREST;
+    if (mipmapped && GLEW_EXT_texture_filter_anisotropic) {
+        glSamplerParameterf(sampler, GL_TEXTURE_MAX_ANISOTROPY_EXT, 4);
+    }
+    CheckOpenGLError();
+
+    mapSamplers[key] = sampler;
+    return sampler;
+}
+
+
+void SamplerManager::BindSampler(GLenum textureUnit, GLuint sampler)
+{
+    glBindSampler(textureUnit - GL_TEXTURE0, sampler);
+}
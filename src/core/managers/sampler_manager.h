@@ -0,0 +1,23 @@
+#pragma once
+
+#include <map>
+#include <tuple>
+
+#include "utils/gl_utils.h"
+
+
+// Shared sampler objects, one per filtering / wrapping combination (linear-clamp, trilinear-repeat, ...).
+// Bound per texture unit, so image textures carry no sampling state and nothing is set while rendering.
+class SamplerManager
+{
+ public:
+    static GLuint GetSampler(GLenum minFilter, GLenum magFilter, GLenum wrappingMode);
+    static void BindSampler(GLenum textureUnit, GLuint sampler);
+
+ protected:
+    SamplerManager() = delete;
+    ~SamplerManager() = delete;
+
+ private:
+    static std::map<std::tuple<GLenum, GLenum, GLenum>, GLuint> mapSamplers;
+};
@@ -0,0 +1,248 @@
+#include "core/managers/texture_cache.h"
+
+#include "core/gpu/texture2D.h"
+#include "core/managers/asset_loader.h"
+#include "utils/image_utils.h"
+
+#include "stb/stb_image.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+
+static const uint32_t CACHE_MAGIC = 0x58544342;     // "BCTX"
+// Bumped whenever the encoders or the layout change, older files are rebaked
+static const uint32_t CACHE_VERSION = 1;
+
+struct CacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t channels;
+    uint32_t nrLevels;
+    uint32_t reserved;
+    uint64_t sourceHash;
+};
+
+
+bool TextureCache::enabled = true;
+
+
+void TextureCache::SetEnabled(bool state)
+{
+    enabled = state;
+}
+
+
+bool TextureCache::IsEnabled()
+{
+    return enabled;
+}
+
+
+bool TextureCache::IsFormatSupported(int channels)
+{
+    if (channels < 1 || channels > 4)
+        return false;
+
+    // RGTC is core since 3.0, S3TC is still an extension
+    return channels <= 2 || GLEW_EXT_texture_compression_s3tc;
+}
+
+
+std::string TextureCache::GetCachePath(const std::string &sourcePath)
+{
+    return sourcePath + ".bctx";
+}
+
+
+bool TextureCache::ReadSource(const std::string &sourcePath, std::vector<unsigned char> &bytes, uint64_t &hash)
+{
+    std::ifstream file(sourcePath, std::ios::binary | std::ios::ate);
+    if (!file.is_open())
+        return false;
+
+    std::streamsize size = file.tellg();
+    if (size <= 0)
+        return false;
+
+    bytes.resize(static_cast<size_t>(size));
+    file.seekg(0, std::ios::beg);
+    if (!file.read(reinterpret_cast<char *>(bytes.data()), size))
+        return false;
+
+    hash = image_utils::Hash(bytes.data(), bytes.size());
+    return true;
+}
+
+
+bool TextureCache::Load(const std::string &sourcePath, uint64_t hash, CompressedTexture &texture)
+{
+    std::ifstream file(GetCachePath(sourcePath), std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    CacheHeader header;
+    if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)))
+        return false;
+
+    // Stale or foreign files are a miss, the texture gets rebaked
+    int channels = static_cast<int>(header.channels);
+    if (header.magic != CACHE_MAGIC || header.version != CACHE_VERSION || header.sourceHash != hash ||
+        channels < 1 || channels > 4 || header.format != image_utils::GetBlockFormat(channels) ||
+        header.width == 0 || header.height == 0 || header.nrLevels == 0 || header.nrLevels > 32)
+    {
+        return false;
+    }
+
+    texture.format = header.format;
+    texture.width = static_cast<int>(header.width);
+    texture.height = static_cast<int>(header.height);
+    texture.channels = channels;
+    texture.levels.resize(header.nrLevels);
+
+    int width = texture.width, height = texture.height;
+    for (auto &level : texture.levels)
+    {
+        uint32_t size = 0;
+        if (!file.read(reinterpret_cast<char *>(&size), sizeof(size)) ||
+            size != image_utils::GetBlockCompressedSize(width, height, channels))
+        {
+            return false;
+        }
+
+        level.resize(size);
+        if (!file.read(reinterpret_cast<char *>(level.data()), size))
+            return false;
+
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+    }
+
+    return true;
+}
+
+
+bool TextureCache::Store(const std::string &sourcePath, uint64_t hash, const CompressedTexture &texture)
+{
+    std::string cachePath = GetCachePath(sourcePath);
+    std::ofstream file(cachePath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        std::cerr << "Texture cache: can't write " << cachePath << std::endl;
+        return false;
+    }
+
+    CacheHeader header;
+    header.magic = CACHE_MAGIC;
+    header.version = CACHE_VERSION;
+    header.format = texture.format;
+    header.width = static_cast<uint32_t>(texture.width);
+    header.height = static_cast<uint32_t>(texture.height);
+    header.channels = static_cast<uint32_t>(texture.channels);
+    header.nrLevels = static_cast<uint32_t>(texture.levels.size());
+    header.reserved = 0;
+    header.sourceHash = hash;
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    for (auto &level : texture.levels)
+    {
+        uint32_t size = static_cast<uint32_t>(level.size());
+        file.write(reinterpret_cast<const char *>(&size), sizeof(size));
+        file.write(reinterpret_cast<const char *>(level.data()), size);
+    }
+
+    return file.good();
+}
+
+
+bool TextureCache::LoadOrBake(const std::string &sourcePath, const std::vector<unsigned char> &source, uint64_t hash,
+                              CompressedTexture &texture)
+{
+    if (Load(sourcePath, hash, texture))
+        return IsFormatSupported(texture.channels);
+
+    // Cache miss: decode once from the bytes already read, bake and store for the next launch
+    int width, height, chn;
+    if (!stbi_info_from_memory(source.data(), static_cast<int>(source.size()), &width, &height, &chn) ||
+        !IsFormatSupported(chn))
+    {
+        return false;
+    }
+
+    unsigned char *image = stbi_load_from_memory(source.data(), static_cast<int>(source.size()), &width, &height, &chn, 0);
+    if (image == NULL)
+        return false;
+
+    Bake(image, width, height, chn, texture);
+    stbi_image_free(image);
+    Store(sourcePath, hash, texture);
+    return true;
+}
+
+
+bool TextureCache::Decode(const std::string &sourcePath, CompressedTexture &texture)
+{
+    std::vector<unsigned char> source;
+    uint64_t hash;
+    if (!ReadSource(sourcePath, source, hash))
+        return false;
+
+    if (enabled && LoadOrBake(sourcePath, source, hash, texture))
+        return true;
+
+    // Plain 8-bit image, the mips are built here rather than with glGenerateMipmap on the render thread
+    int width, height, chn;
+    unsigned char *image = stbi_load_from_memory(source.data(), static_cast<int>(source.size()), &width, &height, &chn, 0);
+    if (image == NULL)
+        return false;
+
+    texture.format = Texture2D::GetImageFormat(chn);
+    texture.width = width;
+    texture.height = height;
+    texture.channels = chn;
+    texture.levels.clear();
+    texture.levels.emplace_back(image, image + static_cast<size_t>(width) * height * chn);
+    stbi_image_free(image);
+
+    while (width > 1 || height > 1)
+    {
+        texture.levels.push_back(image_utils::Downsample(texture.levels.back().data(), width, height, chn));
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+    }
+    return true;
+}
+
+
+void TextureCache::Bake(const unsigned char *image, int width, int height, int channels, CompressedTexture &texture)
+{
+    texture.format = image_utils::GetBlockFormat(channels);
+    texture.width = width;
+    texture.height = height;
+    texture.channels = channels;
+    texture.levels.clear();
+
+    // A loader worker compresses alone, the other workers are busy with the other textures
+    int nrThreads = AssetLoader::IsWorkerThread() ? 1 : 0;
+
+    std::vector<unsigned char> mip;
+    const unsigned char *source = image;
+    while (true)
+    {
+        texture.levels.emplace_back(image_utils::GetBlockCompressedSize(width, height, channels));
+        image_utils::CompressBlocks(source, width, height, channels, texture.levels.back().data(), nrThreads);
+
+        if (width == 1 && height == 1)
+            break;
+
+        mip = image_utils::Downsample(source, width, height, channels);
+        source = mip.data();
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "utils/gl_utils.h"
+
+
+// Mip chain of an image ready for upload: block compressed as baked into the texture cache, or plain 8-bit levels
+struct CompressedTexture
+{
+    GLenum format = 0;
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    std::vector<std::vector<unsigned char>> levels;
+};
+
+
+// Baked textures stored next to their source image (<image>.bctx), keyed by the hash of the source file.
+// A cache hit uploads the precompressed mips directly, skipping image decoding and GPU mip generation.
+class TextureCache
+{
+ public:
+    static void SetEnabled(bool state);
+    static bool IsEnabled();
+
+    // Whether the GPU can sample the block format used for the given channel count
+    static bool IsFormatSupported(int channels);
+
+    static bool ReadSource(const std::string &sourcePath, std::vector<unsigned char> &bytes, uint64_t &hash);
+    static bool Load(const std::string &sourcePath, uint64_t hash, CompressedTexture &texture);
+    static bool Store(const std::string &sourcePath, uint64_t hash, const CompressedTexture &texture);
+
+    // Cached mips of the source bytes, baked and stored on a miss. Fails when the image can't be decoded or
+    // its block format isn't supported
+    static bool LoadOrBake(const std::string &sourcePath, const std::vector<unsigned char> &source, uint64_t hash,
+                           CompressedTexture &texture);
+
+    // CPU half of a texture load, safe on worker threads: the cached block compressed mips when the cache is
+    // enabled and the format supported, the decoded image with box filtered mips otherwise
+    static bool Decode(const std::string &sourcePath, CompressedTexture &texture);
+
+    // Builds the CPU mip chain of an 8-bit image down to 1x1 and block compresses every level
+    static void Bake(const unsigned char *image, int width, int height, int channels, CompressedTexture &texture);
+
+ protected:
+    TextureCache() = delete;
+    ~TextureCache() = delete;
+
+ private:
+    static std::string GetCachePath(const std::string &sourcePath);
+
+ private:
+    static bool enabled;
+};
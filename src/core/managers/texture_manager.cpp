@@ -1,69 +1,234 @@
 #include "core/managers/texture_manager.h"
 
 #include "core/gpu/texture2D.h"
+#include "core/managers/asset_loader.h"
 #include "core/managers/resource_path.h"
+#include "core/managers/sampler_manager.h"
+#include "core/managers/texture_cache.h"
+#include "core/managers/texture_streamer.h"
 #include "utils/memory_utils.h"
 
+#include "stb/stb_image.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <memory>
+
 
 std::unordered_map<std::string, Texture2D*> TextureManager::mapTextures;
 std::vector<Texture2D*> TextureManager::vTextures;
+std::unordered_map<std::string, std::pair<GLuint, GLuint>> TextureManager::mapTextureArrays;
+std::unordered_map<std::string, TextureLayer> TextureManager::mapTextureLayers;
+std::unordered_map<std::string, std::string> TextureManager::mapDeclared;
+std::vector<TextureManager::TextureRecord> TextureManager::records;
+std::vector<unsigned int> TextureManager::freeRecords;
+std::unordered_map<std::string, unsigned int> TextureManager::mapRecords;
+size_t TextureManager::memoryBudget = 0;
+size_t TextureManager::memoryUsage = 0;
+size_t TextureManager::evictionCount = 0;
+std::recursive_mutex TextureManager::mutex;
+
+
+// Bilinear resample of an RGBA8 image
+static std::vector<unsigned char> ResampleRGBA8(const unsigned char *src, int srcWidth, int srcHeight, int dstWidth, int dstHeight)
+{
+    std::vector<unsigned char> dst(static_cast<size_t>(dstWidth) * dstHeight * 4);
+    for (int y = 0; y < dstHeight; y++)
+    {
+        float sy = std::max((y + 0.5f) * srcHeight / dstHeight - 0.5f, 0.0f);
+        int y0 = std::min(static_cast<int>(sy), srcHeight - 1);
+        int y1 = std::min(y0 + 1, srcHeight - 1);
+        float fy = sy - y0;
+
+        for (int x = 0; x < dstWidth; x++)
+        {
+            float sx = std::max((x + 0.5f) * srcWidth / dstWidth - 0.5f, 0.0f);
+            int x0 = std::min(static_cast<int>(sx), srcWidth - 1);
+            int x1 = std::min(x0 + 1, srcWidth - 1);
+            float fx = sx - x0;
+
+            for (int c = 0; c < 4; c++)
+            {
+                float top = src[(y0 * srcWidth + x0) * 4 + c] * (1 - fx) + src[(y0 * srcWidth + x1) * 4 + c] * fx;
+                float bottom = src[(y1 * srcWidth + x0) * 4 + c] * (1 - fx) + src[(y1 * srcWidth + x1) * 4 + c] * fx;
+                dst[(static_cast<size_t>(y) * dstWidth + x) * 4 + c] = static_cast<unsigned char>(top * (1 - fy) + bottom * fy + 0.5f);
+            }
+        }
+    }
+    return dst;
+}
 
 
 void TextureManager::Init(const std::string &selfDir)
 {
-    LoadTexture(PATH_JOIN(selfDir, RESOURCE_PATH::TEXTURES), "default.png");
-    LoadTexture(PATH_JOIN(selfDir, RESOURCE_PATH::TEXTURES), "white.png");
-    LoadTexture(PATH_JOIN(selfDir, RESOURCE_PATH::TEXTURES), "black.jpg");
-    LoadTexture(PATH_JOIN(selfDir, RESOURCE_PATH::TEXTURES), "noise.png");
-    LoadTexture(PATH_JOIN(selfDir, RESOURCE_PATH::TEXTURES), "random.jpg");
-    LoadTexture(PATH_JOIN(selfDir, RESOURCE_PATH::TEXTURES), "particle.png");
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+
+    // default.png is texture 0, the placeholder of every other one. The rest load on first use
+    LoadTextureAsync(PATH_JOIN(selfDir, RESOURCE_PATH::TEXTURES), "default.png");
+    DeclareTexture(PATH_JOIN(selfDir, RESOURCE_PATH::TEXTURES), "white.png");
+    DeclareTexture(PATH_JOIN(selfDir, RESOURCE_PATH::TEXTURES), "black.jpg");
+    DeclareTexture(PATH_JOIN(selfDir, RESOURCE_PATH::TEXTURES), "noise.png");
+    DeclareTexture(PATH_JOIN(selfDir, RESOURCE_PATH::TEXTURES), "random.jpg");
+    DeclareTexture(PATH_JOIN(selfDir, RESOURCE_PATH::TEXTURES), "particle.png");
 }
 
 
 Texture2D* TextureManager::LoadTexture(const std::string& path, const char* fileName, const char* key, bool forceLoad, bool cacheInRAM)
 {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
     std::string uid = key ? std::string(key) : std::string(fileName);
     Texture2D* texture = GetTexture(uid.c_str());
 
     if (forceLoad || texture == nullptr)
     {
-        if (texture == nullptr)
+        bool isNew = texture == nullptr;
+        if (isNew)
         {
             texture = new Texture2D();
         }
 
+        std::string sourcePath = path + (fileName ? (std::string(1, PATH_SEPARATOR) + fileName) : "");
         texture->CacheInMemory(cacheInRAM);
-        bool status = texture->Load2D((path + (fileName ? (std::string(1, PATH_SEPARATOR) + fileName) : "")).c_str());
+        bool status = texture->Load2D(sourcePath.c_str());
 
         if (!status)
         {
-            delete texture;
-            return (!vTextures.empty()) ? vTextures[0] : nullptr;
+            // A failed reload keeps the old texture, it's still referenced
+            if (isNew)
+                delete texture;
+            return isNew ? ((!vTextures.empty()) ? vTextures[0] : nullptr) : texture;
         }
 
-        vTextures.push_back(texture);
-        mapTextures[uid] = texture;
+        if (isNew)
+        {
+            vTextures.push_back(texture);
+            mapTextures[uid] = texture;
+        }
+        Register(uid, texture, sourcePath, true);
     }
     return texture;
 }
 
 
+Texture2D* TextureManager::StreamTexture(const std::string& path, const char* fileName, const char* key)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    if (!TextureStreamer::IsAvailable() || vTextures.empty())
+    {
+        return LoadTexture(path, fileName, key);
+    }
+
+    // Loaded here instead of on first lookup
+    std::string uid = key ? std::string(key) : std::string(fileName);
+    mapDeclared.erase(uid);
+    Texture2D* texture = GetTexture(uid.c_str());
+    if (texture)
+    {
+        return texture;
+    }
+
+    std::string sourcePath = path + (fileName ? (std::string(1, PATH_SEPARATOR) + fileName) : "");
+    texture = new Texture2D();
+    TextureStreamer::Request(texture, sourcePath, vTextures[0]);
+
+    vTextures.push_back(texture);
+    mapTextures[uid] = texture;
+    Register(uid, texture, sourcePath, true);
+    return texture;
+}
+
+
+Texture2D* TextureManager::LoadTextureAsync(const std::string& path, const char* fileName, const char* key)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    // Loaded here instead of on first lookup
+    std::string uid = key ? std::string(key) : std::string(fileName);
+    mapDeclared.erase(uid);
+    Texture2D* texture = GetTexture(uid.c_str());
+    if (texture)
+    {
+        return texture;
+    }
+
+    // Registered in request order, so the texture indices don't depend on which decode finishes first
+    std::string sourcePath = path + (fileName ? (std::string(1, PATH_SEPARATOR) + fileName) : "");
+    texture = new Texture2D();
+    if (!vTextures.empty())
+    {
+        texture->SetPlaceholder(vTextures[0]);
+    }
+    vTextures.push_back(texture);
+    mapTextures[uid] = texture;
+
+    std::shared_ptr<CompressedTexture> image = std::make_shared<CompressedTexture>();
+    AssetLoader::Submit(
+        [sourcePath, image]() { return TextureCache::Decode(sourcePath, *image); },
+        [uid, sourcePath, texture, image](bool decoded)
+        {
+            std::lock_guard<std::recursive_mutex> lock(mutex);
+            if (!decoded)
+            {
+                // Keeps binding the default texture, a later load of the same name tries again
+                std::cerr << "Texture manager: failed to load " << sourcePath << std::endl;
+                auto it = mapTextures.find(uid);
+                if (it != mapTextures.end() && it->second == texture)
+                    mapTextures.erase(it);
+                return;
+            }
+
+            texture->Upload2D(*image);
+            texture->SetPlaceholder(nullptr);
+            Register(uid, texture, sourcePath, true);
+        });
+    return texture;
+}
+
+
 void TextureManager::SetTexture(std::string name, Texture2D *texture)
 {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
     mapTextures[name] = texture;
+    Register(name, texture, "", true);
+}
+
+
+void TextureManager::DeclareTexture(const std::string& path, const char* fileName, const char* key)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    std::string uid = key ? std::string(key) : std::string(fileName);
+    if (mapTextures.find(uid) == mapTextures.end())
+    {
+        mapDeclared[uid] = path + (fileName ? (std::string(1, PATH_SEPARATOR) + fileName) : "");
+    }
 }
 
 
 Texture2D* TextureManager::GetTexture(const char* name)
 {
-    if (mapTextures[name])
-        return mapTextures[name];
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    auto it = mapTextures.find(name);
+    if (it != mapTextures.end())
+        return it->second;
+
+    // First use of a declared texture
+    auto declared = mapDeclared.find(name);
+    if (declared != mapDeclared.end())
+    {
+        std::string uid = declared->first;
+        std::string sourcePath = declared->second;
+        mapDeclared.erase(declared);
+
+        Texture2D* texture = LoadTexture(sourcePath, nullptr, uid.c_str());
+        return (!vTextures.empty() && texture == vTextures[0] && uid != "default.png") ? NULL : texture;
+    }
     return NULL;
 }
 
 
 Texture2D* TextureManager::GetTexture(unsigned int textureID)
 {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
     if (textureID < vTextures.size())
         return vTextures[textureID];
     return NULL;
@@ -72,19 +237,439 @@ Texture2D* TextureManager::GetTexture(unsigned int textureID)
 
 std::string TextureManager::GetNameTexture(Texture2D* texture)
 {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
     if (!texture)
     {
         return "";
     }
 
-    GLuint textureID = texture->GetTextureID();
-
+    // By object: streamed textures have no GL name until they're resident
     for (auto& it : mapTextures)
     {
-        if (it.second->GetTextureID() == textureID)
+        if (it.second == texture)
         {
             return it.first;
         }
     }
     return "";
 }
+
+
+unsigned int TextureManager::Register(const std::string &name, Texture2D *texture, const std::string &sourcePath, bool pinned)
+{
+    auto it = mapRecords.find(name);
+    if (it != mapRecords.end())
+    {
+        TextureRecord &record = records[it->second];
+        record.texture = texture;
+        record.sourcePath = sourcePath;
+        record.pinned = record.pinned || pinned;
+        record.pendingDestroy = false;
+        record.evicted = false;
+        record.droppedLevels = 0;
+        return it->second;
+    }
+
+    unsigned int index;
+    if (!freeRecords.empty())
+    {
+        index = freeRecords.back();
+        freeRecords.pop_back();
+    }
+    else
+    {
+        index = static_cast<unsigned int>(records.size());
+        records.emplace_back();
+    }
+
+    TextureRecord &record = records[index];
+    record.texture = texture;
+    record.name = name;
+    record.sourcePath = sourcePath;
+    record.refCount = 0;
+    record.pinned = pinned;
+    record.pendingDestroy = false;
+    record.evicted = false;
+    record.droppedLevels = 0;
+    record.bytes = 0;
+    record.fullBytes = 0;
+    mapRecords[name] = index;
+    return index;
+}
+
+
+TextureManager::TextureRecord *TextureManager::GetRecord(TextureHandle handle)
+{
+    if (handle.index >= records.size())
+        return nullptr;
+
+    TextureRecord &record = records[handle.index];
+    if (record.texture == nullptr || record.generation != handle.generation)
+        return nullptr;
+    return &record;
+}
+
+
+TextureHandle TextureManager::Acquire(const std::string &path, const char *fileName, const char *key)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    std::string uid = key ? std::string(key) : std::string(fileName);
+    bool registered = mapRecords.find(uid) != mapRecords.end();
+
+    StreamTexture(path, fileName, key);
+
+    auto it = mapRecords.find(uid);
+    if (it == mapRecords.end())
+        return TextureHandle();
+
+    // Loaded for the handle: only the references keep it alive
+    if (!registered)
+        records[it->second].pinned = false;
+
+    return Acquire(uid.c_str());
+}
+
+
+TextureHandle TextureManager::Acquire(const char *name)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    if (mapDeclared.find(name) != mapDeclared.end())
+    {
+        GetTexture(name);
+    }
+
+    auto it = mapRecords.find(name);
+    if (it == mapRecords.end())
+        return TextureHandle();
+
+    TextureRecord &record = records[it->second];
+    record.refCount++;
+    record.pendingDestroy = false;
+
+    TextureHandle handle;
+    handle.index = it->second;
+    handle.generation = record.generation;
+    return handle;
+}
+
+
+void TextureManager::Release(TextureHandle &handle)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    TextureRecord *record = GetRecord(handle);
+    handle = TextureHandle();
+    if (record == nullptr)
+        return;
+
+    // Destroyed by Update, once no streaming request refers to it
+    if (--record->refCount <= 0 && !record->pinned)
+    {
+        record->refCount = 0;
+        record->pendingDestroy = true;
+    }
+}
+
+
+Texture2D *TextureManager::Get(TextureHandle handle)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    TextureRecord *record = GetRecord(handle);
+    return record ? record->texture : nullptr;
+}
+
+
+void TextureManager::Destroy(unsigned int index)
+{
+    TextureRecord &record = records[index];
+    Texture2D *texture = record.texture;
+
+    vTextures.erase(std::remove(vTextures.begin(), vTextures.end(), texture), vTextures.end());
+    mapTextures.erase(record.name);
+    mapRecords.erase(record.name);
+
+    texture->Unload(nullptr);
+    delete texture;
+
+    record.texture = nullptr;
+    record.name.clear();
+    record.sourcePath.clear();
+    record.generation++;
+    freeRecords.push_back(index);
+}
+
+
+void TextureManager::SetMemoryBudget(size_t bytes)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    memoryBudget = bytes;
+}
+
+
+size_t TextureManager::GetMemoryBudget()
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    return memoryBudget;
+}
+
+
+size_t TextureManager::GetMemoryUsage()
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    return memoryUsage;
+}
+
+
+void TextureManager::PrintMemoryStats()
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    size_t resident = 0, degraded = 0, evicted = 0;
+    for (auto &record : records)
+    {
+        if (!record.texture)
+            continue;
+        if (record.evicted)
+            evicted++;
+        else if (record.droppedLevels > 0)
+            degraded++;
+        else
+            resident++;
+    }
+
+    const double MB = 1024.0 * 1024.0;
+    std::cout << "Textures: " << memoryUsage / MB << " MB";
+    if (memoryBudget)
+        std::cout << " of " << memoryBudget / MB << " MB";
+    std::cout << ", " << resident << " resident, " << degraded << " at lower mips, " << evicted << " evicted, "
+              << evictionCount << " evictions" << std::endl;
+}
+
+
+void TextureManager::PrintUsageReport()
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    std::string neverBound;
+    size_t loaded = 0;
+    for (auto &record : records)
+    {
+        if (!record.texture)
+            continue;
+        loaded++;
+        if (record.texture->GetLastBindFrame() == 0)
+            neverBound += (neverBound.empty() ? "" : ", ") + record.name;
+    }
+
+    std::string notLoaded;
+    for (auto &declared : mapDeclared)
+    {
+        notLoaded += (notLoaded.empty() ? "" : ", ") + declared.first;
+    }
+
+    std::cout << "Textures: " << loaded << " loaded, " << mapDeclared.size() << " declared and never loaded" << std::endl;
+    if (!neverBound.empty())
+        std::cout << "\tnever bound: " << neverBound << std::endl;
+    if (!notLoaded.empty())
+        std::cout << "\tnot loaded: " << notLoaded << std::endl;
+}
+
+
+void TextureManager::Reload(TextureRecord &record)
+{
+    Texture2D *texture = record.texture;
+
+    // Lower mips stay bound until the upload is done, evicted textures show the default one
+    const Texture2D *placeholder = record.evicted ? vTextures[0] : nullptr;
+    record.evicted = false;
+    record.droppedLevels = 0;
+
+    if (TextureStreamer::IsAvailable())
+    {
+        TextureStreamer::Request(texture, record.sourcePath, placeholder);
+        return;
+    }
+
+    if (!texture->Load2D(record.sourcePath.c_str(), texture->GetWrappingMode()))
+    {
+        std::cerr << "Texture manager: failed to reload " << record.sourcePath << std::endl;
+        return;
+    }
+    texture->SetPlaceholder(nullptr);
+}
+
+
+void TextureManager::Update()
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    Texture2D::AdvanceFrame();
+    unsigned int frame = Texture2D::GetCurrentFrame();
+
+    memoryUsage = 0;
+    for (unsigned int i = 0; i < records.size(); i++)
+    {
+        TextureRecord &record = records[i];
+        if (!record.texture)
+            continue;
+
+        if (record.pendingDestroy && !TextureStreamer::IsQueued(record.texture))
+        {
+            Destroy(i);
+            continue;
+        }
+
+        record.bytes = record.texture->GetMemorySize();
+        if (!record.evicted && record.droppedLevels == 0 && record.texture->IsResident())
+            record.fullBytes = record.bytes;
+        memoryUsage += record.bytes;
+    }
+
+    if (memoryBudget == 0 || vTextures.empty())
+        return;
+
+    // Evicted textures that are bound again come back at full size, as far as the budget allows
+    for (auto &record : records)
+    {
+        if (!record.texture || (!record.evicted && record.droppedLevels == 0))
+            continue;
+        if (frame - record.texture->GetLastBindFrame() > 1)
+            continue;
+
+        size_t growth = record.fullBytes > record.bytes ? record.fullBytes - record.bytes : 0;
+        if (memoryUsage + growth > memoryBudget)
+            continue;
+
+        Reload(record);
+        memoryUsage += growth;
+    }
+
+    if (memoryUsage <= memoryBudget)
+        return;
+
+    // Least recently bound first, textures in use are never touched
+    std::vector<unsigned int> candidates;
+    for (unsigned int i = 0; i < records.size(); i++)
+    {
+        const TextureRecord &record = records[i];
+        if (!record.texture || record.sourcePath.empty() || record.evicted || !record.texture->IsResident() ||
+            record.texture == vTextures[0] || frame - record.texture->GetLastBindFrame() < EVICTION_IDLE_FRAMES ||
+            TextureStreamer::IsQueued(record.texture))
+        {
+            continue;
+        }
+        candidates.push_back(i);
+    }
+    std::sort(candidates.begin(), candidates.end(), [](unsigned int a, unsigned int b) {
+        return records[a].texture->GetLastBindFrame() < records[b].texture->GetLastBindFrame();
+    });
+
+    // Lower mips first, then whole textures behind the placeholder
+    unsigned int evictions = 0;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (unsigned int index : candidates)
+        {
+            TextureRecord &record = records[index];
+            Texture2D *texture = record.texture;
+            while (!record.evicted && memoryUsage > memoryBudget && evictions < MAX_EVICTIONS_PER_FRAME)
+            {
+                if (pass == 0)
+                {
+                    if (std::min(texture->GetWidth(), texture->GetHeight()) <= MIN_RESIDENT_SIZE || !texture->DropTopLevel())
+                        break;
+                    record.droppedLevels++;
+                }
+                else
+                {
+                    texture->Unload(vTextures[0]);
+                    record.evicted = true;
+                }
+
+                size_t bytes = texture->GetMemorySize();
+                memoryUsage -= record.bytes - bytes;
+                record.bytes = bytes;
+                evictions++;
+                evictionCount++;
+            }
+        }
+    }
+}
+
+
+GLuint TextureManager::BuildTextureArray(const std::string &name, const std::string &path, const std::vector<std::string> &fileNames,
+                                         unsigned int size, GLenum wrappingMode)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    auto it = mapTextureArrays.find(name);
+    if (it != mapTextureArrays.end())
+    {
+        glDeleteTextures(1, &it->second.first);
+        mapTextureArrays.erase(it);
+    }
+
+    int levels = 1 + static_cast<int>(std::floor(std::log2(static_cast<float>(size))));
+    int nrLayers = static_cast<int>(fileNames.size());
+
+    GLuint arrayID = 0;
+    glGenTextures(1, &arrayID);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, arrayID);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, GL_RGBA8, size, size, nrLayers);
+
+    for (int layer = 0; layer < nrLayers; layer++)
+    {
+        const std::string &fileName = fileNames[layer];
+
+        int width, height, chn;
+        unsigned char *data = stbi_load((path + PATH_SEPARATOR + fileName).c_str(), &width, &height, &chn, 4);
+        if (!data)
+        {
+            std::cerr << "Texture array " << name << ": failed to load " << fileName << std::endl;
+            continue;
+        }
+
+        if (width == static_cast<int>(size) && height == static_cast<int>(size))
+        {
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, size, size, 1, GL_RGBA, GL_UNSIGNED_BYTE, data);
+        }
+        else
+        {
+            std::vector<unsigned char> resampled = ResampleRGBA8(data, width, height, size, size);
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, size, size, 1, GL_RGBA, GL_UNSIGNED_BYTE, resampled.data());
+        }
+        stbi_image_free(data);
+
+        TextureLayer textureLayer;
+        textureLayer.arrayID = arrayID;
+        textureLayer.layer = layer;
+        mapTextureLayers[fileName] = textureLayer;
+    }
+
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    CheckOpenGLError();
+
+    GLuint sampler = SamplerManager::GetSampler(GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, wrappingMode);
+    mapTextureArrays[name] = std::make_pair(arrayID, sampler);
+    return arrayID;
+}
+
+
+TextureLayer TextureManager::GetTextureLayer(const std::string &fileName)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    auto it = mapTextureLayers.find(fileName);
+    if (it != mapTextureLayers.end())
+        return it->second;
+    return TextureLayer();
+}
+
+
+bool TextureManager::BindTextureArray(const std::string &name, GLenum textureUnit)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    auto it = mapTextureArrays.find(name);
+    if (it == mapTextureArrays.end())
+        return false;
+
+    glActiveTexture(textureUnit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, it->second.first);
+    SamplerManager::BindSampler(textureUnit, it->second.second);
+    return true;
+}
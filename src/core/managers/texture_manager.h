@@ -1,5 +1,6 @@
 #pragma once
 
+#include <mutex>
 #include <unordered_map>
 #include <string>
 #include <vector>
@@ -7,22 +8,112 @@
 #include "core/gpu/texture2D.h"
 
 
+// Layer of a texture packed by TextureManager::BuildTextureArray
+struct TextureLayer
+{
+    GLuint arrayID = 0;
+    int layer = -1;
+};
+
+
+// Typed reference to a registry texture, the generation catches handles outliving the texture
+struct TextureHandle
+{
+    unsigned int index = 0;
+    unsigned int generation = 0;
+};
+
+
 class TextureManager
 {
  public:
     static void Init(const std::string &selfDir);
     static Texture2D *LoadTexture(const std::string &Path, const char *fileName, const char *key = nullptr, bool forceLoad = false, bool cacheInRAM = false);
+    // Like LoadTexture, but decoded and uploaded in the background: the default texture is bound until it's resident
+    static Texture2D *StreamTexture(const std::string &Path, const char *fileName, const char *key = nullptr);
+    // Like LoadTexture, but decoded on an AssetLoader worker: the texture is registered right away, binds the
+    // default texture meanwhile and gets its data when the upload runs (AssetLoader::Update / Flush)
+    static Texture2D *LoadTextureAsync(const std::string &Path, const char *fileName, const char *key = nullptr);
+    // Only remembers the file under its name, the first GetTexture / Acquire of that name loads it
+    static void DeclareTexture(const std::string &Path, const char *fileName, const char *key = nullptr);
     static void SetTexture(const std::string name, Texture2D * texture);
     static Texture2D* GetTexture(const char* name);
     static Texture2D* GetTexture(unsigned int textureID);
     static std::string GetNameTexture(Texture2D * texture);
 
+    // Reference counted access. Acquire loads (or streams) the file when it isn't registered yet, the texture
+    // is destroyed when its last handle is released. Textures handed out as raw pointers stay pinned.
+    static TextureHandle Acquire(const std::string &path, const char *fileName, const char *key = nullptr);
+    static TextureHandle Acquire(const char *name);
+    static void Release(TextureHandle &handle);
+    static Texture2D *Get(TextureHandle handle);
+
+    // VRAM budget of the registry textures in bytes, 0 disables eviction
+    static void SetMemoryBudget(size_t bytes);
+    static size_t GetMemoryBudget();
+    static size_t GetMemoryUsage();
+    static void PrintMemoryStats();
+    // Loaded textures never bound so far and declared ones never loaded
+    static void PrintUsageReport();
+
+    // Render thread, once per frame: byte accounting, LRU eviction of idle textures while over budget (top
+    // mips first, then the whole texture behind the default one) and reloading of evicted textures in use
+    static void Update();
+
+    // Packs images into the RGBA8 layers of one GL_TEXTURE_2D_ARRAY (size x size, resampled when needed, mips
+    // built once), so draws using any of them share a single bind
+    static GLuint BuildTextureArray(const std::string &name, const std::string &path, const std::vector<std::string> &fileNames,
+                                    unsigned int size, GLenum wrappingMode = GL_CLAMP_TO_EDGE);
+    static TextureLayer GetTextureLayer(const std::string &fileName);
+    static bool BindTextureArray(const std::string &name, GLenum textureUnit);
+
  protected:
     TextureManager() = delete;
     ~TextureManager() = delete;
 
+ private:
+    struct TextureRecord
+    {
+        Texture2D *texture = nullptr;
+        std::string name;
+        // Reloaded from here after an eviction, empty for textures registered with SetTexture
+        std::string sourcePath;
+        unsigned int generation = 1;
+        int refCount = 0;
+        bool pinned = false;
+        bool pendingDestroy = false;
+        bool evicted = false;
+        int droppedLevels = 0;
+        size_t bytes = 0;
+        size_t fullBytes = 0;
+    };
+
+    static unsigned int Register(const std::string &name, Texture2D *texture, const std::string &sourcePath, bool pinned);
+    static TextureRecord *GetRecord(TextureHandle handle);
+    static void Reload(TextureRecord &record);
+    static void Destroy(unsigned int index);
+
+    // Textures bound within this many frames are never evicted
+    static const unsigned int EVICTION_IDLE_FRAMES = 120;
+    // Mips are dropped down to this size before the whole texture goes
+    static const unsigned int MIN_RESIDENT_SIZE = 64;
+    static const unsigned int MAX_EVICTIONS_PER_FRAME = 8;
+
  private:
     static std::unordered_map<std::string, Texture2D*> mapTextures;
     static std::vector<Texture2D*> vTextures;
+    static std::unordered_map<std::string, std::pair<GLuint, GLuint>> mapTextureArrays;
+    static std::unordered_map<std::string, TextureLayer> mapTextureLayers;
+    // Declared name -> source file, until the first lookup
+    static std::unordered_map<std::string, std::string> mapDeclared;
     static std::string selfDir;
+    // Guards every map and the registry: lookups may come from loader threads
+    static std::recursive_mutex mutex;
+
+    static std::vector<TextureRecord> records;
+    static std::vector<unsigned int> freeRecords;
+    static std::unordered_map<std::string, unsigned int> mapRecords;
+    static size_t memoryBudget;
+    static size_t memoryUsage;
+    static size_t evictionCount;
 };
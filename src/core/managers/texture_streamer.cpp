@@ -0,0 +1,368 @@
+#include "core/managers/texture_streamer.h"
+
+#include "core/gpu/texture2D.h"
+#include "core/managers/texture_cache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+
+GLuint TextureStreamer::ringBuffer = 0;
+unsigned char *TextureStreamer::ringData = nullptr;
+size_t TextureStreamer::ringBytes = 0;
+size_t TextureStreamer::frameBudget = 0;
+
+std::vector<std::thread> TextureStreamer::workers;
+std::mutex TextureStreamer::mutex;
+std::condition_variable TextureStreamer::workAvailable;
+std::condition_variable TextureStreamer::ringAvailable;
+bool TextureStreamer::running = false;
+
+std::deque<TextureStreamer::Job*> TextureStreamer::requests;
+std::deque<TextureStreamer::Job*> TextureStreamer::decoded;
+std::deque<TextureStreamer::RingRegion> TextureStreamer::regions;
+std::vector<TextureStreamer::Upload> TextureStreamer::uploads;
+
+
+void TextureStreamer::Init(size_t ringBytes, size_t frameBudgetBytes, unsigned int nrWorkers)
+{
+    if (running || !GLEW_ARB_buffer_storage)
+        return;
+
+    TextureStreamer::ringBytes = ringBytes;
+    frameBudget = frameBudgetBytes;
+
+    // Written by the workers, read by the GPU: coherent so no explicit flushes are needed
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &ringBuffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ringBuffer);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, ringBytes, nullptr, flags);
+    ringData = static_cast<unsigned char *>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, ringBytes, flags));
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    CheckOpenGLError();
+
+    if (ringData == nullptr)
+    {
+        std::cerr << "Texture streamer: can't map the upload ring, textures load synchronously" << std::endl;
+        glDeleteBuffers(1, &ringBuffer);
+        ringBuffer = 0;
+        return;
+    }
+
+    running = true;
+    for (unsigned int i = 0; i < std::max(nrWorkers, 1u); i++)
+    {
+        workers.emplace_back(WorkerLoop);
+    }
+}
+
+
+void TextureStreamer::Shutdown()
+{
+    if (!running)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    workAvailable.notify_all();
+    ringAvailable.notify_all();
+
+    for (auto &worker : workers)
+    {
+        if (worker.joinable())
+        {
+            worker.join();
+        }
+    }
+    workers.clear();
+
+    // Uploads already issued complete, textures still queued keep their placeholder
+    for (auto &upload : uploads)
+    {
+        glClientWaitSync(upload.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(upload.fence);
+        upload.job->texture->SetPlaceholder(nullptr);
+        delete upload.job;
+    }
+    uploads.clear();
+
+    for (auto job : requests)
+        delete job;
+    for (auto job : decoded)
+        delete job;
+    requests.clear();
+    decoded.clear();
+    regions.clear();
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ringBuffer);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &ringBuffer);
+    ringBuffer = 0;
+    ringData = nullptr;
+}
+
+
+bool TextureStreamer::IsAvailable()
+{
+    return running;
+}
+
+
+void TextureStreamer::Request(Texture2D *texture, const std::string &fileName, const Texture2D *placeholder)
+{
+    if (!running)
+        return;
+
+    texture->SetPlaceholder(placeholder);
+
+    Job *job = new Job();
+    job->texture = texture;
+    job->fileName = fileName;
+    job->valid = false;
+    job->inRing = false;
+    job->ringOffset = 0;
+    job->totalBytes = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        requests.push_back(job);
+    }
+    workAvailable.notify_one();
+}
+
+
+size_t TextureStreamer::GetPendingCount()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return requests.size() + decoded.size() + uploads.size();
+}
+
+
+bool TextureStreamer::IsQueued(const Texture2D *texture)
+{
+    if (!running)
+        return false;
+
+    auto matches = [texture](const Job *job) { return job->texture == texture; };
+    for (auto &upload : uploads)
+    {
+        if (upload.job->texture == texture)
+            return true;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    return std::any_of(requests.begin(), requests.end(), matches) || std::any_of(decoded.begin(), decoded.end(), matches);
+}
+
+
+void TextureStreamer::Update()
+{
+    if (!running)
+        return;
+
+    // Retire the uploads the GPU is done with, their textures are visible from this frame on
+    for (auto it = uploads.begin(); it != uploads.end();)
+    {
+        GLenum status = glClientWaitSync(it->fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        {
+            ++it;
+            continue;
+        }
+
+        glDeleteSync(it->fence);
+        it->job->texture->SetPlaceholder(nullptr);
+        if (it->job->inRing)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ReleaseRegion(it->job->ringOffset);
+        }
+        delete it->job;
+        it = uploads.erase(it);
+        ringAvailable.notify_all();
+    }
+
+    // Start new uploads, at least one per frame so a large texture can't stall the queue
+    size_t uploadedBytes = 0;
+    while (true)
+    {
+        Job *job = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (decoded.empty())
+                break;
+
+            job = decoded.front();
+            if (uploadedBytes > 0 && uploadedBytes + job->totalBytes > frameBudget)
+                break;
+            decoded.pop_front();
+        }
+
+        uploadedBytes += job->totalBytes;
+        if (!job->valid)
+        {
+            std::cerr << "Texture streamer: failed to load " << job->fileName << std::endl;
+            delete job;
+            continue;
+        }
+
+        StartUpload(*job);
+        uploads.push_back({ glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), job });
+    }
+}
+
+
+void TextureStreamer::StartUpload(Job &job)
+{
+    Texture2D *texture = job.texture;
+    int nrLevels = static_cast<int>(job.levelSizes.size());
+    texture->CreateImageStorage(job.format, job.width, job.height, job.channels, nrLevels);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (job.inRing)
+    {
+        // Pixel pointers are offsets into the ring while it's bound
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ringBuffer);
+        size_t offset = job.ringOffset;
+        for (int level = 0; level < nrLevels; level++)
+        {
+            texture->UploadLevel(level, reinterpret_cast<const void *>(offset), job.levelSizes[level]);
+            offset += job.levelSizes[level];
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    else
+    {
+        for (int level = 0; level < nrLevels; level++)
+        {
+            texture->UploadLevel(level, job.levels[level].data(), job.levelSizes[level]);
+        }
+    }
+
+    texture->UnBind();
+}
+
+
+void TextureStreamer::WorkerLoop()
+{
+    while (true)
+    {
+        Job *job = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            workAvailable.wait(lock, [] { return !running || !requests.empty(); });
+            if (!running)
+                return;
+
+            job = requests.front();
+            requests.pop_front();
+        }
+
+        Decode(*job);
+
+        // 16 bytes of slack for the region alignment
+        if (job->valid && job->totalBytes + 15 <= ringBytes)
+        {
+            // Waits for the render thread to retire older uploads when the ring is full
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ringAvailable.wait(lock, [job] { return !running || AllocateRegion(job->totalBytes, job->ringOffset); });
+                if (!running)
+                {
+                    delete job;
+                    return;
+                }
+            }
+
+            size_t offset = job->ringOffset;
+            for (auto &level : job->levels)
+            {
+                memcpy(ringData + offset, level.data(), level.size());
+                offset += level.size();
+            }
+            job->levels.clear();
+            job->inRing = true;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            decoded.push_back(job);
+        }
+    }
+}
+
+
+void TextureStreamer::Decode(Job &job)
+{
+    CompressedTexture image;
+    if (!TextureCache::Decode(job.fileName, image))
+        return;
+
+    job.format = image.format;
+    job.width = image.width;
+    job.height = image.height;
+    job.channels = image.channels;
+    job.levels = std::move(image.levels);
+
+    job.totalBytes = 0;
+    for (auto &level : job.levels)
+    {
+        job.levelSizes.push_back(level.size());
+        job.totalBytes += level.size();
+    }
+    job.valid = true;
+}
+
+
+bool TextureStreamer::AllocateRegion(size_t size, size_t &offset)
+{
+    size = (size + 15) & ~static_cast<size_t>(15);
+    if (size > ringBytes)
+        return false;
+
+    if (regions.empty())
+    {
+        offset = 0;
+    }
+    else
+    {
+        size_t tail = regions.front().offset;
+        size_t head = regions.back().offset + regions.back().size;
+        bool wrapped = regions.back().offset < tail;
+
+        if (!wrapped && ringBytes - head >= size)
+            offset = head;
+        else if (!wrapped && tail >= size)
+            offset = 0;
+        else if (wrapped && tail - head >= size)
+            offset = head;
+        else
+            return false;
+    }
+
+    regions.push_back({ offset, size, false });
+    return true;
+}
+
+
+void TextureStreamer::ReleaseRegion(size_t offset)
+{
+    // Uploads can finish out of order, the ring only advances past released regions
+    for (auto &region : regions)
+    {
+        if (region.offset == offset && !region.released)
+        {
+            region.released = true;
+            break;
+        }
+    }
+
+    while (!regions.empty() && regions.front().released)
+    {
+        regions.pop_front();
+    }
+}
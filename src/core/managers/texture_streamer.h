@@ -0,0 +1,97 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "utils/gl_utils.h"
+
+class Texture2D;
+
+
+// Streams image textures in without stalling the render thread. Worker threads decode the file (or read its
+// baked block compressed mips) into a persistently mapped pixel-unpack ring buffer, Update() uploads from the
+// ring within a per-frame byte budget, and a texture replaces its placeholder once the upload fence passed.
+class TextureStreamer
+{
+ public:
+    static void Init(size_t ringBytes = 64 << 20, size_t frameBudgetBytes = 8 << 20, unsigned int nrWorkers = 2);
+    static void Shutdown();
+
+    // Persistent mapping needs GL 4.4 / ARB_buffer_storage, callers load synchronously otherwise
+    static bool IsAvailable();
+
+    // Queues the file, texture binds placeholder until its data is resident
+    static void Request(Texture2D *texture, const std::string &fileName, const Texture2D *placeholder);
+
+    // Render thread, once per frame: retires finished uploads, then starts new ones within the budget
+    static void Update();
+
+    static size_t GetPendingCount();
+    // Whether a request for the texture is still being decoded or uploaded
+    static bool IsQueued(const Texture2D *texture);
+
+ protected:
+    TextureStreamer() = delete;
+    ~TextureStreamer() = delete;
+
+ private:
+    struct Job
+    {
+        Texture2D *texture;
+        std::string fileName;
+
+        bool valid;
+        GLenum format;
+        int width;
+        int height;
+        int channels;
+        std::vector<std::vector<unsigned char>> levels;
+        std::vector<size_t> levelSizes;
+
+        // Levels copied into the ring, or kept in levels when larger than the whole ring
+        bool inRing;
+        size_t ringOffset;
+        size_t totalBytes;
+    };
+
+    struct RingRegion
+    {
+        size_t offset;
+        size_t size;
+        bool released;
+    };
+
+    struct Upload
+    {
+        GLsync fence;
+        Job *job;
+    };
+
+    static void WorkerLoop();
+    static void Decode(Job &job);
+    static bool AllocateRegion(size_t size, size_t &offset);
+    static void ReleaseRegion(size_t offset);
+    static void StartUpload(Job &job);
+
+ private:
+    static GLuint ringBuffer;
+    static unsigned char *ringData;
+    static size_t ringBytes;
+    static size_t frameBudget;
+
+    static std::vector<std::thread> workers;
+    static std::mutex mutex;
+    static std::condition_variable workAvailable;
+    static std::condition_variable ringAvailable;
+    static bool running;
+
+    static std::deque<Job*> requests;
+    static std::deque<Job*> decoded;
+    static std::deque<RingRegion> regions;
+    static std::vector<Upload> uploads;
+};
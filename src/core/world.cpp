@@ -1,6 +1,10 @@
 #include "core/world.h"
 
 #include "core/engine.h"
+#include "core/managers/asset_loader.h"
+#include "core/managers/asset_registry.h"
+#include "core/managers/texture_manager.h"
+#include "core/managers/texture_streamer.h"
 #include "components/camera_input.h"
 #include "components/transform.h"
 
@@ -69,6 +73,13 @@ void World::LoopUpdate()
     // OnInputUpdate will be called each frame, the other functions are called only if an event is registered
     window->UpdateObservers();
 
+    // Creates the GL objects of the assets loaded in the background, uploads streamed textures within the
+    // frame budget (finished ones replace their placeholder), then keeps the resident textures within the VRAM budget
+    AssetLoader::Update();
+    TextureStreamer::Update();
+    TextureManager::Update();
+    AssetRegistry::Update();
+
     // Frame processing
     FrameStart();
     Update(static_cast<float>(deltaTime));
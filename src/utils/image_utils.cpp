@@ -0,0 +1,358 @@
+#include "utils/image_utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+
+// -------------------------------------------------------------------------
+std::vector<unsigned char> image_utils::Downsample(const unsigned char *image, int width, int height, int channels)
+{
+    int nextWidth = std::max(width / 2, 1);
+    int nextHeight = std::max(height / 2, 1);
+
+    std::vector<unsigned char> level(static_cast<size_t>(nextWidth) * nextHeight * channels);
+    for (int y = 0; y < nextHeight; y++)
+    {
+        size_t y0 = static_cast<size_t>(std::min(2 * y, height - 1)) * width;
+        size_t y1 = static_cast<size_t>(std::min(2 * y + 1, height - 1)) * width;
+        for (int x = 0; x < nextWidth; x++)
+        {
+            int x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+            for (int c = 0; c < channels; c++)
+            {
+                int sum = image[(y0 + x0) * channels + c] + image[(y0 + x1) * channels + c] +
+                    image[(y1 + x0) * channels + c] + image[(y1 + x1) * channels + c];
+                level[(static_cast<size_t>(y) * nextWidth + x) * channels + c] = static_cast<unsigned char>((sum + 2) / 4);
+            }
+        }
+    }
+    return level;
+}
+
+
+GLenum image_utils::GetBlockFormat(int channels)
+{
+    switch (channels)
+    {
+    case 1: return GL_COMPRESSED_RED_RGTC1;
+    case 2: return GL_COMPRESSED_RG_RGTC2;
+    case 3: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    default: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    }
+}
+
+
+static size_t GetBlockBytes(int channels)
+{
+    return (channels == 2 || channels == 4) ? 16 : 8;
+}
+
+
+size_t image_utils::GetBlockCompressedSize(int width, int height, int channels)
+{
+    size_t blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+    return blocksX * blocksY * GetBlockBytes(channels);
+}
+
+
+// -------------------------------------------------------------------------
+// Block encoders
+
+static void WriteU16(unsigned char *out, unsigned int value)
+{
+    out[0] = static_cast<unsigned char>(value & 0xFF);
+    out[1] = static_cast<unsigned char>(value >> 8);
+}
+
+
+static unsigned int PackRGB565(const float color[3])
+{
+    unsigned int r = static_cast<unsigned int>(std::min(std::max(color[0], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+    unsigned int g = static_cast<unsigned int>(std::min(std::max(color[1], 0.0f), 255.0f) * 63.0f / 255.0f + 0.5f);
+    unsigned int b = static_cast<unsigned int>(std::min(std::max(color[2], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+    return (r << 11) | (g << 5) | b;
+}
+
+
+static void UnpackRGB565(unsigned int packed, int color[3])
+{
+    int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+
+// Picks the nearest 4-color mode palette entry for every pixel, returns the squared error. The endpoints
+// are swapped into 4-color order (c0 > c1) first
+static int FitColorIndices(const unsigned char pixels[16][4], unsigned int& c0, unsigned int& c1, unsigned int& indices)
+{
+    if (c0 < c1)
+        std::swap(c0, c1);
+
+    int palette[4][3];
+    UnpackRGB565(c0, palette[0]);
+    UnpackRGB565(c1, palette[1]);
+    for (int c = 0; c < 3; c++)
+    {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    // Equal endpoints decode in 3-color mode, index 0 is still the endpoint
+    int nrEntries = c0 == c1 ? 1 : 4;
+
+    indices = 0;
+    int totalError = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        int best = 0, bestError = INT32_MAX;
+        for (int p = 0; p < nrEntries; p++)
+        {
+            int dr = pixels[i][0] - palette[p][0], dg = pixels[i][1] - palette[p][1], db = pixels[i][2] - palette[p][2];
+            int error = dr * dr + dg * dg + db * db;
+            if (error < bestError)
+            {
+                bestError = error;
+                best = p;
+            }
+        }
+        indices |= static_cast<unsigned int>(best) << (2 * i);
+        totalError += bestError;
+    }
+    return totalError;
+}
+
+
+// BC1 color block: endpoints on the principal axis of the block colors, 4-color mode
+static void EncodeColorBlock(const unsigned char pixels[16][4], unsigned char *out)
+{
+    float mean[3] = { 0, 0, 0 };
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < 3; c++)
+            mean[c] += pixels[i][c] / 16.0f;
+
+    float cov[6] = { 0, 0, 0, 0, 0, 0 };
+    for (int i = 0; i < 16; i++)
+    {
+        float d[3] = { pixels[i][0] - mean[0], pixels[i][1] - mean[1], pixels[i][2] - mean[2] };
+        cov[0] += d[0] * d[0]; cov[1] += d[0] * d[1]; cov[2] += d[0] * d[2];
+        cov[3] += d[1] * d[1]; cov[4] += d[1] * d[2]; cov[5] += d[2] * d[2];
+    }
+
+    // Power iteration for the dominant eigenvector
+    float axis[3] = { 1, 1, 1 };
+    for (int iteration = 0; iteration < 4; iteration++)
+    {
+        float next[3] = {
+            cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+            cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+            cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2] };
+        float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+        if (length < 1e-6f)
+            break;
+        for (int c = 0; c < 3; c++)
+            axis[c] = next[c] / length;
+    }
+
+    float tMin = 1e30f, tMax = -1e30f;
+    for (int i = 0; i < 16; i++)
+    {
+        float t = (pixels[i][0] - mean[0]) * axis[0] + (pixels[i][1] - mean[1]) * axis[1] + (pixels[i][2] - mean[2]) * axis[2];
+        tMin = std::min(tMin, t);
+        tMax = std::max(tMax, t);
+    }
+
+    // Inset the endpoints, the extremes are rarely worth a full palette entry
+    float inset = (tMax - tMin) / 16.0f;
+    tMin += inset;
+    tMax -= inset;
+
+    float end0[3], end1[3];
+    for (int c = 0; c < 3; c++)
+    {
+        end0[c] = mean[c] + axis[c] * tMax;
+        end1[c] = mean[c] + axis[c] * tMin;
+    }
+
+    unsigned int c0 = PackRGB565(end0);
+    unsigned int c1 = PackRGB565(end1);
+    unsigned int indices = 0;
+    int error = FitColorIndices(pixels, c0, c1, indices);
+
+    // One least squares refit of the endpoints to the chosen indices
+    if (c0 != c1)
+    {
+        static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+        float aa = 0, ab = 0, bb = 0, ax[3] = { 0, 0, 0 }, bx[3] = { 0, 0, 0 };
+        for (int i = 0; i < 16; i++)
+        {
+            float a = weights[(indices >> (2 * i)) & 3], b = 1.0f - a;
+            aa += a * a; ab += a * b; bb += b * b;
+            for (int c = 0; c < 3; c++)
+            {
+                ax[c] += a * pixels[i][c];
+                bx[c] += b * pixels[i][c];
+            }
+        }
+
+        float det = aa * bb - ab * ab;
+        if (std::fabs(det) > 1e-6f)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                end0[c] = (ax[c] * bb - bx[c] * ab) / det;
+                end1[c] = (bx[c] * aa - ax[c] * ab) / det;
+            }
+
+            unsigned int refined0 = PackRGB565(end0), refined1 = PackRGB565(end1), refinedIndices = 0;
+            int refinedError = FitColorIndices(pixels, refined0, refined1, refinedIndices);
+            if (refinedError < error)
+            {
+                c0 = refined0;
+                c1 = refined1;
+                indices = refinedIndices;
+            }
+        }
+    }
+
+    // FitColorIndices swapped them into 4-color order
+    if (c0 < c1)
+        std::swap(c0, c1);
+
+    WriteU16(out, c0);
+    WriteU16(out + 2, c1);
+    for (int b = 0; b < 4; b++)
+        out[4 + b] = static_cast<unsigned char>(indices >> (8 * b));
+}
+
+
+// BC4 single channel block (also the alpha of BC3 and each channel of BC5), 8-value mode
+static void EncodeChannelBlock(const unsigned char pixels[16][4], int channel, unsigned char *out)
+{
+    int minValue = 255, maxValue = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        minValue = std::min(minValue, static_cast<int>(pixels[i][channel]));
+        maxValue = std::max(maxValue, static_cast<int>(pixels[i][channel]));
+    }
+
+    out[0] = static_cast<unsigned char>(maxValue);
+    out[1] = static_cast<unsigned char>(minValue);
+
+    uint64_t indices = 0;
+    if (maxValue != minValue)
+    {
+        int palette[8] = { maxValue, minValue };
+        for (int p = 2; p < 8; p++)
+            palette[p] = ((8 - p) * maxValue + (p - 1) * minValue) / 7;
+
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0, bestError = INT32_MAX;
+            for (int p = 0; p < 8; p++)
+            {
+                int error = std::abs(pixels[i][channel] - palette[p]);
+                if (error < bestError)
+                {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            indices |= static_cast<uint64_t>(best) << (3 * i);
+        }
+    }
+
+    for (int b = 0; b < 6; b++)
+        out[2 + b] = static_cast<unsigned char>(indices >> (8 * b));
+}
+
+
+static void CompressBlockRows(const unsigned char *image, int width, int height, int channels,
+                              int firstRow, int lastRow, unsigned char *blocks)
+{
+    int blocksX = (width + 3) / 4;
+    size_t blockBytes = GetBlockBytes(channels);
+
+    for (int by = firstRow; by < lastRow; by++)
+    {
+        for (int bx = 0; bx < blocksX; bx++)
+        {
+            // Blocks past the image edge repeat the last row / column
+            unsigned char pixels[16][4];
+            for (int y = 0; y < 4; y++)
+            {
+                size_t row = static_cast<size_t>(std::min(by * 4 + y, height - 1)) * width;
+                for (int x = 0; x < 4; x++)
+                {
+                    const unsigned char *texel = image + (row + std::min(bx * 4 + x, width - 1)) * channels;
+                    unsigned char *pixel = pixels[y * 4 + x];
+                    pixel[0] = texel[0];
+                    pixel[1] = channels > 1 ? texel[1] : 0;
+                    pixel[2] = channels > 2 ? texel[2] : 0;
+                    pixel[3] = channels > 3 ? texel[3] : 255;
+                }
+            }
+
+            unsigned char *out = blocks + (static_cast<size_t>(by) * blocksX + bx) * blockBytes;
+            switch (channels)
+            {
+            case 1:
+                EncodeChannelBlock(pixels, 0, out);
+                break;
+            case 2:
+                EncodeChannelBlock(pixels, 0, out);
+                EncodeChannelBlock(pixels, 1, out + 8);
+                break;
+            case 3:
+                EncodeColorBlock(pixels, out);
+                break;
+            default:
+                EncodeChannelBlock(pixels, 3, out);
+                EncodeColorBlock(pixels, out + 8);
+            }
+        }
+    }
+}
+
+
+void image_utils::CompressBlocks(const unsigned char *image, int width, int height, int channels, unsigned char *blocks,
+                                 int nrThreads)
+{
+    int blocksY = (height + 3) / 4;
+    if (nrThreads <= 0)
+        nrThreads = static_cast<int>(std::thread::hardware_concurrency());
+    nrThreads = std::max(1, std::min(nrThreads, blocksY));
+
+    // The calling thread takes the first rows
+    std::vector<std::thread> threads;
+    for (int t = 1; t < nrThreads; t++)
+    {
+        int firstRow = blocksY * t / nrThreads;
+        int lastRow = blocksY * (t + 1) / nrThreads;
+        threads.emplace_back(CompressBlockRows, image, width, height, channels, firstRow, lastRow, blocks);
+    }
+    CompressBlockRows(image, width, height, channels, 0, blocksY / nrThreads, blocks);
+
+    for (auto &thread : threads)
+    {
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+}
+
+
+uint64_t image_utils::Hash(const void *data, size_t size, uint64_t seed)
+{
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
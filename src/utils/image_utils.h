@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "utils/gl_utils.h"
+
+
+// -------------------------------------------------------------------------
+// CPU side image processing for the texture baking stage
+
+namespace image_utils
+{
+    // 2x2 box filter of an 8-bit image (1-4 channels), odd sizes repeat the last row / column
+    std::vector<unsigned char> Downsample(const unsigned char *image, int width, int height, int channels);
+
+    // Block compressed format used for an 8-bit image: BC4 (R), BC5 (RG), BC1 (RGB), BC3 (RGBA)
+    GLenum GetBlockFormat(int channels);
+    size_t GetBlockCompressedSize(int width, int height, int channels);
+
+    // Encodes every 4x4 block of the image into blocks (GetBlockCompressedSize bytes), rows of
+    // blocks are split between nrThreads threads, 0: the hardware threads
+    void CompressBlocks(const unsigned char *image, int width, int height, int channels, unsigned char *blocks,
+                        int nrThreads = 0);
+
+    // 64-bit FNV-1a
+    uint64_t Hash(const void *data, size_t size, uint64_t seed = 14695981039346656037ull);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+
+// Read-only memory mapping of a whole file, unmapped on Close() or destruction
+class MappedFile
+{
+ public:
+    MappedFile();
+    ~MappedFile();
+
+    bool Open(const std::string &fileName);
+    void Close();
+
+    const unsigned char *GetData() const;
+    size_t GetSize() const;
+
+ private:
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+ private:
+    const unsigned char *data;
+    size_t size;
+
+#if defined(_WIN32)
+    void *fileHandle;
+    void *mappingHandle;
+#endif
+};